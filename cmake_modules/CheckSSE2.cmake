@@ -48,6 +48,7 @@ if(SYSTEM_IS_X86)
     check_c_compiler_flag("-msse4" HAVE_FLAG_M_SSE4)
     check_c_compiler_flag("-msse4.1" HAVE_FLAG_M_SSE41)
     check_c_compiler_flag("-mavx" HAVE_FLAG_M_AVX)
+    check_c_compiler_flag("-mavx512f" HAVE_FLAG_M_AVX512F)
 
 
     # These all fail for some reason
@@ -120,6 +121,11 @@ if(SYSTEM_IS_X86)
       str_append(AVX_FLAGS "-xarch=avx")
     endif()
 
+    set(AVX512_FLAGS ${AVX_FLAGS})
+    if(HAVE_FLAG_M_AVX512F)
+      str_append(AVX512_FLAGS "-mavx512f")
+    endif()
+
 
     check_c_compiler_flag("-mfpmath=387" HAVE_FLAG_M_FPMATH_387)
     check_c_compiler_flag("-mno-sse" HAVE_FLAG_M_NO_SSE)
@@ -177,6 +183,7 @@ if(SYSTEM_IS_X86)
     set(SSE3_FLAGS "${SSE2_FLAGS}")
     set(SSE41_FLAGS "${SSE3_FLAGS}")
     set(AVX_FLAGS "/arch:AVX")
+    set(AVX512_FLAGS "/arch:AVX512")
   endif()
 
   if(NEED_SSE_DEFINES)
@@ -186,6 +193,7 @@ if(SYSTEM_IS_X86)
     str_append(SSE4_FLAGS "-D__SSE4__=1")
     str_append(SSE41_FLAGS "-D__SSE4_1__=1")
     str_append(AVX_FLAGS "-D__AVX__=1")
+    str_append(AVX512_FLAGS "-D__AVX512F__=1")
 
     # want the defines but not /arch:SSE2
     str_append(AVX_FLAGS "-D__SSE4_1__=1")
@@ -207,6 +215,16 @@ if(AVX_CHECK)
 endif()
 mark_as_advanced(HAVE_AVX)
 
+set(_CMAKE_C_FLAGS "${CMAKE_C_FLAGS}")
+set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${AVX512_FLAGS}")
+try_compile(AVX512_CHECK ${CMAKE_BINARY_DIR} ${MILKYWAYATHOME_CLIENT_CMAKE_MODULES}/test_avx512.c)
+set(CMAKE_C_FLAGS ${_CMAKE_C_FLAGS})
+if(AVX512_CHECK)
+  message(STATUS "AVX-512 compiler flags - '${AVX512_FLAGS}'")
+  set(HAVE_AVX512 TRUE CACHE INTERNAL "Compiler has AVX-512 support")
+endif()
+mark_as_advanced(HAVE_AVX512)
+
 
 set(CMAKE_REQUIRED_FLAGS "${SSE41_FLAGS}")
 check_include_files(smmintrin.h HAVE_SSE41 CACHE INTERNAL "Compiler has SSE4.1 headers")
@@ -312,6 +330,17 @@ function(enable_avx target)
                             COMPILE_FLAGS "${comp_flags} ${AVX_FLAGS}")
 endfunction()
 
+function(enable_avx512 target)
+  get_target_property(comp_flags ${target} COMPILE_FLAGS)
+  if(comp_flags STREQUAL "comp_flags-NOTFOUND")
+    set(comp_flags "")
+  endif()
+
+  set_target_properties(${target}
+                          PROPERTIES
+                            COMPILE_FLAGS "${comp_flags} ${AVX512_FLAGS}")
+endfunction()
+
 
 function(maybe_disable_ssen)
   if(SYSTEM_IS_X86)
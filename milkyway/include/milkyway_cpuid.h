@@ -34,7 +34,11 @@ int mwHasSSE3(const int abcd[4]);
 int mwHasSSE2(const int abcd[4]);
 int mwHasAVX(const int abcd[4]);
 
+/* Takes the array from mw_cpuid(abcd, 7, 0) */
+int mwHasAVX512F(const int abcd[4]);
+
 int mwOSHasAVXSupport(void);
+int mwOSHasAVX512Support(void);
 
 #ifdef __cplusplus
 }
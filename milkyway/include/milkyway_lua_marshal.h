@@ -72,6 +72,11 @@ typedef struct
 
 #define END_MW_NAMED_ARG { NULL, -1, NULL, FALSE, NULL }
 
+/* Named argument type for a table, which is stored as an int
+   reference in the registry. Whoever uses this type must release the
+   reference with luaL_unref. */
+#define MW_LUA_TTABLE_REF 0x100
+
 #define mw_lua_assert_top_type(luaSt, t) assert(lua_type((luaSt), -1) == (t))
 
 int oneTableArgument(lua_State* luaSt, const MWNamedArg* argTable);
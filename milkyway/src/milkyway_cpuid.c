@@ -26,6 +26,10 @@
   #include <sys/sysctl.h>
 #endif
 
+#if defined(_MSC_VER) && MW_IS_X86
+  #include <immintrin.h>
+#endif
+
 #define bit_CMPXCHG8B (1 << 8)
 #define bit_CMOV (1 << 15)
 #define bit_MMX (1 << 23)
@@ -34,6 +38,8 @@
 #define bit_SSE3 (1 << 0)
 #define bit_SSE41 (1 << 19)
 #define bit_AVX (1 << 28)
+#define bit_AVX512F (1 << 16)
+#define bit_OSXSAVE (1 << 27)
 #define bit_CMPXCHG16B (1 << 13)
 #define bit_3DNOW (1 << 31)
 #define bit_3DNOWP (1 << 30)
@@ -99,6 +105,11 @@ int mwHasAVX(const int abcd[4])
     return !!(abcd[2] & bit_AVX);
 }
 
+int mwHasAVX512F(const int abcd[4])
+{
+    return !!(abcd[1] & bit_AVX512F);
+}
+
 int mwHasSSE41(const int abcd[4])
 {
     return !!(abcd[2] & bit_SSE41);
@@ -114,6 +125,47 @@ int mwHasSSE2(const int abcd[4])
     return !!(abcd[3] & bit_SSE2);
 }
 
+/* XMM, YMM, opmask, and both halves of the ZMM state enabled in XCR0 */
+#define XCR0_AVX512_STATE 0xe6
+
+#if MW_IS_X86
+
+static unsigned long long mw_xgetbv0(void)
+{
+  #ifdef _MSC_VER
+    return (unsigned long long) _xgetbv(0);
+  #else
+    unsigned int lo, hi;
+
+    /* xgetbv, written out for assemblers that don't know it */
+    __asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((unsigned long long) hi << 32) | lo;
+  #endif
+}
+
+/* The OS must save the extra register state for AVX-512 to be usable */
+int mwOSHasAVX512Support(void)
+{
+    int abcd[4];
+
+    mw_cpuid(abcd, 1, 0);
+    if (!(abcd[2] & bit_OSXSAVE))
+    {
+        return FALSE;
+    }
+
+    return (mw_xgetbv0() & XCR0_AVX512_STATE) == XCR0_AVX512_STATE;
+}
+
+#else
+
+int mwOSHasAVX512Support(void)
+{
+    return FALSE;
+}
+
+#endif /* MW_IS_X86 */
+
 
 
 #if defined(_WIN32)
@@ -484,6 +484,11 @@ static void setValueFromType(lua_State* luaSt, void* v, int type, int idx)
             *(void**) v = lua_touserdata(luaSt, idx);
             break;
 
+        case MW_LUA_TTABLE_REF:
+            lua_pushvalue(luaSt, idx);
+            *(int*) v = luaL_ref(luaSt, LUA_REGISTRYINDEX);
+            break;
+
         case LUA_TTABLE:
         case LUA_TFUNCTION:
         case LUA_TLIGHTUSERDATA:
@@ -494,12 +499,18 @@ static void setValueFromType(lua_State* luaSt, void* v, int type, int idx)
     }
 }
 
+/* Lua type a named argument must have */
+static int namedArgumentLuaType(const MWNamedArg* p)
+{
+    return p->type == MW_LUA_TTABLE_REF ? LUA_TTABLE : p->type;
+}
+
 static void namedArgumentError(lua_State* luaSt, const MWNamedArg* p, int arg, int idx)
 {
     luaL_error(luaSt, "Bad argument for key '%s' in argument #%d (`%s' expected, got %s)",
                p->name,
                arg,
-               p->userDataTypeName ? p->userDataTypeName : lua_typename(luaSt, p->type),
+               p->userDataTypeName ? p->userDataTypeName : lua_typename(luaSt, namedArgumentLuaType(p)),
                lua_type(luaSt, idx) == LUA_TUSERDATA ? "other userdata" : luaL_typename(luaSt, idx)
         );
 }
@@ -644,7 +655,7 @@ void handleNamedArgumentTable(lua_State* luaSt, const MWNamedArg* args, int tabl
 
         /* We do our own type checking and errors to avoid
            Confusing and innaccurate error messages, which suggest the use of the table is wrong. */
-        if (!typeEqualOrConversionOK(luaSt, p->type, -1))
+        if (!typeEqualOrConversionOK(luaSt, namedArgumentLuaType(p), -1))
         {
             namedArgumentError(luaSt, p, table, item);
         }
@@ -43,8 +43,13 @@ typedef struct
     char* histogramFileName;
     char* histoutFileName;
     char* matchHistogram;   /* Just match this histogram to other histogram, no simulation */
+    char* matchHistogramList;  /* File listing histograms to match, one per line */
+    char* matchMethods;     /* Likelihood methods to match the list with */
     char* graphicsBin;
     char* visArgs;
+    char* snapshotFileName;
+    char* snapshotFloat32;  /* Fields to store in single precision */
+    char* streamSocket;     /* Unix domain socket to stream snapshots on */
 
     const char** forwardedArgs;
     unsigned int numForwardedArgs;
@@ -53,13 +58,19 @@ typedef struct
     uint32_t seed;   /* Seed value */
 
     int numThreads;
+    int snapshotInterval;   /* Steps between snapshots */
+    int visQueueSize;       /* Snapshots the visualizer queue holds */
+    int visStride;          /* Share every visStride'th body with the visualizer */
+    int streamStride;       /* Stream every streamStride'th body */
 
     time_t checkpointPeriod;
+    double snapshotTime;    /* Simulation time between snapshots */
     unsigned int platform;
     unsigned int devNum;
 
     /* These all must be int since that's the type popt expects them to be */
     int visualizer;
+    int visQuantize;    /* Share 16 bit positions with the visualizer */
     int debugBOINC;
     int outputCartesian;
     int printTiming;
@@ -73,11 +84,18 @@ typedef struct
     int reportProgress;
     int ignoreResponsive;
     int noCleanCheckpoint;
+    int compressCheckpoint;
+    int asyncCheckpoint;
     int disableGPUCheckpointing;
     int verbose;
+
+    int forceNoIntrinsics;
+    int forceSSE2;
+    int forceAVX;
+    int forceAVX512;
 } NBodyFlags;
 
-#define EMPTY_NBODY_FLAGS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+#define EMPTY_NBODY_FLAGS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
 
 NBodyStatus nbStepSystem(const NBodyCtx* ctx, NBodyState* st);
 NBodyStatus nbRunSystem(const NBodyCtx* ctx, NBodyState* st);
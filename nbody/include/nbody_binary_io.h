@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_BINARY_IO_H_
+#define _NBODY_BINARY_IO_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Helpers shared by the binary body output, checkpoints and snapshots.
+   Values in all of these files are little endian. */
+
+static inline int nbHostIsBigEndian(void)
+{
+    const uint16_t one = 1;
+    return *(const uint8_t*) &one == 0;
+}
+
+static inline void nbPutU32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static inline void nbPutU64(uint8_t* p, uint64_t v)
+{
+    nbPutU32(p, (uint32_t) v);
+    nbPutU32(p + 4, (uint32_t) (v >> 32));
+}
+
+static inline uint32_t nbGetU32(const uint8_t* p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t nbGetU64(const uint8_t* p)
+{
+    return (uint64_t) nbGetU32(p) | ((uint64_t) nbGetU32(p + 4) << 32);
+}
+
+static inline void nbPutF64(uint8_t* p, double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    nbPutU64(p, u);
+}
+
+static inline double nbGetF64(const uint8_t* p)
+{
+    uint64_t u = nbGetU64(p);
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+/* Seek to an absolute offset, which may be past 2GB */
+static inline int nbSeekFile(FILE* f, uint64_t offset)
+{
+  #ifdef _WIN32
+    return _fseeki64(f, (__int64) offset, SEEK_SET);
+  #else
+    return fseeko(f, (off_t) offset, SEEK_SET);
+  #endif
+}
+
+#endif /* _NBODY_BINARY_IO_H_ */
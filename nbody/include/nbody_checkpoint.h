@@ -35,6 +35,10 @@ int nbWriteCheckpointWithTmpFile(const NBodyCtx* ctx, const NBodyState* st, cons
 NBodyStatus nbWriteFinalCheckpoint(const NBodyCtx* ctx, NBodyState* st);
 int nbTimeToCheckpoint(const NBodyCtx* ctx, NBodyState* st);
 
+int nbStartCheckpointWrite(const NBodyCtx* ctx, NBodyState* st);
+int nbFinishCheckpointWrite(NBodyState* st, mwbool wait, mwbool* finished);
+int nbDestroyCheckpointWriter(NBodyState* st);
+
 #ifdef __cplusplus
 }
 #endif
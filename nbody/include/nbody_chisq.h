@@ -24,6 +24,7 @@
 
 #include "nbody_types.h"
 #include "nbody.h"
+#include "nbody_emd.h"
 
 
 #ifdef __cplusplus
@@ -35,6 +36,11 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
                    NBodyLikelihoodMethod method);
 double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram);
 
+/* Same as nbMatchEMD, reusing the EMD buffers in ws for many matches */
+double nbMatchEMDWorkspace(const NBodyHistogram* data,
+                           const NBodyHistogram* histogram,
+                           EMDWorkspace* ws);
+
 double nbSystemChisq(const NBodyState* st,
                      const NBodyHistogram* data,
                      const NBodyHistogram* histogram,
@@ -43,6 +49,22 @@ double nbSystemChisq(const NBodyState* st,
 int nbGetLikelihoodInfo(const NBodyFlags* nbf, HistogramParams* hp, NBodyLikelihoodMethod* method);
 
 double nbMatchHistogramFiles(const char* datHist, const char* matchHist);
+
+#define NBODY_MAX_MATCH_METHODS (NBODY_SAHA + 1)
+
+/* Parse a comma separated list of likelihood method names, as used
+ * for nbodyLikelihoodMethod. Returns nonzero on an unknown name. */
+int nbParseLikelihoodMethods(const char* list, NBodyLikelihoodMethod* methods, unsigned int* nMethods);
+
+/* Match every histogram listed in listFile, one file name per line,
+ * against the data histogram with each of the methods. A table with a
+ * row per histogram is printed to f. The histograms are read and
+ * matched in parallel. Returns nonzero if any of them couldn't be read. */
+int nbMatchHistogramList(FILE* f,
+                         const char* datHist,
+                         const char* listFile,
+                         const NBodyLikelihoodMethod* methods,
+                         unsigned int nMethods);
 NBodyHistogram* nbReadHistogram(const char* histogramFile);
 NBodyHistogram* nbCreateHistogram(const NBodyCtx* ctx, const NBodyState* st, const HistogramParams* hp);
 
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_COMPRESS_H_
+#define _NBODY_COMPRESS_H_
+
+#include <stddef.h>
+#include "milkyway_extra.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Blocks use the LZ4 block format: greedy matching over a 64K
+ * window. This is meant for byte shuffled arrays of numbers, where
+ * the exponent and high mantissa bytes end up in long repetitive
+ * runs, rather than for squeezing out every last byte. */
+
+/* Worst case size of a compressed block of n bytes */
+size_t nbLZCompressBound(size_t n);
+
+/* Returns the compressed size, or 0 if it would not fit in dstCap */
+size_t nbLZCompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstCap);
+
+/* Returns nonzero if src is not a valid block of exactly dstSize bytes */
+int nbLZDecompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_COMPRESS_H_ */
+
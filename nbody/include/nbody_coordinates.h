@@ -26,14 +26,15 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_math.h"
 #include "nbody_types.h"
 
+/* The two rows of the Newberg et al (2009) rotation which lambda
+   depends on, applied to Sun centered cartesian coordinates. lambda
+   is the angle between them, so no per body trig is needed besides
+   one atan2. */
 typedef struct
 {
-    real cosphi;
-    real sinphi;
-    real sinpsi;
-    real cospsi;
-    real costh;
-    real sinth;
+    real lambdaCos[3];  /* Component proportional to cos(beta) cos(lambda) */
+    real lambdaSin[3];  /* Component proportional to cos(beta) sin(lambda) */
+    real beta[3];       /* Component proportional to sin(beta) */
 } NBHistTrig;
 
 #ifdef __cplusplus
@@ -48,6 +49,7 @@ mwvector lbrToCartesian_rad(mwvector lbr, real sunGCDist);
 
 void nbGetHistTrig(NBHistTrig* ht, const HistogramParams* hp);
 real nbXYZToLambda(const NBHistTrig* ht, mwvector xyz, real runGCDist);
+void nbXYZToLambdaBeta(const NBHistTrig* ht, mwvector xyz, real sunGCDist, real* lambda, real* beta);
 
 #ifdef __cplusplus
 }
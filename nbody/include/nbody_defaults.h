@@ -42,6 +42,16 @@ extern "C" {
 #define DEFAULT_USE_QUADRUPOLE_MOMENTS TRUE
 #define DEFAULT_ALLOW_INCEST FALSE
 #define DEFAULT_QUIET_ERRORS FALSE
+#define DEFAULT_PARALLEL_TREE FALSE
+#define DEFAULT_BODY_SORT_INTERVAL 0
+#define DEFAULT_FLAT_TREE FALSE
+#define DEFAULT_GROUP_SIZE 0
+#define DEFAULT_TREE_REBUILD_INTERVAL 0
+#define DEFAULT_TIMESTEP_LEVELS 0
+#define DEFAULT_TIMESTEP_ETA 0.025
+
+/* Largest number of timestep halvings allowed with block timesteps */
+#define NB_MAX_TIMESTEP_LEVELS 16
 
   /*
     Return this when a big likelihood is needed.
@@ -29,6 +29,9 @@ typedef struct
     float pos;    /* 2nd column */
 } WeightPos;
 
+/* Buffers for the transportation simplex, kept between calls so
+   repeated comparisons don't need to allocate them again */
+typedef struct EMDWorkspace EMDWorkspace;
 
 
 #ifdef __cplusplus
@@ -41,6 +44,25 @@ float emdCalc(const float* RESTRICT signature_arr1,
               unsigned int size2,
               float* RESTRICT lower_bound);
 
+float emdCalcDims(const float* RESTRICT signature_arr1,
+                  const float* RESTRICT signature_arr2,
+                  unsigned int size1,
+                  unsigned int size2,
+                  int dims,
+                  float* RESTRICT lower_bound);
+
+/* The buffers grow as needed, so the sizes are only a hint. With a
+   hint of 0 nothing is allocated until the solver is first used. */
+EMDWorkspace* emdCreateWorkspace(unsigned int size1, unsigned int size2);
+void emdDestroyWorkspace(EMDWorkspace* ws);
+
+float emdCalcWorkspace(EMDWorkspace* ws,
+                       const float* RESTRICT signature_arr1,
+                       const float* RESTRICT signature_arr2,
+                       unsigned int size1,
+                       unsigned int size2,
+                       int dims,
+                       float* RESTRICT lower_bound);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_EXACT_H_
+#define _NBODY_EXACT_H_
+
+#include "nbody.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bodies are padded to a multiple of the widest vector (AVX-512 doubles) */
+#define NB_EXACT_PAD 8
+
+/* Bodies per j-block. The 4 arrays take 16 KiB in double, which
+ * leaves half of a 32 KiB L1 data cache for everything else. */
+#define NB_EXACT_TILE 512
+
+/* Sum the forces from every body on the bodies targets[iStart, iEnd)
+ * into acc. If targets is NULL the bodies are those in [iStart, iEnd). */
+typedef void (*NBodyExactKernel)(const NBodyExactSoA* soa,
+                                 int nbody,
+                                 real eps2,
+                                 const int* targets,
+                                 int iStart,
+                                 int iEnd,
+                                 mwvector* acc);
+
+void nbExactKernel_Scalar(const NBodyExactSoA* soa, int nbody, real eps2, const int* targets, int iStart, int iEnd, mwvector* acc);
+void nbExactKernel_SSE2(const NBodyExactSoA* soa, int nbody, real eps2, const int* targets, int iStart, int iEnd, mwvector* acc);
+void nbExactKernel_AVX(const NBodyExactSoA* soa, int nbody, real eps2, const int* targets, int iStart, int iEnd, mwvector* acc);
+void nbExactKernel_AVX512(const NBodyExactSoA* soa, int nbody, real eps2, const int* targets, int iStart, int iEnd, mwvector* acc);
+
+extern NBodyExactKernel nbExactKernel;
+
+/* Pick the fastest kernel this CPU can run, or the one forced by the flags */
+int nbExactKernelDispatch(const NBodyFlags* nbf);
+
+/* Copy the current bodies into st->exactSoA */
+void nbFillExactSoA(NBodyState* st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_EXACT_H_ */
+
@@ -37,7 +37,12 @@
   #define NBODY_SHMEM_NAME_FMT_STR "milkyway_nbody_%d"
 #endif
 
+/* Default and largest number of snapshots in the queue */
 #define NBODY_CIRC_QUEUE_SIZE 3
+#define NBODY_MAX_QUEUE_SIZE 64
+
+/* Largest magnitude of a quantized position component */
+#define NBODY_QUANT_MAX 32767
 
 /* Number of milliseconds to sleep if we are blocking the simulation
  * waiting for the queue to clear */
@@ -57,6 +62,13 @@ typedef struct
     int32_t ignore;
 } FloatPos;
 
+/* Position relative to the center of mass in units of the snapshot's positionScale */
+typedef struct
+{
+    int16_t x, y, z;
+    int16_t ignore;
+} QuantPos;
+
 /* Mostly for progress information */
 typedef struct
 {
@@ -64,13 +76,15 @@ typedef struct
     float currentTime;
     float timeEvolve;
     float rootCenterOfMass[3];     /* Center of mass of the system  */
+    float positionScale;           /* Size of one step of a quantized position */
 } SceneInfo;
 
 typedef struct
 {
     OPA_int_t head;
     OPA_int_t tail;
-    SceneInfo info[NBODY_CIRC_QUEUE_SIZE];
+    int size;    /* Number of snapshot slots in use, at most NBODY_MAX_QUEUE_SIZE */
+    SceneInfo info[NBODY_MAX_QUEUE_SIZE];
 } NBodyCircularQueue;
 
 /* the scene structure */
@@ -113,8 +127,12 @@ typedef struct
     */
     OPA_int_t blockSimulationOnGraphics;
 
-    int nbody;
+    int nbody;             /* Number of bodies in each snapshot */
+    int nbodyTotal;        /* Number of bodies in the simulation */
+    int stride;            /* Snapshots hold every stride'th body */
+    int quantized;         /* Snapshots hold QuantPos instead of FloatPos */
     unsigned int nSteps;
+    unsigned int traceLength;  /* Steps of the orbit trace already copied */
     int hasGalaxy;
     int hasInfo;
     int staticScene;
@@ -123,10 +141,27 @@ typedef struct
     FloatPos sceneData[1]; /* Space for orbit trace then space for actual data for the queue */
 } scene_t;
 
-/* Get the starting position of the given queue position accounting for the orbit trace offset */
+static inline size_t nbSceneBodySize(int quantized)
+{
+    return quantized ? sizeof(QuantPos) : sizeof(FloatPos);
+}
+
+/* Get the start of the given queue position accounting for the orbit trace offset */
+static inline void* nbSceneGetSnapshot(scene_t* scene, int buffer)
+{
+    char* start = (char*) &scene->sceneData[scene->nSteps];
+    return start + (size_t) buffer * scene->nbody * nbSceneBodySize(scene->quantized);
+}
+
+/* Queue position of a scene which isn't quantized */
 static inline FloatPos* nbSceneGetQueueBuffer(scene_t* scene, int buffer)
 {
-    return &scene->sceneData[scene->nSteps + buffer * scene->nbody];
+    return (FloatPos*) nbSceneGetSnapshot(scene, buffer);
+}
+
+static inline QuantPos* nbSceneGetQuantizedQueueBuffer(scene_t* scene, int buffer)
+{
+    return (QuantPos*) nbSceneGetSnapshot(scene, buffer);
 }
 
 /* Get the starting position of the orbit trace in the scene data */
@@ -135,10 +170,29 @@ static inline FloatPos* nbSceneGetOrbitTrace(scene_t* scene)
     return &scene->sceneData[0];
 }
 
-static inline size_t nbFindShmemSize(int nbody, int nSteps)
+/* Expand a quantized queue position to full positions */
+static inline void nbSceneUnpackQueueBuffer(scene_t* scene, int buffer, FloatPos* r)
+{
+    int i;
+    const QuantPos* q = nbSceneGetQuantizedQueueBuffer(scene, buffer);
+    const SceneInfo* info = &scene->queue.info[buffer];
+    const float* cm = info->rootCenterOfMass;
+    float scale = info->positionScale;
+
+    for (i = 0; i < scene->nbody; ++i)
+    {
+        r[i].x = cm[0] + scale * (float) q[i].x;
+        r[i].y = cm[1] + scale * (float) q[i].y;
+        r[i].z = cm[2] + scale * (float) q[i].z;
+        r[i].ignore = q[i].ignore;
+    }
+}
+
+/* Size of a scene with queueSize snapshots of nbody bodies each */
+static inline size_t nbFindShmemSize(int nbody, unsigned int nSteps, int queueSize, int quantized)
 {
-    size_t snapshotSize = nbody * sizeof(FloatPos);
-    return sizeof(scene_t) + nSteps * sizeof(FloatPos) + NBODY_CIRC_QUEUE_SIZE * snapshotSize;
+    size_t snapshotSize = (size_t) nbody * nbSceneBodySize(quantized);
+    return sizeof(scene_t) + nSteps * sizeof(FloatPos) + (size_t) queueSize * snapshotSize;
 }
 
 #endif /* _NBODY_GRAPHICS_H_ */
@@ -30,6 +30,9 @@ extern "C" {
 /* compute force on all the bodies */
 NBodyStatus nbGravMap(const NBodyCtx* ctx, NBodyState* st);
 
+/* compute force on only the nActive bodies listed in active */
+NBodyStatus nbGravMapActive(const NBodyCtx* ctx, NBodyState* st, const int* active, int nActive);
+
 #ifdef __cplusplus
 }
 #endif
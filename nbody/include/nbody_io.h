@@ -28,6 +28,9 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+#define NBODY_BINARY_OUTPUT_MAGIC "mwbodies"
+#define NBODY_BINARY_OUTPUT_VERSION 1
+
 int nbWriteBodies(const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* nbf);
 
 #ifdef __cplusplus
@@ -28,6 +28,7 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "nbody_types.h"
 
 Body* checkBody(lua_State* luaSt, int idx);
+Body* toBody(lua_State* luaSt, int idx);
 Body* expectBody(lua_State* luaSt, int idx);
 int pushBody(lua_State* luaSt, const Body* b);
 int registerBody(lua_State* luaSt);
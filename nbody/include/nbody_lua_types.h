@@ -33,6 +33,7 @@ extern "C" {
 #include "nbody_lua_nbodyctx.h"
 #include "nbody_lua_nbodystate.h"
 #include "nbody_lua_body.h"
+#include "nbody_lua_bodyblock.h"
 #include "nbody_lua_halo.h"
 #include "nbody_lua_disk.h"
 #include "nbody_lua_spherical.h"
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_MODEL_UTIL_H_
+#define _NBODY_MODEL_UTIL_H_
+
+#include <lua.h>
+
+#include "nbody_types.h"
+#include "dSFMT.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where the bodies of a generated model go: the C array bodies, or
+ * when that is NULL, straight into the table at index table on the
+ * stack of luaSt */
+typedef struct
+{
+    Body* bodies;
+    lua_State* luaSt;
+    int table;
+} NBodyModelOutput;
+
+/* Fill bodies first .. first + n of the model, drawing only from prng
+ * and storing each with nbStoreModelBody */
+typedef void (*NBodyModelFill)(dsfmt_t* prng,
+                               const NBodyModelOutput* out,
+                               unsigned int first,
+                               unsigned int n,
+                               const void* params);
+
+void nbStoreModelBody(const NBodyModelOutput* out, unsigned int i, const Body* b);
+
+/* Generate a model with fill and leave it on the stack, as a BodyBlock
+ * with asBlock or else as a table of Body */
+int nbPushModelBodies(lua_State* luaSt,
+                      dsfmt_t* prng,
+                      unsigned int nbody,
+                      unsigned int chunkSize,
+                      mwbool asBlock,
+                      NBodyModelFill fill,
+                      const void* params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_MODEL_UTIL_H_ */
+
@@ -29,6 +29,17 @@ extern "C" {
 
 mwvector nbExtAcceleration(const Potential* pot, mwvector pos);
 
+/* Find the external acceleration at n positions, given and returned
+ * as separate x, y, z arrays */
+void nbExtAccelerationBatch(const Potential* pot,
+                            int n,
+                            const real* x,
+                            const real* y,
+                            const real* z,
+                            real* ax,
+                            real* ay,
+                            real* az);
+
 #ifdef __cplusplus
 }
 #endif
@@ -99,12 +99,24 @@ typedef struct MW_ALIGN_TYPE
 
 #define HALO_TYPE "Halo"
 
+/* Maximum number of extra components of each kind in a composite potential */
+#define NB_MAX_EXTRA_COMPONENTS 4
+
 typedef struct MW_ALIGN_TYPE
 {
     Spherical sphere[1];
     Disk disk;
     Halo halo;
     void* rings;       /* currently unused */
+
+    /* Additional components summed with the above, so potentials that
+     * would otherwise need a Lua function stay in compiled code */
+    int nExtraSphere;
+    int nExtraDisk;
+    int nExtraHalo;
+    Spherical extraSphere[NB_MAX_EXTRA_COMPONENTS];
+    Disk extraDisk[NB_MAX_EXTRA_COMPONENTS];
+    Halo extraHalo[NB_MAX_EXTRA_COMPONENTS];
 } Potential;
 
 #define POTENTIAL_TYPE "Potential"
@@ -114,7 +126,10 @@ typedef struct MW_ALIGN_TYPE
 #define EMPTY_SPHERICAL { InvalidSpherical, 0.0, 0.0 }
 #define EMPTY_DISK { InvalidDisk, 0.0, 0.0, 0.0 }
 #define EMPTY_HALO { InvalidHalo, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }
-#define EMPTY_POTENTIAL { {EMPTY_SPHERICAL}, EMPTY_DISK, EMPTY_HALO, NULL }
+#define EMPTY_POTENTIAL { {EMPTY_SPHERICAL}, EMPTY_DISK, EMPTY_HALO, NULL, 0, 0, 0,                   \
+                         { EMPTY_SPHERICAL, EMPTY_SPHERICAL, EMPTY_SPHERICAL, EMPTY_SPHERICAL }, \
+                         { EMPTY_DISK, EMPTY_DISK, EMPTY_DISK, EMPTY_DISK },                     \
+                         { EMPTY_HALO, EMPTY_HALO, EMPTY_HALO, EMPTY_HALO } }
 
 
 #endif /* _NBODY_POTENTIAL_TYPES_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_SAMPLER_H_
+#define _NBODY_SAMPLER_H_
+
+#include "nbody_types.h"
+#include "dSFMT.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NB_SAMPLER_BINS 1024
+
+/* Draws from a 1D density on [xMin, xMax], approximated as piecewise
+ * linear over NB_SAMPLER_BINS equal bins. A bin is picked with the
+ * alias method and the point inside it by inverting the linear
+ * density, so each draw takes two uniform numbers and a square root. */
+typedef struct
+{
+    real xMin;
+    real binWidth;
+    real y[NB_SAMPLER_BINS + 1];    /* Density at bin edges */
+    real prob[NB_SAMPLER_BINS];     /* Chance of keeping a bin rather than its alias */
+    int alias[NB_SAMPLER_BINS];
+} NBodySampler;
+
+typedef real (*NBodyDensity)(real x, const void* args);
+
+int nbInitSampler(NBodySampler* s, NBodyDensity density, const void* args, real xMin, real xMax);
+real nbSample(const NBodySampler* s, dsfmt_t* prng);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_SAMPLER_H_ */
+
@@ -20,13 +20,13 @@
 #ifndef _NBODY_SHMEM_H_
 #define _NBODY_SHMEM_H_
 
-#include "nbody_types.h"
+#include "nbody.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx);
+int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx, const NBodyFlags* nbf);
 void nbLaunchVisualizer(NBodyState* st, const char* graphicsBin, const char* visArgs);
 NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st);
 NBodyStatus nbForceUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st);
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_SNAPSHOT_H_
+#define _NBODY_SNAPSHOT_H_
+
+#include <stdio.h>
+#include "nbody_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NBODY_SNAPSHOT_MAGIC "mwnbsnap"
+#define NBODY_SNAPSHOT_VERSION 1
+
+/* Fields which may be stored as float32 instead of float64 */
+typedef enum
+{
+    NBODY_SNAPSHOT_POSITION_FLOAT = 1 << 0,
+    NBODY_SNAPSHOT_VELOCITY_FLOAT = 1 << 1
+} NBodySnapshotFields;
+
+/* Parse a comma separated list of field names ("position",
+ * "velocity"). Returns nonzero if a name isn't known. */
+int nbParseSnapshotFields(const char* list, unsigned int* fields);
+
+/* Start writing frames every interval steps, or the first step after
+ * every multiple of timeInterval, to filename. If the state is being
+ * resumed from a checkpoint, frames already in the file up to the
+ * current step are kept and new ones are appended after them. */
+int nbCreateSnapshotWriter(NBodyState* st,
+                           const char* filename,
+                           unsigned int interval,
+                           real timeInterval,
+                           unsigned int floatFields);
+
+/* Write the index and close the file. Safe to call without a writer. */
+int nbCloseSnapshotWriter(NBodyState* st);
+
+int nbTimeToSnapshot(const NBodyCtx* ctx, const NBodyState* st);
+int nbAppendSnapshotFrame(const NBodyCtx* ctx, const NBodyState* st);
+
+
+/* Random access to frames of a snapshot file */
+typedef struct
+{
+    FILE* f;
+    uint64_t nbody;
+    uint64_t nFrames;
+    uint64_t frameSize;
+    uint64_t dataOffset;
+    unsigned int floatFields;
+    uint64_t* steps;
+    double* times;
+    uint64_t* offsets;
+} NBodySnapshotReader;
+
+int nbOpenSnapshotReader(NBodySnapshotReader* r, const char* filename);
+void nbCloseSnapshotReader(NBodySnapshotReader* r);
+
+/* Read positions and velocities of every body in frame k, in the
+ * original body order. Either of pos or vel may be NULL. */
+int nbReadSnapshotFrame(NBodySnapshotReader* r, uint64_t k, mwvector* pos, mwvector* vel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_SNAPSHOT_H_ */
+
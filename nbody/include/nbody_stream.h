@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NBODY_STREAM_H_
+#define _NBODY_STREAM_H_
+
+#include "nbody_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NBODY_STREAM_MAGIC "mwnbstrm"
+#define NBODY_STREAM_VERSION 1
+
+/* Most clients connected to the socket at once */
+#define NBODY_STREAM_MAX_CLIENTS 8
+
+/* Listen on a Unix domain socket at path and send every stride'th
+ * body to anything connected to it as the simulation runs. */
+int nbCreateStreamServer(NBodyState* st, const char* path, unsigned int stride);
+
+/* Disconnect clients and remove the socket. Safe to call without a server. */
+void nbCloseStreamServer(NBodyState* st);
+
+/* Accept any waiting clients, and tell if there is anyone to send a
+ * frame to. Never blocks. */
+int nbStreamHasClients(NBodyState* st);
+
+/* Send the current step to the clients accepted by
+ * nbStreamHasClients which have taken the last one. Never blocks;
+ * clients which are behind miss the frame. */
+void nbPublishStreamFrame(const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NBODY_STREAM_H_ */
+
@@ -28,6 +28,10 @@ extern "C" {
 #endif
 
 NBodyStatus nbMakeTree(const NBodyCtx*, NBodyState*);    /* construct tree structure */
+void nbReclaimTree(NBodyState* st);
+
+void nbFreeCellArena(NBodyCellArena* a);
+unsigned int nbCellArenaHighWater(const NBodyCellArena* a);  /* most cells used by a tree */
 
 #if 0
 void registerFindRCrit(lua_State* luaSt);
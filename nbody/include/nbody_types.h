@@ -126,6 +126,16 @@ typedef struct MW_ALIGN_TYPE
 
 #define Vel(x)  (((Body*) (x))->vel)
 
+/* Array of bodies owned by a Lua userdata, so models can be generated
+ * straight into C memory instead of into a table of Body userdata */
+typedef struct
+{
+    Body* bodies;
+    int nbody;
+} NBodyBlock;
+
+#define NBODYBLOCK_TYPE "BodyBlock"
+
 /* CELL: structure used to represent internal nodes of tree. */
 
 #define NSUB (1 << NDIM)        /* subcells per cell */
@@ -144,6 +154,7 @@ typedef struct MW_ALIGN_TYPE
     NBodyNode cellnode;         /* data common to all nodes */
     real rcrit2;                /* critical c-of-m radius^2 */
     NBodyNode* more;            /* link to first descendent */
+    mwvector center;            /* geometric center, kept for refitting */
     union MW_ALIGN_V(16)        /* shared storage for... */
     {
         NBodyNode* subp[NSUB];  /* descendents of cell */
@@ -172,6 +183,7 @@ typedef enum
 
 #define Rcrit2(x) (((NBodyCell*) (x))->rcrit2)
 #define More(x)   (((NBodyCell*) (x))->more)
+#define Center(x) (((NBodyCell*) (x))->center)
 #define Subp(x)   (((NBodyCell*) (x))->stuff.subp)
 #define Quad(x)   (((NBodyCell*) (x))->stuff.quad)
 
@@ -187,6 +199,62 @@ typedef struct MW_ALIGN_TYPE
     int structureError;
 } NBodyTree;
 
+/* Cells for the tree are handed out from one block, which is reset
+ * with each new tree. If the block runs out while building, overflow
+ * blocks are used and the main block is grown on the next reset. */
+typedef struct MW_ALIGN_TYPE
+{
+    NBodyCell* cells;            /* main block */
+    unsigned int nUsed;          /* cells handed out from main block */
+    unsigned int maxCell;        /* size of main block */
+
+    NBodyCell** overflow;        /* blocks of NB_CELL_ARENA_BLOCK cells */
+    unsigned int nOverflow;
+    unsigned int overflowUsed;   /* cells handed out from last overflow block */
+
+    unsigned int highWater;      /* most cells used by any tree so far */
+} NBodyCellArena;
+
+/* Compacted copy of the threaded tree for the CPU force calculation,
+ * with the same layout as the OpenCL buffers. Nodes are stored in the
+ * order of the tree walk, so the first child of a cell always follows
+ * it and only the Next link needs to be kept. */
+typedef struct MW_ALIGN_TYPE
+{
+    real* pos[3];            /* center of mass of cells, position of bodies */
+    real* masses;
+    real* critRadii;         /* Rcrit2 of cells */
+
+    struct
+    {
+        real* xx;
+        real* xy;
+        real* xz;
+        real* yy;
+        real* yz;
+        real* zz;
+    } quad;
+
+    int* next;               /* index of node after this one's subtree */
+    int* body;               /* index in bodytab of bodies, -1 for cells */
+    int* count;              /* number of bodies in subtree */
+
+    unsigned int nNode;
+    unsigned int maxNode;    /* allocated size of arrays */
+} NBodyFlatTree;
+
+/* Copies of body positions and masses for the direct summation
+ * kernels. The arrays are padded out to a whole number of vectors
+ * with massless bodies placed far away. */
+typedef struct MW_ALIGN_TYPE
+{
+    real* pos[3];
+    real* masses;
+
+    int nPad;                /* nbody rounded up to the vector width */
+    int maxBody;             /* allocated size of arrays */
+} NBodyExactSoA;
+
 
 
 #if NBODY_OPENCL
@@ -270,16 +338,33 @@ typedef struct
 
 
 
+/* Background checkpoint write, private to nbody_checkpoint.c */
+typedef struct NBodyCheckpointWriter NBodyCheckpointWriter;
+
+/* Snapshot time series being written, private to nbody_snapshot.c */
+typedef struct NBodySnapshotWriter NBodySnapshotWriter;
+
+/* Socket streaming snapshots to clients, private to nbody_stream.c */
+typedef struct NBodyStreamServer NBodyStreamServer;
+
 /* Mutable state used during an evaluation */
 typedef struct MW_ALIGN_TYPE
 {
     NBodyTree tree;
-    NBodyNode* freeCell;      /* list of free cells */
+    NBodyFlatTree flatTree;   /* copy of tree used by the flat tree walk */
+    NBodyExactSoA exactSoA;   /* copy of bodies used by the Exact criterion */
+    NBodyCellArena cellArena; /* storage for cells of tree */
     char* checkpointResolved;
     Body* bodytab;            /* points to array of bodies */
     mwvector* acctab;         /* Corresponding accelerations of bodies */
+    int* bodyOrder;           /* Original index of each body if bodytab has been sorted */
+    int* bodyStride;          /* Block timestep of each body, in substeps of the smallest level */
+    int* activeBodies;        /* Bodies whose forces are found on the current substep */
     mwvector* orbitTrace;     /* Trail of center of masses for display purposes */
     scene_t* scene;
+    NBodyCheckpointWriter* checkpointWriter;  /* Checkpoint being written in the background */
+    NBodySnapshotWriter* snapshotWriter;      /* Intermediate states being recorded */
+    NBodyStreamServer* streamServer;          /* Clients watching the simulation */
 
     lua_State** potEvalStates;  /* If using a Lua closure as a potential, the evaluation states.
                                    We need one per thread in the general case. */
@@ -304,6 +389,8 @@ typedef struct MW_ALIGN_TYPE
     mwbool usesCL;
     mwbool useCLCheckpointing;
     mwbool reportProgress;
+    mwbool compressCheckpoint; /* Shuffle and compress sections of checkpoints */
+    mwbool asyncCheckpoint;    /* Write checkpoints from a copy in another thread */
 
   #if NBODY_OPENCL
     CLInfo* ci;
@@ -319,9 +406,19 @@ typedef struct MW_ALIGN_TYPE
 
 #define NBODYSTATE_TYPE "NBodyState"
 
-#define EMPTY_NBODYSTATE { EMPTY_TREE, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, NULL, NULL, NULL, NULL }
+#define EMPTY_NBODYSTATE { EMPTY_TREE, EMPTY_FLAT_TREE, EMPTY_EXACT_SOA, EMPTY_CELL_ARENA, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, NULL, NULL, NULL, NULL }
 
 
+/* An extra histogram dimension. It is only used if binSize > 0 */
+typedef struct
+{
+    real start;
+    real end;
+    real binSize;
+} HistogramAxis;
+
+#define EMPTY_HISTOGRAM_AXIS { 0.0, 0.0, 0.0 }
+
 typedef struct
 {
     real phi;
@@ -331,30 +428,60 @@ typedef struct
     real endRaw;
     real binSize;
     real center;
+
+    HistogramAxis beta;      /* Degrees, in the same frame as lambda */
+    HistogramAxis distance;  /* Heliocentric distance in kpc */
+    HistogramAxis vlos;      /* Heliocentric line of sight velocity */
+    mwbool sparse;           /* Only keep bins with bodies in them */
 } HistogramParams;
 
-#define EMPTY_HISTOGRAM_PARAMS { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }
+#define EMPTY_HISTOGRAM_PARAMS { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, EMPTY_HISTOGRAM_AXIS, EMPTY_HISTOGRAM_AXIS, EMPTY_HISTOGRAM_AXIS, FALSE }
 #define HISTOGRAM_PARAMS_TYPE "HistogramParams"
 
 
+typedef enum
+{
+    NBODY_HIST_LAMBDA = 0,
+    NBODY_HIST_BETA,
+    NBODY_HIST_DISTANCE,
+    NBODY_HIST_VLOS
+} NBodyHistogramAxisType;
+
+#define NBODY_HIST_MAX_DIMS 4
+
+typedef struct
+{
+    NBodyHistogramAxisType type;
+    unsigned int nBin;
+    double start;
+    double binSize;
+} NBodyHistogramDim;
+
 typedef struct
 {
     int useBin;
     unsigned int rawCount;
+    unsigned int index;     /* Bin number with lambda varying slowest */
     double lambda;
+    double extra[NBODY_HIST_MAX_DIMS - 1];  /* Centers in the other dimensions */
     double count;
     double err;
 } HistData;
 
 typedef struct
 {
-    unsigned int nBin;
+    unsigned int nBin;      /* Number of entries in data */
     unsigned int totalNum;
     unsigned int totalSimulated;
     int hasRawCounts;
     HistogramParams params;
     double massPerParticle;
 
+    unsigned int nDims;
+    unsigned int totalBins; /* Number of bins over all dimensions */
+    int sparse;             /* data only has the bins with something in them, ordered by index */
+    NBodyHistogramDim dims[NBODY_HIST_MAX_DIMS];
+
     /* This is used as a variable length struct. Do not add any fields
      * after data. */
     HistData data[1];
@@ -373,6 +500,7 @@ typedef struct MW_ALIGN_TYPE
     real timeEvolve;
     real treeRSize;
     real sunGCDist;
+    real timestepEta;         /* accuracy parameter for choosing block timestep levels */
 
     criterion_t criterion;
     ExternalPotentialType potentialType;
@@ -380,6 +508,12 @@ typedef struct MW_ALIGN_TYPE
     mwbool useQuad;           /* use quadrupole corrections */
     mwbool allowIncest;
     mwbool quietErrors;
+    mwbool parallelTree;      /* build tree with multiple threads */
+    int bodySortInterval;     /* steps between sorting bodies along a space filling curve, 0 to disable */
+    mwbool flatTree;          /* walk a compacted copy of the tree */
+    int groupSize;            /* max bodies sharing an interaction list, 0 to walk for each body */
+    int treeRebuildInterval;  /* steps between full tree rebuilds, refitting in between. 0 to rebuild every step */
+    int timestepLevels;       /* number of halvings of timestep bodies can use, 0 for a single timestep */
 
     time_t checkpointT;       /* Period to checkpoint when not using BOINC */
     unsigned int nStep;
@@ -453,9 +587,12 @@ typedef enum
 
 
 #define EMPTY_TREE { NULL, 0.0, 0, 0, FALSE }
-#define EMPTY_NBODYCTX { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,                  \
+#define EMPTY_CELL_ARENA { NULL, 0, 0, NULL, 0, 0, 0 }
+#define EMPTY_FLAT_TREE { { NULL, NULL, NULL }, NULL, NULL, { NULL, NULL, NULL, NULL, NULL, NULL }, NULL, NULL, NULL, 0, 0 }
+#define EMPTY_EXACT_SOA { { NULL, NULL, NULL }, NULL, 0, 0 }
+#define EMPTY_NBODYCTX { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,             \
                          InvalidCriterion, EXTERNAL_POTENTIAL_DEFAULT,  \
-                         FALSE, FALSE, FALSE,                           \
+                         FALSE, FALSE, FALSE, FALSE, 0, FALSE, 0, 0, 0, \
                          0, 0,                                          \
                          EMPTY_POTENTIAL }
 
@@ -522,6 +522,7 @@ static scene_t* nbglLoadStaticSceneFromFile(const char* filename)
     scene->staticScene = TRUE;
 
     /* Make read data fake that we have 1 element in the queue */
+    scene->queue.size = NBODY_CIRC_QUEUE_SIZE;
     OPA_store_int(&scene->queue.head, 0);
     OPA_store_int(&scene->queue.tail, 1);
 
@@ -585,6 +586,8 @@ static scene_t* nbglLoadStaticSceneFromFile(const char* filename)
     }
 
     scene->nbody = nbody;
+    scene->nbodyTotal = nbody;
+    scene->stride = 1;
     if (hasError)
     {
         free(scene);
@@ -646,7 +649,9 @@ static scene_t* nbglConnectSharedScene(int instanceId)
 
     if (   sb.st_size < (ssize_t) sizeof(scene_t)
         || sb.st_size < (ssize_t) scene->sceneSize
-        || sb.st_size < (ssize_t) (calcSize = nbFindShmemSize(scene->nbody, scene->nSteps))
+        || scene->queue.size < 2
+        || scene->queue.size > NBODY_MAX_QUEUE_SIZE
+        || sb.st_size < (ssize_t) (calcSize = nbFindShmemSize(scene->nbody, scene->nSteps, scene->queue.size, scene->quantized))
         || calcSize != scene->sceneSize)
     {
         mw_printf("Shared memory segment is impossibly small ("ZU")\n", (size_t) sb.st_size);
@@ -704,7 +709,10 @@ static scene_t* nbglConnectSharedScene(int instanceId)
     /* Because this API sucks and doesn't give us a way to find the size of a
        paging file backed shared mapped file use the size we stored ourselves. */
     size = scene->sceneSize;
-    if (size < sizeof(scene_t) || size != nbFindShmemSize(scene->nbody))
+    if (   size < sizeof(scene_t)
+        || scene->queue.size < 2
+        || scene->queue.size > NBODY_MAX_QUEUE_SIZE
+        || size != nbFindShmemSize(scene->nbody, scene->nSteps, scene->queue.size, scene->quantized))
     {
         mw_printf("Shared memory segment '%s' is impossibly small (%u)\n", name, size);
         CloseHandle(mapFile);
@@ -32,6 +32,7 @@
 #include "nbody.h"
 #include "nbody_chisq.h"
 #include "nbody_defaults.h"
+#include "nbody_snapshot.h"
 #include "milkyway_git_version.h"
 
 #ifdef _OPENMP
@@ -200,6 +201,9 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
     int argRead;
     poptContext context;
     const char** rest = NULL;   /* Leftover arguments */
+    unsigned int snapshotFields;
+    unsigned int nMatchMethods;
+    NBodyLikelihoodMethod matchMethods[NBODY_MAX_MATCH_METHODS];
     static int version = FALSE;
     static int copyright = FALSE;
     static NBodyFlags nbf = EMPTY_NBODY_FLAGS;
@@ -234,19 +238,29 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
             0, "Only match this histogram against other histogram (requires histogram argument)", NULL
         },
 
+        {
+            "match-histogram-list", '\0',
+            POPT_ARG_STRING, &nbf.matchHistogramList,
+            0, "Match every histogram listed in this file (one per line) against the histogram argument, and print a table", NULL
+        },
+
+        {
+            "match-methods", '\0',
+            POPT_ARG_STRING, &nbf.matchMethods,
+            0, "Comma separated likelihood methods for --match-histogram-list (EMD, Original, AltOriginal, ChisqAlt, Poisson, Kolmogorov, KullbackLeibler, Saha). Default EMD", NULL
+        },
+
         {
             "output-file", 'o',
             POPT_ARG_STRING, &nbf.outFileName,
             0, "Output file", NULL
         },
 
-      #if 0
         {
             "binary-output", 'B',
             POPT_ARG_NONE, &nbf.outputBinary,
             0, "Write output dump as a binary", NULL
         },
-      #endif
 
         {
             "output-cartesian", 'x',
@@ -314,6 +328,36 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
             0, "Path to visualize", NULL
         },
 
+        {
+            "visualizer-queue-size", '\0',
+            POPT_ARG_INT, &nbf.visQueueSize,
+            0, "Number of snapshots queued for the visualizer", NULL
+        },
+
+        {
+            "visualizer-stride", '\0',
+            POPT_ARG_INT, &nbf.visStride,
+            0, "Only show every n'th body in the visualizer", NULL
+        },
+
+        {
+            "visualizer-quantize", '\0',
+            POPT_ARG_NONE, &nbf.visQuantize,
+            0, "Share 16 bit positions relative to the center of mass with the visualizer", NULL
+        },
+
+        {
+            "stream-socket", '\0',
+            POPT_ARG_STRING, &nbf.streamSocket,
+            0, "Stream snapshots to clients of a Unix domain socket", NULL
+        },
+
+        {
+            "stream-stride", '\0',
+            POPT_ARG_INT, &nbf.streamStride,
+            0, "Only stream every n'th body", NULL
+        },
+
         {
             "ignore-checkpoint", 'i',
             POPT_ARG_NONE, &nbf.ignoreCheckpoint,
@@ -386,12 +430,72 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
             0, "Do not delete checkpoint on finish", NULL
         },
 
+        {
+            "compress-checkpoint", '\0',
+            POPT_ARG_NONE, &nbf.compressCheckpoint,
+            0, "Compress checkpoints. Slower to write, but smaller", NULL
+        },
+
+        {
+            "async-checkpoint", '\0',
+            POPT_ARG_NONE, &nbf.asyncCheckpoint,
+            0, "Write checkpoints in the background while the simulation continues", NULL
+        },
+
+        {
+            "snapshot-file", '\0',
+            POPT_ARG_STRING, &nbf.snapshotFileName,
+            0, "Record intermediate states of the bodies to this file", NULL
+        },
+
+        {
+            "snapshot-interval", '\0',
+            POPT_ARG_INT, &nbf.snapshotInterval,
+            0, "Number of steps between snapshots", NULL
+        },
+
+        {
+            "snapshot-time", '\0',
+            POPT_ARG_DOUBLE, &nbf.snapshotTime,
+            0, "Simulation time (Gyr) between snapshots", NULL
+        },
+
+        {
+            "snapshot-float32", '\0',
+            POPT_ARG_STRING, &nbf.snapshotFloat32,
+            0, "Comma separated snapshot fields (position, velocity) to store in single precision", NULL
+        },
+
         {
             "verbose", '\0',
             POPT_ARG_NONE, &nbf.verbose,
             0, "Print some extra debugging information", NULL
         },
 
+        {
+            "force-no-intrinsics", '\0',
+            POPT_ARG_NONE, &nbf.forceNoIntrinsics,
+            0, "Use plain path for Exact criterion", NULL
+        },
+
+        {
+            "force-sse2", '\0',
+            POPT_ARG_NONE, &nbf.forceSSE2,
+            0, "Force to use SSE2 path for Exact criterion", NULL
+        },
+
+        {
+            "force-avx", '\0',
+            POPT_ARG_NONE, &nbf.forceAVX,
+            0, "Force to use AVX path for Exact criterion", NULL
+        },
+
+        {
+            "force-avx512", '\0',
+            POPT_ARG_NONE, &nbf.forceAVX512,
+            0, "Force to use AVX-512 path for Exact criterion", NULL
+        },
+
         {
             "version", 'v',
             POPT_ARG_NONE, &version,
@@ -448,7 +552,7 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
         exit(EXIT_SUCCESS);
     }
 
-    if (!nbf.inputFile && !nbf.checkpointFileName && !nbf.matchHistogram)
+    if (!nbf.inputFile && !nbf.checkpointFileName && !nbf.matchHistogram && !nbf.matchHistogramList)
     {
         mw_printf("An input file, checkpoint, or matching histogram argument is required\n");
         poptFreeContext(context);
@@ -462,6 +566,55 @@ static mwbool nbReadParameters(const int argc, const char* argv[], NBodyFlags* n
         return TRUE;
     }
 
+    if (nbf.matchHistogramList && !nbf.histogramFileName)
+    {
+        mw_printf("--match-histogram-list argument requires --histogram-file\n");
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (nbf.matchMethods && nbParseLikelihoodMethods(nbf.matchMethods, matchMethods, &nMatchMethods))
+    {
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (nbf.snapshotInterval < 0 || nbf.snapshotTime < 0.0)
+    {
+        mw_printf("Snapshot interval must not be negative\n");
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (   nbf.visQueueSize < 0
+        || nbf.visQueueSize == 1
+        || nbf.visQueueSize > NBODY_MAX_QUEUE_SIZE)
+    {
+        mw_printf("Visualizer queue size must be between 2 and %d\n", NBODY_MAX_QUEUE_SIZE);
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (nbf.visStride < 0)
+    {
+        mw_printf("Visualizer stride must not be negative\n");
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (nbf.streamStride < 0)
+    {
+        mw_printf("Stream stride must not be negative\n");
+        poptFreeContext(context);
+        return TRUE;
+    }
+
+    if (nbf.snapshotFloat32 && nbParseSnapshotFields(nbf.snapshotFloat32, &snapshotFields))
+    {
+        poptFreeContext(context);
+        return TRUE;
+    }
+
     nbf.setSeed = !!(argRead & SEED_ARGUMENT);
 
     rest = poptGetArgs(context);
@@ -496,6 +649,21 @@ static void nbSetDefaultFlags(NBodyFlags* nbf)
         nbf->checkpointPeriod = NOBOINC_DEFAULT_CHECKPOINT_PERIOD;
     }
 
+    if (nbf->visQueueSize == 0)
+    {
+        nbf->visQueueSize = NBODY_CIRC_QUEUE_SIZE;
+    }
+
+    if (nbf->visStride == 0)
+    {
+        nbf->visStride = 1;
+    }
+
+    if (nbf->streamStride == 0)
+    {
+        nbf->streamStride = 1;
+    }
+
     if (BOINC_APPLICATION && nbf->debugLuaLibs)
     {
         mw_printf("Warning: disabling --lua-debug-libraries\n");
@@ -511,9 +679,14 @@ static void freeNBodyFlags(NBodyFlags* nbf)
     free(nbf->histogramFileName);
     free(nbf->histoutFileName);
     free(nbf->matchHistogram);
+    free(nbf->matchHistogramList);
+    free(nbf->matchMethods);
     free(nbf->forwardedArgs);
     free(nbf->graphicsBin);
     free(nbf->visArgs);
+    free(nbf->snapshotFileName);
+    free(nbf->snapshotFloat32);
+    free(nbf->streamSocket);
 }
 
 static int nbSetNumThreads(int numThreads)
@@ -606,6 +779,18 @@ int main(int argc, const char* argv[])
     {
         rc = nbVerifyFile(&nbf);
     }
+    else if (nbf.matchHistogramList)
+    {
+        unsigned int nMethods = 1;
+        NBodyLikelihoodMethod methods[NBODY_MAX_MATCH_METHODS] = { NBODY_EMD };
+
+        if (nbf.matchMethods)
+        {
+            nbParseLikelihoodMethods(nbf.matchMethods, methods, &nMethods);
+        }
+
+        rc = nbMatchHistogramList(stdout, nbf.histogramFileName, nbf.matchHistogramList, methods, nMethods);
+    }
     else if (nbf.matchHistogram)
     {
         double emd;
@@ -616,10 +801,18 @@ int main(int argc, const char* argv[])
     }
     else
     {
-        rc = nbMain(&nbf);
-        rc = nbStatusToRC(rc);
+        NBodyStatus status;
 
-        if (!nbf.noCleanCheckpoint)
+        status = nbMain(&nbf);
+        rc = nbStatusToRC(status);
+
+        /* A checkpoint that could not be read or written may still be
+         * the only way to resume the run, so leave it alone */
+        if (status & NBODY_CHECKPOINT_ERROR)
+        {
+            mw_report("Keeping checkpoint file '%s'\n", nbf.checkpointFileName);
+        }
+        else if (!nbf.noCleanCheckpoint)
         {
             mw_report("Removing checkpoint file '%s'\n", nbf.checkpointFileName);
             mw_remove(nbf.checkpointFileName);
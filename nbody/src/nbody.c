@@ -30,6 +30,11 @@
 #include "nbody_defaults.h"
 #include "nbody_plain.h"
 #include "nbody_chisq.h"
+#include "nbody_exact.h"
+#include "nbody_tree.h"
+#include "nbody_snapshot.h"
+#include "nbody_stream.h"
+#include "nbody_sort.h"
 
 #if NBODY_OPENCL
   #include "nbody_cl.h"
@@ -102,6 +107,24 @@ static void nbSetStateFromFlags(NBodyState* st, const NBodyFlags* nbf)
 {
     st->reportProgress = nbf->reportProgress;
     st->ignoreResponsive = nbf->ignoreResponsive;
+    st->compressCheckpoint = nbf->compressCheckpoint;
+    st->asyncCheckpoint = nbf->asyncCheckpoint;
+}
+
+static int nbStartSnapshots(NBodyState* st, const NBodyFlags* nbf)
+{
+    unsigned int floatFields = 0;
+
+    if (nbf->snapshotFloat32 && nbParseSnapshotFields(nbf->snapshotFloat32, &floatFields))
+    {
+        return 1;
+    }
+
+    return nbCreateSnapshotWriter(st,
+                                  nbf->snapshotFileName,
+                                  (unsigned int) nbf->snapshotInterval,
+                                  (real) nbf->snapshotTime,
+                                  floatFields);
 }
 
 static void nbSetCLRequestFromFlags(CLRequest* clr, const NBodyFlags* nbf)
@@ -168,7 +191,8 @@ static int nbOutputIsUseful(const NBodyFlags* nbf)
         && !nbf->histoutFileName
         && !nbf->printHistogram
         && !nbf->verifyOnly
-        && !nbf->printTiming)
+        && !nbf->printTiming
+        && !nbf->snapshotFileName)
     {
         mw_printf("Don't you want some kind of result?\n");
         return FALSE;
@@ -179,6 +203,8 @@ static int nbOutputIsUseful(const NBodyFlags* nbf)
 
 NBodyStatus nbStepSystem(const NBodyCtx* ctx, NBodyState* st)
 {
+    NBodyStatus rc;
+
   #if NBODY_OPENCL
     if (st->usesCL)
     {
@@ -186,7 +212,13 @@ NBodyStatus nbStepSystem(const NBodyCtx* ctx, NBodyState* st)
     }
   #endif
 
-    return nbStepSystemPlain(ctx, st);
+    rc = nbStepSystemPlain(ctx, st);
+
+    /* The caller sees the state between steps, so put the bodies back
+     * in their original order if the step sorted them */
+    nbRestoreBodyOrder(st);
+
+    return rc;
 }
 
 NBodyStatus nbRunSystem(const NBodyCtx* ctx, NBodyState* st)
@@ -335,6 +367,12 @@ int nbMain(const NBodyFlags* nbf)
     nbSetCtxFromFlags(ctx, nbf); /* Do this after setup to avoid the setup clobbering the flags */
     nbSetStateFromFlags(st, nbf);
 
+    if (ctx->criterion == Exact && nbExactKernelDispatch(nbf))
+    {
+        destroyNBodyState(st);
+        return NBODY_USER_ERROR;
+    }
+
     if (NBODY_OPENCL && !nbf->noCL)
     {
         rc = nbInitNBodyStateCL(st, ctx);
@@ -345,7 +383,20 @@ int nbMain(const NBodyFlags* nbf)
         }
     }
 
-    if (nbCreateSharedScene(st, ctx))
+    if (nbf->snapshotFileName && nbStartSnapshots(st, nbf))
+    {
+        destroyNBodyState(st);
+        return NBODY_IO_ERROR;
+    }
+
+    if (   nbf->streamSocket
+        && nbCreateStreamServer(st, nbf->streamSocket, (unsigned int) nbf->streamStride))
+    {
+        destroyNBodyState(st);
+        return NBODY_IO_ERROR;
+    }
+
+    if (nbCreateSharedScene(st, ctx, nbf))
     {
         mw_printf("Failed to create shared scene\n");
     }
@@ -392,9 +443,19 @@ int nbMain(const NBodyFlags* nbf)
         if (nbf->printTiming)
         {
             printf("<run_time> %f </run_time>\n", te - ts);
+            if (!st->usesExact && !st->usesCL)
+            {
+                printf("<max_tree_cells> %u </max_tree_cells>\n", nbCellArenaHighWater(&st->cellArena));
+            }
         }
     }
 
+    if (nbCloseSnapshotWriter(st))
+    {
+        destroyNBodyState(st);
+        return NBODY_IO_ERROR;
+    }
+
     rc = nbReportResults(ctx, st, nbf);
 
     destroyNBodyState(st);
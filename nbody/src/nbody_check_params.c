@@ -21,6 +21,7 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "nbody_priv.h"
 #include "milkyway_util.h"
 #include "nbody_check_params.h"
+#include "nbody_defaults.h"
 
 mwbool checkSphericalConstants(Spherical* s)
 {
@@ -139,7 +140,38 @@ mwbool checkHaloConstants(Halo* h)
 
 mwbool checkPotentialConstants(Potential* p)
 {
-    return checkSphericalConstants(&p->sphere[0]) || checkDiskConstants(&p->disk) || checkHaloConstants(&p->halo);
+    int i;
+
+    if (checkSphericalConstants(&p->sphere[0]) || checkDiskConstants(&p->disk) || checkHaloConstants(&p->halo))
+        return TRUE;
+
+    if (   p->nExtraSphere < 0 || p->nExtraSphere > NB_MAX_EXTRA_COMPONENTS
+        || p->nExtraDisk < 0 || p->nExtraDisk > NB_MAX_EXTRA_COMPONENTS
+        || p->nExtraHalo < 0 || p->nExtraHalo > NB_MAX_EXTRA_COMPONENTS)
+    {
+        mw_printf("Invalid number of extra potential components\n");
+        return TRUE;
+    }
+
+    for (i = 0; i < p->nExtraSphere; ++i)
+    {
+        if (checkSphericalConstants(&p->extraSphere[i]))
+            return TRUE;
+    }
+
+    for (i = 0; i < p->nExtraDisk; ++i)
+    {
+        if (checkDiskConstants(&p->extraDisk[i]))
+            return TRUE;
+    }
+
+    for (i = 0; i < p->nExtraHalo; ++i)
+    {
+        if (checkHaloConstants(&p->extraHalo[i]))
+            return TRUE;
+    }
+
+    return FALSE;
 }
 
 static int hasAcceptableTheta(const NBodyCtx* ctx)
@@ -181,8 +213,21 @@ static int hasAcceptableSteps(const NBodyCtx* ctx)
     return rc;
 }
 
+static int hasAcceptableTimestepLevels(const NBodyCtx* ctx)
+{
+    int rc = (ctx->timestepLevels < 0 || ctx->timestepLevels > NB_MAX_TIMESTEP_LEVELS);
+    if (rc)
+        mw_printf("Got an unacceptable number of timestep levels (%d)\n", ctx->timestepLevels);
+
+    return rc;
+}
+
 mwbool checkNBodyCtxConstants(const NBodyCtx* ctx)
 {
-    return hasAcceptableTimes(ctx) || hasAcceptableSteps(ctx) || hasAcceptableEps2(ctx) || hasAcceptableTheta(ctx);
+    return hasAcceptableTimes(ctx)
+        || hasAcceptableSteps(ctx)
+        || hasAcceptableEps2(ctx)
+        || hasAcceptableTheta(ctx)
+        || hasAcceptableTimestepLevels(ctx);
 }
 
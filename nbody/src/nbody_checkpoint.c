@@ -22,6 +22,16 @@
 #include "nbody_checkpoint.h"
 #include "milkyway_util.h"
 #include "nbody_defaults.h"
+#include "nbody_compress.h"
+#include "nbody_check_params.h"
+#include "nbody_binary_io.h"
+
+#include <limits.h>
+#include <opa_primitives.h>
+
+#ifndef _WIN32
+  #include <pthread.h>
+#endif
 
 #if HAVE_FCNTL_H
   #include <fcntl.h>
@@ -69,7 +79,8 @@ typedef struct
 #endif /* _WIN32 */
 
 
-/* Checkpoint file: Very simple binary "format"
+/* Version 1 checkpoint file, which is only read now to resume older runs.
+   Very simple binary "format"
    Name        Type         Values     Notes
 -------------------------------------------------------
    NBodyCheckpointHeader
@@ -81,6 +92,39 @@ typedef struct
 static const char hdr[] = "mwnbody";
 static const char tail[] = "end";
 
+/* Layouts of Potential and NBodyCtx as they were when version 1 files
+   were written. These are part of the file format and must not change
+   along with the real structs. */
+typedef struct MW_ALIGN_TYPE
+{
+    Spherical sphere[1];
+    Disk disk;
+    Halo halo;
+    void* rings;
+} PotentialV1;
+
+typedef struct MW_ALIGN_TYPE
+{
+    real eps2;
+    real theta;
+    real timestep;
+    real timeEvolve;
+    real treeRSize;
+    real sunGCDist;
+
+    criterion_t criterion;
+    ExternalPotentialType potentialType;
+
+    mwbool useQuad;
+    mwbool allowIncest;
+    mwbool quietErrors;
+
+    time_t checkpointT;
+    unsigned int nStep;
+
+    PotentialV1 pot;
+} NBodyCtxV1;
+
 typedef struct
 {
     char header[128];                     /* "mwnbody" */
@@ -92,33 +136,42 @@ typedef struct
     uint32_t nOrbitTrace;
     uint32_t treeIncest;
     real rsize;
-    NBodyCtx ctx;
+    NBodyCtxV1 ctx;
 } NBodyCheckpointHeader;
 
 static const size_t hdrSize = sizeof(NBodyCheckpointHeader) + sizeof(tail);
 
 
 
-static void nbPrepareWriteCheckpointHeader(NBodyCheckpointHeader* cp, const NBodyCtx* ctx, const NBodyState* st)
+static void nbReadCheckpointHeader(NBodyCheckpointHeader* cp, NBodyCtx* ctx, NBodyState* st)
 {
-    strcpy(cp->header, hdr);
-    cp->realSize = sizeof(real);
-    cp->ptrSize = sizeof(void*);
-    cp->nOrbitTrace = st->nOrbitTrace;
+    const NBodyCtxV1* v1 = &cp->ctx;
 
-    cp->majorVersion = NBODY_VERSION_MAJOR;
-    cp->minorVersion= NBODY_VERSION_MINOR;
+    /* Fields added since version 1 get their defaults */
+    *ctx = defaultNBodyCtx;
 
-    memcpy(&cp->ctx, ctx, sizeof(cp->ctx));
-    cp->nbody = st->nbody;
-    cp->step = st->step;
-    cp->rsize = st->tree.rsize;
-    cp->treeIncest = st->treeIncest;
-}
+    ctx->eps2 = v1->eps2;
+    ctx->theta = v1->theta;
+    ctx->timestep = v1->timestep;
+    ctx->timeEvolve = v1->timeEvolve;
+    ctx->treeRSize = v1->treeRSize;
+    ctx->sunGCDist = v1->sunGCDist;
+
+    ctx->criterion = v1->criterion;
+    ctx->potentialType = v1->potentialType;
+
+    ctx->useQuad = v1->useQuad;
+    ctx->allowIncest = v1->allowIncest;
+    ctx->quietErrors = v1->quietErrors;
+
+    ctx->checkpointT = v1->checkpointT;
+    ctx->nStep = v1->nStep;
+
+    ctx->pot.sphere[0] = v1->pot.sphere[0];
+    ctx->pot.disk = v1->pot.disk;
+    ctx->pot.halo = v1->pot.halo;
+    ctx->pot.rings = v1->pot.rings;
 
-static void nbReadCheckpointHeader(NBodyCheckpointHeader* cp, NBodyCtx* ctx, NBodyState* st)
-{
-    memcpy(ctx, &cp->ctx, sizeof(*ctx));
     st->nbody = cp->nbody;
     st->step = cp->step;
     st->tree.rsize = cp->rsize;
@@ -177,14 +230,11 @@ static int nbVerifyCheckpointHeader(const NBodyCheckpointHeader* cpHdr,
 
 #ifndef _WIN32
 
-static int nbOpenCheckpointHandle(const NBodyState* st,
-                                  CheckpointHandle* cp,
-                                  const char* filename,
-                                  int writing)
+static int nbOpenCheckpointHandle(CheckpointHandle* cp, const char* filename)
 {
     struct stat sb;
 
-    cp->fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    cp->fd = open(filename, O_RDONLY);
     if (cp->fd == -1)
     {
         mwPerror("Error opening checkpoint '%s'", filename);
@@ -203,27 +253,14 @@ static int nbOpenCheckpointHandle(const NBodyState* st,
         return TRUE;
     }
 
-    if (writing)
+    cp->cpFileSize = sb.st_size;
+    if (cp->cpFileSize == 0)
     {
-        cp->cpFileSize = hdrSize + st->nbody * sizeof(Body) + st->nOrbitTrace * sizeof(mwvector);
-        /* Make the file the right size in case it's a new file */
-        if (ftruncate(cp->fd, cp->cpFileSize) < 0)
-        {
-            mwPerror("Error ftruncate() on checkpoint '%s'", filename);
-            return TRUE;
-        }
-    }
-    else
-    {
-        cp->cpFileSize = sb.st_size;
-        if (cp->cpFileSize == 0)
-        {
-            mw_printf("Checkpoint '%s' is empty\n", filename);
-            return 1;
-        }
+        mw_printf("Checkpoint '%s' is empty\n", filename);
+        return 1;
     }
 
-    cp->mptr = mmap(NULL, cp->cpFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, cp->fd, 0);
+    cp->mptr = mmap(NULL, cp->cpFileSize, PROT_READ, MAP_PRIVATE, cp->fd, 0);
     if (cp->mptr == MAP_FAILED)
     {
         mwPerror("Error mmap()ing checkpoint '%s'", filename);
@@ -271,36 +308,20 @@ static int nbCloseCheckpointHandle(CheckpointHandle* cp)
              Flushing:
              http://msdn.microsoft.com/en-us/library/aa366563(v=VS.85).aspx
  */
-static int nbOpenCheckpointHandle(const NBodyState* st,
-                                  CheckpointHandle* cp,
-                                  const char* filename,
-                                  int writing)
+static int nbOpenCheckpointHandle(CheckpointHandle* cp, const char* filename)
 {
     SYSTEM_INFO si;
     DWORD sysGran;
     DWORD mapViewSize, fileMapStart, fileMapSize;
 
-    /* Try to create a new file */
     cp->file = CreateFile(filename,
-                          GENERIC_READ | GENERIC_WRITE,
+                          GENERIC_READ,
                           0,     /* Other processes can't touch this */
                           NULL,
-                          CREATE_NEW,
+                          OPEN_EXISTING,
                           FILE_FLAG_SEQUENTIAL_SCAN,
                           NULL);
 
-    /* If the checkpoint already exists, open it */
-    if (GetLastError() == ERROR_FILE_EXISTS)
-    {
-        cp->file = CreateFile(filename,
-                              GENERIC_READ | GENERIC_WRITE,
-                              0,     /* Other processes can't touch this */
-                              NULL,
-                              OPEN_EXISTING,
-                              FILE_FLAG_SEQUENTIAL_SCAN,
-                              NULL);
-    }
-
     /* TODO: More filetype checking and stuff */
 
     if (cp->file == INVALID_HANDLE_VALUE)
@@ -309,21 +330,14 @@ static int nbOpenCheckpointHandle(const NBodyState* st,
         return TRUE;
     }
 
-    if (writing)
-    {
-        cp->cpFileSize = (DWORD) (hdrSize + st->nbody * sizeof(Body) + st->nOrbitTrace * sizeof(mwvector));
-    }
-    else
+    /* We don't know how much to expect when reading the file */
+    cp->cpFileSize = GetFileSize(cp->file, NULL);
+    if (cp->cpFileSize == INVALID_FILE_SIZE || cp->cpFileSize == 0)
     {
-        /* We don't know how much to expect when reading the file */
-        cp->cpFileSize = GetFileSize(cp->file, NULL);
-        if (cp->cpFileSize == INVALID_FILE_SIZE || cp->cpFileSize == 0)
-        {
-            mwPerrorW32("Invalid checkpoint file size (%ld) or empty checkpoint file '%s'",
-                        cp->cpFileSize, filename);
-            CloseHandle(cp->file);
-            return TRUE;
-        }
+        mwPerrorW32("Invalid checkpoint file size (%ld) or empty checkpoint file '%s'",
+                    cp->cpFileSize, filename);
+        CloseHandle(cp->file);
+        return TRUE;
     }
 
     GetSystemInfo(&si);
@@ -334,7 +348,7 @@ static int nbOpenCheckpointHandle(const NBodyState* st,
 
     cp->mapFile = CreateFileMapping(cp->file,
                                     NULL,
-                                    PAGE_READWRITE,
+                                    PAGE_READONLY,
                                     0,
                                     fileMapSize,
                                     NULL);
@@ -345,7 +359,7 @@ static int nbOpenCheckpointHandle(const NBodyState* st,
     }
 
     cp->mptr = (char*) MapViewOfFile(cp->mapFile,
-                                     FILE_MAP_ALL_ACCESS,
+                                     FILE_MAP_READ,
                                      0,
                                      fileMapStart,
                                      mapViewSize);
@@ -437,30 +451,866 @@ static int nbThawState(NBodyCtx* ctx, NBodyState* st, CheckpointHandle* cp)
     return FALSE;
 }
 
-static void nbFreezeState(const NBodyCtx* ctx, const NBodyState* st, CheckpointHandle* cp)
+/* Version 2 checkpoint file. Everything is little endian and reals
+   are stored as doubles, so a checkpoint can be resumed by a build
+   with a different real size or architecture.
+
+   Name         Type         Notes
+-------------------------------------------------------
+   magic        char[8]      "mwnbody2"
+   version      u32          2
+   flags        u32          Unused, 0
+   nbody        u64
+   nOrbitTrace  u64
+   step         u32
+   treeIncest   i32
+   rsize        f64
+   ctx fields   { u8 nameLen, name, u8 kind, 8 byte value }, ended by nameLen = 0
+   sections     { char[4] id, u8 nColumns, { char[4] id, u8 elemSize } per column,
+                  u64 rows, row groups }, ended by id "end"
+   row group    One chunk per column, for up to CHECKPOINT_CHUNK rows
+   chunk        { u32 rawBytes, u32 storedBytes, data }
+
+   Each context field is written by name, so fields can be added
+   without breaking old files; missing fields keep whatever the
+   context had before reading.
+
+   The "body" section has a column for each field of the bodies, in
+   their original order, and "trce" has the orbit trace. Row groups
+   are gathered and written one at a time, so the file is streamed
+   out without a full size copy of the state. If storedBytes <
+   rawBytes, the chunk is byte shuffled (the lowest byte of every
+   value first, and so on) and LZ compressed. Otherwise it is the
+   plain values. Readers skip sections and columns they don't know.
+ */
+
+static const char hdrV2[8] = { 'm', 'w', 'n', 'b', 'o', 'd', 'y', '2' };
+
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_CHUNK 8192
+#define CHECKPOINT_MAX_NAME 64
+#define CHECKPOINT_MAX_FIELDS 4096
+
+typedef enum
 {
-    const size_t bodySize = st->nbody * sizeof(Body);
-    const size_t traceSize = st->nOrbitTrace * sizeof(mwvector);
-    char* p = cp->mptr;
-    NBodyCheckpointHeader cpHdr;
+    CHECKPOINT_REAL = 1,
+    CHECKPOINT_INT  = 2
+} CheckpointValueKind;
 
-    memset(&cpHdr, 0, sizeof(cpHdr));
-    nbPrepareWriteCheckpointHeader(&cpHdr, ctx, st);
+typedef struct
+{
+    char id[4];
+    size_t offset;             /* Of the value in a row */
+    CheckpointValueKind kind;  /* Reals are stored as doubles, ints as 16 bits */
+} CheckpointColumn;
 
-    memcpy(p, &cpHdr, sizeof(cpHdr));
-    p += sizeof(cpHdr);
+static const CheckpointColumn bodyColumns[] =
+{
+    { { 'p', 'o', 's', 'x' }, offsetof(Body, bodynode.pos.x), CHECKPOINT_REAL },
+    { { 'p', 'o', 's', 'y' }, offsetof(Body, bodynode.pos.y), CHECKPOINT_REAL },
+    { { 'p', 'o', 's', 'z' }, offsetof(Body, bodynode.pos.z), CHECKPOINT_REAL },
+    { { 'v', 'e', 'l', 'x' }, offsetof(Body, vel.x),          CHECKPOINT_REAL },
+    { { 'v', 'e', 'l', 'y' }, offsetof(Body, vel.y),          CHECKPOINT_REAL },
+    { { 'v', 'e', 'l', 'z' }, offsetof(Body, vel.z),          CHECKPOINT_REAL },
+    { { 'm', 'a', 's', 's' }, offsetof(Body, bodynode.mass),  CHECKPOINT_REAL },
+    { { 't', 'y', 'p', 'e' }, offsetof(Body, bodynode.type),  CHECKPOINT_INT  }
+};
+
+static const CheckpointColumn traceColumns[] =
+{
+    { { 'x', ' ', ' ', ' ' }, offsetof(mwvector, x), CHECKPOINT_REAL },
+    { { 'y', ' ', ' ', ' ' }, offsetof(mwvector, y), CHECKPOINT_REAL },
+    { { 'z', ' ', ' ', ' ' }, offsetof(mwvector, z), CHECKPOINT_REAL }
+};
 
-    /* The main piece of state*/
-    memcpy(p, st->bodytab, bodySize);
-    p += bodySize;
+#define N_BODY_COLUMNS (sizeof(bodyColumns) / sizeof(bodyColumns[0]))
+#define N_TRACE_COLUMNS (sizeof(traceColumns) / sizeof(traceColumns[0]))
+
+static const char bodySection[4] = { 'b', 'o', 'd', 'y' };
+static const char traceSection[4] = { 't', 'r', 'c', 'e' };
+static const char sectionEnd[4] = { 'e', 'n', 'd', '\0' };
+
+/* Where the rows of a section live in memory */
+typedef struct
+{
+    char* base;
+    size_t stride;
+    const int* order;  /* Row for each position in the file if reordered, or NULL */
+} CheckpointRows;
+
+typedef struct
+{
+    FILE* f;
+    int failed;
 
-    if (st->orbitTrace)
+    /* Scratch for a chunk */
+    uint8_t* elems;     /* Little endian values */
+    uint8_t* shuffled;  /* Bytes of the values grouped by significance */
+    uint8_t* packed;    /* Compressed */
+} CheckpointStream;
+
+typedef struct
+{
+    char name[CHECKPOINT_MAX_NAME];
+    int kind;
+    uint64_t value;
+} CheckpointField;
+
+typedef struct
+{
+    CheckpointField* fields;
+    unsigned int nFields;
+} CheckpointFieldList;
+
+typedef void (*CheckpointFieldFunc)(void* data, const char* name, CheckpointValueKind kind, void* field, size_t size);
+
+
+static int nbAllocCheckpointStream(CheckpointStream* s, FILE* f)
+{
+    s->f = f;
+    s->failed = FALSE;
+    s->elems = (uint8_t*) mwMalloc(CHECKPOINT_CHUNK * sizeof(uint64_t));
+    s->shuffled = (uint8_t*) mwMalloc(CHECKPOINT_CHUNK * sizeof(uint64_t));
+    s->packed = (uint8_t*) mwMalloc(nbLZCompressBound(CHECKPOINT_CHUNK * sizeof(uint64_t)));
+
+    return !s->elems || !s->shuffled || !s->packed;
+}
+
+static void nbFreeCheckpointStream(CheckpointStream* s)
+{
+    free(s->elems);
+    free(s->shuffled);
+    free(s->packed);
+}
+
+static void nbCheckpointWrite(CheckpointStream* s, const void* p, size_t n)
+{
+    if (!s->failed && fwrite(p, 1, n, s->f) != n)
     {
-        memcpy(p, st->orbitTrace, traceSize);
-        p += traceSize;
+        s->failed = TRUE;
+    }
+}
+
+static void nbCheckpointRead(CheckpointStream* s, void* p, size_t n)
+{
+    if (s->failed || fread(p, 1, n, s->f) != n)
+    {
+        s->failed = TRUE;
+        memset(p, 0, n);
+    }
+}
+
+/* Write the low n bytes of v, least significant first */
+static void nbCheckpointPutU(CheckpointStream* s, uint64_t v, size_t n)
+{
+    uint8_t b[8];
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+    {
+        b[i] = (uint8_t) (v >> (8 * i));
+    }
+
+    nbCheckpointWrite(s, b, n);
+}
+
+static uint64_t nbCheckpointGetU(CheckpointStream* s, size_t n)
+{
+    uint8_t b[8];
+    uint64_t v = 0;
+    size_t i;
+
+    nbCheckpointRead(s, b, n);
+    for (i = 0; i < n; ++i)
+    {
+        v |= (uint64_t) b[i] << (8 * i);
+    }
+
+    return v;
+}
+
+static uint64_t nbDoubleBits(double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+static double nbBitsDouble(uint64_t u)
+{
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+static int64_t nbLoadInt(const void* field, size_t size)
+{
+    switch (size)
+    {
+        case sizeof(int64_t):
+            return *(const int64_t*) field;
+        case sizeof(int32_t):
+            return *(const int32_t*) field;
+        case sizeof(int16_t):
+            return *(const int16_t*) field;
+        case sizeof(int8_t):
+            return *(const int8_t*) field;
+        default:
+            mw_panic("Unhandled checkpoint field size "ZU"\n", size);
+            return 0;
+    }
+}
+
+static void nbStoreInt(void* field, size_t size, int64_t v)
+{
+    switch (size)
+    {
+        case sizeof(int64_t):
+            *(int64_t*) field = v;
+            break;
+        case sizeof(int32_t):
+            *(int32_t*) field = (int32_t) v;
+            break;
+        case sizeof(int16_t):
+            *(int16_t*) field = (int16_t) v;
+            break;
+        case sizeof(int8_t):
+            *(int8_t*) field = (int8_t) v;
+            break;
+        default:
+            mw_panic("Unhandled checkpoint field size "ZU"\n", size);
+    }
+}
+
+
+/* Every field of the context, by name. Writing and reading both go
+ * through here so they can't disagree about what's saved. */
+static void nbVisitField(CheckpointFieldFunc f,
+                         void* data,
+                         const char* prefix,
+                         const char* member,
+                         CheckpointValueKind kind,
+                         void* field,
+                         size_t size)
+{
+    char name[CHECKPOINT_MAX_NAME];
+
+    snprintf(name, sizeof(name), "%s%s", prefix, member);
+    f(data, name, kind, field, size);
+}
+
+#define VISIT_REAL(obj, member) nbVisitField(f, data, prefix, #member, CHECKPOINT_REAL, &(obj)->member, sizeof((obj)->member))
+#define VISIT_INT(obj, member) nbVisitField(f, data, prefix, #member, CHECKPOINT_INT, &(obj)->member, sizeof((obj)->member))
+
+static void nbVisitSpherical(CheckpointFieldFunc f, void* data, const char* prefix, Spherical* s)
+{
+    VISIT_INT(s, type);
+    VISIT_REAL(s, mass);
+    VISIT_REAL(s, scale);
+}
+
+static void nbVisitDisk(CheckpointFieldFunc f, void* data, const char* prefix, Disk* d)
+{
+    VISIT_INT(d, type);
+    VISIT_REAL(d, mass);
+    VISIT_REAL(d, scaleLength);
+    VISIT_REAL(d, scaleHeight);
+}
+
+static void nbVisitHalo(CheckpointFieldFunc f, void* data, const char* prefix, Halo* h)
+{
+    VISIT_INT(h, type);
+    VISIT_REAL(h, vhalo);
+    VISIT_REAL(h, scaleLength);
+    VISIT_REAL(h, flattenZ);
+    VISIT_REAL(h, flattenY);
+    VISIT_REAL(h, flattenX);
+    VISIT_REAL(h, triaxAngle);
+    VISIT_REAL(h, c1);
+    VISIT_REAL(h, c2);
+    VISIT_REAL(h, c3);
+}
+
+static void nbVisitPotential(CheckpointFieldFunc f, void* data, Potential* pot)
+{
+    int i;
+    char prefix[CHECKPOINT_MAX_NAME];
+
+    nbVisitSpherical(f, data, "pot.sphere.", &pot->sphere[0]);
+    nbVisitDisk(f, data, "pot.disk.", &pot->disk);
+    nbVisitHalo(f, data, "pot.halo.", &pot->halo);
+
+    strcpy(prefix, "pot.");
+    VISIT_INT(pot, nExtraSphere);
+    VISIT_INT(pot, nExtraDisk);
+    VISIT_INT(pot, nExtraHalo);
+
+    for (i = 0; i < NB_MAX_EXTRA_COMPONENTS; ++i)
+    {
+        snprintf(prefix, sizeof(prefix), "pot.extraSphere[%d].", i);
+        nbVisitSpherical(f, data, prefix, &pot->extraSphere[i]);
+
+        snprintf(prefix, sizeof(prefix), "pot.extraDisk[%d].", i);
+        nbVisitDisk(f, data, prefix, &pot->extraDisk[i]);
+
+        snprintf(prefix, sizeof(prefix), "pot.extraHalo[%d].", i);
+        nbVisitHalo(f, data, prefix, &pot->extraHalo[i]);
+    }
+}
+
+static void nbVisitCtx(CheckpointFieldFunc f, void* data, NBodyCtx* ctx)
+{
+    const char* prefix = "";
+
+    VISIT_REAL(ctx, eps2);
+    VISIT_REAL(ctx, theta);
+    VISIT_REAL(ctx, timestep);
+    VISIT_REAL(ctx, timeEvolve);
+    VISIT_REAL(ctx, treeRSize);
+    VISIT_REAL(ctx, sunGCDist);
+    VISIT_REAL(ctx, timestepEta);
+
+    VISIT_INT(ctx, criterion);
+    VISIT_INT(ctx, potentialType);
+    VISIT_INT(ctx, useQuad);
+    VISIT_INT(ctx, allowIncest);
+    VISIT_INT(ctx, quietErrors);
+    VISIT_INT(ctx, parallelTree);
+    VISIT_INT(ctx, bodySortInterval);
+    VISIT_INT(ctx, flatTree);
+    VISIT_INT(ctx, groupSize);
+    VISIT_INT(ctx, treeRebuildInterval);
+    VISIT_INT(ctx, timestepLevels);
+    VISIT_INT(ctx, checkpointT);
+    VISIT_INT(ctx, nStep);
+
+    nbVisitPotential(f, data, &ctx->pot);
+}
+
+#undef VISIT_REAL
+#undef VISIT_INT
+
+static void nbWriteCtxField(void* data, const char* name, CheckpointValueKind kind, void* field, size_t size)
+{
+    CheckpointStream* s = (CheckpointStream*) data;
+    size_t len = strlen(name);
+
+    nbCheckpointPutU(s, len, 1);
+    nbCheckpointWrite(s, name, len);
+    nbCheckpointPutU(s, kind, 1);
+
+    if (kind == CHECKPOINT_REAL)
+        nbCheckpointPutU(s, nbDoubleBits((double) *(const real*) field), 8);
+    else
+        nbCheckpointPutU(s, (uint64_t) nbLoadInt(field, size), 8);
+}
+
+static void nbReadCtxField(void* data, const char* name, CheckpointValueKind kind, void* field, size_t size)
+{
+    const CheckpointFieldList* list = (const CheckpointFieldList*) data;
+    unsigned int i;
+
+    for (i = 0; i < list->nFields; ++i)
+    {
+        const CheckpointField* cf = &list->fields[i];
+
+        if (cf->kind != (int) kind || strcmp(cf->name, name))
+            continue;
+
+        if (kind == CHECKPOINT_REAL)
+            *(real*) field = (real) nbBitsDouble(cf->value);
+        else
+            nbStoreInt(field, size, (int64_t) cf->value);
+        return;
     }
+}
+
+static int nbReadCtxFieldList(CheckpointStream* s, CheckpointFieldList* list)
+{
+    size_t len;
+    unsigned int maxFields = 0;
+    CheckpointField* cf;
+
+    while ((len = (size_t) nbCheckpointGetU(s, 1)) != 0 && !s->failed)
+    {
+        if (len >= CHECKPOINT_MAX_NAME || list->nFields >= CHECKPOINT_MAX_FIELDS)
+        {
+            mw_printf("Invalid context field in checkpoint\n");
+            return TRUE;
+        }
 
-    strcpy(p, tail);
+        if (list->nFields == maxFields)
+        {
+            maxFields = maxFields ? 2 * maxFields : 128;
+            list->fields = (CheckpointField*) mwRealloc(list->fields, maxFields * sizeof(CheckpointField));
+        }
+
+        cf = &list->fields[list->nFields++];
+        nbCheckpointRead(s, cf->name, len);
+        cf->name[len] = '\0';
+        cf->kind = (int) nbCheckpointGetU(s, 1);
+        cf->value = nbCheckpointGetU(s, 8);
+    }
+
+    return s->failed;
+}
+
+/* Reverse the bytes of each element. Values in the file are little
+ * endian, so this is only needed on big endian hosts. */
+static void nbSwapElements(uint8_t* p, size_t n, size_t elemSize)
+{
+    size_t i, k;
+    uint8_t tmp;
+
+    for (i = 0; i < n; ++i, p += elemSize)
+    {
+        for (k = 0; k < elemSize / 2; ++k)
+        {
+            tmp = p[k];
+            p[k] = p[elemSize - 1 - k];
+            p[elemSize - 1 - k] = tmp;
+        }
+    }
+}
+
+static void nbShuffleBytes(uint8_t* dst, const uint8_t* src, size_t n, size_t elemSize)
+{
+    size_t i, k;
+
+    for (k = 0; k < elemSize; ++k)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            dst[k * n + i] = src[i * elemSize + k];
+        }
+    }
+}
+
+static void nbUnshuffleBytes(uint8_t* dst, const uint8_t* src, size_t n, size_t elemSize)
+{
+    size_t i, k;
+
+    for (k = 0; k < elemSize; ++k)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            dst[i * elemSize + k] = src[k * n + i];
+        }
+    }
+}
+
+static size_t nbColumnElemSize(const CheckpointColumn* col)
+{
+    return col->kind == CHECKPOINT_REAL ? sizeof(double) : sizeof(int16_t);
+}
+
+/* Copy n values of a column starting at first into elems, converting
+ * reals to double */
+static void nbGatherColumn(const CheckpointRows* rows,
+                           const CheckpointColumn* col,
+                           size_t first,
+                           size_t n,
+                           uint8_t* elems)
+{
+    size_t i, idx;
+    const char* base = rows->base + col->offset;
+    double d;
+    int16_t t;
+
+    for (i = 0; i < n; ++i)
+    {
+        idx = rows->order ? (size_t) rows->order[first + i] : first + i;
+
+        if (col->kind == CHECKPOINT_REAL)
+        {
+            d = (double) *(const real*) (base + idx * rows->stride);
+            memcpy(&elems[i * sizeof(d)], &d, sizeof(d));
+        }
+        else
+        {
+            t = (int16_t) *(const body_t*) (base + idx * rows->stride);
+            memcpy(&elems[i * sizeof(t)], &t, sizeof(t));
+        }
+    }
+}
+
+static void nbScatterColumn(const CheckpointRows* rows,
+                            const CheckpointColumn* col,
+                            size_t first,
+                            size_t n,
+                            const uint8_t* elems)
+{
+    size_t i;
+    char* base = rows->base + col->offset + first * rows->stride;
+    double d;
+    int16_t t;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (col->kind == CHECKPOINT_REAL)
+        {
+            memcpy(&d, &elems[i * sizeof(d)], sizeof(d));
+            *(real*) (base + i * rows->stride) = (real) d;
+        }
+        else
+        {
+            memcpy(&t, &elems[i * sizeof(t)], sizeof(t));
+            *(body_t*) (base + i * rows->stride) = (body_t) t;
+        }
+    }
+}
+
+static void nbWriteChunk(CheckpointStream* s,
+                         const CheckpointRows* rows,
+                         const CheckpointColumn* col,
+                         size_t first,
+                         size_t n,
+                         mwbool compress)
+{
+    const size_t elemSize = nbColumnElemSize(col);
+    const size_t raw = n * elemSize;
+    size_t stored = 0;
+    const uint8_t* out = s->elems;
+
+    nbGatherColumn(rows, col, first, n, s->elems);
+    if (nbHostIsBigEndian())
+    {
+        nbSwapElements(s->elems, n, elemSize);
+    }
+
+    if (compress)
+    {
+        /* Only keep it if it's actually smaller */
+        nbShuffleBytes(s->shuffled, s->elems, n, elemSize);
+        stored = nbLZCompress(s->shuffled, raw, s->packed, raw - 1);
+        if (stored != 0)
+        {
+            out = s->packed;
+        }
+    }
+
+    if (stored == 0)
+    {
+        stored = raw;
+    }
+
+    nbCheckpointPutU(s, raw, 4);
+    nbCheckpointPutU(s, stored, 4);
+    nbCheckpointWrite(s, out, stored);
+}
+
+/* Read the next chunk of n values into elems */
+static int nbReadChunk(CheckpointStream* s, size_t n, size_t elemSize)
+{
+    const size_t raw = (size_t) nbCheckpointGetU(s, 4);
+    const size_t stored = (size_t) nbCheckpointGetU(s, 4);
+
+    if (s->failed)
+        return TRUE;
+
+    if (raw != n * elemSize || stored > raw)
+    {
+        mw_printf("Invalid chunk size in checkpoint\n");
+        return TRUE;
+    }
+
+    if (stored == raw)
+    {
+        nbCheckpointRead(s, s->elems, raw);
+    }
+    else
+    {
+        nbCheckpointRead(s, s->packed, stored);
+        if (!s->failed && nbLZDecompress(s->packed, stored, s->shuffled, raw))
+        {
+            mw_printf("Corrupt compressed chunk in checkpoint\n");
+            return TRUE;
+        }
+        nbUnshuffleBytes(s->elems, s->shuffled, n, elemSize);
+    }
+
+    if (nbHostIsBigEndian())
+    {
+        nbSwapElements(s->elems, n, elemSize);
+    }
+
+    return s->failed;
+}
+
+/* Write a section a group of rows at a time, so gathering stays
+ * within a cache friendly block of bodies */
+static void nbWriteSection(CheckpointStream* s,
+                           const char id[4],
+                           const CheckpointColumn* cols,
+                           unsigned int nCols,
+                           const CheckpointRows* rows,
+                           size_t count,
+                           mwbool compress)
+{
+    size_t start, n;
+    unsigned int c;
+
+    nbCheckpointWrite(s, id, 4);
+    nbCheckpointPutU(s, nCols, 1);
+    for (c = 0; c < nCols; ++c)
+    {
+        nbCheckpointWrite(s, cols[c].id, sizeof(cols[c].id));
+        nbCheckpointPutU(s, nbColumnElemSize(&cols[c]), 1);
+    }
+    nbCheckpointPutU(s, count, 8);
+
+    for (start = 0; start < count && !s->failed; start += n)
+    {
+        n = count - start < CHECKPOINT_CHUNK ? count - start : CHECKPOINT_CHUNK;
+
+        for (c = 0; c < nCols; ++c)
+        {
+            nbWriteChunk(s, rows, &cols[c], start, n, compress);
+        }
+    }
+}
+
+/* Read a section into rows after its id. Columns we don't know are
+ * skipped, as is the whole section if cols is NULL. Each known column
+ * found sets its bit in seen. */
+static int nbReadSection(CheckpointStream* s,
+                         const CheckpointColumn* cols,
+                         unsigned int nCols,
+                         const CheckpointRows* rows,
+                         size_t expectCount,
+                         unsigned int* seen)
+{
+    int map[256];
+    size_t elemSize[256];
+    char id[4];
+    unsigned int fc, c, nFileCols;
+    size_t count, start, n;
+
+    nFileCols = (unsigned int) nbCheckpointGetU(s, 1);
+    for (fc = 0; fc < nFileCols; ++fc)
+    {
+        nbCheckpointRead(s, id, sizeof(id));
+        elemSize[fc] = (size_t) nbCheckpointGetU(s, 1);
+        map[fc] = -1;
+
+        if (elemSize[fc] == 0 || elemSize[fc] > sizeof(uint64_t))
+        {
+            mw_printf("Invalid column in checkpoint\n");
+            return TRUE;
+        }
+
+        for (c = 0; cols && c < nCols; ++c)
+        {
+            if (memcmp(id, cols[c].id, sizeof(id)))
+                continue;
+
+            if (elemSize[fc] != nbColumnElemSize(&cols[c]))
+            {
+                mw_printf("Column '%.4s' of checkpoint has the wrong size\n", id);
+                return TRUE;
+            }
+
+            map[fc] = (int) c;
+            *seen |= 1u << c;
+        }
+    }
+
+    count = (size_t) nbCheckpointGetU(s, 8);
+    if (cols && count != expectCount)
+    {
+        mw_printf("Checkpoint has "ZU" rows in a section, expected "ZU"\n", count, expectCount);
+        return TRUE;
+    }
+
+    for (start = 0; start < count && !s->failed; start += n)
+    {
+        n = count - start < CHECKPOINT_CHUNK ? count - start : CHECKPOINT_CHUNK;
+
+        for (fc = 0; fc < nFileCols; ++fc)
+        {
+            if (nbReadChunk(s, n, elemSize[fc]))
+                return TRUE;
+
+            if (map[fc] >= 0)
+            {
+                nbScatterColumn(rows, &cols[map[fc]], start, n, s->elems);
+            }
+        }
+    }
+
+    return s->failed;
+}
+
+static int nbWriteStateV2(FILE* f, const NBodyCtx* ctx, const NBodyState* st)
+{
+    CheckpointStream s;
+    NBodyCtx ctxCopy = *ctx;
+    int* order = NULL;
+    const size_t nTrace = st->orbitTrace ? st->nOrbitTrace : 0;
+    CheckpointRows bodyRows, traceRows;
+    int i;
+    int failed;
+
+    if (nbAllocCheckpointStream(&s, f))
+    {
+        nbFreeCheckpointStream(&s);
+        return TRUE;
+    }
+
+    /* Bodies are always written in their original order */
+    if (st->bodyOrder)
+    {
+        order = (int*) mwMalloc(st->nbody * sizeof(int));
+        for (i = 0; i < st->nbody; ++i)
+        {
+            order[st->bodyOrder[i]] = i;
+        }
+    }
+
+    nbCheckpointWrite(&s, hdrV2, sizeof(hdrV2));
+    nbCheckpointPutU(&s, CHECKPOINT_VERSION, 4);
+    nbCheckpointPutU(&s, 0, 4);
+    nbCheckpointPutU(&s, (uint64_t) st->nbody, 8);
+    nbCheckpointPutU(&s, (uint64_t) nTrace, 8);
+    nbCheckpointPutU(&s, st->step, 4);
+    nbCheckpointPutU(&s, (uint32_t) st->treeIncest, 4);
+    nbCheckpointPutU(&s, nbDoubleBits((double) st->tree.rsize), 8);
+
+    nbVisitCtx(nbWriteCtxField, &s, &ctxCopy);
+    nbCheckpointPutU(&s, 0, 1);
+
+    bodyRows.base = (char*) st->bodytab;
+    bodyRows.stride = sizeof(Body);
+    bodyRows.order = order;
+    nbWriteSection(&s, bodySection, bodyColumns, N_BODY_COLUMNS, &bodyRows,
+                   (size_t) st->nbody, st->compressCheckpoint);
+
+    traceRows.base = (char*) st->orbitTrace;
+    traceRows.stride = sizeof(mwvector);
+    traceRows.order = NULL;
+    nbWriteSection(&s, traceSection, traceColumns, N_TRACE_COLUMNS, &traceRows,
+                   nTrace, st->compressCheckpoint);
+
+    nbCheckpointWrite(&s, sectionEnd, sizeof(sectionEnd));
+
+    failed = s.failed;
+    free(order);
+    nbFreeCheckpointStream(&s);
+
+    return failed;
+}
+
+/* Read a v2 checkpoint after the magic has been checked */
+static int nbThawStateV2(FILE* f, NBodyCtx* ctx, NBodyState* st)
+{
+    CheckpointStream s;
+    CheckpointFieldList list = { NULL, 0 };
+    uint32_t version;
+    uint64_t nbody, nTrace;
+    CheckpointRows bodyRows, traceRows;
+    char id[4];
+    unsigned int seenBody = 0, seenTrace = 0;
+    int rc;
+    int failed = TRUE;
+
+    if (nbAllocCheckpointStream(&s, f))
+    {
+        nbFreeCheckpointStream(&s);
+        return TRUE;
+    }
+
+    version = (uint32_t) nbCheckpointGetU(&s, 4);
+    if (version != CHECKPOINT_VERSION)
+    {
+        mw_printf("Unsupported checkpoint version %u\n", version);
+        goto fail;
+    }
+
+    (void) nbCheckpointGetU(&s, 4);  /* flags */
+    nbody = nbCheckpointGetU(&s, 8);
+    nTrace = nbCheckpointGetU(&s, 8);
+    if (s.failed || nbody == 0 || nbody > INT_MAX || nTrace > INT_MAX)
+    {
+        mw_printf("Invalid checkpoint header\n");
+        goto fail;
+    }
+
+    st->nbody = (int) nbody;
+    st->step = (unsigned int) nbCheckpointGetU(&s, 4);
+    st->treeIncest = (int) (int32_t) nbCheckpointGetU(&s, 4);
+    st->tree.rsize = (real) nbBitsDouble(nbCheckpointGetU(&s, 8));
+
+    if (nbReadCtxFieldList(&s, &list))
+        goto fail;
+    nbVisitCtx(nbReadCtxField, &list, ctx);
+
+    st->bodytab = (Body*) mwCallocA(st->nbody, sizeof(Body));
+    if (nTrace != 0)
+    {
+        st->nOrbitTrace = (size_t) nTrace;
+        st->orbitTrace = (mwvector*) mwCallocA(st->nOrbitTrace, sizeof(mwvector));
+    }
+
+    bodyRows.base = (char*) st->bodytab;
+    bodyRows.stride = sizeof(Body);
+    bodyRows.order = NULL;
+
+    traceRows.base = (char*) st->orbitTrace;
+    traceRows.stride = sizeof(mwvector);
+    traceRows.order = NULL;
+
+    while (TRUE)
+    {
+        nbCheckpointRead(&s, id, sizeof(id));
+        if (s.failed || !memcmp(id, sectionEnd, sizeof(sectionEnd)))
+            break;
+
+        if (!memcmp(id, bodySection, sizeof(id)))
+            rc = nbReadSection(&s, bodyColumns, N_BODY_COLUMNS, &bodyRows, (size_t) nbody, &seenBody);
+        else if (!memcmp(id, traceSection, sizeof(id)))
+            rc = nbReadSection(&s, traceColumns, N_TRACE_COLUMNS, &traceRows, (size_t) nTrace, &seenTrace);
+        else
+            rc = nbReadSection(&s, NULL, 0, NULL, 0, NULL);
+
+        if (rc)
+            goto fail;
+    }
+
+    if (s.failed)
+        goto fail;
+
+    if (seenBody != (1u << N_BODY_COLUMNS) - 1)
+    {
+        mw_printf("Checkpoint is missing body data\n");
+        goto fail;
+    }
+
+    if (nTrace != 0 && seenTrace != (1u << N_TRACE_COLUMNS) - 1)
+    {
+        mw_printf("Checkpoint is missing orbit trace\n");
+        goto fail;
+    }
+
+    failed = FALSE;
+
+fail:
+    if (failed)
+    {
+        if (s.failed)
+            mw_printf("Checkpoint is truncated\n");
+
+        mwFreeA(st->bodytab);
+        st->bodytab = NULL;
+
+        mwFreeA(st->orbitTrace);
+        st->orbitTrace = NULL;
+        st->nOrbitTrace = 0;
+    }
+
+    free(list.fields);
+    nbFreeCheckpointStream(&s);
+
+    return failed;
 }
 
 /* Open the temporary checkpoint file for writing */
@@ -492,17 +1342,14 @@ int nbResolvedCheckpointExists(const NBodyState* st)
 /* Try to open a checkpoint with a few tries if the open fails.
    This is in case of weird/rare failures like interrupted system calls.
  */
-static int nbOpenCheckpointHandleWithAttempts(const NBodyState* st,
-                                              CheckpointHandle* cp,
-                                              const char* filename,
-                                              int writing)
+static int nbOpenCheckpointHandleWithAttempts(CheckpointHandle* cp, const char* filename)
 {
     unsigned int tries = 0;
     const unsigned int maxTries = 5;
 
     do
     {
-        if (!nbOpenCheckpointHandle(st, cp, filename, writing))
+        if (!nbOpenCheckpointHandle(cp, filename))
             break;
 
         if (nbCloseCheckpointHandle(cp))
@@ -522,12 +1369,12 @@ static int nbOpenCheckpointHandleWithAttempts(const NBodyState* st,
     return FALSE;
 }
 
-/* Read the actual checkpoint file to resume */
-int nbReadCheckpoint(NBodyCtx* ctx, NBodyState* st)
+/* Read a version 1 checkpoint */
+static int nbReadCheckpointV1(NBodyCtx* ctx, NBodyState* st)
 {
     CheckpointHandle cp = EMPTY_CHECKPOINT_HANDLE;
 
-    if (nbOpenCheckpointHandleWithAttempts(st, &cp, st->checkpointResolved, FALSE))
+    if (nbOpenCheckpointHandleWithAttempts(&cp, st->checkpointResolved))
     {
         mw_printf("Opening checkpoint '%s' for resuming failed\n", st->checkpointResolved);
         nbCloseCheckpointHandle(&cp);
@@ -540,11 +1387,45 @@ int nbReadCheckpoint(NBodyCtx* ctx, NBodyState* st)
         return TRUE;
     }
 
-    if (nbCloseCheckpointHandle(&cp))
+    return nbCloseCheckpointHandle(&cp);
+}
+
+/* Read the actual checkpoint file to resume */
+int nbReadCheckpoint(NBodyCtx* ctx, NBodyState* st)
+{
+    FILE* f;
+    char magic[sizeof(hdrV2)];
+    int failed;
+
+    f = mw_fopen(st->checkpointResolved, "rb");
+    if (!f)
+    {
+        mwPerror("Opening checkpoint '%s' for resuming failed", st->checkpointResolved);
+        return TRUE;
+    }
+
+    if (fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, hdrV2, sizeof(hdrV2)))
+    {
+        failed = nbThawStateV2(f, ctx, st);
+        fclose(f);
+    }
+    else
+    {
+        fclose(f);
+        failed = nbReadCheckpointV1(ctx, st);
+    }
+
+    if (failed)
     {
         return TRUE;
     }
 
+    if (checkNBodyCtxConstants(ctx))
+    {
+        mw_printf("Checkpoint '%s' has an invalid context\n", st->checkpointResolved);
+        return TRUE;
+    }
+
     /* Make sure state is ready to use */
     st->acctab = (mwvector*) mwCallocA(st->nbody, sizeof(mwvector));
 
@@ -555,21 +1436,23 @@ int nbReadCheckpoint(NBodyCtx* ctx, NBodyState* st)
  * multiple tests running at a time */
 int nbWriteCheckpointWithTmpFile(const NBodyCtx* ctx, const NBodyState* st, const char* tmpFile)
 {
-    int failed = FALSE;
-    CheckpointHandle cp = EMPTY_CHECKPOINT_HANDLE;
+    int failed;
+    FILE* f;
 
     assert(st->checkpointResolved);
 
-    if (nbOpenCheckpointHandleWithAttempts(st, &cp, tmpFile, TRUE))
+    f = mw_fopen(tmpFile, "wb");
+    if (!f)
     {
+        mwPerror("Error opening temporary checkpoint '%s'", tmpFile);
         return TRUE;
     }
 
-    nbFreezeState(ctx, st, &cp);
+    failed = nbWriteStateV2(f, ctx, st);
 
-    if (nbCloseCheckpointHandle(&cp))
+    if (fclose(f) || failed)
     {
-        mw_printf("Failed to properly close temporary checkpoint file\n");
+        mw_printf("Failed to properly write temporary checkpoint file\n");
         failed = TRUE;
     }
 
@@ -600,6 +1483,239 @@ int nbWriteCheckpoint(const NBodyCtx* ctx, const NBodyState* st)
     return nbWriteCheckpointWithTmpFile(ctx, st, path);
 }
 
+/* Asynchronous checkpoints copy what the checkpoint needs out of the
+ * state and write it from another thread, so the simulation only
+ * waits on the copy. Only one write is in flight at a time, and it
+ * goes through the same temporary file and rename as a synchronous
+ * write, so an interrupted write never replaces a good checkpoint. */
+struct NBodyCheckpointWriter
+{
+    NBodyCtx ctx;
+    NBodyState snapshot;   /* Only the parts of the state written to the checkpoint */
+
+    Body* bodies;          /* Copies the snapshot points into */
+    int* bodyOrder;
+    mwvector* orbitTrace;
+    int maxBody;           /* Allocated size of the copies */
+    size_t maxTrace;
+
+    char tmpFile[256];
+    int failed;
+    mwbool running;
+    OPA_int_t done;
+
+  #ifndef _WIN32
+    pthread_t thread;
+  #else
+    HANDLE thread;
+  #endif
+};
+
+#ifndef _WIN32
+
+static void* nbCheckpointWriterThread(void* arg)
+{
+    NBodyCheckpointWriter* w = (NBodyCheckpointWriter*) arg;
+
+    w->failed = nbWriteCheckpointWithTmpFile(&w->ctx, &w->snapshot, w->tmpFile);
+    OPA_write_barrier();
+    OPA_store_int(&w->done, TRUE);
+
+    return NULL;
+}
+
+static int nbLaunchCheckpointWriter(NBodyCheckpointWriter* w)
+{
+    return pthread_create(&w->thread, NULL, nbCheckpointWriterThread, w) != 0;
+}
+
+static void nbJoinCheckpointWriter(NBodyCheckpointWriter* w)
+{
+    pthread_join(w->thread, NULL);
+}
+
+#else
+
+static DWORD WINAPI nbCheckpointWriterThread(LPVOID arg)
+{
+    NBodyCheckpointWriter* w = (NBodyCheckpointWriter*) arg;
+
+    w->failed = nbWriteCheckpointWithTmpFile(&w->ctx, &w->snapshot, w->tmpFile);
+    OPA_write_barrier();
+    OPA_store_int(&w->done, TRUE);
+
+    return 0;
+}
+
+static int nbLaunchCheckpointWriter(NBodyCheckpointWriter* w)
+{
+    w->thread = CreateThread(NULL, 0, nbCheckpointWriterThread, w, 0, NULL);
+    return w->thread == NULL;
+}
+
+static void nbJoinCheckpointWriter(NBodyCheckpointWriter* w)
+{
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread);
+}
+
+#endif /* _WIN32 */
+
+/* Copy in large blocks split between threads */
+static void nbParallelCopy(void* dest, const void* src, size_t size)
+{
+    const size_t blockSize = 1 << 20;
+    const int nBlock = (int) ((size + blockSize - 1) / blockSize);
+    int i;
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i) schedule(static)
+  #endif
+    for (i = 0; i < nBlock; ++i)
+    {
+        size_t offset = (size_t) i * blockSize;
+        size_t n = size - offset < blockSize ? size - offset : blockSize;
+
+        memcpy((char*) dest + offset, (const char*) src + offset, n);
+    }
+}
+
+static void nbSnapshotState(NBodyCheckpointWriter* w, const NBodyCtx* ctx, const NBodyState* st)
+{
+    NBodyState* snap = &w->snapshot;
+    const size_t nTrace = st->orbitTrace ? st->nOrbitTrace : 0;
+
+    if (st->nbody > w->maxBody)
+    {
+        mwFreeA(w->bodies);
+        free(w->bodyOrder);
+        w->bodies = (Body*) mwMallocA(st->nbody * sizeof(Body));
+        w->bodyOrder = (int*) mwMalloc(st->nbody * sizeof(int));
+        w->maxBody = st->nbody;
+    }
+
+    if (nTrace > w->maxTrace)
+    {
+        mwFreeA(w->orbitTrace);
+        w->orbitTrace = (mwvector*) mwMallocA(nTrace * sizeof(mwvector));
+        w->maxTrace = nTrace;
+    }
+
+    w->ctx = *ctx;
+
+    nbParallelCopy(w->bodies, st->bodytab, st->nbody * sizeof(Body));
+    snap->bodytab = w->bodies;
+
+    if (st->bodyOrder)
+    {
+        nbParallelCopy(w->bodyOrder, st->bodyOrder, st->nbody * sizeof(int));
+    }
+    snap->bodyOrder = st->bodyOrder ? w->bodyOrder : NULL;
+
+    if (nTrace != 0)
+    {
+        memcpy(w->orbitTrace, st->orbitTrace, nTrace * sizeof(mwvector));
+    }
+    snap->orbitTrace = nTrace != 0 ? w->orbitTrace : NULL;
+
+    snap->nbody = st->nbody;
+    snap->step = st->step;
+    snap->treeIncest = st->treeIncest;
+    snap->tree.rsize = st->tree.rsize;
+    snap->nOrbitTrace = nTrace;
+    snap->compressCheckpoint = st->compressCheckpoint;
+
+    free(snap->checkpointResolved);
+    snap->checkpointResolved = strdup(st->checkpointResolved);
+}
+
+/* Wait for, or if wait is false check on, a background write. finished
+ * is set if a write completed. Returns nonzero if that write failed. */
+int nbFinishCheckpointWrite(NBodyState* st, mwbool wait, mwbool* finished)
+{
+    NBodyCheckpointWriter* w = st->checkpointWriter;
+
+    if (finished)
+        *finished = FALSE;
+
+    if (!w || !w->running)
+        return FALSE;
+
+    if (!wait && !OPA_load_int(&w->done))
+        return FALSE;
+
+    nbJoinCheckpointWriter(w);
+    w->running = FALSE;
+
+    if (finished)
+        *finished = TRUE;
+
+    if (w->failed)
+    {
+        mw_printf("Background checkpoint write failed\n");
+    }
+
+    return w->failed;
+}
+
+/* Snapshot the state and write the checkpoint in the background.
+ * Blocks only if the previous write is still going. */
+int nbStartCheckpointWrite(const NBodyCtx* ctx, NBodyState* st)
+{
+    static const NBodyState emptyState = EMPTY_NBODYSTATE;
+    NBodyCheckpointWriter* w;
+    int failed;
+
+    assert(st->checkpointResolved);
+
+    failed = nbFinishCheckpointWrite(st, TRUE, NULL);
+
+    if (!st->checkpointWriter)
+    {
+        w = (NBodyCheckpointWriter*) mwCalloc(1, sizeof(NBodyCheckpointWriter));
+        w->snapshot = emptyState;
+        snprintf(w->tmpFile, sizeof(w->tmpFile), "nbody_checkpoint_tmp_%d", (int) getpid());
+        st->checkpointWriter = w;
+    }
+
+    w = st->checkpointWriter;
+    nbSnapshotState(w, ctx, st);
+
+    OPA_store_int(&w->done, FALSE);
+    w->failed = FALSE;
+
+    if (nbLaunchCheckpointWriter(w))
+    {
+        mw_printf("Failed to start checkpoint thread, writing checkpoint now\n");
+        return nbWriteCheckpointWithTmpFile(&w->ctx, &w->snapshot, w->tmpFile) || failed;
+    }
+
+    w->running = TRUE;
+
+    return failed;
+}
+
+/* Wait for any write in progress and free the writer */
+int nbDestroyCheckpointWriter(NBodyState* st)
+{
+    NBodyCheckpointWriter* w = st->checkpointWriter;
+    int failed;
+
+    if (!w)
+        return FALSE;
+
+    failed = nbFinishCheckpointWrite(st, TRUE, NULL);
+
+    mwFreeA(w->bodies);
+    free(w->bodyOrder);
+    mwFreeA(w->orbitTrace);
+    free(w->snapshot.checkpointResolved);
+    free(w);
+    st->checkpointWriter = NULL;
+
+    return failed;
+}
+
 int nbTimeToCheckpoint(const NBodyCtx* ctx, NBodyState* st)
 {
     time_t now;
@@ -626,6 +1742,20 @@ int nbTimeToCheckpoint(const NBodyCtx* ctx, NBodyState* st)
 
 NBodyStatus nbWriteFinalCheckpoint(const NBodyCtx* ctx, NBodyState* st)
 {
+    mwbool finished;
+
+    /* The final checkpoint must not be replaced by an earlier one
+     * still being written */
+    if (nbFinishCheckpointWrite(st, TRUE, &finished))
+    {
+        return NBODY_CHECKPOINT_ERROR;
+    }
+
+    if (finished)
+    {
+        mw_checkpoint_completed();
+    }
+
     if (BOINC_APPLICATION || ctx->checkpointT >= 0)
     {
         mw_report("Making final checkpoint\n");
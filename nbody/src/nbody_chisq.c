@@ -28,6 +28,13 @@
 #include "nbody_mass.h"
 #include "nbody_defaults.h"
 
+#include <limits.h>
+#include <ctype.h>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif /* _OPENMP */
+
 /* From the range of a histogram, find the number of bins */
 static unsigned int nbHistogramNBin(const HistogramParams* hp)
 {
@@ -47,6 +54,191 @@ static inline double nbNormalizedHistogramError(unsigned int n, double total)
     return (n == 0) ? inv(total) : sqrt((double) n) / total;
 }
 
+static const char* nbHistogramAxisName(NBodyHistogramAxisType type)
+{
+    switch (type)
+    {
+        case NBODY_HIST_LAMBDA:
+            return "lambda";
+        case NBODY_HIST_BETA:
+            return "beta";
+        case NBODY_HIST_DISTANCE:
+            return "distance";
+        case NBODY_HIST_VLOS:
+            return "vlos";
+        default:
+            return "???";
+    }
+}
+
+static int nbHistogramAxisFromName(const char* name, NBodyHistogramAxisType* type)
+{
+    int i;
+
+    for (i = NBODY_HIST_LAMBDA; i <= NBODY_HIST_VLOS; ++i)
+    {
+        if (!strcmp(name, nbHistogramAxisName((NBodyHistogramAxisType) i)))
+        {
+            *type = (NBodyHistogramAxisType) i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void nbAddHistogramDim(NBodyHistogramDim* dims,
+                              unsigned int* nDims,
+                              NBodyHistogramAxisType type,
+                              const HistogramAxis* axis)
+{
+    NBodyHistogramDim* dim;
+
+    if (axis->binSize <= 0.0)
+        return;
+
+    dim = &dims[(*nDims)++];
+    dim->type = type;
+    dim->nBin = (unsigned int) mw_ceil((axis->end - axis->start) / axis->binSize);
+    dim->start = (double) axis->start;
+    dim->binSize = (double) axis->binSize;
+}
+
+/* Find the bins in each dimension. Lambda always comes first, and
+   varies slowest in the bin index. Returns nonzero if the total
+   number of bins is too large. */
+static int nbHistogramDims(NBodyHistogramDim* dims,
+                           unsigned int* nDims,
+                           unsigned int* totalBins,
+                           const HistogramParams* hp)
+{
+    unsigned int i;
+    uint64_t total = 1;
+
+    dims[0].type = NBODY_HIST_LAMBDA;
+    dims[0].nBin = nbHistogramNBin(hp);
+    dims[0].start = nbHistogramStart(hp);
+    dims[0].binSize = (double) hp->binSize;
+    *nDims = 1;
+
+    nbAddHistogramDim(dims, nDims, NBODY_HIST_BETA, &hp->beta);
+    nbAddHistogramDim(dims, nDims, NBODY_HIST_DISTANCE, &hp->distance);
+    nbAddHistogramDim(dims, nDims, NBODY_HIST_VLOS, &hp->vlos);
+
+    for (i = 0; i < *nDims; ++i)
+    {
+        total *= dims[i].nBin;
+        if (total > UINT_MAX)
+            return 1;
+    }
+
+    *totalBins = (unsigned int) total;
+    return 0;
+}
+
+static int nbHistogramShapesMatch(const NBodyHistogram* a, const NBodyHistogram* b)
+{
+    unsigned int i;
+
+    if (a->nDims != b->nDims || a->totalBins != b->totalBins)
+        return FALSE;
+
+    for (i = 0; i < a->nDims; ++i)
+    {
+        if (a->dims[i].type != b->dims[i].type || a->dims[i].nBin != b->dims[i].nBin)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Find the entry for a bin, or NULL if a sparse histogram left it out */
+static const HistData* nbFindHistData(const NBodyHistogram* h, unsigned int index)
+{
+    unsigned int lo = 0;
+    unsigned int hi = h->nBin;
+    unsigned int mid;
+
+    if (!h->sparse)
+        return index < h->nBin ? &h->data[index] : NULL;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (h->data[mid].index < index)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < h->nBin && h->data[lo].index == index) ? &h->data[lo] : NULL;
+}
+
+/* Walks the bins of two histograms with the same dimensions
+   together. The bins left out of a sparse histogram are used and
+   empty. Bins left out of both are skipped, since they add nothing to
+   any of the likelihoods. */
+typedef struct
+{
+    const NBodyHistogram* a;
+    const NBodyHistogram* b;
+    unsigned int i;
+    unsigned int j;
+    const HistData* binA;
+    const HistData* binB;
+    HistData emptyA;
+    HistData emptyB;
+} NBHistogramBinPairs;
+
+static void nbEmptyHistData(HistData* bin, const NBodyHistogram* h, unsigned int index)
+{
+    memset(bin, 0, sizeof(*bin));
+    bin->useBin = TRUE;
+    bin->index = index;
+    bin->err = nbNormalizedHistogramError(0, (double) h->totalNum);
+}
+
+static void nbStartBinPairs(NBHistogramBinPairs* it, const NBodyHistogram* a, const NBodyHistogram* b)
+{
+    memset(it, 0, sizeof(*it));
+    it->a = a;
+    it->b = b;
+}
+
+static int nbNextBinPair(NBHistogramBinPairs* it)
+{
+    unsigned int ia, ib, index;
+
+    if (it->i >= it->a->nBin && it->j >= it->b->nBin)
+        return FALSE;
+
+    ia = it->i < it->a->nBin ? it->a->data[it->i].index : UINT_MAX;
+    ib = it->j < it->b->nBin ? it->b->data[it->j].index : UINT_MAX;
+    index = MIN(ia, ib);
+
+    if (ia == index)
+    {
+        it->binA = &it->a->data[it->i++];
+    }
+    else
+    {
+        nbEmptyHistData(&it->emptyA, it->a, index);
+        it->binA = &it->emptyA;
+    }
+
+    if (ib == index)
+    {
+        it->binB = &it->b->data[it->j++];
+    }
+    else
+    {
+        nbEmptyHistData(&it->emptyB, it->b, index);
+        it->binB = &it->emptyB;
+    }
+
+    return TRUE;
+}
+
 static double nbCorrectRenormalizedInHistogram(const NBodyHistogram* histogram, const NBodyHistogram* data)
 {
     unsigned int i;
@@ -77,15 +269,20 @@ static unsigned int nbCorrectTotalNumberInHistogram(const NBodyHistogram* histog
     unsigned int i;
     unsigned int nBin = data->nBin;
     unsigned int totalNum = histogram->totalNum;
+    const HistData* bin;
 
     assert(histogram->hasRawCounts);
-    assert(data->nBin == histogram->nBin);
+    assert(data->totalBins == histogram->totalBins);
 
     for (i = 0; i < nBin; ++i)
     {
         if (!data->data[i].useBin)
         {
-            totalNum -= histogram->data[i].rawCount;
+            bin = nbFindHistData(histogram, data->data[i].index);
+            if (bin)
+            {
+                totalNum -= bin->rawCount;
+            }
         }
     }
 
@@ -197,7 +394,6 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
                    const NBodyHistogram* histogram,   /* Generated histogram */
                    NBodyLikelihoodMethod method)
 {
-    unsigned int i;
     double tmp;
     double effTotalNum;
     double chiSq = 0.0;
@@ -205,9 +401,11 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
     double err;
     double simErr;
     double scale = 1.0;
-    unsigned int nBin = data->nBin;
+    const HistData* d;
+    const HistData* h;
+    NBHistogramBinPairs bins;
 
-    assert(nBin == histogram->nBin);
+    assert(data->totalBins == histogram->totalBins);
 
     if (!histogram->hasRawCounts)
     {
@@ -234,17 +432,21 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
 
     effTotalNum = (double) nbCorrectTotalNumberInHistogram(histogram, data);
 
-    for (i = 0; i < nBin; ++i)
+    nbStartBinPairs(&bins, data, histogram);
+    while (nbNextBinPair(&bins))
     {
-        if (data->data[i].useBin)  /* Skip bins with missing data */
+        d = bins.binA;
+        h = bins.binB;
+
+        if (d->useBin)  /* Skip bins with missing data */
         {
-            n = (double) histogram->data[i].rawCount;
-            err = data->data[i].err;
+            n = (double) h->rawCount;
+            err = d->err;
 
             switch (method)
             {
                 case NBODY_ORIG_CHISQ:
-                    tmp = (data->data[i].count - (n / effTotalNum)) / err;
+                    tmp = (d->count - (n / effTotalNum)) / err;
                     chiSq += sqr(tmp);
                     break;
 
@@ -253,35 +455,35 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
                      * we need to correct the errors in case there
                      * were any bins we are skipping for matching to
                      * the data */
-                    simErr = nbNormalizedHistogramError(histogram->data[i].rawCount, effTotalNum);
+                    simErr = nbNormalizedHistogramError(h->rawCount, effTotalNum);
 
                     /* effective error = sqrt( (data error)^2 + (sim count error)^2 ) */
                     err = sqrt(sqr(err) + sqr(simErr));
-                    tmp = (data->data[i].count - (n / effTotalNum)) / err;
+                    tmp = (d->count - (n / effTotalNum)) / err;
                     chiSq += sqr(tmp);
                     break;
 
                 case NBODY_CHISQ_ALT:
-                    chiSq += nbChisqAlt(data->data[i].count, n / effTotalNum);
+                    chiSq += nbChisqAlt(d->count, n / effTotalNum);
                     break;
 
                 case NBODY_POISSON:
                     /* Poisson one */
-                    chiSq += nbPoissonTerm(data->data[i].count, n / effTotalNum);
+                    chiSq += nbPoissonTerm(d->count, n / effTotalNum);
                     break;
 
                 case NBODY_KOLMOGOROV:
-                    chiSq = mw_fmax(chiSq, fabs(data->data[i].count - (n / effTotalNum)));
+                    chiSq = mw_fmax(chiSq, fabs(d->count - (n / effTotalNum)));
                     break;
 
                 case NBODY_KULLBACK_LEIBLER:
                     /* "Relative entropy" */
-                    chiSq += nbKullbackLeiblerTerm(data->data[i].count, n / effTotalNum);
+                    chiSq += nbKullbackLeiblerTerm(d->count, n / effTotalNum);
                     break;
 
                 case NBODY_SAHA:
                     /* This will actually find ln(W). W is an unreasonably large number. */
-                    chiSq += nbSahaTerm(n, scale * data->data[i].count);
+                    chiSq += nbSahaTerm(n, scale * d->count);
                     break;
 
                 case NBODY_INVALID_METHOD:
@@ -295,6 +497,19 @@ double nbCalcChisq(const NBodyHistogram* data,        /* Data histogram */
     return chiSq;
 }
 
+static void nbPrintHistogramAxisHeader(FILE* f, const char* name, const HistogramAxis* axis)
+{
+    if (axis->binSize > 0.0)
+    {
+        fprintf(f,
+                "# %s (start, end) = (%f, %f)\n"
+                "# %s bin size = %f\n"
+                "#\n",
+                name, axis->start, axis->end,
+                name, axis->binSize);
+    }
+}
+
 static void nbPrintHistogramHeader(FILE* f,
                                    const NBodyCtx* ctx,
                                    const HistogramParams* hp,
@@ -319,6 +534,9 @@ static void nbPrintHistogramHeader(FILE* f,
             hp->startRaw, hp->center, hp->endRaw,
             hp->binSize);
 
+    nbPrintHistogramAxisHeader(f, "Beta", &hp->beta);
+    nbPrintHistogramAxisHeader(f, "Distance", &hp->distance);
+    nbPrintHistogramAxisHeader(f, "Vlos", &hp->vlos);
 
     fprintf(f,
             "# Nbody = %d\n"
@@ -434,9 +652,15 @@ static void nbPrintHistogramHeader(FILE* f,
                     "#\n");
     }
 
+    fprintf(f, "#\n# UseBin  Lambda  ");
+    if (hp->beta.binSize > 0.0)
+        fprintf(f, "Beta  ");
+    if (hp->distance.binSize > 0.0)
+        fprintf(f, "Distance  ");
+    if (hp->vlos.binSize > 0.0)
+        fprintf(f, "Vlos  ");
     fprintf(f,
-            "#\n"
-            "# UseBin  Lambda  Probability  Error\n"
+            "Probability  Error\n"
             "#\n"
             "\n"
         );
@@ -445,8 +669,9 @@ static void nbPrintHistogramHeader(FILE* f,
 /* Print the histogram without a header. */
 void nbPrintHistogram(FILE* f, const NBodyHistogram* histogram)
 {
-    unsigned int i;
+    unsigned int i, j;
     const HistData* data;
+    const NBodyHistogramDim* dim;
     unsigned int nBin = histogram->nBin;
 
     mw_boinc_print(f, "<histogram>\n");
@@ -454,15 +679,35 @@ void nbPrintHistogram(FILE* f, const NBodyHistogram* histogram)
     fprintf(f, "massPerParticle = %12.10f\n", histogram->massPerParticle);
     fprintf(f, "totalSimulated = %u\n", histogram->totalSimulated);
 
+    /* Plain lambda histograms are written the same as they always were */
+    if (histogram->nDims > 1 || histogram->sparse)
+    {
+        fprintf(f, "dimensions = %u\n", histogram->nDims);
+        for (j = 0; j < histogram->nDims; ++j)
+        {
+            dim = &histogram->dims[j];
+            fprintf(f, "axis = %s %12.10f %12.10f %u\n",
+                    nbHistogramAxisName(dim->type),
+                    dim->start,
+                    dim->binSize,
+                    dim->nBin);
+        }
+
+        if (histogram->sparse)
+        {
+            fprintf(f, "sparse = 1\n");
+        }
+    }
+
     for (i = 0; i < nBin; ++i)
     {
         data = &histogram->data[i];
-        fprintf(f,
-                "%d %12.10f %12.10f %12.10f\n",
-                data->useBin,
-                data->lambda,
-                data->count,
-                data->err);
+        fprintf(f, "%d %12.10f", data->useBin, data->lambda);
+        for (j = 1; j < histogram->nDims; ++j)
+        {
+            fprintf(f, " %12.10f", data->extra[j - 1]);
+        }
+        fprintf(f, " %12.10f %12.10f\n", data->count, data->err);
     }
 
     mw_boinc_print(f, "</histogram>\n");
@@ -493,6 +738,28 @@ void nbWriteHistogram(const char* histoutFileName,
         fclose(f);
 }
 
+/* Find the center of a bin in each dimension from its index */
+static void nbHistogramBinCenter(const NBodyHistogram* histogram, HistData* bin)
+{
+    unsigned int i, k;
+    unsigned int index = bin->index;
+    const NBodyHistogramDim* dim;
+    double center;
+
+    for (i = histogram->nDims; i-- > 0; )
+    {
+        dim = &histogram->dims[i];
+        k = index % dim->nBin;
+        index /= dim->nBin;
+
+        center = ((double) k + 0.5) * dim->binSize + dim->start;
+        if (i == 0)
+            bin->lambda = center;
+        else
+            bin->extra[i - 1] = center;
+    }
+}
+
 /* Get normalized histogram counts and errors */
 static void nbNormalizeHistogram(NBodyHistogram* histogram)
 {
@@ -500,16 +767,13 @@ static void nbNormalizeHistogram(NBodyHistogram* histogram)
     double count;
 
     unsigned int nBin = histogram->nBin;
-    const HistogramParams* hp = &histogram->params;
-    double binSize = (double) hp->binSize;
     double totalNum = (double) histogram->totalNum;
     HistData* histData = histogram->data;
-    double start = nbHistogramStart(&histogram->params);
 
     for (i = 0; i < nBin; ++i)
     {
         count = (double) histData[i].rawCount;
-        histData[i].lambda = ((double) i + 0.5) * binSize + start;  /* Report center of the bins */
+        nbHistogramBinCenter(histogram, &histData[i]);  /* Report center of the bins */
         histData[i].count = count / totalNum;
         histData[i].err = nbNormalizedHistogramError(histData[i].rawCount, totalNum);
     }
@@ -547,12 +811,136 @@ static double nbHistogramCenterOfMass(const NBodyHistogram* hist, int useBinInde
 
 
 /*
-Takes a treecode position, converts it to (l,b), then to (lambda,
-beta), and then constructs a histogram of the density in lambda.
+Takes a treecode position, rotates it into the (lambda, beta) frame,
+and then constructs a histogram of the density in lambda.
 
 Then calculates the cross correlation between the model histogram and
 the data histogram A maximum correlation means the best fit */
 
+/* The Sun is taken to be at rest, so these are relative to it */
+static inline real nbHeliocentricDistance(mwvector pos, real sunGCDist)
+{
+    return mw_sqrt(sqr(X(pos) + sunGCDist) + sqr(Y(pos)) + sqr(Z(pos)));
+}
+
+static inline real nbHeliocentricVlos(mwvector pos, mwvector vel, real sunGCDist)
+{
+    real r = nbHeliocentricDistance(pos, sunGCDist);
+    return ((X(pos) + sunGCDist) * X(vel) + Y(pos) * Y(vel) + Z(pos) * Z(vel)) / r;
+}
+
+/* Marks a body outside of the histogram in the list of body bins */
+#define NB_HIST_NO_BIN UINT_MAX
+
+/* Find the index of the bin each body lands in, or NB_HIST_NO_BIN.
+ * Returns the number of bodies which landed in a bin. */
+static unsigned int nbFindBodyBins(unsigned int* bodyBins,
+                                   const NBodyCtx* ctx,
+                                   const NBodyState* st,
+                                   const NBHistTrig* histTrig,
+                                   const NBodyHistogramDim* dims,
+                                   unsigned int nDims)
+{
+    int i;
+    unsigned int j;
+    unsigned int totalNum = 0;
+    mwbool useBeta = FALSE;
+
+    for (j = 1; j < nDims; ++j)
+    {
+        useBeta |= (dims[j].type == NBODY_HIST_BETA);
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, j) reduction(+:totalNum) schedule(static)
+  #endif
+    for (i = 0; i < st->nbody; ++i)
+    {
+        const Body* p = &st->bodytab[i];
+        unsigned int index = 0;
+        double bin;
+        real x = 0.0;
+        real lambda;
+        real beta = 0.0;
+
+        bodyBins[i] = NB_HIST_NO_BIN;
+
+        /* Only include bodies in models we aren't ignoring */
+        if (ignoreBody(p))
+            continue;
+
+        if (useBeta)
+            nbXYZToLambdaBeta(histTrig, Pos(p), ctx->sunGCDist, &lambda, &beta);
+        else
+            lambda = nbXYZToLambda(histTrig, Pos(p), ctx->sunGCDist);
+
+        for (j = 0; j < nDims; ++j)
+        {
+            switch (dims[j].type)
+            {
+                case NBODY_HIST_LAMBDA:
+                    x = lambda;
+                    break;
+                case NBODY_HIST_BETA:
+                    x = beta;
+                    break;
+                case NBODY_HIST_DISTANCE:
+                    x = nbHeliocentricDistance(Pos(p), ctx->sunGCDist);
+                    break;
+                case NBODY_HIST_VLOS:
+                default:
+                    x = nbHeliocentricVlos(Pos(p), Vel(p), ctx->sunGCDist);
+                    break;
+            }
+
+            bin = floor((x - dims[j].start) / dims[j].binSize);
+            if (!(bin >= 0.0 && bin < (double) dims[j].nBin))
+                break;
+
+            index = index * dims[j].nBin + (unsigned int) bin;
+        }
+
+        if (j == nDims)
+        {
+            bodyBins[i] = index;
+            ++totalNum;
+        }
+    }
+
+    return totalNum;
+}
+
+static int nbCompareBodyBins(const void* a, const void* b)
+{
+    unsigned int ia = *(const unsigned int*) a;
+    unsigned int ib = *(const unsigned int*) b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+static NBodyHistogram* nbAllocHistogram(const NBodyState* st,
+                                        const HistogramParams* hp,
+                                        const NBodyHistogramDim* dims,
+                                        unsigned int nDims,
+                                        unsigned int totalBins,
+                                        unsigned int nStored)
+{
+    NBodyHistogram* histogram;
+
+    histogram = mwCalloc(sizeof(NBodyHistogram) + nStored * sizeof(HistData), sizeof(char));
+    histogram->nBin = nStored;
+    histogram->hasRawCounts = TRUE;
+    histogram->params = *hp;
+    histogram->totalSimulated = (unsigned int) st->nbody;
+    histogram->massPerParticle = (double) st->bodytab->bodynode.mass;
+    histogram->nDims = nDims;
+    histogram->totalBins = totalBins;
+    histogram->sparse = hp->sparse;
+    memcpy(histogram->dims, dims, nDims * sizeof(NBodyHistogramDim));
+
+    return histogram;
+}
+
 /* Bin the bodies from the simulation into maxIdx bins.
    Returns null on failure
  */
@@ -560,73 +948,246 @@ NBodyHistogram* nbCreateHistogram(const NBodyCtx* ctx,        /* Simulation cont
                                   const NBodyState* st,       /* Final state of the simulation */
                                   const HistogramParams* hp)  /* Range of histogram to create */
 {
-    double lambda;
-    unsigned int i;
-    unsigned int idx;
-    unsigned int totalNum = 0;
-    Body* p;
+    unsigned int i, j, n;
+    unsigned int totalNum;
+    unsigned int nDims;
+    unsigned int totalBins;
+    unsigned int nStored;
+    unsigned int* counts;
+    unsigned int* bodyBins;
+    NBodyHistogramDim dims[NBODY_HIST_MAX_DIMS];
     NBodyHistogram* histogram;
     HistData* histData;
     NBHistTrig histTrig;
-    const Body* endp = st->bodytab + st->nbody;
-    double binSize = (double) hp->binSize;
 
     /* Calculate the bounds of the bin range, making sure to use a
      * fixed bin size which spans the entire range, and is symmetric
      * around 0 */
+    if (nbHistogramDims(dims, &nDims, &totalBins, hp))
+    {
+        mw_printf("Too many histogram bins\n");
+        return NULL;
+    }
 
-    double start = nbHistogramStart(hp);
-    unsigned int nBin = nbHistogramNBin(hp);
+    nbGetHistTrig(&histTrig, hp);
 
+    /* Finding the bins is the expensive part and is done in
+     * parallel. The bins are then counted from the list, which takes
+     * no memory per thread however many bins there are. */
+    bodyBins = (unsigned int*) mwMalloc(st->nbody * sizeof(unsigned int));
+    totalNum = nbFindBodyBins(bodyBins, ctx, st, &histTrig, dims, nDims);
 
-    nbGetHistTrig(&histTrig, hp);
+    if (hp->sparse)
+    {
+        /* Only the occupied bins are stored, which there can be no
+         * more of than bodies, so count them from the sorted list
+         * instead of from every bin */
+        qsort(bodyBins, st->nbody, sizeof(unsigned int), nbCompareBodyBins);
 
-    histogram = mwCalloc(sizeof(NBodyHistogram) + nBin * sizeof(HistData), sizeof(char));
-    histogram->nBin = nBin;
-    histogram->hasRawCounts = TRUE;
-    histogram->params = *hp;
-    histogram->totalSimulated = (unsigned int) st->nbody;
-    histogram->massPerParticle = (double) st->bodytab->bodynode.mass;
-    histData = histogram->data;
+        nStored = 0;
+        for (i = 0; i < totalNum; ++i)
+        {
+            nStored += (i == 0 || bodyBins[i] != bodyBins[i - 1]);
+        }
 
-    /* It does not make sense to ignore bins in a generated histogram */
-    for (i = 0; i < nBin; ++i)
+        histogram = nbAllocHistogram(st, hp, dims, nDims, totalBins, nStored);
+        histData = histogram->data;
+
+        for (i = 0, j = 0; i < totalNum; i += n, ++j)
+        {
+            for (n = 1; i + n < totalNum && bodyBins[i + n] == bodyBins[i]; ++n);
+
+            histData[j].useBin = TRUE;
+            histData[j].index = bodyBins[i];
+            histData[j].rawCount = n;
+        }
+    }
+    else
     {
-        histData[i].useBin = TRUE;
+        counts = (unsigned int*) mwCalloc(totalBins, sizeof(unsigned int));
+        for (i = 0; i < (unsigned int) st->nbody; ++i)
+        {
+            if (bodyBins[i] != NB_HIST_NO_BIN)
+                counts[bodyBins[i]]++;
+        }
+
+        histogram = nbAllocHistogram(st, hp, dims, nDims, totalBins, totalBins);
+        histData = histogram->data;
+
+        /* It does not make sense to ignore bins in a generated histogram */
+        for (i = 0; i < totalBins; ++i)
+        {
+            histData[i].useBin = TRUE;
+            histData[i].index = i;
+            histData[i].rawCount = counts[i];
+        }
+
+        free(counts);
     }
 
+    free(bodyBins);
+
+    histogram->totalNum = totalNum; /* Total particles in range */
+
+    nbNormalizeHistogram(histogram);
+
+    return histogram;
+}
 
-    for (p = st->bodytab; p < endp; ++p)
+
+/* Read a line of "useBin lambda [other centers] count err" */
+static int nbReadHistogramLine(const char* line, HistData* bin, unsigned int nDims)
+{
+    unsigned int i;
+    char* end;
+    double x;
+
+    bin->useBin = (int) strtol(line, &end, 10);
+    if (end == line)
+        return 1;
+
+    for (i = 0; i < nDims + 2; ++i)
     {
-        /* Only include bodies in models we aren't ignoring */
-        if (!ignoreBody(p))
+        line = end;
+        x = strtod(line, &end);
+        if (end == line)
+            return 1;
+
+        if (i == 0)
+            bin->lambda = x;
+        else if (i < nDims)
+            bin->extra[i - 1] = x;
+        else if (i == nDims)
+            bin->count = x;
+        else
+            bin->err = x;
+    }
+
+    return 0;
+}
+
+static int nbCompareHistData(const void* a, const void* b)
+{
+    unsigned int ia = ((const HistData*) a)->index;
+    unsigned int ib = ((const HistData*) b)->index;
+
+    return (ia > ib) - (ia < ib);
+}
+
+/* Find which bin each line of a multidimensional histogram is from
+ * its centers, and put them in order */
+static int nbIndexHistogramBins(NBodyHistogram* histogram, unsigned int nAxes)
+{
+    unsigned int i, j;
+    uint64_t total = 1;
+    double k, center;
+    HistData* bin;
+    const NBodyHistogramDim* dim;
+
+    if (nAxes != histogram->nDims || histogram->dims[0].type != NBODY_HIST_LAMBDA)
+    {
+        mw_printf("Histogram has %u axes for %u dimensions, starting with lambda\n",
+                  nAxes, histogram->nDims);
+        return 1;
+    }
+
+    for (j = 0; j < histogram->nDims; ++j)
+    {
+        total *= histogram->dims[j].nBin;
+        if (total > UINT_MAX || histogram->dims[j].binSize <= 0.0)
+        {
+            mw_printf("Invalid histogram axis '%s'\n", nbHistogramAxisName(histogram->dims[j].type));
+            return 1;
+        }
+    }
+    histogram->totalBins = (unsigned int) total;
+
+    for (i = 0; i < histogram->nBin; ++i)
+    {
+        bin = &histogram->data[i];
+        bin->index = 0;
+
+        for (j = 0; j < histogram->nDims; ++j)
         {
-            lambda = nbXYZToLambda(&histTrig, Pos(p), ctx->sunGCDist);
-            idx = (unsigned int) floor((lambda - start) / binSize);
-            if (idx < nBin)
+            dim = &histogram->dims[j];
+            center = (j == 0) ? bin->lambda : bin->extra[j - 1];
+            k = floor((center - dim->start) / dim->binSize);
+            if (!(k >= 0.0 && k < (double) dim->nBin))
             {
-                histData[idx].rawCount++;
-                ++totalNum;
+                mw_printf("Histogram bin %u is outside of axis '%s'\n", i, nbHistogramAxisName(dim->type));
+                return 1;
             }
+
+            bin->index = bin->index * dim->nBin + (unsigned int) k;
         }
     }
 
-    histogram->totalNum = totalNum; /* Total particles in range */
+    qsort(histogram->data, histogram->nBin, sizeof(HistData), nbCompareHistData);
 
-    nbNormalizeHistogram(histogram);
+    for (i = 1; i < histogram->nBin; ++i)
+    {
+        if (histogram->data[i].index == histogram->data[i - 1].index)
+        {
+            mw_printf("Histogram has more than one line for bin %u\n", histogram->data[i].index);
+            return 1;
+        }
+    }
 
-    return histogram;
+    if (!histogram->sparse && histogram->nBin != histogram->totalBins)
+    {
+        mw_printf("Histogram has %u bins, expected %u\n", histogram->nBin, histogram->totalBins);
+        return 1;
+    }
+
+    return 0;
 }
 
+/* Cut the next line out of text, ending it with a NUL in place of the
+ * newline (and the carriage return of a CRLF). Returns NULL at the end. */
+static char* nbNextLine(char** text)
+{
+    char* line = *text;
+    char* end;
+    size_t len;
 
-/* The chisq is calculated by reading a histogram file of normalized data.
-   Returns null on failure.
- */
-NBodyHistogram* nbReadHistogram(const char* histogramFile)
+    if (!line || *line == '\0')
+        return NULL;
+
+    end = strchr(line, '\n');
+    if (end)
+    {
+        *end = '\0';
+        *text = end + 1;
+    }
+    else
+    {
+        *text = NULL;
+    }
+
+    len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r')
+        line[len - 1] = '\0';
+
+    return line;
+}
+
+/* Bin lines start with the useBin flag. Anything else is a header. */
+static int nbIsHistogramDataLine(const char* line)
+{
+    while (*line == ' ' || *line == '\t')
+        ++line;
+
+    return isdigit((unsigned char) *line) || *line == '-' || *line == '+';
+}
+
+/* Parse a histogram in memory. The text is modified to split it into
+   lines. name is only used for error messages. Returns NULL on failure. */
+static NBodyHistogram* nbParseHistogram(char* text, const char* name)
 {
-    FILE* f;
     int rc = 0;
-    size_t fsize = 0;
+    size_t maxLines = 1;
+    const char* p;
+    char* line;
     NBodyHistogram* histogram = NULL;
     HistData* histData = NULL;
     unsigned int fileCount = 0;
@@ -636,50 +1197,63 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
     mwbool readNGen = FALSE;  /* Read the scale for the histogram (particles in data bin) */
     mwbool readTotalSim = FALSE; /*Read the total number of particles simulated for the histogram */
     mwbool readMass = FALSE; /*Read the mass per particle for the histogram*/
+    mwbool readDims = FALSE;  /* Read the number of dimensions. Only lambda without it. */
+    mwbool readSparse = FALSE;
+    unsigned int nAxes = 0;   /* Axes of the dimensions read so far */
     unsigned int nGen = 0;    /* Number of particles read from the histogram */
     unsigned int totalSim = 0;	/*Total number of simulated particles read from the histogram */
     double mass = 0;			/*mass per particle read from the histogram */
-    char lineBuf[1024];
 
-    f = mwOpenResolved(histogramFile, "r");
+    for (p = strchr(text, '\n'); p; p = strchr(p + 1, '\n'))
+        ++maxLines;
 
-    if (f == NULL)
-    {
-        mw_printf("Error opening histogram file '%s'\n", histogramFile);
-        return NULL;
-    }
-    fsize = mwCountLinesInFile(f);
-    if (fsize == 0)
+    if (*text == '\0')
     {
         mw_printf("Histogram line count = 0\n");
         return NULL;
     }
 
-    histogram = (NBodyHistogram*) mwCalloc(sizeof(NBodyHistogram) + fsize * sizeof(HistData), sizeof(char));
+    histogram = (NBodyHistogram*) mwCalloc(sizeof(NBodyHistogram) + maxLines * sizeof(HistData), sizeof(char));
     histogram->hasRawCounts = FALSE;     /* Do we want to include these? */
     histData = histogram->data;
 
-
-    while (fgets(lineBuf, (int) sizeof(lineBuf), f))
+    while ((line = nbNextLine(&text)))
     {
         ++lineNum;
 
-        if (strlen(lineBuf) + 1 >= sizeof(lineBuf))
+        /* Skip comments and blank lines */
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+
+        /* Most lines are bins, so don't try every header on them */
+        if (nbIsHistogramDataLine(line) && (!readDims || nAxes == histogram->nDims))
         {
-            mw_printf("Error reading histogram line %d (Line buffer too small): %s", lineNum, lineBuf);
-            error = TRUE;
-            break;
-        }
+            if (readDims)
+            {
+                rc = nbReadHistogramLine(line, &histData[fileCount], histogram->nDims);
+            }
+            else
+            {
+                rc = nbReadHistogramLine(line, &histData[fileCount], 1);
+                histData[fileCount].index = fileCount;
+            }
 
-        /* Skip comments and blank lines */
-        if (lineBuf[0] == '#' || lineBuf[0] == '\n')
+            if (rc)
+            {
+                mw_printf("Error reading histogram line %u: %s\n", lineNum, line);
+                error = TRUE;
+                break;
+            }
+
+            ++fileCount;
             continue;
+        }
 
         if (!readParams)  /* One line is allowed for information on the histogram */
         {
             double phi, theta, psi;
 
-            rc = sscanf(lineBuf,
+            rc = sscanf(line,
                         " phi = %lf , theta = %lf , psi = %lf \n",
                         &phi, &theta, &psi);
             if (rc == 3)
@@ -691,7 +1265,7 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
 
         if (!readNGen)
         {
-            rc = sscanf(lineBuf, " n = %u \n", &nGen);
+            rc = sscanf(line, " n = %u \n", &nGen);
             if (rc == 1)
             {
                 readNGen = TRUE;
@@ -700,7 +1274,7 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
         }
         if (!readMass)
         {
-            rc = sscanf(lineBuf, " massPerParticle = %lf \n", &mass);
+            rc = sscanf(line, " massPerParticle = %lf \n", &mass);
             if (rc == 1)
             {
                 readMass = TRUE;
@@ -709,7 +1283,7 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
         }
         if (!readTotalSim)
         {
-            rc = sscanf(lineBuf, " totalSimulated = %u \n", &totalSim);
+            rc = sscanf(line, " totalSimulated = %u \n", &totalSim);
             if (rc == 1)
             {
                 readTotalSim = TRUE;
@@ -717,23 +1291,57 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
             }
         }
 
-        rc = sscanf(lineBuf,
-                    "%d %lf %lf %lf \n",
-                    &histData[fileCount].useBin,
-                    &histData[fileCount].lambda,
-                    &histData[fileCount].count,
-                    &histData[fileCount].err);
-        if (rc != 4)
+        if (!readDims && fileCount == 0)
         {
-            mw_printf("Error reading histogram line %d: %s", lineNum, lineBuf);
-            error = TRUE;
-            break;
+            rc = sscanf(line, " dimensions = %u \n", &histogram->nDims);
+            if (rc == 1)
+            {
+                if (histogram->nDims == 0 || histogram->nDims > NBODY_HIST_MAX_DIMS)
+                {
+                    mw_printf("Invalid number of histogram dimensions %u\n", histogram->nDims);
+                    error = TRUE;
+                    break;
+                }
+
+                readDims = TRUE;
+                continue;
+            }
         }
 
-        ++fileCount;
-    }
+        if (readDims && nAxes < histogram->nDims)
+        {
+            char axisName[32];
+            NBodyHistogramDim* dim = &histogram->dims[nAxes];
 
-    fclose(f);
+            rc = sscanf(line, " axis = %31s %lf %lf %u \n", axisName, &dim->start, &dim->binSize, &dim->nBin);
+            if (rc == 4)
+            {
+                if (nbHistogramAxisFromName(axisName, &dim->type))
+                {
+                    mw_printf("Unknown histogram axis '%s'\n", axisName);
+                    error = TRUE;
+                    break;
+                }
+
+                ++nAxes;
+                continue;
+            }
+        }
+
+        if (readDims && !readSparse)
+        {
+            rc = sscanf(line, " sparse = %d \n", &histogram->sparse);
+            if (rc == 1)
+            {
+                readSparse = TRUE;
+                continue;
+            }
+        }
+
+        mw_printf("Error reading histogram line %u: %s\n", lineNum, line);
+        error = TRUE;
+        break;
+    }
 
     if (error)
     {
@@ -745,6 +1353,43 @@ NBodyHistogram* nbReadHistogram(const char* histogramFile)
     histogram->totalNum = nGen;
     histogram->totalSimulated = totalSim;
     histogram->massPerParticle = mass;
+
+    if (!readDims)
+    {
+        /* The original format only has lambda with every bin */
+        histogram->nDims = 1;
+        histogram->totalBins = fileCount;
+        histogram->dims[0].type = NBODY_HIST_LAMBDA;
+        histogram->dims[0].nBin = fileCount;
+    }
+    else if (nbIndexHistogramBins(histogram, nAxes))
+    {
+        mw_printf("Error reading histogram '%s'\n", name);
+        free(histogram);
+        return NULL;
+    }
+
+    return histogram;
+}
+
+/* The chisq is calculated by reading a histogram file of normalized data.
+   Returns null on failure.
+ */
+NBodyHistogram* nbReadHistogram(const char* histogramFile)
+{
+    char* text;
+    NBodyHistogram* histogram;
+
+    text = mwReadFileResolved(histogramFile);
+    if (!text)
+    {
+        mw_printf("Error opening histogram file '%s'\n", histogramFile);
+        return NULL;
+    }
+
+    histogram = nbParseHistogram(text, histogramFile);
+    free(text);
+
     return histogram;
 }
 
@@ -755,7 +1400,71 @@ static double nbWorstCaseEMD(const NBodyHistogram* hist)
   return DEFAULT_WORST_CASE;
 }
 
-double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram)
+/* Add a bin to an EMD signature. A bin in any dimension is made as far
+   as a bin in lambda. */
+static void nbAddSignatureBin(float* sig, unsigned int* n, const NBodyHistogram* data, const HistData* bin)
+{
+    unsigned int i;
+    float* p = &sig[*n * (data->nDims + 1)];
+
+    p[0] = (float) bin->count;
+    p[1] = (float) bin->lambda;
+    for (i = 1; i < data->nDims; ++i)
+    {
+        p[i + 1] = (float) (bin->extra[i - 1] * data->dims[0].binSize / data->dims[i].binSize);
+    }
+
+    ++*n;
+}
+
+/* The EMD between histograms with more than lambda, or leaving out
+   empty bins. Only bins with something in them go into the
+   signatures. */
+static double nbHistogramEMD(const NBodyHistogram* data,
+                             const NBodyHistogram* histogram,
+                             EMDWorkspace* ws)
+{
+    unsigned int nDat = 0;
+    unsigned int nHist = 0;
+    unsigned int width = data->nDims + 1;
+    float* dat;
+    float* hist;
+    double emd;
+    NBHistogramBinPairs bins;
+
+    dat = (float*) mwCalloc((size_t) (data->nBin + 1) * width, sizeof(float));
+    hist = (float*) mwCalloc((size_t) (histogram->nBin + 1) * width, sizeof(float));
+
+    nbStartBinPairs(&bins, data, histogram);
+    while (nbNextBinPair(&bins))
+    {
+        if (!bins.binA->useBin)
+            continue;
+
+        if (bins.binA->count > 0.0)
+            nbAddSignatureBin(dat, &nDat, data, bins.binA);
+
+        if (bins.binB->count > 0.0)
+            nbAddSignatureBin(hist, &nHist, data, bins.binB);
+    }
+
+    if (nDat == 0 || nHist == 0)
+        emd = INFINITY;
+    else if (ws)
+        emd = emdCalcWorkspace(ws, dat, hist, nDat, nHist, (int) data->nDims, NULL);
+    else
+        emd = emdCalcDims(dat, hist, nDat, nHist, (int) data->nDims, NULL);
+
+    free(dat);
+    free(hist);
+
+    return emd;
+}
+
+/* ws may be NULL, in which case the EMD allocates its own buffers */
+double nbMatchEMDWorkspace(const NBodyHistogram* data,
+                           const NBodyHistogram* histogram,
+                           EMDWorkspace* ws)
 {
 	unsigned int k;
     unsigned int bins = data->nBin;
@@ -766,13 +1475,13 @@ double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram)
     real histMass = histogram->massPerParticle;
     real dataMass = data->massPerParticle;
     unsigned int i;
-    WeightPos* hist;
-    WeightPos* dat;
+    WeightPos* hist = NULL;
+    WeightPos* dat = NULL;
     real ratio;
     double emd;
     double likelihood;
 
-    if (data->nBin != histogram->nBin)
+    if (!nbHistogramShapesMatch(data, histogram))
     {
         /* FIXME?: We could have mismatched histogram sizes, but I'm
          * not sure what to do with ignored bins and
@@ -792,23 +1501,33 @@ double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram)
 		return NAN;
 	}
 
-	/* This creates histograms that emdCalc can use */
-	hist = mwCalloc(bins, sizeof(WeightPos));
-    dat = mwCalloc(bins, sizeof(WeightPos));
-
-    for (i = 0; i < bins; ++i)
+    if (data->nDims > 1 || data->sparse || histogram->sparse)
     {
-        if (data->data[i].useBin)
+        emd = nbHistogramEMD(data, histogram, ws);
+    }
+    else
+    {
+        /* This creates histograms that emdCalc can use */
+        hist = mwCalloc(bins, sizeof(WeightPos));
+        dat = mwCalloc(bins, sizeof(WeightPos));
+
+        for (i = 0; i < bins; ++i)
         {
-            dat[i].weight = (float) data->data[i].count;
-            hist[i].weight = (float) histogram->data[i].count;
-		}
+            if (data->data[i].useBin)
+            {
+                dat[i].weight = (float) data->data[i].count;
+                hist[i].weight = (float) histogram->data[i].count;
+            }
 
-        hist[i].pos = (float) histogram->data[i].lambda;
-        dat[i].pos = (float) data->data[i].lambda;
-    }
+            hist[i].pos = (float) histogram->data[i].lambda;
+            dat[i].pos = (float) data->data[i].lambda;
+        }
 
-    emd = emdCalc((const float*) dat, (const float*) hist, bins, bins, NULL);
+        if (ws)
+            emd = emdCalcWorkspace(ws, (const float*) dat, (const float*) hist, bins, bins, 1, NULL);
+        else
+            emd = emdCalc((const float*) dat, (const float*) hist, bins, bins, NULL);
+    }
 
     if (emd > 50.0)
     {
@@ -838,6 +1557,11 @@ double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram)
     return likelihood;
 }
 
+double nbMatchEMD(const NBodyHistogram* data, const NBodyHistogram* histogram)
+{
+    return nbMatchEMDWorkspace(data, histogram, NULL);
+}
+
 /*
   Load information necessary to calculate the likelihood from input lua script.
 
@@ -873,12 +1597,18 @@ double nbSystemChisq(const NBodyState* st,
                      const NBodyHistogram* histogram,
                      NBodyLikelihoodMethod method)
 {
-    if (data->nBin != histogram->nBin)
+    if (data->totalBins != histogram->totalBins)
     {
         mw_printf("Number of bins does not match those in histogram file. "
                   "Expected %u, got %u\n",
-                  histogram->nBin,
-                  data->nBin);
+                  histogram->totalBins,
+                  data->totalBins);
+        return NAN;
+    }
+
+    if (!nbHistogramShapesMatch(data, histogram))
+    {
+        mw_printf("Histogram dimensions do not match those in histogram file\n");
         return NAN;
     }
 
@@ -939,3 +1669,218 @@ double nbMatchHistogramFiles(const char* datHist, const char* matchHist)
     return emd;
 }
 
+static const struct
+{
+    const char* name;
+    NBodyLikelihoodMethod method;
+} nbLikelihoodMethodNames[] =
+{
+    { "EMD",             NBODY_EMD              },
+    { "Original",        NBODY_ORIG_CHISQ       },
+    { "AltOriginal",     NBODY_ORIG_ALT         },
+    { "ChisqAlt",        NBODY_CHISQ_ALT        },
+    { "Poisson",         NBODY_POISSON          },
+    { "Kolmogorov",      NBODY_KOLMOGOROV       },
+    { "KullbackLeibler", NBODY_KULLBACK_LEIBLER },
+    { "Saha",            NBODY_SAHA             }
+};
+
+static const char* nbLikelihoodMethodName(NBodyLikelihoodMethod method)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(nbLikelihoodMethodNames) / sizeof(nbLikelihoodMethodNames[0]); ++i)
+    {
+        if (nbLikelihoodMethodNames[i].method == method)
+            return nbLikelihoodMethodNames[i].name;
+    }
+
+    return "Invalid";
+}
+
+int nbParseLikelihoodMethods(const char* list, NBodyLikelihoodMethod* methods, unsigned int* nMethods)
+{
+    const char* p = list;
+    size_t i, len;
+    const size_t nNames = sizeof(nbLikelihoodMethodNames) / sizeof(nbLikelihoodMethodNames[0]);
+
+    *nMethods = 0;
+
+    while (p && *p)
+    {
+        len = strcspn(p, ",");
+
+        for (i = 0; i < nNames; ++i)
+        {
+            if (len == strlen(nbLikelihoodMethodNames[i].name)
+                && !strncmp(p, nbLikelihoodMethodNames[i].name, len))
+                break;
+        }
+
+        if (i == nNames)
+        {
+            mw_printf("Unknown likelihood method '%.*s'\n", (int) len, p);
+            return 1;
+        }
+
+        if (*nMethods == NBODY_MAX_MATCH_METHODS)
+        {
+            mw_printf("Too many likelihood methods (at most %d)\n", NBODY_MAX_MATCH_METHODS);
+            return 1;
+        }
+
+        methods[(*nMethods)++] = nbLikelihoodMethodNames[i].method;
+
+        p += len;
+        if (*p == ',')
+            ++p;
+    }
+
+    if (*nMethods == 0)
+    {
+        mw_printf("No likelihood methods given\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Histogram files only have the normalized counts, but they are
+   exact enough to get back the raw counts the other likelihoods use */
+static void nbRecoverRawCounts(NBodyHistogram* histogram)
+{
+    unsigned int i;
+
+    if (histogram->totalNum == 0)
+        return;
+
+    for (i = 0; i < histogram->nBin; ++i)
+    {
+        histogram->data[i].rawCount = (unsigned int) floor(histogram->data[i].count * (double) histogram->totalNum + 0.5);
+    }
+
+    histogram->hasRawCounts = TRUE;
+}
+
+static double nbScoreHistogram(const NBodyHistogram* data,
+                               const NBodyHistogram* histogram,
+                               NBodyLikelihoodMethod method,
+                               EMDWorkspace* ws)
+{
+    if (data->totalBins != histogram->totalBins || !nbHistogramShapesMatch(data, histogram))
+        return NAN;
+
+    if (method == NBODY_EMD)
+        return nbMatchEMDWorkspace(data, histogram, ws);
+
+    return nbCalcChisq(data, histogram, method);
+}
+
+int nbMatchHistogramList(FILE* f,
+                         const char* datHist,
+                         const char* listFile,
+                         const NBodyLikelihoodMethod* methods,
+                         unsigned int nMethods)
+{
+    int i;
+    unsigned int j;
+    int nFiles = 0;
+    int failed = 0;
+    size_t maxFiles = 1;
+    char* text;
+    char* rest;
+    char* line;
+    const char* p;
+    const char** names;
+    double* results;
+    NBodyHistogram* dat;
+
+    dat = nbReadHistogram(datHist);
+    if (!dat)
+        return 1;
+
+    text = mwReadFileResolved(listFile);
+    if (!text)
+    {
+        mw_printf("Error reading histogram list '%s'\n", listFile);
+        free(dat);
+        return 1;
+    }
+
+    for (p = strchr(text, '\n'); p; p = strchr(p + 1, '\n'))
+        ++maxFiles;
+
+    /* One file name per line, skipping blank lines and comments */
+    names = (const char**) mwMalloc(maxFiles * sizeof(const char*));
+    rest = text;
+    while ((line = nbNextLine(&rest)))
+    {
+        char* end;
+
+        while (isspace((unsigned char) *line))
+            ++line;
+
+        end = line + strlen(line);
+        while (end > line && isspace((unsigned char) end[-1]))
+            *--end = '\0';
+
+        if (line[0] != '\0' && line[0] != '#')
+            names[nFiles++] = line;
+    }
+
+    results = (double*) mwMalloc(((size_t) nFiles * nMethods + 1) * sizeof(double));
+
+  #ifdef _OPENMP
+    #pragma omp parallel private(i, j) reduction(+ : failed)
+  #endif
+    {
+        NBodyHistogram* match;
+        EMDWorkspace* ws = emdCreateWorkspace(0, 0);
+
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+      #endif
+        for (i = 0; i < nFiles; ++i)
+        {
+            match = nbReadHistogram(names[i]);
+            if (match)
+                nbRecoverRawCounts(match);
+            else
+                ++failed;
+
+            for (j = 0; j < nMethods; ++j)
+            {
+                results[(size_t) i * nMethods + j] = match ? nbScoreHistogram(dat, match, methods[j], ws) : NAN;
+            }
+
+            free(match);
+        }
+
+        emdDestroyWorkspace(ws);
+    }
+
+    fprintf(f, "# histogram");
+    for (j = 0; j < nMethods; ++j)
+    {
+        fprintf(f, "\t%s", nbLikelihoodMethodName(methods[j]));
+    }
+    fprintf(f, "\n");
+
+    for (i = 0; i < nFiles; ++i)
+    {
+        fprintf(f, "%s", names[i]);
+        for (j = 0; j < nMethods; ++j)
+        {
+            fprintf(f, "\t%.15f", results[(size_t) i * nMethods + j]);
+        }
+        fprintf(f, "\n");
+    }
+
+    free(results);
+    free(names);
+    free(text);
+    free(dat);
+
+    return failed != 0;
+}
+
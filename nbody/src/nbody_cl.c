@@ -26,6 +26,7 @@
 #include "nbody_curses.h"
 #include "nbody_shmem.h"
 #include "nbody_checkpoint.h"
+#include "nbody_snapshot.h"
 #include "nbody_tree.h"
 
 /* We want to restrict this a bit to ensure we can get better occupancy.
@@ -1550,6 +1551,30 @@ static cl_int nbRunPreStep(NBodyState* st)
     return clSetKernelArg(kernel, 29, sizeof(cl_int), &trueVal);
 }
 
+/* The bodies only need to be read back when a frame is due */
+static NBodyStatus nbSnapshotCL(const NBodyCtx* ctx, NBodyState* st)
+{
+    cl_int err;
+
+    if (!nbTimeToSnapshot(ctx, st))
+    {
+        return NBODY_SUCCESS;
+    }
+
+    err = nbMarshalBodies(st, CL_FALSE);
+    if (err != CL_SUCCESS)
+    {
+        return NBODY_CL_ERROR;
+    }
+
+    if (nbAppendSnapshotFrame(ctx, st))
+    {
+        return NBODY_IO_ERROR;
+    }
+
+    return NBODY_SUCCESS;
+}
+
 static NBodyStatus nbMainLoopCL(const NBodyCtx* ctx, NBodyState* st)
 {
     NBodyStatus rc = NBODY_SUCCESS;
@@ -1562,6 +1587,12 @@ static NBodyStatus nbMainLoopCL(const NBodyCtx* ctx, NBodyState* st)
         return NBODY_CL_ERROR;
     }
 
+    rc = nbSnapshotCL(ctx, st);
+    if (nbStatusIsFatal(rc))
+    {
+        return rc;
+    }
+
     while (st->step < ctx->nStep)
     {
         rc = nbCheckKernelErrorCode(ctx, st);
@@ -1583,6 +1614,12 @@ static NBodyStatus nbMainLoopCL(const NBodyCtx* ctx, NBodyState* st)
         }
 
         st->step++;
+
+        rc = nbSnapshotCL(ctx, st);
+        if (nbStatusIsFatal(rc))
+        {
+            return rc;
+        }
     }
 
     return rc;
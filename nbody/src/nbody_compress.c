@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "nbody_compress.h"
+
+#define NB_LZ_MIN_MATCH 4
+#define NB_LZ_HASH_BITS 14
+#define NB_LZ_MAX_OFFSET 65535
+
+/* The format requires the last 5 bytes to be literals, and the last
+ * match to start at least 12 bytes before the end */
+#define NB_LZ_LAST_LITERALS 5
+#define NB_LZ_MF_LIMIT 12
+
+/* Skip ahead faster the longer we go without finding a match, so
+ * incompressible data doesn't cost much */
+#define NB_LZ_SKIP_TRIGGER 6
+
+
+static uint32_t nbLZRead32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t nbLZHash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - NB_LZ_HASH_BITS);
+}
+
+static uint8_t* nbLZWriteLength(uint8_t* op, size_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t) len;
+
+    return op;
+}
+
+/* Read the extra length bytes following a token nibble of 15 */
+static int nbLZReadLength(const uint8_t** ip, const uint8_t* ipEnd, size_t* len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= ipEnd)
+            return 1;
+        b = *(*ip)++;
+        *len += b;
+    }
+    while (b == 255);
+
+    return 0;
+}
+
+size_t nbLZCompressBound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+/* Emit a sequence of literals followed by an optional match. Returns
+ * NULL if it would overrun the output. */
+static uint8_t* nbLZWriteSequence(uint8_t* op,
+                                  const uint8_t* opEnd,
+                                  const uint8_t* literals,
+                                  size_t litLen,
+                                  size_t offset,
+                                  size_t matchLen)
+{
+    uint8_t* token;
+
+    if ((size_t) (opEnd - op) < litLen + litLen / 255 + matchLen / 255 + 6)
+        return NULL;
+
+    token = op++;
+    *token = (uint8_t) ((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15)
+        op = nbLZWriteLength(op, litLen - 15);
+
+    memcpy(op, literals, litLen);
+    op += litLen;
+
+    if (matchLen == 0)  /* Final literals only */
+        return op;
+
+    *op++ = (uint8_t) (offset & 0xff);
+    *op++ = (uint8_t) (offset >> 8);
+
+    matchLen -= NB_LZ_MIN_MATCH;
+    *token |= (uint8_t) (matchLen >= 15 ? 15 : matchLen);
+    if (matchLen >= 15)
+        op = nbLZWriteLength(op, matchLen - 15);
+
+    return op;
+}
+
+size_t nbLZCompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstCap)
+{
+    uint32_t table[1 << NB_LZ_HASH_BITS];
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + n;
+    const uint8_t* matchLimit = end - NB_LZ_LAST_LITERALS;
+    const uint8_t* ref;
+    uint8_t* op = dst;
+    const uint8_t* opEnd = dst + dstCap;
+    size_t matchLen;
+    uint32_t h, misses = 1 << NB_LZ_SKIP_TRIGGER;
+
+    memset(table, 0, sizeof(table));
+
+    while (n >= NB_LZ_MF_LIMIT && ip < end - NB_LZ_MF_LIMIT)
+    {
+        h = nbLZHash(nbLZRead32(ip));
+        ref = src + table[h];
+        table[h] = (uint32_t) (ip - src);
+
+        if (   ref >= ip
+            || ip - ref > NB_LZ_MAX_OFFSET
+            || nbLZRead32(ref) != nbLZRead32(ip))
+        {
+            ip += misses++ >> NB_LZ_SKIP_TRIGGER;
+            continue;
+        }
+
+        /* Extend the match backwards into pending literals, then forwards */
+        while (ip > anchor && ref > src && ip[-1] == ref[-1])
+        {
+            --ip;
+            --ref;
+        }
+
+        matchLen = NB_LZ_MIN_MATCH;
+        while (ip + matchLen < matchLimit && ip[matchLen] == ref[matchLen])
+            ++matchLen;
+
+        op = nbLZWriteSequence(op, opEnd, anchor, ip - anchor, ip - ref, matchLen);
+        if (!op)
+            return 0;
+
+        ip += matchLen;
+        anchor = ip;
+        misses = 1 << NB_LZ_SKIP_TRIGGER;
+
+        /* Remember a position inside the match so runs keep chaining */
+        table[nbLZHash(nbLZRead32(ip - 2))] = (uint32_t) (ip - 2 - src);
+    }
+
+    op = nbLZWriteSequence(op, opEnd, anchor, end - anchor, 0, 0);
+    return op ? (size_t) (op - dst) : 0;
+}
+
+int nbLZDecompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstSize)
+{
+    const uint8_t* ip = src;
+    const uint8_t* ipEnd = src + n;
+    const uint8_t* ref;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstSize;
+    uint8_t token;
+    size_t len, offset;
+
+    while (ip < ipEnd)
+    {
+        token = *ip++;
+
+        len = token >> 4;
+        if (len == 15 && nbLZReadLength(&ip, ipEnd, &len))
+            return 1;
+
+        if (len > (size_t) (ipEnd - ip) || len > (size_t) (opEnd - op))
+            return 1;
+
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        if (ip == ipEnd)  /* Block ends with literals */
+            break;
+
+        if (ipEnd - ip < 2)
+            return 1;
+
+        offset = ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - dst))
+            return 1;
+
+        len = token & 15;
+        if (len == 15 && nbLZReadLength(&ip, ipEnd, &len))
+            return 1;
+        len += NB_LZ_MIN_MATCH;
+
+        if (len > (size_t) (opEnd - op))
+            return 1;
+
+        ref = op - offset;
+        if (offset >= len)
+        {
+            memcpy(op, ref, len);
+            op += len;
+        }
+        else
+        {
+            /* Overlapping copy repeats the last offset bytes */
+            while (len--)
+                *op++ = *ref++;
+        }
+    }
+
+    return op != opEnd;
+}
+
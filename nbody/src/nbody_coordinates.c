@@ -76,47 +76,46 @@ void nbGetHistTrig(NBHistTrig* ht, const HistogramParams* hp)
     real rpsi = d2r(hp->psi);
     real rth  = d2r(hp->theta);
 
-    ht->cosphi = mw_cos(rphi);
-    ht->sinphi = mw_sin(rphi);
-    ht->sinpsi = mw_sin(rpsi);
-    ht->cospsi = mw_cos(rpsi);
-    ht->costh  = mw_cos(rth);
-    ht->sinth  = mw_sin(rth);
+    real cosphi = mw_cos(rphi);
+    real sinphi = mw_sin(rphi);
+    real sinpsi = mw_sin(rpsi);
+    real cospsi = mw_cos(rpsi);
+    real costh  = mw_cos(rth);
+    real sinth  = mw_sin(rth);
+
+    ht->lambdaCos[0] = cospsi * cosphi - costh * sinphi * sinpsi;
+    ht->lambdaCos[1] = cospsi * sinphi + costh * cosphi * sinpsi;
+    ht->lambdaCos[2] = sinpsi * sinth;
+
+    ht->lambdaSin[0] = -(sinpsi * cosphi + costh * sinphi * cospsi);
+    ht->lambdaSin[1] = -sinpsi * sinphi + costh * cosphi * cospsi;
+    ht->lambdaSin[2] = cospsi * sinth;
+
+    ht->beta[0] = sinth * sinphi;
+    ht->beta[1] = -sinth * cosphi;
+    ht->beta[2] = costh;
 }
 
+/* With (cos b cos l, cos b sin l, sin b) = (x + sunGCDist, y, z) / r,
+   the 1 / r cancels in the atan2, so the Sun centered position can be
+   rotated directly */
 real nbXYZToLambda(const NBHistTrig* ht, mwvector xyz, real sunGCDist)
 {
-    real bcos, bsin, lsin, lcos;
-    real lambda;
-    mwvector lbr;
-
-    real cosphi = ht->cosphi;
-    real sinphi = ht->sinphi;
-    real sinpsi = ht->sinpsi;
-    real cospsi = ht->cospsi;
-    real costh = ht->costh;
-    real sinth = ht->sinth;
-
-    /* Convert to (l,b) (involves convert x to Sun-centered)
-       Leave in radians to make rotation easier */
-    lbr = cartesianToLbr_rad(xyz, sunGCDist);
-
-    /* Convert to (lambda, beta) (involves a rotation using the
-       Newberg et al (2009) rotation matrices) */
-    bcos = mw_cos(B(lbr));
-    bsin = mw_sin(B(lbr));
-    lsin = mw_sin(L(lbr));
-    lcos = mw_cos(L(lbr));
-
-    lambda = r2d(mw_atan2(
-                      -(sinpsi * cosphi + costh * sinphi * cospsi) * bcos * lcos
-                     + (-sinpsi * sinphi + costh * cosphi * cospsi) * bcos * lsin
-                     + cospsi * sinth * bsin,
-
-                     (cospsi * cosphi - costh * sinphi * sinpsi) * bcos * lcos
-                     + (cospsi * sinphi + costh * cosphi * sinpsi) * bcos * lsin
-                     + sinpsi * sinth * bsin ));
-
-    return lambda;
+    const real xp = X(xyz) + sunGCDist;
+    const real c = ht->lambdaCos[0] * xp + ht->lambdaCos[1] * Y(xyz) + ht->lambdaCos[2] * Z(xyz);
+    const real s = ht->lambdaSin[0] * xp + ht->lambdaSin[1] * Y(xyz) + ht->lambdaSin[2] * Z(xyz);
+
+    return r2d(mw_atan2(s, c));
 }
 
+/* Both angles at once, for histograms binned in beta too */
+void nbXYZToLambdaBeta(const NBHistTrig* ht, mwvector xyz, real sunGCDist, real* lambda, real* beta)
+{
+    const real xp = X(xyz) + sunGCDist;
+    const real c = ht->lambdaCos[0] * xp + ht->lambdaCos[1] * Y(xyz) + ht->lambdaCos[2] * Z(xyz);
+    const real s = ht->lambdaSin[0] * xp + ht->lambdaSin[1] * Y(xyz) + ht->lambdaSin[2] * Z(xyz);
+    const real z = ht->beta[0] * xp + ht->beta[1] * Y(xyz) + ht->beta[2] * Z(xyz);
+
+    *lambda = r2d(mw_atan2(s, c));
+    *beta = r2d(mw_atan2(z, mw_sqrt(sqr(c) + sqr(s))));
+}
@@ -30,6 +30,7 @@ const NBodyCtx defaultNBodyCtx =
     /* .timeEvolve      */  0.0,
     /* .treeRSize       */  DEFAULT_TREE_ROOT_SIZE,
     /* .sunGCDist       */  DEFAULT_SUN_GC_DISTANCE,
+    /* .timestepEta     */  DEFAULT_TIMESTEP_ETA,
 
     /* .criterion       */  DEFAULT_CRITERION,
     /* .potentialType   */  EXTERNAL_POTENTIAL_DEFAULT,
@@ -38,6 +39,12 @@ const NBodyCtx defaultNBodyCtx =
     /* .useQuad         */  DEFAULT_USE_QUADRUPOLE_MOMENTS,
     /* .allowIncest     */  DEFAULT_ALLOW_INCEST,
     /* .quietErrors     */  DEFAULT_QUIET_ERRORS,
+    /* .parallelTree    */  DEFAULT_PARALLEL_TREE,
+    /* .bodySortInterval */ DEFAULT_BODY_SORT_INTERVAL,
+    /* .flatTree        */  DEFAULT_FLAT_TREE,
+    /* .groupSize       */  DEFAULT_GROUP_SIZE,
+    /* .treeRebuildInterval */ DEFAULT_TREE_REBUILD_INTERVAL,
+    /* .timestepLevels  */  DEFAULT_TIMESTEP_LEVELS,
 
 
     /* .checkpointT     */  NOBOINC_DEFAULT_CHECKPOINT_PERIOD,
@@ -54,7 +61,11 @@ const HistogramParams defaultHistogramParams =
     /* .startRaw */  histogramStartRaw,
     /* .endRaw   */  histogramEndRaw,
     /* .binSize  */  histogramBinSize,
-    /* .center   */  histogramCenter
+    /* .center   */  histogramCenter,
+    /* .beta     */  EMPTY_HISTOGRAM_AXIS,
+    /* .distance */  EMPTY_HISTOGRAM_AXIS,
+    /* .vlos     */  EMPTY_HISTOGRAM_AXIS,
+    /* .sparse   */  FALSE
 };
 
 
@@ -57,12 +57,19 @@
     ==========================================================================
 */
 
+#include "nbody_config.h"
 #include "milkyway_util.h"
 #include "nbody_emd.h"
 
+#if NBODY_EMD_DOUBLE
+typedef double emd_real;
+#else
+typedef float emd_real;
+#endif
+
 #define MAX_ITERATIONS 500
-#define EMD_INF   ((float)1.0e20)
-#define EMD_EPS   ((float)1.0e-5)
+#define EMD_INF   ((emd_real)1.0e20)
+#define EMD_EPS   ((emd_real)1.0e-5)
 #define EMD_INVALID NAN
 
 typedef enum
@@ -72,96 +79,151 @@ typedef enum
     EMD_DIST_C
 } EMDDistanceType;
 
-typedef float (*EMDDistanceFunction)(const float* a, const float* b, void* user_param);
-
-/* EMDNode1D is used for lists, representing 1D sparse array */
-typedef struct EMDNode1D
-{
-    float val;
-    struct EMDNode1D* next;
-} EMDNode1D;
+typedef emd_real (*EMDDistanceFunction)(const float* a, const float* b, void* user_param);
 
-/* EMDNode2D is used for lists, representing 2D sparse matrix */
-typedef struct EMDNode2D
+/* A basic variable of the transportation problem. They are kept in one
+   array, and each row and column is a list linked by index. */
+typedef struct
 {
-    float val;
-    struct EMDNode2D* next[2];  /* next row & next column */
+    emd_real val;
     int i, j;
-} EMDNode2D;
+    int next[2];  /* next in row & next in column, or -1 */
+} EMDBasic;
 
-
-typedef struct EMDState
+struct EMDWorkspace
 {
+    /* Largest signatures the buffers have room for */
+    unsigned int capacity1;
+    unsigned int capacity2;
+
     int ssize;
     int dsize;
 
-    float** cost;
-    EMDNode2D* _x;
-    EMDNode2D* end_x;
-    EMDNode2D* enter_x;
-    char** is_x;
+    /* ssize x dsize matrices, row major */
+    emd_real* cost;
+    char* is_x;
+    emd_real* delta;   /* russel buffer */
+
+    EMDBasic* x;
+    int end_x;     /* number of entries of x used */
+    int enter_x;
 
-    EMDNode2D** rows_x;
-    EMDNode2D** cols_x;
+    int* rows_x;   /* first basic variable in each row, or -1 */
+    int* cols_x;
 
-    EMDNode1D* u;
-    EMDNode1D* v;
+    /* Row and column values */
+    emd_real* u;
+    emd_real* v;
+
+    /* find_basic_variables buffers */
+    int* queue;
+    char* is_found;
 
     int* idx1;
     int* idx2;
 
     /* find_loop buffers */
-    EMDNode2D** loop;
+    int* loop;
     char* is_used;
 
     /* russel buffers */
-    float* s;
-    float* d;
-    float** delta;
+    emd_real* s;
+    emd_real* d;
+    int* active_rows;
+    int* active_cols;
+
+    emd_real weight, max_cost;
+};
 
-    float weight, max_cost;
-    char* buffer;
-} EMDState;
 
+static void emdFreeWorkspaceBuffers(EMDWorkspace* ws)
+{
+    free(ws->cost);
+    free(ws->is_x);
+    free(ws->delta);
+    free(ws->x);
+    free(ws->rows_x);
+    free(ws->cols_x);
+    free(ws->u);
+    free(ws->v);
+    free(ws->queue);
+    free(ws->is_found);
+    free(ws->idx1);
+    free(ws->idx2);
+    free(ws->loop);
+    free(ws->is_used);
+    free(ws->s);
+    free(ws->d);
+    free(ws->active_rows);
+    free(ws->active_cols);
+}
 
-/* static function declaration */
-static size_t emdAllocateStateBuffer(EMDState* state, int size1, int size2, int dims)
+/* Make sure the buffers fit signatures of the given sizes. There may
+ * be one more row or column than that for the dummy cluster. */
+static void emdReserveWorkspace(EMDWorkspace* ws, unsigned int size1, unsigned int size2)
 {
-    size_t bufferSize;
-
-    /* calculate buffer size */
-    bufferSize = (size1 + 1) * (size2 + 1) * (sizeof(float) +   /* cost */
-                 sizeof(char) +       /* is_x */
-                 sizeof(float)) +     /* delta matrix */
-                 (size1 + size2 + 2) * (sizeof(EMDNode2D) +   /* _x */
-                                        sizeof(EMDNode2D*) +  /* cols_x & rows_x */
-                                        sizeof(EMDNode1D) +   /* u & v */
-                                        sizeof(float) +      /* s & d */
-                                        sizeof(int) + sizeof(EMDNode2D*)) +    /* idx1 & idx2 */
-                 (size1 + 1) * (sizeof(float*) + sizeof(char*) +     /* rows pointers for */
-                                sizeof(float*)) + 256;               /*  cost, is_x and delta */
-
-    if (bufferSize < dims * 2 * sizeof(float))
+    size_t rows, cols;
+
+    if (ws->cost && size1 <= ws->capacity1 && size2 <= ws->capacity2)
     {
-        bufferSize = dims * 2 * sizeof(float);
+        return;
     }
 
+    emdFreeWorkspaceBuffers(ws);
+
+    ws->capacity1 = size1 > ws->capacity1 ? size1 : ws->capacity1;
+    ws->capacity2 = size2 > ws->capacity2 ? size2 : ws->capacity2;
+    rows = (size_t) ws->capacity1 + 1;
+    cols = (size_t) ws->capacity2 + 1;
+
+    ws->cost = (emd_real*) mwMalloc(rows * cols * sizeof(emd_real));
+    ws->is_x = (char*) mwMalloc(rows * cols * sizeof(char));
+    ws->delta = (emd_real*) mwMalloc(rows * cols * sizeof(emd_real));
+    ws->x = (EMDBasic*) mwMalloc((rows + cols) * sizeof(EMDBasic));
+    ws->rows_x = (int*) mwMalloc(rows * sizeof(int));
+    ws->cols_x = (int*) mwMalloc(cols * sizeof(int));
+    ws->u = (emd_real*) mwMalloc(rows * sizeof(emd_real));
+    ws->v = (emd_real*) mwMalloc(cols * sizeof(emd_real));
+    ws->queue = (int*) mwMalloc((rows + cols) * sizeof(int));
+    ws->is_found = (char*) mwMalloc((rows + cols) * sizeof(char));
+    ws->idx1 = (int*) mwMalloc(rows * sizeof(int));
+    ws->idx2 = (int*) mwMalloc(cols * sizeof(int));
+    ws->loop = (int*) mwMalloc((rows + cols) * sizeof(int));
+    ws->is_used = (char*) mwMalloc((rows + cols) * sizeof(char));
+    ws->s = (emd_real*) mwMalloc(rows * sizeof(emd_real));
+    ws->d = (emd_real*) mwMalloc(cols * sizeof(emd_real));
+    ws->active_rows = (int*) mwMalloc(rows * sizeof(int));
+    ws->active_cols = (int*) mwMalloc(cols * sizeof(int));
+}
+
+EMDWorkspace* emdCreateWorkspace(unsigned int size1, unsigned int size2)
+{
+    EMDWorkspace* ws = (EMDWorkspace*) mwCalloc(1, sizeof(EMDWorkspace));
 
-    state->buffer = mwCalloc(bufferSize, sizeof(char));
+    /* Nothing is allocated without a hint, so signatures which are
+     * solved in closed form never need the buffers */
+    if (size1 > 0 && size2 > 0)
+    {
+        emdReserveWorkspace(ws, size1, size2);
+    }
 
-    return bufferSize;
+    return ws;
 }
 
-static void emdReleaseEMD(EMDState* state)
+void emdDestroyWorkspace(EMDWorkspace* ws)
 {
-    free(state->buffer);
+    if (ws)
+    {
+        emdFreeWorkspaceBuffers(ws);
+        free(ws);
+    }
 }
 
 
 /****************************************************************************************\
 *                                  standard  metrics                                     *
 \****************************************************************************************/
-static float emdDistL1(const float* x, const float* y, void* user_param)
+static emd_real emdDistL1(const float* x, const float* y, void* user_param)
 {
     int i;
     int dims = (int)(size_t)user_param;
@@ -174,10 +236,10 @@ static float emdDistL1(const float* x, const float* y, void* user_param)
         s += fabs(t);
     }
 
-    return (float) s;
+    return (emd_real) s;
 }
 
-static float emdDistL2(const float* x, const float* y, void* user_param)
+static emd_real emdDistL2(const float* x, const float* y, void* user_param)
 {
     int i;
     int dims = (int)(size_t)user_param;
@@ -190,10 +252,14 @@ static float emdDistL2(const float* x, const float* y, void* user_param)
         s += t * t;
     }
 
+  #if NBODY_EMD_DOUBLE
+    return sqrt(s);
+  #else
     return sqrtf((float) s);
+  #endif
 }
 
-static float emdDistC(const float* x, const float* y, void* user_param)
+static emd_real emdDistC(const float* x, const float* y, void* user_param)
 {
     int i;
     int dims = (int)(size_t)user_param;
@@ -209,266 +275,189 @@ static float emdDistC(const float* x, const float* y, void* user_param)
         }
     }
 
-    return (float) s;
+    return (emd_real) s;
 }
 
-static int emdFindBasicVariables(float** cost, char** is_x,
-                                 EMDNode1D* u, EMDNode1D* v, int ssize, int dsize)
+/* Find the row and column values u[i] + v[j] = cost[i][j] of the basic
+ * variables. The basic variables form a tree, so each value can be
+ * found from the one before it by walking the basic variables in each
+ * row and column, starting from v[0] = 0. Returns -1 if the basis
+ * doesn't reach every row and column. */
+static int emdFindBasicVariables(EMDWorkspace* ws)
 {
-    int i, j, found;
-    int u_cfound, v_cfound;
-    EMDNode1D u0_head, u1_head, *cur_u, *prev_u;
-    EMDNode1D v0_head, v1_head, *cur_v, *prev_v;
-
-    /* initialize the rows list (u) and the columns list (v) */
-    u0_head.next = u;
-
-    for (i = 0; i < ssize; i++)
-    {
-        u[i].next = u + i + 1;
-    }
-
-    u[ssize - 1].next = 0;
-    u1_head.next = 0;
-
-    v0_head.next = ssize > 1 ? v + 1 : 0;
-
-    for (i = 1; i < dsize; i++)
-    {
-        v[i].next = v + i + 1;
-    }
-
-    v[dsize - 1].next = 0;
-    v1_head.next = 0;
+    int k, head, tail, cur;
+    const int ssize = ws->ssize;
+    const int dsize = ws->dsize;
+    const emd_real* cost = ws->cost;
+    const EMDBasic* x = ws->x;
+    emd_real* u = ws->u;
+    emd_real* v = ws->v;
+    int* queue = ws->queue;
+    char* is_found = ws->is_found;
+
+    /* rows are queued as i, and columns as ssize + j */
+    memset(is_found, 0, ssize + dsize);
 
     /* there are ssize+dsize variables but only ssize+dsize-1 independent equations,
        so set v[0]=0 */
-    v[0].val = 0;
-    v1_head.next = v;
-    v1_head.next->next = 0;
+    v[0] = 0;
+    is_found[ssize] = 1;
+    queue[0] = ssize;
+    head = 0;
+    tail = 1;
 
-    /* loop until all variables are found */
-    u_cfound = v_cfound = 0;
-
-    while (u_cfound < ssize || v_cfound < dsize)
+    while (head < tail)
     {
-        found = 0;
+        cur = queue[head++];
 
-        if (v_cfound < dsize)
+        if (cur >= ssize)
         {
-            /* loop over all marked columns */
-            prev_v = &v1_head;
+            /* find the rows of the variables in column j */
+            const int j = cur - ssize;
+            const emd_real cur_v_val = v[j];
 
-            for (found |= (cur_v = v1_head.next) != NULL; cur_v != NULL; cur_v = cur_v->next)
+            for (k = ws->cols_x[j]; k >= 0; k = x[k].next[1])
             {
-                float cur_v_val = cur_v->val;
-
-                j = (int)(cur_v - v);
-                /* find the variables in column j */
-                prev_u = &u0_head;
+                const int i = x[k].i;
 
-                for (cur_u = u0_head.next; cur_u != NULL;)
+                if (!is_found[i])
                 {
-                    i = (int)(cur_u - u);
-
-                    if (is_x[i][j])
-                    {
-                        /* compute u[i] */
-                        cur_u->val = cost[i][j] - cur_v_val;
-                        /* ...and add it to the marked list */
-                        prev_u->next = cur_u->next;
-                        cur_u->next = u1_head.next;
-                        u1_head.next = cur_u;
-                        cur_u = prev_u->next;
-                    }
-                    else
-                    {
-                        prev_u = cur_u;
-                        cur_u = cur_u->next;
-                    }
+                    u[i] = cost[i * dsize + j] - cur_v_val;
+                    is_found[i] = 1;
+                    queue[tail++] = i;
                 }
-
-                prev_v->next = cur_v->next;
-                v_cfound++;
             }
         }
-
-        if (u_cfound < ssize)
+        else
         {
-            /* loop over all marked rows */
-            prev_u = &u1_head;
+            /* find the columns of the variables in row i */
+            const int i = cur;
+            const emd_real cur_u_val = u[i];
 
-            for (found |= (cur_u = u1_head.next) != NULL; cur_u != NULL; cur_u = cur_u->next)
+            for (k = ws->rows_x[i]; k >= 0; k = x[k].next[0])
             {
-                float cur_u_val = cur_u->val;
-                float* _cost;
-                char* _is_x;
-
-                i = (int)(cur_u - u);
-                _cost = cost[i];
-                _is_x = is_x[i];
-                /* find the variables in rows i */
-                prev_v = &v0_head;
+                const int j = x[k].j;
 
-                for (cur_v = v0_head.next; cur_v != NULL;)
+                if (!is_found[ssize + j])
                 {
-                    j = (int)(cur_v - v);
-
-                    if (_is_x[j])
-                    {
-                        /* compute v[j] */
-                        cur_v->val = _cost[j] - cur_u_val;
-                        /* ...and add it to the marked list */
-                        prev_v->next = cur_v->next;
-                        cur_v->next = v1_head.next;
-                        v1_head.next = cur_v;
-                        cur_v = prev_v->next;
-                    }
-                    else
-                    {
-                        prev_v = cur_v;
-                        cur_v = cur_v->next;
-                    }
+                    v[j] = cost[i * dsize + j] - cur_u_val;
+                    is_found[ssize + j] = 1;
+                    queue[tail++] = ssize + j;
                 }
-
-                prev_u->next = cur_u->next;
-                u_cfound++;
             }
         }
-
-        if (!found)
-        {
-            return -1;
-        }
     }
 
-    return 0;
+    return tail == ssize + dsize ? 0 : -1;
+}
+
+/* Remove entry k from a list of n, keeping the order of the rest */
+static void emdRemoveActive(int* list, int n, int k)
+{
+    memmove(&list[k], &list[k + 1], (size_t) (n - k - 1) * sizeof(int));
 }
 
-static void emdAddBasicVariable(EMDState* state,
-                                int min_i, int min_j,
-                                EMDNode1D* prev_u_min_i, EMDNode1D* prev_v_min_j, EMDNode1D* u_head)
+/* Add x(min_i,min_j) to the basis. Returns TRUE if the supply row was
+   taken out of the active rows, and FALSE for the demand column */
+static mwbool emdAddBasicVariable(EMDWorkspace* ws, int min_i, int min_j, int nRows)
 {
-    float temp;
-    EMDNode2D* end_x = state->end_x;
+    emd_real temp;
+    EMDBasic* x = &ws->x[ws->end_x];
 
-    if (state->s[min_i] < state->d[min_j] + state->weight * EMD_EPS)
+    if (ws->s[min_i] < ws->d[min_j] + ws->weight * EMD_EPS)
     {
         /* supply exhausted */
-        temp = state->s[min_i];
-        state->s[min_i] = 0;
-        state->d[min_j] -= temp;
+        temp = ws->s[min_i];
+        ws->s[min_i] = 0;
+        ws->d[min_j] -= temp;
     }
     else                        /* demand exhausted */
     {
-        temp = state->d[min_j];
-        state->d[min_j] = 0;
-        state->s[min_i] -= temp;
+        temp = ws->d[min_j];
+        ws->d[min_j] = 0;
+        ws->s[min_i] -= temp;
     }
 
     /* x(min_i,min_j) is a basic variable */
-    state->is_x[min_i][min_j] = 1;
+    ws->is_x[min_i * ws->dsize + min_j] = 1;
 
-    end_x->val = temp;
-    end_x->i = min_i;
-    end_x->j = min_j;
-    end_x->next[0] = state->rows_x[min_i];
-    end_x->next[1] = state->cols_x[min_j];
-    state->rows_x[min_i] = end_x;
-    state->cols_x[min_j] = end_x;
-    state->end_x = end_x + 1;
+    x->val = temp;
+    x->i = min_i;
+    x->j = min_j;
+    x->next[0] = ws->rows_x[min_i];
+    x->next[1] = ws->cols_x[min_j];
+    ws->rows_x[min_i] = ws->end_x;
+    ws->cols_x[min_j] = ws->end_x;
+    ws->end_x++;
 
     /* delete supply row only if the empty, and if not last row */
-    if (state->s[min_i] == 0.0 && u_head->next->next != NULL)
-    {
-        prev_u_min_i->next = prev_u_min_i->next->next;    /* remove row from list */
-    }
-    else
-    {
-        prev_v_min_j->next = prev_v_min_j->next->next;    /* remove column from list */
-    }
+    return ws->s[min_i] == 0.0 && nRows > 1;
 }
 
-static void emdRussel(EMDState* state)
+static void emdRussel(EMDWorkspace* ws)
 {
-    int i, j, min_i = -1, min_j = -1;
-    float min_delta, diff;
-
-    EMDNode1D u_head;
-    EMDNode1D* cur_u;
-    EMDNode1D* prev_u;
-
-    EMDNode1D v_head;
-    EMDNode1D* cur_v;
-    EMDNode1D* prev_v;
-
-    EMDNode1D* prev_u_min_i = NULL;
-    EMDNode1D* prev_v_min_j = NULL;
-    EMDNode1D* remember;
-
-    EMDNode1D* u = state->u;
-    EMDNode1D* v = state->v;
-
-    int ssize = state->ssize;
-    int dsize = state->dsize;
-    float eps = EMD_EPS * state->max_cost;
-    float** cost = state->cost;
-    float** delta = state->delta;
-
-    /* initialize the rows list (ur), and the columns list (vr) */
-    u_head.next = u;
+    int i, j, k, l, min_i = -1, min_j = -1, min_k = -1, min_l = -1;
+    emd_real min_delta, diff;
+
+    const int ssize = ws->ssize;
+    const int dsize = ws->dsize;
+    const emd_real eps = EMD_EPS * ws->max_cost;
+    const emd_real* cost = ws->cost;
+    emd_real* delta = ws->delta;
+    emd_real* u = ws->u;
+    emd_real* v = ws->v;
+
+    /* rows and columns still in the problem, in their original order */
+    int* rows = ws->active_rows;
+    int* cols = ws->active_cols;
+    int nRows = ssize;
+    int nCols = dsize;
 
     for (i = 0; i < ssize; i++)
     {
-        u[i].next = u + i + 1;
+        rows[i] = i;
     }
 
-    u[ssize - 1].next = 0;
-
-    v_head.next = v;
-
-    for (i = 0; i < dsize; i++)
+    for (j = 0; j < dsize; j++)
     {
-        v[i].val = -EMD_INF;
-        v[i].next = v + i + 1;
+        v[j] = -EMD_INF;
+        cols[j] = j;
     }
 
-    v[dsize - 1].next = 0;
-
     /* find the maximum row and column values (ur[i] and vr[j]) */
     for (i = 0; i < ssize; i++)
     {
-        float u_val = -EMD_INF;
-        float* cost_row = cost[i];
+        emd_real u_val = -EMD_INF;
+        const emd_real* cost_row = &cost[i * dsize];
 
         for (j = 0; j < dsize; j++)
         {
-            float temp = cost_row[j];
+            emd_real temp = cost_row[j];
 
             if (u_val < temp)
             {
                 u_val = temp;
             }
 
-            if (v[j].val < temp)
+            if (v[j] < temp)
             {
-                v[j].val = temp;
+                v[j] = temp;
             }
         }
 
-        u[i].val = u_val;
+        u[i] = u_val;
     }
 
     /* compute the delta matrix */
     for (i = 0; i < ssize; i++)
     {
-        float u_val = u[i].val;
-        float* delta_row = delta[i];
-        float* cost_row = cost[i];
+        emd_real u_val = u[i];
+        emd_real* delta_row = &delta[i * dsize];
+        const emd_real* cost_row = &cost[i * dsize];
 
         for (j = 0; j < dsize; j++)
         {
-            delta_row[j] = cost_row[j] - u_val - v[j].val;
+            delta_row[j] = cost_row[j] - u_val - v[j];
         }
     }
 
@@ -478,34 +467,21 @@ static void emdRussel(EMDState* state)
         /* find the smallest delta[i][j] */
         min_i = -1;
         min_delta = EMD_INF;
-        prev_u = &u_head;
 
-        for (cur_u = u_head.next; cur_u != NULL; cur_u = cur_u->next)
+        for (k = 0; k < nRows; k++)
         {
-            float* delta_row;
+            const emd_real* delta_row = &delta[rows[k] * dsize];
 
-            i = (int)(cur_u - u);
-            delta_row = delta[i];
-
-            prev_v = &v_head;
-
-            for (cur_v = v_head.next; cur_v != NULL; cur_v = cur_v->next)
+            for (l = 0; l < nCols; l++)
             {
-                j = (int)(cur_v - v);
-
-                if (min_delta > delta_row[j])
+                if (min_delta > delta_row[cols[l]])
                 {
-                    min_delta = delta_row[j];
-                    min_i = i;
-                    min_j = j;
-                    prev_u_min_i = prev_u;
-                    prev_v_min_j = prev_v;
+                    min_delta = delta_row[cols[l]];
+                    min_k = k;
+                    min_l = l;
+                    min_i = rows[k];
                 }
-
-                prev_v = cur_v;
             }
-
-            prev_u = cur_u;
         }
 
         if (min_i < 0)
@@ -513,25 +489,26 @@ static void emdRussel(EMDState* state)
             break;
         }
 
-        /* add x[min_i][min_j] to the basis, and adjust supplies and cost */
-        remember = prev_u_min_i->next;
-        emdAddBasicVariable(state, min_i, min_j, prev_u_min_i, prev_v_min_j, &u_head);
+        min_j = cols[min_l];
 
-        /* update the necessary delta[][] */
-        if (remember == prev_u_min_i->next)    /* line min_i was deleted */
+        /* add x[min_i][min_j] to the basis, and adjust supplies and cost */
+        if (emdAddBasicVariable(ws, min_i, min_j, nRows))
         {
-            for (cur_v = v_head.next; cur_v != NULL; cur_v = cur_v->next)
+            emdRemoveActive(rows, nRows--, min_k);
+
+            /* update the necessary delta[][] */
+            for (i = 0; i < nRows; i++)
             {
-                j = (int)(cur_v - v);
+                const int r = rows[i];
 
-                if (cur_v->val == cost[min_i][j])      /* column j needs updating */
+                if (u[r] == cost[r * dsize + min_j])      /* row r needs updating */
                 {
-                    float max_val = -EMD_INF;
+                    emd_real max_val = -EMD_INF;
 
-                    /* find the new maximum value in the column */
-                    for (cur_u = u_head.next; cur_u != NULL; cur_u = cur_u->next)
+                    /* find the new maximum value in the row */
+                    for (l = 0; l < nCols; l++)
                     {
-                        float temp = cost[cur_u - u][j];
+                        emd_real temp = cost[r * dsize + cols[l]];
 
                         if (max_val < temp)
                         {
@@ -539,34 +516,36 @@ static void emdRussel(EMDState* state)
                         }
                     }
 
-                    /* if needed, adjust the relevant delta[*][j] */
-                    diff = max_val - cur_v->val;
-                    cur_v->val = max_val;
+                    /* if needed, adjust the relevant delta[r][*] */
+                    diff = max_val - u[r];
+                    u[r] = max_val;
 
                     if (fabs(diff) < eps)
                     {
-                        for (cur_u = u_head.next; cur_u != NULL; cur_u = cur_u->next)
+                        for (l = 0; l < nCols; l++)
                         {
-                            delta[cur_u - u][j] += diff;
+                            delta[r * dsize + cols[l]] += diff;
                         }
                     }
                 }
             }
         }
-        else                    /* column min_j was deleted */
+        else
         {
-            for (cur_u = u_head.next; cur_u != NULL; cur_u = cur_u->next)
+            emdRemoveActive(cols, nCols--, min_l);
+
+            for (j = 0; j < nCols; j++)
             {
-                i = (int)(cur_u - u);
+                const int c = cols[j];
 
-                if (cur_u->val == cost[i][min_j])      /* row i needs updating */
+                if (v[c] == cost[min_i * dsize + c])      /* column c needs updating */
                 {
-                    float max_val = -EMD_INF;
+                    emd_real max_val = -EMD_INF;
 
-                    /* find the new maximum value in the row */
-                    for (cur_v = v_head.next; cur_v != NULL; cur_v = cur_v->next)
+                    /* find the new maximum value in the column */
+                    for (k = 0; k < nRows; k++)
                     {
-                        float temp = cost[i][cur_v - v];
+                        emd_real temp = cost[rows[k] * dsize + c];
 
                         if (max_val < temp)
                         {
@@ -574,73 +553,52 @@ static void emdRussel(EMDState* state)
                         }
                     }
 
-                    /* if needed, adjust the relevant delta[i][*] */
-                    diff = max_val - cur_u->val;
-                    cur_u->val = max_val;
+                    /* if needed, adjust the relevant delta[*][c] */
+                    diff = max_val - v[c];
+                    v[c] = max_val;
 
                     if (fabs(diff) < eps)
                     {
-                        for (cur_v = v_head.next; cur_v != NULL; cur_v = cur_v->next)
+                        for (k = 0; k < nRows; k++)
                         {
-                            delta[i][cur_v - v] += diff;
+                            delta[rows[k] * dsize + c] += diff;
                         }
                     }
                 }
             }
         }
     }
-    while (u_head.next != NULL || v_head.next != NULL);
+    while (nRows > 0 || nCols > 0);
 }
 
 /************************************************************************************\
-*          initialize structure, allocate buffers and generate initial golution      *
+*          initialize structure and generate initial solution                        *
 \************************************************************************************/
-static int emdInitEMD(const float* signature1, int size1,
+static int emdInitEMD(EMDWorkspace* ws,
+                      const float* signature1, int size1,
                       const float* signature2, int size2,
                       int dims, EMDDistanceFunction dist_func, void* user_param,
-                      const float* cost, int cost_step,
-                      EMDState* state, float* lower_bound)
+                      float* lower_bound)
 {
-    float s_sum = 0.0, d_sum = 0.0, diff;
+    emd_real s_sum = 0.0, d_sum = 0.0, diff;
     int i, j;
     int ssize = 0;
     int dsize = 0;
     int equal_sums = 1;
-    size_t buffer_size;
-    float max_cost = 0.0;
-    char* buffer;
-    char* buffer_end;
-
-    memset(state, 0, sizeof(*state));
-    assert(cost_step % sizeof(float) == 0);
-    cost_step /= sizeof(float);
-
-    buffer_size = emdAllocateStateBuffer(state, size1, size2, dims);
-    buffer = state->buffer;
-    buffer_end = buffer + buffer_size;
-
-    state->idx1 = (int*) buffer;
-    buffer += (size1 + 1) * sizeof(int);
-
-    state->idx2 = (int*) buffer;
-    buffer += (size2 + 1) * sizeof(int);
-
-    state->s = (float*) buffer;
-    buffer += (size1 + 1) * sizeof(float);
+    emd_real max_cost = 0.0;
 
-    state->d = (float*) buffer;
-    buffer += (size2 + 1) * sizeof(float);
+    emdReserveWorkspace(ws, size1, size2);
 
     /* sum up the supply and demand */
     for (i = 0; i < size1; i++)
     {
-        float weight = signature1[i * (dims + 1)];
+        emd_real weight = signature1[i * (dims + 1)];
 
         if (weight > 0.0)
         {
             s_sum += weight;
-            state->s[ssize] = weight;
-            state->idx1[ssize++] = i;
+            ws->s[ssize] = weight;
+            ws->idx1[ssize++] = i;
 
         }
         else if (weight < 0.0)
@@ -652,13 +610,13 @@ static int emdInitEMD(const float* signature1, int size1,
 
     for (i = 0; i < size2; i++)
     {
-        float weight = signature2[i * (dims + 1)];
+        emd_real weight = signature2[i * (dims + 1)];
 
         if (weight > 0.0)
         {
             d_sum += weight;
-            state->d[dsize] = weight;
-            state->idx2[dsize++] = i;
+            ws->d[dsize] = weight;
+            ws->idx2[dsize++] = i;
         }
         else if (weight < 0.0)
         {
@@ -682,19 +640,19 @@ static int emdInitEMD(const float* signature1, int size1,
 
         if (diff < 0)
         {
-            state->s[ssize] = -diff;
-            state->idx1[ssize++] = -1;
+            ws->s[ssize] = -diff;
+            ws->idx1[ssize++] = -1;
         }
         else
         {
-            state->d[dsize] = diff;
-            state->idx2[dsize++] = -1;
+            ws->d[dsize] = diff;
+            ws->idx2[dsize++] = -1;
         }
     }
 
-    state->ssize = ssize;
-    state->dsize = dsize;
-    state->weight = s_sum > d_sum ? s_sum : d_sum;
+    ws->ssize = ssize;
+    ws->dsize = dsize;
+    ws->weight = s_sum > d_sum ? s_sum : d_sum;
 
     if (lower_bound && equal_sums)     /* check lower bound */
     {
@@ -702,12 +660,9 @@ static int emdInitEMD(const float* signature1, int size1,
         int sz2 = size2 * (dims + 1);
         float lb = 0.0;
 
-        float* xs = (float*) buffer;
+        float* xs = (float*) mwCalloc(2 * dims, sizeof(float));
         float* xd = xs + dims;
 
-        memset(xs, 0, dims * sizeof(xs[0]));
-        memset(xd, 0, dims * sizeof(xd[0]));
-
         for (j = 0; j < sz1; j += dims + 1)
         {
             float weight = signature1[j];
@@ -728,7 +683,8 @@ static int emdInitEMD(const float* signature1, int size1,
             }
         }
 
-        lb = dist_func(xs, xd, user_param) / state->weight;
+        lb = (float) (dist_func(xs, xd, user_param) / ws->weight);
+        free(xs);
         i = *lower_bound <= lb;
         *lower_bound = lb;
 
@@ -738,63 +694,29 @@ static int emdInitEMD(const float* signature1, int size1,
         }
     }
 
-    /* assign pointers */
-    state->is_used = (char*) buffer;
-    /* init delta matrix */
-    state->delta = (float**) buffer;
-    buffer += ssize * sizeof(float*);
-
-    for (i = 0; i < ssize; i++)
-    {
-        state->delta[i] = (float*) buffer;
-        buffer += dsize * sizeof(float);
-    }
-
-    state->loop = (EMDNode2D**) buffer;
-    buffer += (ssize + dsize + 1) * sizeof(EMDNode2D*);
-
-    state->_x = state->end_x = (EMDNode2D*) buffer;
-    buffer += (ssize + dsize) * sizeof(EMDNode2D);
-
-    /* init cost matrix */
-    state->cost = (float**) buffer;
-    buffer += ssize * sizeof(float*);
-
     /* compute the distance matrix */
     for (i = 0; i < ssize; i++)
     {
-        int ci = state->idx1[i];
-
-        state->cost[i] = (float*) buffer;
-        buffer += dsize * sizeof(float);
+        int ci = ws->idx1[i];
+        emd_real* cost_row = &ws->cost[i * dsize];
 
         if (ci >= 0)
         {
             for (j = 0; j < dsize; j++)
             {
-                int cj = state->idx2[j];
+                int cj = ws->idx2[j];
 
                 if (cj < 0)
                 {
-                    state->cost[i][j] = 0;
+                    cost_row[j] = 0;
                 }
                 else
                 {
-                    float val;
-
-                    if (dist_func)
-                    {
-                        val = dist_func(signature1 + ci * (dims + 1) + 1,
-                                        signature2 + cj * (dims + 1) + 1,
-                                        user_param);
-                    }
-                    else
-                    {
-                        assert(cost);
-                        val = cost[cost_step * ci + cj];
-                    }
+                    emd_real val = dist_func(signature1 + ci * (dims + 1) + 1,
+                                             signature2 + cj * (dims + 1) + 1,
+                                             user_param);
 
-                    state->cost[i][j] = val;
+                    cost_row[j] = val;
 
                     if (max_cost < val)
                     {
@@ -807,65 +729,58 @@ static int emdInitEMD(const float* signature1, int size1,
         {
             for (j = 0; j < dsize; j++)
             {
-                state->cost[i][j] = 0;
+                cost_row[j] = 0;
             }
         }
     }
 
-    state->max_cost = max_cost;
-
-    memset(buffer, 0, buffer_end - buffer);
-
-    state->rows_x = (EMDNode2D**) buffer;
-    buffer += ssize * sizeof(EMDNode2D*);
+    ws->max_cost = max_cost;
 
-    state->cols_x = (EMDNode2D**) buffer;
-    buffer += dsize * sizeof(EMDNode2D*);
-
-    state->u = (EMDNode1D*) buffer;
-    buffer += ssize * sizeof(EMDNode1D);
-
-    state->v = (EMDNode1D*) buffer;
-    buffer += dsize * sizeof(EMDNode1D);
-
-    /* init is_x matrix */
-    state->is_x = (char**) buffer;
-    buffer += ssize * sizeof(char*);
+    memset(ws->is_x, 0, (size_t) ssize * dsize * sizeof(char));
+    memset(ws->x, 0, (size_t) (ssize + dsize) * sizeof(EMDBasic));
 
     for (i = 0; i < ssize; i++)
     {
-        state->is_x[i] = buffer;
-        buffer += dsize;
+        ws->rows_x[i] = -1;
+        ws->u[i] = 0;
+    }
+
+    for (j = 0; j < dsize; j++)
+    {
+        ws->cols_x[j] = -1;
+        ws->v[j] = 0;
     }
 
-    assert(buffer <= buffer_end);
+    ws->end_x = 0;
 
-    emdRussel(state);
+    emdRussel(ws);
 
-    state->enter_x = (state->end_x)++;
+    ws->enter_x = (ws->end_x)++;
     return 0;
 }
 
-static float emdIsOptimal(float** cost, char** is_x,
-                          EMDNode1D* u, EMDNode1D* v, int ssize, int dsize, EMDNode2D* enter_x)
+static emd_real emdIsOptimal(EMDWorkspace* ws)
 {
-    float delta, min_delta = EMD_INF;
+    emd_real delta, min_delta = EMD_INF;
     int i, j;
     int min_i = 0;
     int min_j = 0;
+    const int ssize = ws->ssize;
+    const int dsize = ws->dsize;
+    const emd_real* v = ws->v;
 
     /* find the minimal cij-ui-vj over all i,j */
     for (i = 0; i < ssize; i++)
     {
-        float u_val = u[i].val;
-        float* _cost = cost[i];
-        char* _is_x = is_x[i];
+        emd_real u_val = ws->u[i];
+        const emd_real* _cost = &ws->cost[i * dsize];
+        const char* _is_x = &ws->is_x[i * dsize];
 
         for (j = 0; j < dsize; j++)
         {
             if (!_is_x[j])
             {
-                delta = _cost[j] - u_val - v[j].val;
+                delta = _cost[j] - u_val - v[j];
 
                 if (min_delta > delta)
                 {
@@ -877,26 +792,26 @@ static float emdIsOptimal(float** cost, char** is_x,
         }
     }
 
-    enter_x->i = min_i;
-    enter_x->j = min_j;
+    ws->x[ws->enter_x].i = min_i;
+    ws->x[ws->enter_x].j = min_j;
 
     return min_delta;
 }
 
-static int emdFindLoop(EMDState* state)
+static int emdFindLoop(EMDWorkspace* ws)
 {
     int i;
     int steps = 1;
-    EMDNode2D* new_x;
-    EMDNode2D** loop = state->loop;
-    EMDNode2D* enter_x = state->enter_x;
-    EMDNode2D* _x = state->_x;
-    char* is_used = state->is_used;
+    int new_x;
+    int* loop = ws->loop;
+    const int enter_x = ws->enter_x;
+    const EMDBasic* x = ws->x;
+    char* is_used = ws->is_used;
 
-    memset(is_used, 0, state->ssize + state->dsize);
+    memset(is_used, 0, ws->ssize + ws->dsize);
 
     new_x = loop[0] = enter_x;
-    is_used[enter_x - _x] = 1;
+    is_used[enter_x] = 1;
     steps = 1;
 
     do
@@ -904,21 +819,21 @@ static int emdFindLoop(EMDState* state)
         if ((steps & 1) == 1)
         {
             /* find an unused x in the row */
-            new_x = state->rows_x[new_x->i];
+            new_x = ws->rows_x[x[new_x].i];
 
-            while (new_x != NULL && is_used[new_x - _x])
+            while (new_x >= 0 && is_used[new_x])
             {
-                new_x = new_x->next[0];
+                new_x = x[new_x].next[0];
             }
         }
         else
         {
             /* find an unused x in the column, or the entering x */
-            new_x = state->cols_x[new_x->j];
+            new_x = ws->cols_x[x[new_x].j];
 
-            while (new_x != NULL && is_used[new_x - _x] && new_x != enter_x)
+            while (new_x >= 0 && is_used[new_x] && new_x != enter_x)
             {
-                new_x = new_x->next[1];
+                new_x = x[new_x].next[1];
             }
 
             if (new_x == enter_x)
@@ -927,11 +842,11 @@ static int emdFindLoop(EMDState* state)
             }
         }
 
-        if (new_x != NULL)        /* found the next x */
+        if (new_x >= 0)        /* found the next x */
         {
             /* add x to the loop */
             loop[steps++] = new_x;
-            is_used[new_x - _x] = 1;
+            is_used[new_x] = 1;
         }
         else                    /* didn't find the next x */
         {
@@ -943,20 +858,25 @@ static int emdFindLoop(EMDState* state)
 
                 do
                 {
-                    new_x = new_x->next[i];
+                    new_x = x[new_x].next[i];
                 }
-                while (new_x != NULL && is_used[new_x - _x]);
+                while (new_x >= 0 && is_used[new_x]);
 
-                if (new_x == NULL)
+                if (new_x < 0)
                 {
-                    is_used[loop[--steps] - _x] = 0;
+                    is_used[loop[--steps]] = 0;
                 }
             }
-            while (new_x == NULL && steps > 0);
+            while (new_x < 0 && steps > 0);
 
-            is_used[loop[steps - 1] - _x] = 0;
+            if (steps == 0)
+            {
+                break;
+            }
+
+            is_used[loop[steps - 1]] = 0;
             loop[steps - 1] = new_x;
-            is_used[new_x - _x] = 1;
+            is_used[new_x] = 1;
         }
     }
     while (steps > 0);
@@ -964,30 +884,29 @@ static int emdFindLoop(EMDState* state)
     return steps;
 }
 
-static mwbool emdNewSolution(EMDState* state)
+static mwbool emdNewSolution(EMDWorkspace* ws)
 {
     int i, j;
-    float min_val = EMD_INF;
+    emd_real min_val = EMD_INF;
     int steps;
-    EMDNode2D head;
-    EMDNode2D* cur_x;
-    EMDNode2D* next_x;
-    EMDNode2D* leave_x = NULL;
-    EMDNode2D* enter_x = state->enter_x;
-    EMDNode2D** loop = state->loop;
+    int* prev;
+    int leave_x = -1;
+    const int enter_x = ws->enter_x;
+    const int* loop = ws->loop;
+    EMDBasic* x = ws->x;
 
     /* enter the new basic variable */
-    i = enter_x->i;
-    j = enter_x->j;
-    state->is_x[i][j] = 1;
-    enter_x->next[0] = state->rows_x[i];
-    enter_x->next[1] = state->cols_x[j];
-    enter_x->val = 0;
-    state->rows_x[i] = enter_x;
-    state->cols_x[j] = enter_x;
+    i = x[enter_x].i;
+    j = x[enter_x].j;
+    ws->is_x[i * ws->dsize + j] = 1;
+    x[enter_x].next[0] = ws->rows_x[i];
+    x[enter_x].next[1] = ws->cols_x[j];
+    x[enter_x].val = 0;
+    ws->rows_x[i] = enter_x;
+    ws->cols_x[j] = enter_x;
 
     /* find a chain reaction */
-    steps = emdFindLoop(state);
+    steps = emdFindLoop(ws);
 
     if (steps == 0)
     {
@@ -997,7 +916,7 @@ static mwbool emdNewSolution(EMDState* state)
     /* find the largest value in the loop */
     for (i = 1; i < steps; i += 2)
     {
-        float temp = loop[i]->val;
+        emd_real temp = x[loop[i]].val;
 
         if (min_val > temp)
         {
@@ -1006,7 +925,7 @@ static mwbool emdNewSolution(EMDState* state)
         }
     }
 
-    if (!leave_x)
+    if (leave_x < 0)
     {
         return FALSE;
     }
@@ -1014,73 +933,66 @@ static mwbool emdNewSolution(EMDState* state)
     /* update the loop */
     for (i = 0; i < steps; i += 2)
     {
-        float temp0 = loop[i]->val + min_val;
-        float temp1 = loop[i + 1]->val - min_val;
+        emd_real temp0 = x[loop[i]].val + min_val;
+        emd_real temp1 = x[loop[i + 1]].val - min_val;
 
-        loop[i]->val = temp0;
-        loop[i + 1]->val = temp1;
+        x[loop[i]].val = temp0;
+        x[loop[i + 1]].val = temp1;
     }
 
     /* remove the leaving basic variable */
-    i = leave_x->i;
-    j = leave_x->j;
-    state->is_x[i][j] = 0;
+    i = x[leave_x].i;
+    j = x[leave_x].j;
+    ws->is_x[i * ws->dsize + j] = 0;
 
-    head.next[0] = state->rows_x[i];
-    cur_x = &head;
+    prev = &ws->rows_x[i];
 
-    while ((next_x = cur_x->next[0]) != leave_x)
+    while (*prev != leave_x)
     {
-        cur_x = next_x;
-        assert(cur_x);
+        assert(*prev >= 0);
+        prev = &x[*prev].next[0];
     }
 
-    cur_x->next[0] = next_x->next[0];
-    state->rows_x[i] = head.next[0];
+    *prev = x[leave_x].next[0];
 
-    head.next[1] = state->cols_x[j];
-    cur_x = &head;
+    prev = &ws->cols_x[j];
 
-    while ((next_x = cur_x->next[1]) != leave_x)
+    while (*prev != leave_x)
     {
-        cur_x = next_x;
-        assert(cur_x);
+        assert(*prev >= 0);
+        prev = &x[*prev].next[1];
     }
 
-    cur_x->next[1] = next_x->next[1];
-    state->cols_x[j] = head.next[1];
+    *prev = x[leave_x].next[1];
 
     /* set enter_x to be the new empty slot */
-    state->enter_x = leave_x;
+    ws->enter_x = leave_x;
 
     return TRUE;
 }
 
-static int emdIterateSolution(EMDState* state)
+static int emdIterateSolution(EMDWorkspace* ws)
 {
     int result;
-    float min_delta;
-    float eps = EMD_EPS * state->max_cost;
+    emd_real min_delta;
+    emd_real eps = EMD_EPS * ws->max_cost;
 
     /* if ssize = 1 or dsize = 1 then we are done, else ... */
-    if (state->ssize > 1 && state->dsize > 1)
+    if (ws->ssize > 1 && ws->dsize > 1)
     {
         int itr;
 
         for (itr = 1; itr < MAX_ITERATIONS; itr++)
         {
             /* find basic variables */
-            result = emdFindBasicVariables(state->cost, state->is_x,
-                                           state->u, state->v, state->ssize, state->dsize);
+            result = emdFindBasicVariables(ws);
             if (result < 0)
             {
                 break;
             }
 
             /* check for optimality */
-            min_delta = emdIsOptimal(state->cost, state->is_x,
-                                     state->u, state->v,
-                                     state->ssize, state->dsize, state->enter_x);
+            min_delta = emdIsOptimal(ws);
 
             if (min_delta == EMD_INF)
             {
@@ -1095,7 +1007,7 @@ static int emdIterateSolution(EMDState* state)
             }
 
             /* improve solution */
-            if (!emdNewSolution(state))
+            if (!emdNewSolution(ws))
             {
                 mw_printf("Iteration didn't converge");
                 return 1;
@@ -1148,34 +1060,32 @@ static EMDDistanceFunction nbMetricDistanceFunction(EMDDistanceType distType)
     }
 }
 
-static double emdComputeTotalFlow(EMDState* state, float* flow)
+static double emdComputeTotalFlow(EMDWorkspace* ws, float* flow)
 {
-    EMDNode2D* xp = NULL;
+    int k;
     double totalCost = 0.0;
     const int flowStep = 1;
 
-    for (xp = state->_x; xp < state->end_x; xp++)
+    for (k = 0; k < ws->end_x; k++)
     {
         int ci, cj;
-        float val = xp->val;
-        int i = xp->i;
-        int j = xp->j;
+        const EMDBasic* xp = &ws->x[k];
 
-        if (xp == state->enter_x)
+        if (k == ws->enter_x)
         {
             continue;
         }
 
-        ci = state->idx1[i];
-        cj = state->idx2[j];
+        ci = ws->idx1[xp->i];
+        cj = ws->idx2[xp->j];
 
         if (ci >= 0 && cj >= 0)
         {
-            totalCost += (double) val * state->cost[i][j];
+            totalCost += (double) xp->val * ws->cost[xp->i * ws->dsize + xp->j];
 
             if (flow)
             {
-                flow[flowStep * ci + cj] = val;
+                flow[flowStep * ci + cj] = (float) xp->val;
             }
         }
     }
@@ -1183,14 +1093,145 @@ static double emdComputeTotalFlow(EMDState* state, float* flow)
     return totalCost;
 }
 
-/* The main function */
-float emdCalc(const float* RESTRICT signature_arr1,
-              const float* RESTRICT signature_arr2,
-              unsigned int size1,
-              unsigned int size2,
-              float* RESTRICT lower_bound)
+/* Find the one coordinate the positions of both signatures vary in.
+ * Returns FALSE if they vary in more than one. */
+static int emdFindVaryingAxis(const float* signature1,
+                              const float* signature2,
+                              unsigned int size1,
+                              unsigned int size2,
+                              int dims,
+                              int* axis)
+{
+    int k;
+    unsigned int i;
+    int varying = -1;
+    const float* first = signature1 + 1;
+
+    for (k = 0; k < dims; ++k)
+    {
+        for (i = 0; i < size1 + size2; ++i)
+        {
+            const float* p = (i < size1) ? &signature1[i * (dims + 1) + 1]
+                                         : &signature2[(i - size1) * (dims + 1) + 1];
+            if (p[k] < first[k] || p[k] > first[k])
+            {
+                break;
+            }
+        }
+
+        if (i < size1 + size2)
+        {
+            if (varying >= 0)
+            {
+                return FALSE;
+            }
+
+            varying = k;
+        }
+    }
+
+    *axis = varying >= 0 ? varying : 0;
+    return TRUE;
+}
+
+/* Signatures along a single axis with the same total weight need no
+   transportation problem. The EMD is then the area between their
+   cumulative distributions, which can be found by merging the two in
+   order of position. Each is normalized by its own total, so rounding
+   in totals the solver would treat as equal doesn't pile up over the
+   trailing bins. Gives up with FALSE if the positions aren't in order
+   or the totals differ, since then the excess goes to a free dummy
+   bin. */
+static int emdCalc1D(const float* RESTRICT signature1,
+                     const float* RESTRICT signature2,
+                     unsigned int size1,
+                     unsigned int size2,
+                     int dims,
+                     int axis,
+                     float* emd)
+{
+    unsigned int i, j;
+    const int stride = dims + 1;
+    const float* w1 = signature1;
+    const float* w2 = signature2;
+    const float* x1 = signature1 + 1 + axis;
+    const float* x2 = signature2 + 1 + axis;
+    double s_sum = 0.0, d_sum = 0.0;
+    double cdf = 0.0;
+    double totalCost = 0.0;
+    double x, prev;
+
+    for (i = 0; i < size1; ++i)
+    {
+        if (w1[i * stride] < 0.0f || (i > 0 && x1[i * stride] < x1[(i - 1) * stride]))
+            return FALSE;
+        s_sum += (double) w1[i * stride];
+    }
+
+    for (j = 0; j < size2; ++j)
+    {
+        if (w2[j * stride] < 0.0f || (j > 0 && x2[j * stride] < x2[(j - 1) * stride]))
+            return FALSE;
+        d_sum += (double) w2[j * stride];
+    }
+
+    if (s_sum <= 0.0 || d_sum <= 0.0 || fabs(s_sum - d_sum) >= EMD_EPS * s_sum)
+        return FALSE;
+
+    i = j = 0;
+    prev = (double) (x1[0] < x2[0] ? x1[0] : x2[0]);
+    while (i < size1 || j < size2)
+    {
+        if (j >= size2 || (i < size1 && x1[i * stride] <= x2[j * stride]))
+        {
+            x = (double) x1[i * stride];
+            totalCost += fabs(cdf) * (x - prev);
+            cdf += (double) w1[i * stride] / s_sum;
+            ++i;
+        }
+        else
+        {
+            x = (double) x2[j * stride];
+            totalCost += fabs(cdf) * (x - prev);
+            cdf -= (double) w2[j * stride] / d_sum;
+            ++j;
+        }
+
+        prev = x;
+    }
+
+    *emd = (float) totalCost;
+    return TRUE;
+}
+
+
+/* The lower bound is only useful to skip the solver */
+static int emdTryCalc1D(const float* RESTRICT signature_arr1,
+                        const float* RESTRICT signature_arr2,
+                        unsigned int size1,
+                        unsigned int size2,
+                        int dims,
+                        const float* RESTRICT lower_bound,
+                        float* emd)
+{
+    int axis;
+
+    return !lower_bound
+        && size1 > 0 && size2 > 0
+        && emdFindVaryingAxis(signature_arr1, signature_arr2, size1, size2, dims, &axis)
+        && emdCalc1D(signature_arr1, signature_arr2, size1, size2, dims, axis, emd);
+}
+
+/* The main function. Each signature entry is a weight followed by
+ * dims coordinates. */
+float emdCalcWorkspace(EMDWorkspace* ws,
+                       const float* RESTRICT signature_arr1,
+                       const float* RESTRICT signature_arr2,
+                       unsigned int size1,
+                       unsigned int size2,
+                       int dims,
+                       float* RESTRICT lower_bound)
 {
-    EMDState state;
     float emd = (float) EMD_INVALID;
     double totalCost = 0.0;
     int result = 0;
@@ -1198,27 +1239,26 @@ float emdCalc(const float* RESTRICT signature_arr1,
     const EMDDistanceType dist_type = EMD_DIST_L1;
     const mwbool debugFlow = FALSE;
     float* flow = NULL;
-    const int dims = 1; /* We only have 1 dimension, lambda */
-    void* user_param = (void*) dims;
+    void* user_param = (void*) (size_t) dims;
 
-    memset(&state, 0, sizeof(state));
+    if (emdTryCalc1D(signature_arr1, signature_arr2, size1, size2, dims, lower_bound, &emd))
+    {
+        return emd;
+    }
 
     dist_func = nbMetricDistanceFunction(dist_type);
-    result = emdInitEMD(signature_arr1, size1,
+    result = emdInitEMD(ws,
+                        signature_arr1, size1,
                         signature_arr2, size2,
                         dims, dist_func, user_param,
-                        NULL, 0,
-                        &state, lower_bound);
+                        lower_bound);
 
     if (result > 0 && lower_bound)
     {
-        emd = *lower_bound;
-        emdReleaseEMD(&state);
-        return emd;
+        return *lower_bound;
     }
     else if (result < 0)
     {
-        emdReleaseEMD(&state);
         return (float) EMD_INVALID;
     }
 
@@ -1227,10 +1267,10 @@ float emdCalc(const float* RESTRICT signature_arr1,
         flow = mwCalloc(size1 * size2, sizeof(float));
     }
 
-    if (!emdIterateSolution(&state))
+    if (!emdIterateSolution(ws))
     {
-        totalCost = emdComputeTotalFlow(&state, flow);
-        emd = (float)(totalCost / state.weight);
+        totalCost = emdComputeTotalFlow(ws, flow);
+        emd = (float)(totalCost / ws->weight);
     }
 
     if (debugFlow)
@@ -1239,8 +1279,34 @@ float emdCalc(const float* RESTRICT signature_arr1,
     }
 
     free(flow);
-    emdReleaseEMD(&state);
 
     return emd;
 }
 
+float emdCalcDims(const float* RESTRICT signature_arr1,
+                  const float* RESTRICT signature_arr2,
+                  unsigned int size1,
+                  unsigned int size2,
+                  int dims,
+                  float* RESTRICT lower_bound)
+{
+    float emd;
+
+    /* The buffers are only allocated if the solver is needed */
+    EMDWorkspace* ws = emdCreateWorkspace(0, 0);
+
+    emd = emdCalcWorkspace(ws, signature_arr1, signature_arr2, size1, size2, dims, lower_bound);
+    emdDestroyWorkspace(ws);
+
+    return emd;
+}
+
+float emdCalc(const float* RESTRICT signature_arr1,
+              const float* RESTRICT signature_arr2,
+              unsigned int size1,
+              unsigned int size2,
+              float* RESTRICT lower_bound)
+{
+    /* WeightPos signatures only have lambda */
+    return emdCalcDims(signature_arr1, signature_arr2, size1, size2, 1, lower_bound);
+}
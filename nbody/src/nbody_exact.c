@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody_priv.h"
+#include "nbody_exact.h"
+#include "milkyway_util.h"
+#include "milkyway_cpuid.h"
+
+/* Far enough away that padding bodies don't contribute, but close
+ * enough that the distance squared still fits in a float */
+#define NB_EXACT_FAR_AWAY ((real) 1.0e18)
+
+
+NBodyExactKernel nbExactKernel = NULL;
+
+/* Kernels that weren't built are stand ins for NULL */
+#if !NBODY_EXACT_AVX512
+  #define nbExactKernel_AVX512 NULL
+#endif
+
+#if !NBODY_EXACT_AVX
+  #define nbExactKernel_AVX NULL
+#endif
+
+#if !NBODY_EXACT_SSE2
+  #define nbExactKernel_SSE2 NULL
+#endif
+
+/* Can't use the functions themselves if defined to NULL */
+static NBodyExactKernel kernAVX512 = nbExactKernel_AVX512;
+static NBodyExactKernel kernAVX = nbExactKernel_AVX;
+static NBodyExactKernel kernSSE2 = nbExactKernel_SSE2;
+
+
+/* Same blocking as the vector kernels. Each body's sum is kept in the
+ * same order as a plain loop over all bodies. */
+void nbExactKernel_Scalar(const NBodyExactSoA* soa,
+                          int nbody,
+                          real eps2,
+                          const int* targets,
+                          int iStart,
+                          int iEnd,
+                          mwvector* acc)
+{
+    int i, j, jStart, jEnd;
+    const real* x = soa->pos[0];
+    const real* y = soa->pos[1];
+    const real* z = soa->pos[2];
+    const real* m = soa->masses;
+
+    for (i = iStart; i < iEnd; ++i)
+    {
+        mw_zerov(acc[targets ? targets[i] : i]);
+    }
+
+    for (jStart = 0; jStart < nbody; jStart += NB_EXACT_TILE)
+    {
+        jEnd = jStart + NB_EXACT_TILE;
+        if (jEnd > nbody)
+            jEnd = nbody;
+
+        for (i = iStart; i < iEnd; ++i)
+        {
+            const int k = targets ? targets[i] : i;
+            mwvector a = acc[k];
+
+            for (j = jStart; j < jEnd; ++j)
+            {
+                real dx = x[j] - x[k];
+                real dy = y[j] - y[k];
+                real dz = z[j] - z[k];
+                real drSq = dx * dx + dy * dy + dz * dz + eps2;
+
+                real drab = mw_sqrt(drSq);
+                real phii = m[j] / drab;
+                real mor3 = phii / drSq;
+
+                X(a) += dx * mor3;
+                Y(a) += dy * mor3;
+                Z(a) += dz * mor3;
+            }
+
+            acc[k] = a;
+        }
+    }
+}
+
+static void nbResizeExactSoA(NBodyExactSoA* soa, int n)
+{
+    size_t size;
+
+    if (n <= soa->maxBody)
+        return;
+
+    mwFreeA(soa->pos[0]);
+    mwFreeA(soa->pos[1]);
+    mwFreeA(soa->pos[2]);
+    mwFreeA(soa->masses);
+
+    size = n * sizeof(real);
+    soa->pos[0] = (real*) mwMallocA(size);
+    soa->pos[1] = (real*) mwMallocA(size);
+    soa->pos[2] = (real*) mwMallocA(size);
+    soa->masses = (real*) mwMallocA(size);
+    soa->maxBody = n;
+}
+
+void nbFillExactSoA(NBodyState* st)
+{
+    int i;
+    const int nbody = st->nbody;
+    const int nPad = (nbody + NB_EXACT_PAD - 1) / NB_EXACT_PAD * NB_EXACT_PAD;
+    NBodyExactSoA* soa = &st->exactSoA;
+    const Body* bodies = st->bodytab;
+
+    nbResizeExactSoA(soa, nPad);
+    soa->nPad = nPad;
+
+    for (i = 0; i < nbody; ++i)
+    {
+        soa->pos[0][i] = X(Pos(&bodies[i]));
+        soa->pos[1][i] = Y(Pos(&bodies[i]));
+        soa->pos[2][i] = Z(Pos(&bodies[i]));
+        soa->masses[i] = Mass(&bodies[i]);
+    }
+
+    for (i = nbody; i < nPad; ++i)
+    {
+        soa->pos[0][i] = NB_EXACT_FAR_AWAY;
+        soa->pos[1][i] = NB_EXACT_FAR_AWAY;
+        soa->pos[2][i] = NB_EXACT_FAR_AWAY;
+        soa->masses[i] = 0.0;
+    }
+}
+
+#if MW_IS_X86
+
+int nbExactKernelDispatch(const NBodyFlags* nbf)
+{
+    int hasSSE2, hasAVX, hasAVX512;
+    int forcingInstructions = nbf->forceAVX512 || nbf->forceAVX || nbf->forceSSE2;
+    int abcd[4];
+
+    if (nbf->forceNoIntrinsics)
+    {
+        mw_printf("Forced to not use intrinsics functions\n");
+        nbExactKernel = nbExactKernel_Scalar;
+        return 0;
+    }
+
+    mw_cpuid(abcd, 1, 0);
+    hasAVX = mwHasAVX(abcd) && mwOSHasAVXSupport();
+    hasSSE2 = mwHasSSE2(abcd);
+
+    mw_cpuid(abcd, 7, 0);
+    hasAVX512 = hasAVX && mwHasAVX512F(abcd) && mwOSHasAVX512Support();
+
+    if (nbf->verbose)
+    {
+        mw_printf("CPU features:        SSE2 = %d, AVX = %d, AVX-512 = %d\n"
+                  "Available functions: SSE2 = %d, AVX = %d, AVX-512 = %d\n"
+                  "Forcing:             SSE2 = %d, AVX = %d, AVX-512 = %d\n",
+                  hasSSE2, hasAVX, hasAVX512,
+                  kernSSE2 != NULL, kernAVX != NULL, kernAVX512 != NULL,
+                  nbf->forceSSE2, nbf->forceAVX, nbf->forceAVX512);
+    }
+
+    /* If multiple instructions are forced, the highest will take precedence */
+    if (forcingInstructions)
+    {
+        if (nbf->forceAVX512 && hasAVX512 && kernAVX512)
+        {
+            mw_printf("Using AVX-512 path\n");
+            nbExactKernel = kernAVX512;
+        }
+        else if (nbf->forceAVX && hasAVX && kernAVX)
+        {
+            mw_printf("Using AVX path\n");
+            nbExactKernel = kernAVX;
+        }
+        else if (nbf->forceSSE2 && hasSSE2 && kernSSE2)
+        {
+            mw_printf("Using SSE2 path\n");
+            nbExactKernel = kernSSE2;
+        }
+        else
+        {
+            mw_printf("Tried to force an unusable path\n");
+            return 1;
+        }
+    }
+    else
+    {
+        /* Choose the highest level with available function and instructions */
+        if (hasAVX512 && kernAVX512)
+        {
+            mw_printf("Using AVX-512 path\n");
+            nbExactKernel = kernAVX512;
+        }
+        else if (hasAVX && kernAVX)
+        {
+            mw_printf("Using AVX path\n");
+            nbExactKernel = kernAVX;
+        }
+        else if (hasSSE2 && kernSSE2)
+        {
+            mw_printf("Using SSE2 path\n");
+            nbExactKernel = kernSSE2;
+        }
+        else
+        {
+            mw_printf("Using other path\n");
+            nbExactKernel = nbExactKernel_Scalar;
+        }
+    }
+
+    return 0;
+}
+
+#else
+
+int nbExactKernelDispatch(const NBodyFlags* nbf)
+{
+    (void) nbf;
+
+    nbExactKernel = nbExactKernel_Scalar;
+    return 0;
+}
+
+#endif /* MW_IS_X86 */
+
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Direct summation kernel for the Exact criterion. This is built once
+ * for each instruction set, with the vector width picked from what
+ * the compiler was told it may use.
+ */
+
+#include "nbody_priv.h"
+#include "nbody_exact.h"
+
+#if defined(__AVX512F__)
+  #include <immintrin.h>
+
+  #define NB_EXACT_KERNEL nbExactKernel_AVX512
+  #define VWIDTH 8
+
+  typedef __m512d vreal;
+
+  #define vset1(x) _mm512_set1_pd(x)
+  #define vzero() _mm512_setzero_pd()
+  #define vload(p) _mm512_loadu_pd(p)
+  #define vadd(a, b) _mm512_add_pd(a, b)
+  #define vsub(a, b) _mm512_sub_pd(a, b)
+  #define vmul(a, b) _mm512_mul_pd(a, b)
+  #define vdiv(a, b) _mm512_div_pd(a, b)
+  #define vsqrt(a) _mm512_sqrt_pd(a)
+
+static inline real vhsum(vreal v)
+{
+    return _mm512_reduce_add_pd(v);
+}
+
+#elif defined(__AVX__)
+  #include <immintrin.h>
+
+  #define NB_EXACT_KERNEL nbExactKernel_AVX
+  #define VWIDTH 4
+
+  typedef __m256d vreal;
+
+  #define vset1(x) _mm256_set1_pd(x)
+  #define vzero() _mm256_setzero_pd()
+  #define vload(p) _mm256_loadu_pd(p)
+  #define vadd(a, b) _mm256_add_pd(a, b)
+  #define vsub(a, b) _mm256_sub_pd(a, b)
+  #define vmul(a, b) _mm256_mul_pd(a, b)
+  #define vdiv(a, b) _mm256_div_pd(a, b)
+  #define vsqrt(a) _mm256_sqrt_pd(a)
+
+static inline real vhsum(vreal v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+
+  #define NB_EXACT_KERNEL nbExactKernel_SSE2
+  #define VWIDTH 2
+
+  typedef __m128d vreal;
+
+  #define vset1(x) _mm_set1_pd(x)
+  #define vzero() _mm_setzero_pd()
+  #define vload(p) _mm_loadu_pd(p)
+  #define vadd(a, b) _mm_add_pd(a, b)
+  #define vsub(a, b) _mm_sub_pd(a, b)
+  #define vmul(a, b) _mm_mul_pd(a, b)
+  #define vdiv(a, b) _mm_div_pd(a, b)
+  #define vsqrt(a) _mm_sqrt_pd(a)
+
+static inline real vhsum(vreal v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+#else
+  #error "Intrinsics kernel built without SSE2, AVX or AVX-512 enabled"
+#endif
+
+#if !DOUBLEPREC
+  #error "Intrinsics kernel requires double precision"
+#endif
+
+
+/* Each j-block is run over all of the i bodies while it is still in
+ * the L1 cache. The padding bodies have no mass and are far enough
+ * away that they add exactly 0. */
+void NB_EXACT_KERNEL(const NBodyExactSoA* soa,
+                     int nbody,
+                     real eps2,
+                     const int* targets,
+                     int iStart,
+                     int iEnd,
+                     mwvector* acc)
+{
+    int i, j, jStart, jEnd;
+    const real* RESTRICT x = soa->pos[0];
+    const real* RESTRICT y = soa->pos[1];
+    const real* RESTRICT z = soa->pos[2];
+    const real* RESTRICT m = soa->masses;
+    const vreal veps2 = vset1(eps2);
+
+    (void) nbody;
+
+    for (i = iStart; i < iEnd; ++i)
+    {
+        mw_zerov(acc[targets ? targets[i] : i]);
+    }
+
+    for (jStart = 0; jStart < soa->nPad; jStart += NB_EXACT_TILE)
+    {
+        jEnd = jStart + NB_EXACT_TILE;
+        if (jEnd > soa->nPad)
+            jEnd = soa->nPad;
+
+        for (i = iStart; i < iEnd; ++i)
+        {
+            const int k = targets ? targets[i] : i;
+            const vreal xi = vset1(x[k]);
+            const vreal yi = vset1(y[k]);
+            const vreal zi = vset1(z[k]);
+            vreal ax = vzero();
+            vreal ay = vzero();
+            vreal az = vzero();
+
+            for (j = jStart; j < jEnd; j += VWIDTH)
+            {
+                vreal dx = vsub(vload(&x[j]), xi);
+                vreal dy = vsub(vload(&y[j]), yi);
+                vreal dz = vsub(vload(&z[j]), zi);
+                vreal drSq = vadd(vadd(vmul(dx, dx), vmul(dy, dy)), vadd(vmul(dz, dz), veps2));
+
+                /* One divide instead of two; they dominate the loop */
+                vreal drab = vsqrt(drSq);
+                vreal mor3 = vdiv(vload(&m[j]), vmul(drab, drSq));
+
+                ax = vadd(ax, vmul(dx, mor3));
+                ay = vadd(ay, vmul(dy, mor3));
+                az = vadd(az, vmul(dz, mor3));
+            }
+
+            X(acc[k]) += vhsum(ax);
+            Y(acc[k]) += vhsum(ay);
+            Z(acc[k]) += vhsum(az);
+        }
+    }
+}
+
@@ -950,10 +950,25 @@ static int nbPopCircularQueue(scene_t* scene,
     }
 
     const SceneInfo* info = &queue->info[head];
-    const GLfloat* bodyData = (const GLfloat*) nbSceneGetQueueBuffer(scene, head);
+    GLsizeiptr bodyDataSize = 4 * scene->nbody * sizeof(GLfloat);
 
     glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * scene->nbody * sizeof(GLfloat), bodyData);
+    if (scene->quantized)
+    {
+        /* Expand the positions straight into the buffer */
+        FloatPos* r = (FloatPos*) glMapBufferRange(GL_ARRAY_BUFFER, 0, bodyDataSize,
+                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (r)
+        {
+            nbSceneUnpackQueueBuffer(scene, head, r);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    else
+    {
+        const GLfloat* bodyData = (const GLfloat*) nbSceneGetQueueBuffer(scene, head);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bodyDataSize, bodyData);
+    }
 
     sceneData->currentStep = info->currentStep;
     sceneData->currentTime = info->currentTime;
@@ -964,7 +979,7 @@ static int nbPopCircularQueue(scene_t* scene,
 
     trace->updatePoints(nbSceneGetOrbitTrace(scene), sceneData->currentStep);
 
-    head = (head + 1) % NBODY_CIRC_QUEUE_SIZE;
+    head = (head + 1) % queue->size;
     OPA_store_int(&queue->head, head);
     return TRUE;
 }
@@ -363,6 +363,13 @@ void NBodyText::prepareConstantText(const scene_t* scene)
                  L"Static N-body scene (%d particles)\n",
                  scene->nbody);
     }
+    else if (scene->stride > 1)
+    {
+        swprintf(buf, sizeof(buf) / sizeof(wchar_t),
+                 L"N-body simulation (%d particles, showing %d)\n",
+                 scene->nbodyTotal,
+                 scene->nbody);
+    }
     else
     {
         swprintf(buf, sizeof(buf) / sizeof(wchar_t),
@@ -22,12 +22,17 @@
 #include "nbody_priv.h"
 #include "nbody_util.h"
 #include "nbody_grav.h"
+#include "nbody_exact.h"
 #include "milkyway_util.h"
 
 #ifdef _OPENMP
   #include <omp.h>
 #endif /* _OPENMP */
 
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#endif
+
 
 /*
  * nbodyGravity: Walk the tree starting at the root to do force
@@ -123,115 +128,641 @@ static inline mwvector nbGravity(const NBodyCtx* ctx, NBodyState* st, const Body
     return acc0;
 }
 
-static inline void nbMapForceBody(const NBodyCtx* ctx, NBodyState* st)
+/* Same as nbGravity, but walking the flat tree. The first child of a
+ * cell is the node after it, so opening a cell is just moving on to
+ * the next node. The walk ends once it steps past the last node.
+ */
+static inline mwvector nbGravityFlat(const NBodyCtx* ctx, NBodyState* st, int i)
 {
-    int i;
+    mwbool skipSelf = FALSE;
+
+    const NBodyFlatTree* ft = &st->flatTree;
+    const real* RESTRICT px = ft->pos[0];
+    const real* RESTRICT py = ft->pos[1];
+    const real* RESTRICT pz = ft->pos[2];
+    const real* RESTRICT masses = ft->masses;
+    const real* RESTRICT critRadii = ft->critRadii;
+    const int* RESTRICT next = ft->next;
+    const int* RESTRICT body = ft->body;
+    const int nNode = (int) ft->nNode;
+
+    mwvector pos0 = Pos(&st->bodytab[i]);
+    mwvector acc0 = ZERO_VECTOR;
+
+    int q = 0;  /* Start at the root */
+
+    while (q < nNode)
+    {
+        mwvector dr;
+        real drSq;
+
+        dr.x = px[q] - pos0.x;
+        dr.y = py[q] - pos0.y;
+        dr.z = pz[q] - pos0.z;
+        drSq = mw_sqrv(dr);
+
+        if (body[q] >= 0 || (drSq >= critRadii[q]))  /* If is a body or far enough away to approximate */
+        {
+            if (mw_likely(body[q] != i))    /* self-interaction? */
+            {
+                real drab, phii, mor3;
+
+                drSq += ctx->eps2;   /* use standard softening */
+                drab = mw_sqrt(drSq);
+                phii = masses[q] / drab;
+                mor3 = phii / drSq;
+
+                acc0.x += mor3 * dr.x;
+                acc0.y += mor3 * dr.y;
+                acc0.z += mor3 * dr.z;
+
+                if (ctx->useQuad && body[q] < 0)   /* if cell, add quad term */
+                {
+                    real dr5inv, drQdr, phiQ;
+                    mwvector Qdr;
+
+                    /* form Q * dr */
+                    Qdr.x = ft->quad.xx[q] * dr.x + ft->quad.xy[q] * dr.y + ft->quad.xz[q] * dr.z;
+                    Qdr.y = ft->quad.xy[q] * dr.x + ft->quad.yy[q] * dr.y + ft->quad.yz[q] * dr.z;
+                    Qdr.z = ft->quad.xz[q] * dr.x + ft->quad.yz[q] * dr.y + ft->quad.zz[q] * dr.z;
+
+                    /* form dr * Q * dr */
+                    drQdr = Qdr.x * dr.x + Qdr.y * dr.y + Qdr.z * dr.z;
+
+                    dr5inv = 1.0 / (sqr(drSq) * drab);  /* form dr^-5 */
+
+                    /* get quad. part of phi */
+                    phiQ = 2.5 * (dr5inv * drQdr) / drSq;
+
+                    acc0.x += phiQ * dr.x;
+                    acc0.y += phiQ * dr.y;
+                    acc0.z += phiQ * dr.z;
+
+                    /* acceleration */
+                    acc0.x -= dr5inv * Qdr.x;
+                    acc0.y -= dr5inv * Qdr.y;
+                    acc0.z -= dr5inv * Qdr.z;
+                }
+            }
+            else
+            {
+                skipSelf = TRUE;   /* Encountered self */
+            }
+
+            q = next[q];  /* Skip over the subtree */
+        }
+        else
+        {
+            ++q;          /* Open the cell */
+        }
+    }
+
+    if (!skipSelf)
+    {
+        nbReportTreeIncest(ctx, st);
+    }
+
+    return acc0;
+}
+
+/* Bodies whose external acceleration is found in one batch */
+#define NB_EXT_CHUNK 128
+
+/* Add the external acceleration to the accelerations of bodies
+ * [iStart, iEnd), at most NB_EXT_CHUNK of them. If idx is given, the
+ * bodies are idx[iStart] to idx[iEnd - 1] instead. */
+static void nbAddExternalAccels(const NBodyCtx* ctx, NBodyState* st, const int* idx, int iStart, int iEnd)
+{
+    int i, k;
+    const int n = iEnd - iStart;
+    const Body* bodies = st->bodytab;
+    mwvector* accels = st->acctab;
+    mwvector externAcc;
+    real x[NB_EXT_CHUNK], y[NB_EXT_CHUNK], z[NB_EXT_CHUNK];
+    real ax[NB_EXT_CHUNK], ay[NB_EXT_CHUNK], az[NB_EXT_CHUNK];
+
+    if (n <= 0)
+        return;
+
+    switch (ctx->potentialType)
+    {
+        case EXTERNAL_POTENTIAL_DEFAULT:
+            for (i = 0; i < n; ++i)
+            {
+                k = idx ? idx[iStart + i] : iStart + i;
+                x[i] = X(Pos(&bodies[k]));
+                y[i] = Y(Pos(&bodies[k]));
+                z[i] = Z(Pos(&bodies[k]));
+            }
+
+            nbExtAccelerationBatch(&ctx->pot, n, x, y, z, ax, ay, az);
+
+            for (i = 0; i < n; ++i)
+            {
+                k = idx ? idx[iStart + i] : iStart + i;
+                X(accels[k]) += ax[i];
+                Y(accels[k]) += ay[i];
+                Z(accels[k]) += az[i];
+            }
+            break;
+
+        case EXTERNAL_POTENTIAL_NONE:
+            break;
+
+        case EXTERNAL_POTENTIAL_CUSTOM_LUA:
+            for (i = 0; i < n; ++i)
+            {
+                k = idx ? idx[iStart + i] : iStart + i;
+                nbEvalPotentialClosure(st, Pos(&bodies[k]), &externAcc);
+                mw_incaddv(accels[k], externAcc);
+            }
+            break;
+
+        default:
+            mw_fail("Bad external potential type: %d\n", ctx->potentialType);
+    }
+}
+
+static inline void nbMapForceBodyFlat(const NBodyCtx* ctx, NBodyState* st)
+{
+    int i, iStart, iEnd;
     const int nbody = st->nbody;  /* Prevent reload on each loop */
-    mwvector a, externAcc;
-    const Body* b;
 
-    const Body* bodies = mw_assume_aligned(st->bodytab, 16);
     mwvector* accels = mw_assume_aligned(st->acctab, 16);
 
   #ifdef _OPENMP
-    #pragma omp parallel for private(i, b, a, externAcc) shared(bodies, accels) schedule(dynamic, 4096 / sizeof(accels[0]))
+    #pragma omp parallel for private(i, iStart, iEnd) shared(accels) schedule(dynamic)
   #endif
-    for (i = 0; i < nbody; ++i)      /* get force on each body */
+    for (iStart = 0; iStart < nbody; iStart += NB_EXT_CHUNK)
     {
-        /* Repeat the base hackGrav part in each case or else GCC's
-         * -funswitch-loops doesn't happen. Without that this constant
-         * gets checked on every body on every step which is dumb.  */
-        switch (ctx->potentialType)
+        iEnd = MIN(iStart + NB_EXT_CHUNK, nbody);
+
+        for (i = iStart; i < iEnd; ++i)      /* get force on each body */
         {
-            case EXTERNAL_POTENTIAL_DEFAULT:
-                /* Include the external potential */
-                b = &bodies[i];
-                a = nbGravity(ctx, st, b);
-
-                externAcc = nbExtAcceleration(&ctx->pot, Pos(b));
-                mw_incaddv(a, externAcc);
-                accels[i] = a;
-                break;
-
-            case EXTERNAL_POTENTIAL_NONE:
-                accels[i] = nbGravity(ctx, st, &bodies[i]);
-                break;
-
-            case EXTERNAL_POTENTIAL_CUSTOM_LUA:
-                a = nbGravity(ctx, st, &bodies[i]);
-                nbEvalPotentialClosure(st, Pos(&bodies[i]), &externAcc);
-                mw_incaddv(a, externAcc)
-                accels[i] = a;
-                break;
-
-            default:
-                mw_fail("Bad external potential type: %d\n", ctx->potentialType);
+            accels[i] = nbGravityFlat(ctx, st, i);
         }
+
+        nbAddExternalAccels(ctx, st, NULL, iStart, iEnd);
     }
 }
 
-static mwvector nbGravity_Exact(const NBodyCtx* ctx, NBodyState* st, const Body* p)
+/* Interaction list shared by a group of bodies. Cells and bodies are
+ * kept in separate lists so the body loop is a plain monopole loop
+ * over contiguous arrays. */
+typedef struct
 {
-    int i;
-    const int nbody = st->nbody;
-    mwvector a = ZERO_VECTOR;
+    real* x;
+    real* y;
+    real* z;
+    real* m;
+    real* quad[6];  /* xx, xy, xz, yy, yz, zz. Only used for cells */
+    int* id;        /* bodytab index of bodies */
+    unsigned int n;
+    unsigned int max;
+} NBodyIList;
+
+static void nbGrowIList(NBodyIList* l)
+{
+    unsigned int i;
+
+    l->max = 2 * l->max + 64;
+    l->x = (real*) mwRealloc(l->x, l->max * sizeof(real));
+    l->y = (real*) mwRealloc(l->y, l->max * sizeof(real));
+    l->z = (real*) mwRealloc(l->z, l->max * sizeof(real));
+    l->m = (real*) mwRealloc(l->m, l->max * sizeof(real));
+    for (i = 0; i < 6; ++i)
+    {
+        l->quad[i] = (real*) mwRealloc(l->quad[i], l->max * sizeof(real));
+    }
+    l->id = (int*) mwRealloc(l->id, l->max * sizeof(int));
+}
+
+static void nbFreeIList(NBodyIList* l)
+{
+    unsigned int i;
+
+    free(l->x);
+    free(l->y);
+    free(l->z);
+    free(l->m);
+    for (i = 0; i < 6; ++i)
+    {
+        free(l->quad[i]);
+    }
+    free(l->id);
+}
+
+static inline void nbIListAdd(NBodyIList* l, const NBodyFlatTree* ft, int q, mwbool withQuad)
+{
+    unsigned int k;
+
+    if (l->n == l->max)
+        nbGrowIList(l);
+
+    k = l->n++;
+    l->x[k] = ft->pos[0][q];
+    l->y[k] = ft->pos[1][q];
+    l->z[k] = ft->pos[2][q];
+    l->m[k] = ft->masses[q];
+    l->id[k] = ft->body[q];
+
+    if (withQuad)
+    {
+        l->quad[0][k] = ft->quad.xx[q];
+        l->quad[1][k] = ft->quad.xy[q];
+        l->quad[2][k] = ft->quad.xz[q];
+        l->quad[3][k] = ft->quad.yy[q];
+        l->quad[4][k] = ft->quad.yz[q];
+        l->quad[5][k] = ft->quad.zz[q];
+    }
+}
+
+ALWAYS_INLINE
+static inline real nbBoxDist1(real p, real lo, real hi)
+{
+    return p < lo ? lo - p : (p > hi ? p - hi : 0.0);
+}
+
+/* Find the interaction list for the bodies of the subtree at group
+ * node g. A cell is only accepted if it passes the opening test from
+ * the closest point of the bounding box of the group, so it would have
+ * been accepted by every body in the group. Returns TRUE if a body of
+ * the group was hidden in an accepted cell, which is tree incest.
+ */
+static mwbool nbGroupInteractionList(const NBodyCtx* ctx,
+                                     const NBodyFlatTree* ft,
+                                     int g,
+                                     NBodyIList* cells,
+                                     NBodyIList* bodies)
+{
+    int q, j;
+    int nSelf = 0;
+    mwvector lo, hi;
+    const int gEnd = ft->next[g];
+    const int nNode = (int) ft->nNode;
+
+    X(lo) = Y(lo) = Z(lo) = REAL_MAX;
+    X(hi) = Y(hi) = Z(hi) = -REAL_MAX;
+    for (j = g; j < gEnd; ++j)
+    {
+        if (ft->body[j] >= 0)
+        {
+            X(lo) = mw_fmin(X(lo), ft->pos[0][j]);
+            Y(lo) = mw_fmin(Y(lo), ft->pos[1][j]);
+            Z(lo) = mw_fmin(Z(lo), ft->pos[2][j]);
+
+            X(hi) = mw_fmax(X(hi), ft->pos[0][j]);
+            Y(hi) = mw_fmax(Y(hi), ft->pos[1][j]);
+            Z(hi) = mw_fmax(Z(hi), ft->pos[2][j]);
+        }
+    }
+
+    cells->n = 0;
+    bodies->n = 0;
+
+    q = 0;
+    while (q < nNode)
+    {
+        if (ft->body[q] >= 0)
+        {
+            nbIListAdd(bodies, ft, q, FALSE);
+            nSelf += (q >= g && q < gEnd);
+            q = ft->next[q];
+        }
+        else
+        {
+            real dx = nbBoxDist1(ft->pos[0][q], X(lo), X(hi));
+            real dy = nbBoxDist1(ft->pos[1][q], Y(lo), Y(hi));
+            real dz = nbBoxDist1(ft->pos[2][q], Z(lo), Z(hi));
+
+            if (sqr(dx) + sqr(dy) + sqr(dz) >= ft->critRadii[q])
+            {
+                nbIListAdd(cells, ft, q, ctx->useQuad);
+                q = ft->next[q];
+            }
+            else
+            {
+                ++q;
+            }
+        }
+    }
+
+    return nSelf != ft->count[g];
+}
+
+/* Force on a body at pos0 with index i from an interaction list. The
+ * loops are written over contiguous arrays without branches so they
+ * can be vectorized.
+ */
+static inline mwvector nbIListForce(const NBodyCtx* ctx,
+                                    const NBodyIList* cells,
+                                    const NBodyIList* bodies,
+                                    int i,
+                                    mwvector pos0)
+{
+    unsigned int j;
     const real eps2 = ctx->eps2;
+    real ax = 0.0, ay = 0.0, az = 0.0;
+    mwvector acc;
+
+    {
+        const real* RESTRICT x = bodies->x;
+        const real* RESTRICT y = bodies->y;
+        const real* RESTRICT z = bodies->z;
+        const real* RESTRICT m = bodies->m;
+        const int* RESTRICT id = bodies->id;
+        const unsigned int n = bodies->n;
+
+        for (j = 0; j < n; ++j)
+        {
+            real dx = x[j] - X(pos0);
+            real dy = y[j] - Y(pos0);
+            real dz = z[j] - Z(pos0);
+            real drSq = dx * dx + dy * dy + dz * dz + eps2;
+            real drab = mw_sqrt(drSq);
+            real mor3 = (m[j] / drab) / drSq;
+
+            mor3 = (id[j] == i) ? 0.0 : mor3;  /* skip self-interaction */
+
+            ax += mor3 * dx;
+            ay += mor3 * dy;
+            az += mor3 * dz;
+        }
+    }
 
-    for (i = 0; i < nbody; ++i)
     {
-        const Body* b = &st->bodytab[i];
+        const real* RESTRICT x = cells->x;
+        const real* RESTRICT y = cells->y;
+        const real* RESTRICT z = cells->z;
+        const real* RESTRICT m = cells->m;
+        const real* RESTRICT qxx = cells->quad[0];
+        const real* RESTRICT qxy = cells->quad[1];
+        const real* RESTRICT qxz = cells->quad[2];
+        const real* RESTRICT qyy = cells->quad[3];
+        const real* RESTRICT qyz = cells->quad[4];
+        const real* RESTRICT qzz = cells->quad[5];
+        const unsigned int n = cells->n;
+
+        if (ctx->useQuad)
+        {
+            for (j = 0; j < n; ++j)
+            {
+                real dx = x[j] - X(pos0);
+                real dy = y[j] - Y(pos0);
+                real dz = z[j] - Z(pos0);
+                real drSq = dx * dx + dy * dy + dz * dz + eps2;
+                real drab = mw_sqrt(drSq);
+                real mor3 = (m[j] / drab) / drSq;
+
+                /* form Q * dr */
+                real Qdrx = qxx[j] * dx + qxy[j] * dy + qxz[j] * dz;
+                real Qdry = qxy[j] * dx + qyy[j] * dy + qyz[j] * dz;
+                real Qdrz = qxz[j] * dx + qyz[j] * dy + qzz[j] * dz;
+
+                /* form dr * Q * dr */
+                real drQdr = Qdrx * dx + Qdry * dy + Qdrz * dz;
+                real dr5inv = 1.0 / (sqr(drSq) * drab);
+                real phiQ = 2.5 * (dr5inv * drQdr) / drSq;
+
+                ax += (mor3 + phiQ) * dx - dr5inv * Qdrx;
+                ay += (mor3 + phiQ) * dy - dr5inv * Qdry;
+                az += (mor3 + phiQ) * dz - dr5inv * Qdrz;
+            }
+        }
+        else
+        {
+            for (j = 0; j < n; ++j)
+            {
+                real dx = x[j] - X(pos0);
+                real dy = y[j] - Y(pos0);
+                real dz = z[j] - Z(pos0);
+                real drSq = dx * dx + dy * dy + dz * dz + eps2;
+                real drab = mw_sqrt(drSq);
+                real mor3 = (m[j] / drab) / drSq;
+
+                ax += mor3 * dx;
+                ay += mor3 * dy;
+                az += mor3 * dz;
+            }
+        }
+    }
 
-        mwvector dr = mw_subv(Pos(b), Pos(p));
-        real drSq = mw_sqrv(dr) + eps2;
+    X(acc) = ax;
+    Y(acc) = ay;
+    Z(acc) = az;
+    W(acc) = 0.0;
 
-        real drab = mw_sqrt(drSq);
-        real phii = Mass(b) / drab;
-        real mor3 = phii / drSq;
+    return acc;
+}
+
+/* Split the flat tree into subtrees with at most groupSize bodies */
+static int* nbFindGroups(const NBodyFlatTree* ft, int groupSize, int* nGroupOut)
+{
+    int q = 0;
+    int nGroup = 0;
+    int maxGroup = 64;
+    int* groups = (int*) mwMalloc(maxGroup * sizeof(int));
 
-        mw_incaddv(a, mw_mulvs(dr, mor3));
+    while (q < (int) ft->nNode)
+    {
+        if (ft->count[q] <= groupSize)
+        {
+            if (nGroup == maxGroup)
+            {
+                maxGroup *= 2;
+                groups = (int*) mwRealloc(groups, maxGroup * sizeof(int));
+            }
+
+            groups[nGroup++] = q;
+            q = ft->next[q];
+        }
+        else
+        {
+            ++q;
+        }
     }
 
-    return a;
+    *nGroupOut = nGroup;
+    return groups;
 }
 
+/* Grouped walk: each group of nearby bodies walks the flat tree once to
+ * find an interaction list, which is then evaluated for every body in
+ * the group. Test particles aren't in the tree, so they do their own
+ * walk.
+ */
+static inline void nbMapForceBodyGrouped(const NBodyCtx* ctx, NBodyState* st)
+{
+    int i, g, nGroup;
+    const int nbody = st->nbody;
+    const NBodyFlatTree* ft = &st->flatTree;
+    const Body* bodies = mw_assume_aligned(st->bodytab, 16);
+    mwvector* accels = mw_assume_aligned(st->acctab, 16);
+    int* groups = nbFindGroups(ft, ctx->groupSize, &nGroup);
+
+  #ifdef _OPENMP
+    #pragma omp parallel private(i, g) shared(bodies, accels, groups)
+  #endif
+    {
+        NBodyIList cells, lbodies;
+
+        memset(&cells, 0, sizeof(cells));
+        memset(&lbodies, 0, sizeof(lbodies));
+
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 1)
+      #endif
+        for (g = 0; g < nGroup; ++g)
+        {
+            int q;
+            const int gStart = groups[g];
+            const int gEnd = ft->next[gStart];
+
+            if (nbGroupInteractionList(ctx, ft, gStart, &cells, &lbodies))
+            {
+                nbReportTreeIncest(ctx, st);
+            }
+
+            for (q = gStart; q < gEnd; ++q)
+            {
+                if (ft->body[q] >= 0)
+                {
+                    i = ft->body[q];
+                    accels[i] = nbIListForce(ctx, &cells, &lbodies, i, Pos(&bodies[i]));
+                }
+            }
+        }
+
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 4096 / sizeof(accels[0]))
+      #endif
+        for (i = 0; i < nbody; ++i)
+        {
+            if (Mass(&bodies[i]) == 0.0)
+            {
+                accels[i] = nbGravityFlat(ctx, st, i);
+            }
+        }
+
+        /* Group members are scattered through the body table, so the
+         * external potential is added afterwards in chunks */
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+      #endif
+        for (i = 0; i < nbody; i += NB_EXT_CHUNK)
+        {
+            nbAddExternalAccels(ctx, st, NULL, i, MIN(i + NB_EXT_CHUNK, nbody));
+        }
+
+        nbFreeIList(&cells);
+        nbFreeIList(&lbodies);
+    }
+
+    free(groups);
+}
+
+static inline void nbMapForceBody(const NBodyCtx* ctx, NBodyState* st)
+{
+    int i, iStart, iEnd;
+    const int nbody = st->nbody;  /* Prevent reload on each loop */
+
+    const Body* bodies = mw_assume_aligned(st->bodytab, 16);
+    mwvector* accels = mw_assume_aligned(st->acctab, 16);
+
+    /* The tree walk is done for a chunk of bodies, and then the
+     * external potential for the whole chunk at once */
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, iStart, iEnd) shared(bodies, accels) schedule(dynamic)
+  #endif
+    for (iStart = 0; iStart < nbody; iStart += NB_EXT_CHUNK)
+    {
+        iEnd = MIN(iStart + NB_EXT_CHUNK, nbody);
+
+        for (i = iStart; i < iEnd; ++i)      /* get force on each body */
+        {
+            accels[i] = nbGravity(ctx, st, &bodies[i]);
+        }
+
+        nbAddExternalAccels(ctx, st, NULL, iStart, iEnd);
+    }
+}
+
+/* Bodies handed to the direct summation kernel at a time */
+#define NB_EXACT_BLOCK 64
+
 static inline void nbMapForceBody_Exact(const NBodyCtx* ctx, NBodyState* st)
 {
-    int i;
+    int iStart, iEnd;
     const int nbody = st->nbody;  /* Prevent reload on each loop */
-    mwvector a, externAcc;
-    const Body* b;
+    const NBodyExactKernel kernel = nbExactKernel ? nbExactKernel : nbExactKernel_Scalar;
 
-    Body* bodies = mw_assume_aligned(st->bodytab, 16);
     mwvector* accels = mw_assume_aligned(st->acctab, 16);
 
+    nbFillExactSoA(st);
+
   #ifdef _OPENMP
-    #pragma omp parallel for private(i, b, a, externAcc) shared(bodies, accels) schedule(dynamic, 4096 / sizeof(accels[0]))
+    #pragma omp parallel for private(iStart, iEnd) shared(accels) schedule(dynamic)
   #endif
-    for (i = 0; i < nbody; ++i)      /* get force on each body */
+    for (iStart = 0; iStart < nbody; iStart += NB_EXACT_BLOCK)
     {
-        switch (ctx->potentialType)
+        iEnd = iStart + NB_EXACT_BLOCK;
+        if (iEnd > nbody)
+            iEnd = nbody;
+
+        kernel(&st->exactSoA, nbody, ctx->eps2, NULL, iStart, iEnd, accels);
+        nbAddExternalAccels(ctx, st, NULL, iStart, iEnd);
+    }
+}
+
+/* Find the forces on only the bodies in active. The walk for each body
+ * is used regardless of groupSize, since the active bodies are usually
+ * too scattered to share interaction lists. */
+static inline void nbMapForceActive(const NBodyCtx* ctx, NBodyState* st, const int* active, int nActive)
+{
+    int i, k, iStart, iEnd;
+    const mwbool useFlat = ctx->flatTree || ctx->groupSize > 0;
+
+    const Body* bodies = mw_assume_aligned(st->bodytab, 16);
+    mwvector* accels = mw_assume_aligned(st->acctab, 16);
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, k, iStart, iEnd) shared(bodies, accels) schedule(dynamic)
+  #endif
+    for (iStart = 0; iStart < nActive; iStart += NB_EXT_CHUNK)
+    {
+        iEnd = MIN(iStart + NB_EXT_CHUNK, nActive);
+
+        for (i = iStart; i < iEnd; ++i)
         {
-            case EXTERNAL_POTENTIAL_DEFAULT:
-                b = &bodies[i];
-                a = nbGravity_Exact(ctx, st, b);
-                mw_incaddv(a, nbExtAcceleration(&ctx->pot, Pos(b)));
-                accels[i] = a;
-                break;
-
-            case EXTERNAL_POTENTIAL_NONE:
-                accels[i] = nbGravity_Exact(ctx, st, &bodies[i]);
-                break;
-
-            case EXTERNAL_POTENTIAL_CUSTOM_LUA:
-                a = nbGravity_Exact(ctx, st, &bodies[i]);
-                nbEvalPotentialClosure(st, Pos(&bodies[i]), &externAcc);
-                mw_incaddv(a, externAcc);
-                accels[i] = a;
-                break;
-
-            default:
-                mw_fail("Bad external potential type: %d\n", ctx->potentialType);
+            k = active[i];
+            accels[k] = useFlat ? nbGravityFlat(ctx, st, k) : nbGravity(ctx, st, &bodies[k]);
         }
+
+        nbAddExternalAccels(ctx, st, active, iStart, iEnd);
+    }
+}
+
+static inline void nbMapForceActive_Exact(const NBodyCtx* ctx, NBodyState* st, const int* active, int nActive)
+{
+    int iStart, iEnd;
+    const int nbody = st->nbody;
+    const NBodyExactKernel kernel = nbExactKernel ? nbExactKernel : nbExactKernel_Scalar;
+
+    mwvector* accels = mw_assume_aligned(st->acctab, 16);
+
+    nbFillExactSoA(st);
+
+    /* Each block of active bodies is a tile of targets, so every
+     * j-block is loaded once for all of them */
+  #ifdef _OPENMP
+    #pragma omp parallel for private(iStart, iEnd) shared(accels) schedule(dynamic)
+  #endif
+    for (iStart = 0; iStart < nActive; iStart += NB_EXACT_BLOCK)
+    {
+        iEnd = MIN(iStart + NB_EXACT_BLOCK, nActive);
+
+        kernel(&st->exactSoA, nbody, ctx->eps2, active, iStart, iEnd, accels);
+        nbAddExternalAccels(ctx, st, active, iStart, iEnd);
     }
 }
 
@@ -255,7 +786,12 @@ NBodyStatus nbGravMap(const NBodyCtx* ctx, NBodyState* st)
         if (nbStatusIsFatal(rc))
             return rc;
 
-        nbMapForceBody(ctx, st);
+        if (ctx->groupSize > 0)
+            nbMapForceBodyGrouped(ctx, st);
+        else if (ctx->flatTree)
+            nbMapForceBodyFlat(ctx, st);
+        else
+            nbMapForceBody(ctx, st);
     }
     else
     {
@@ -270,3 +806,28 @@ NBodyStatus nbGravMap(const NBodyCtx* ctx, NBodyState* st)
     return nbIncestStatusCheck(ctx, st); /* Check if incest occured during step */
 }
 
+NBodyStatus nbGravMapActive(const NBodyCtx* ctx, NBodyState* st, const int* active, int nActive)
+{
+    NBodyStatus rc;
+
+    if (mw_likely(ctx->criterion != Exact))
+    {
+        rc = nbMakeTree(ctx, st);
+        if (nbStatusIsFatal(rc))
+            return rc;
+
+        nbMapForceActive(ctx, st, active, nActive);
+    }
+    else
+    {
+        nbMapForceActive_Exact(ctx, st, active, nActive);
+    }
+
+    if (st->potentialEvalError)
+    {
+        return NBODY_LUA_POTENTIAL_ERROR;
+    }
+
+    return nbIncestStatusCheck(ctx, st);
+}
+
@@ -24,6 +24,7 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_lua.h"
 #include "nbody_lua_types.h"
 #include "nbody_hernq.h"
+#include "nbody_model_util.h"
 
 static real hernqMassInsideRadius(real radius, real radius_scale, real a, real mass)
 {
@@ -36,21 +37,19 @@ static real hernqMassInsideRadius(real radius, real radius_scale, real a, real m
 
 }
 
-static real hernqNextRadius(real startRadius, real goalMass, real radius, real a, real mass)
+/* Inverse of hernqMassInsideRadius. The enclosed mass only reaches
+ * the total at infinity, so goals are capped a quarter of a particle
+ * below it to keep the outermost shell finite. */
+static real hernqRadiusForMass(real goalMass, real radius_scale, real a, real mass, real massEpsilon)
 {
-    // This is a scary function which returns the next radius limit
-    // Do not use this code on client computers. It is slow inneficient
-    // and well just dirty.
+    real s;
 
-    real test_radius;
+    goalMass = mw_fmin(goalMass, mass - 0.25 * massEpsilon);
+    if (goalMass <= 0.0)
+        return 0.0;
 
-    for (test_radius = startRadius;; test_radius += (real)0.0001)
-    {
-        if (hernqMassInsideRadius(test_radius, radius, a, mass) >= goalMass)
-        {
-            return test_radius;
-        }
-    }
+    s = mw_sqrt(goalMass / mass);
+    return radius_scale * a * s / (1.0 - s);
 }
 
 /* hernqPickShell: pick a random point on a sphere of specified radius. */
@@ -83,20 +82,6 @@ static real hernqRandomR(dsfmt_t* dsfmtState, real startradius, real endradius)
     return (endradius - startradius) * rnd + startradius;
 }
 
-static real hernqSelectFromG(dsfmt_t* dsfmtState)
-{
-    real x, y;
-
-    do                      /* select from fn g(x) */
-    {
-        x = mwXrandom(dsfmtState, 0.0, 1.0);      /* for x in range 0:1 */
-        y = mwXrandom(dsfmtState, 0.0, 0.1);      /* max of g(x) is 0.092 */
-    }   /* using von Neumann tech */
-    while (y > sqr(x) * mw_pow(1.0 - sqr(x), 3.5));
-
-    return x;
-}
-
 static real hernqCalculateV(real r, real radius, real a, real mass)
 {
     real v;
@@ -128,45 +113,38 @@ static mwvector hernqBodyVelocity(dsfmt_t* dsfmtState, mwvector vshift, real r,
     return vel;
 }
 
-/* generateHernq: generate hernquist model initial conditions
- * Extremely hacky. If you actually want to use this
- * talk to Colin Rice before you do anything. Seriously.
- */
-static int nbGenerateHernqCore(lua_State* luaSt,
-
-                                 dsfmt_t* prng,
-                                 unsigned int nbody,
-                                 real mass,
-
-                                 mwbool ignore,
-
-                                 mwvector rShift,
-                                 mwvector vShift,
-                                 real radius_scale,
-                                 real a)
+typedef struct
+{
+    mwvector rShift;
+    mwvector vShift;
+    real radius_scale;
+    real a;
+    real mass;
+    real massEpsilon;   /* The amount of mass we increase for each particle */
+    body_t type;
+} HernqParams;
+
+/* Body i is placed between the radii enclosing (i + 0.5) and (i + 1.5)
+ * mass epsilons, with the first starting from the center. */
+static void hernqFillBodies(dsfmt_t* prng, const NBodyModelOutput* out, unsigned int first, unsigned int n, const void* params)
 {
     unsigned int i;
-    int table;
     Body b;
-    real r;
-    real radius = 0.0;
-    real massEpsilon = mass / nbody; /* The amount of mass we increase for
-                                        each particle */
-
-    /* Start with half an epsilon */
-    real totalMass = 0.5 * massEpsilon;
+    real r, radius, endradius;
+    const HernqParams* p = (const HernqParams*) params;
 
     memset(&b, 0, sizeof(b));
 
-    b.bodynode.type = BODY(ignore);    /* Same for all in the model */
-    b.bodynode.mass = mass / nbody;    /* Mass per particle */
+    b.bodynode.type = p->type;          /* Same for all in the model */
+    b.bodynode.mass = p->massEpsilon;   /* Mass per particle */
 
-    lua_createtable(luaSt, nbody, 0);
-    table = lua_gettop(luaSt);
+    radius = first == 0 ? 0.0 : hernqRadiusForMass((first + 0.5) * p->massEpsilon,
+                                                   p->radius_scale, p->a, p->mass, p->massEpsilon);
 
-    for (i = 0; i < nbody; ++i)
+    for (i = 0; i < n; ++i)
     {
-        real endradius = hernqNextRadius(radius, totalMass + massEpsilon, radius, a, mass);
+        endradius = hernqRadiusForMass((first + i + 1.5) * p->massEpsilon,
+                                       p->radius_scale, p->a, p->mass, p->massEpsilon);
 
         do
         {
@@ -175,17 +153,45 @@ static int nbGenerateHernqCore(lua_State* luaSt,
         while (isinf(r));
 
         radius = endradius;
-        totalMass += massEpsilon;
 
-        b.bodynode.pos = hernqBodyPosition(prng, rShift, 1, r);
-        b.vel = hernqBodyVelocity(prng, vShift, r, radius_scale, a, mass);
+        b.bodynode.pos = hernqBodyPosition(prng, p->rShift, 1, r);
+        b.vel = hernqBodyVelocity(prng, p->vShift, r, p->radius_scale, p->a, p->mass);
         assert(nbPositionValid(b.bodynode.pos));
 
-        pushBody(luaSt, &b);
-        lua_rawseti(luaSt, table, i + 1);
+        nbStoreModelBody(out, first + i, &b);
     }
+}
+
+/* generateHernq: generate hernquist model initial conditions
+ * Extremely hacky. If you actually want to use this
+ * talk to Colin Rice before you do anything. Seriously.
+ */
+static int nbGenerateHernqCore(lua_State* luaSt,
+
+                                 dsfmt_t* prng,
+                                 unsigned int nbody,
+                                 real mass,
+
+                                 mwbool ignore,
+                                 mwbool asBlock,
+                                 unsigned int chunkSize,
+
+                                 mwvector rShift,
+                                 mwvector vShift,
+                                 real radius_scale,
+                                 real a)
+{
+    HernqParams p;
+
+    p.rShift = rShift;
+    p.vShift = vShift;
+    p.radius_scale = radius_scale;
+    p.a = a;
+    p.mass = mass;
+    p.massEpsilon = mass / nbody;
+    p.type = BODY(ignore);
 
-    return 1;
+    return nbPushModelBodies(luaSt, prng, nbody, chunkSize, asBlock, hernqFillBodies, &p);
 }
 
 int nbGenerateHernq(lua_State* luaSt)
@@ -194,27 +200,36 @@ int nbGenerateHernq(lua_State* luaSt)
     static const mwvector* position = NULL;
     static const mwvector* velocity = NULL;
     static mwbool ignore;
-    static real mass = 0.0, nbodyf = 0.0, radius = 0.0, a = 0.0;
+    static mwbool asBlock;
+    static real mass = 0.0, nbodyf = 0.0, radius = 0.0, a = 0.0, chunkSizef = 0.0;
 
     static const MWNamedArg argTable[] =
         {
-            { "nbody",    LUA_TNUMBER,   NULL,          TRUE,  &nbodyf   },
-            { "mass",     LUA_TNUMBER,   NULL,          TRUE,  &mass     },
-            { "radius",   LUA_TNUMBER,   NULL,          TRUE,  &radius   },
-            { "a",        LUA_TNUMBER,   NULL,          TRUE,  &a        },
-            { "position", LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position },
-            { "velocity", LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity },
-            { "ignore",   LUA_TBOOLEAN,  NULL,          FALSE, &ignore   },
-            { "prng",     LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng     },
+            { "nbody",     LUA_TNUMBER,   NULL,          TRUE,  &nbodyf     },
+            { "mass",      LUA_TNUMBER,   NULL,          TRUE,  &mass       },
+            { "radius",    LUA_TNUMBER,   NULL,          TRUE,  &radius     },
+            { "a",         LUA_TNUMBER,   NULL,          TRUE,  &a          },
+            { "position",  LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position   },
+            { "velocity",  LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity   },
+            { "ignore",    LUA_TBOOLEAN,  NULL,          FALSE, &ignore     },
+            { "block",     LUA_TBOOLEAN,  NULL,          FALSE, &asBlock    },
+            { "chunkSize", LUA_TNUMBER,   NULL,          FALSE, &chunkSizef },
+            { "prng",      LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng       },
             END_MW_NAMED_ARG
         };
 
     if (lua_gettop(luaSt) != 1)
         return luaL_argerror(luaSt, 1, "Expected 1 arguments");
 
+    asBlock = FALSE;
+    chunkSizef = 0.0;
     handleNamedArgumentTable(luaSt, argTable, 1);
 
-    return nbGenerateHernqCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore,
+    if (chunkSizef < 0.0)
+        return luaL_argerror(luaSt, 1, "chunkSize must be >= 0");
+
+    return nbGenerateHernqCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore, asBlock,
+                                 (unsigned int) chunkSizef,
                                  *position, *velocity, radius, a);
 }
 
@@ -21,23 +21,41 @@
 
 #include "nbody_config.h"
 
+#include <string.h>
+
 #include "nbody_util.h"
 #include "nbody_io.h"
 #include "milkyway_util.h"
 #include "nbody_coordinates.h"
+#include "nbody_binary_io.h"
 
-static void nbPrintSimInfoHeader(FILE* f, const NBodyFlags* nbf, const NBodyCtx* ctx, const NBodyState* st)
+/* Columns of the text output are formatted in parallel, a chunk of
+ * bodies at a time into separate buffers, then written out in order */
+#define NB_TEXT_CHUNK_BODIES 2048
+#define NB_TEXT_CHUNKS 32
+
+/* Longest possible line, with every value as long as %22.15f can be */
+#define NB_TEXT_MAX_LINE (12 + 6 * 330)
+
+/* Bodies gathered at a time for the binary output */
+#define NB_BINARY_CHUNK 65536
+
+typedef struct
 {
-    mwvector cmPos;
+    char* buf;
+    size_t len;
+    size_t cap;
+} NBodyTextChunk;
 
-    if (st->tree.root)
-    {
-        cmPos = Pos(st->tree.root);
-    }
-    else
-    {
-        cmPos = nbCenterOfMass(st);
-    }
+
+static mwvector nbOutputCenterOfMass(const NBodyState* st)
+{
+    return st->tree.root ? Pos(st->tree.root) : nbCenterOfMass(st);
+}
+
+static void nbPrintSimInfoHeader(FILE* f, const NBodyFlags* nbf, const NBodyCtx* ctx, const NBodyState* st)
+{
+    mwvector cmPos = nbOutputCenterOfMass(st);
 
     fprintf(f,
             "cartesian    = %d\n"
@@ -62,36 +80,221 @@ static void nbPrintBodyOutputHeader(FILE* f, int cartesian)
         );
 }
 
+#ifdef __SIZEOF_INT128__
+
+/* Find the integer and fraction digits of x rounded to 15 decimal
+ * places, rounding exactly as printf does. With x = m * 2^e,
+ * x * 10^15 = m * 5^15 * 2^(e + 15), and m * 5^15 < 2^88, so this is
+ * exact in 128 bit integers. Returns nonzero if x is not finite or is
+ * too big for the integer part to fit in 64 bits. */
+static int nbFixedDigits(double x, int* neg, uint64_t* intPart, uint64_t* fracPart)
+{
+    const uint64_t pow5_15 = 30517578125ULL;
+    const uint64_t pow10_15 = 1000000000000000ULL;
+    unsigned __int128 p, q, rem, half;
+    uint64_t bits, m;
+    int e, shift;
+
+    memcpy(&bits, &x, sizeof(bits));
+    *neg = (int) (bits >> 63);
+    e = (int) ((bits >> 52) & 0x7ff);
+    m = bits & ((UINT64_C(1) << 52) - 1);
+
+    if (e == 0x7ff)
+        return 1;
+
+    if (e == 0)
+        e = 1;          /* Subnormal */
+    else
+        m |= UINT64_C(1) << 52;
+
+    p = (unsigned __int128) m * pow5_15;
+    shift = e - 1075 + 15;
+
+    if (shift >= 0)
+    {
+        if (shift > 127 - 88)
+            return 1;
+        q = p << shift;
+    }
+    else if (shift <= -89)
+    {
+        q = 0;          /* Less than half of the last place */
+    }
+    else
+    {
+        /* Round half to even */
+        q = p >> -shift;
+        rem = p - (q << -shift);
+        half = (unsigned __int128) 1 << (-shift - 1);
+        if (rem > half || (rem == half && (q & 1)))
+            ++q;
+    }
+
+    if (q / pow10_15 > UINT64_MAX)
+        return 1;
+
+    *intPart = (uint64_t) (q / pow10_15);
+    *fracPart = (uint64_t) (q % pow10_15);
+
+    return 0;
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+/* Same output as sprintf(out, "%22.15f", x) */
+static char* nbPutFixed(char* out, double x)
+{
+  #ifdef __SIZEOF_INT128__
+    char tmp[48];
+    char* s = tmp + sizeof(tmp);
+    uint64_t intPart, fracPart;
+    int neg, i;
+    size_t len;
+
+    if (!nbFixedDigits(x, &neg, &intPart, &fracPart))
+    {
+        for (i = 0; i < 15; ++i)
+        {
+            *--s = (char) ('0' + fracPart % 10);
+            fracPart /= 10;
+        }
+
+        *--s = '.';
+
+        do
+        {
+            *--s = (char) ('0' + intPart % 10);
+            intPart /= 10;
+        }
+        while (intPart);
+
+        if (neg)
+            *--s = '-';
+
+        len = (size_t) (tmp + sizeof(tmp) - s);
+        for (; len < 22; ++len)
+            *out++ = ' ';
+
+        memcpy(out, s, (size_t) (tmp + sizeof(tmp) - s));
+        return out + (tmp + sizeof(tmp) - s);
+    }
+  #endif
+
+    return out + sprintf(out, "%22.15f", x);
+}
+
+/* Format the lines for bodies [first, last) */
+static int nbFormatBodies(NBodyTextChunk* chunk,
+                          const NBodyCtx* ctx,
+                          const NBodyState* st,
+                          int cartesian,
+                          int first,
+                          int last)
+{
+    const Body* p;
+    mwvector r;
+    char* out;
+    char* newBuf;
+    int i;
+
+    chunk->len = 0;
+
+    for (i = first; i < last; ++i)
+    {
+        if (chunk->cap - chunk->len < NB_TEXT_MAX_LINE)
+        {
+            newBuf = (char*) realloc(chunk->buf, 2 * chunk->cap + NB_TEXT_MAX_LINE);
+            if (!newBuf)
+                return 1;
+
+            chunk->buf = newBuf;
+            chunk->cap = 2 * chunk->cap + NB_TEXT_MAX_LINE;
+        }
+
+        p = &st->bodytab[i];
+        r = cartesian ? Pos(p) : cartesianToLbr(Pos(p), ctx->sunGCDist);
+
+        /* Print if model it belongs to is ignored */
+        out = chunk->buf + chunk->len;
+        out += sprintf(out, "%8d,", ignoreBody(p));
+
+        *out++ = ' ';
+        out = nbPutFixed(out, X(r));
+        memcpy(out, ", ", 2);
+        out = nbPutFixed(out + 2, Y(r));
+        memcpy(out, ", ", 2);
+        out = nbPutFixed(out + 2, Z(r));
+        memcpy(out, ", ", 2);
+        out = nbPutFixed(out + 2, X(Vel(p)));
+        memcpy(out, ", ", 2);
+        out = nbPutFixed(out + 2, Y(Vel(p)));
+        memcpy(out, ", ", 2);
+        out = nbPutFixed(out + 2, Z(Vel(p)));
+        *out++ = '\n';
+
+        chunk->len = (size_t) (out - chunk->buf);
+    }
+
+    return 0;
+}
+
 /* output: Print bodies */
 static int nbOutputBodies(FILE* f, const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* nbf)
 {
-    Body* p;
-    mwvector lbr;
-    const Body* endp = st->bodytab + st->nbody;
+    NBodyTextChunk chunks[NB_TEXT_CHUNKS];
+    const int nbody = st->nbody;
+    const int perRound = NB_TEXT_CHUNKS * NB_TEXT_CHUNK_BODIES;
+    int first, c, nChunks;
+    int failed = FALSE;
 
     nbPrintSimInfoHeader(f, nbf, ctx, st);
     nbPrintBodyOutputHeader(f, nbf->outputCartesian);
 
-    for (p = st->bodytab; p < endp; p++)
+    memset(chunks, 0, sizeof(chunks));
+
+    for (first = 0; first < nbody && !failed; first += perRound)
     {
-        fprintf(f, "%8d,", ignoreBody(p));  /* Print if model it belongs to is ignored */
-        if (nbf->outputCartesian)
+        nChunks = (MIN(perRound, nbody - first) + NB_TEXT_CHUNK_BODIES - 1) / NB_TEXT_CHUNK_BODIES;
+
+      #ifdef _OPENMP
+        #pragma omp parallel for private(c) schedule(dynamic, 1) reduction(|:failed)
+      #endif
+        for (c = 0; c < nChunks; ++c)
+        {
+            int chunkFirst = first + c * NB_TEXT_CHUNK_BODIES;
+            int chunkLast = MIN(chunkFirst + NB_TEXT_CHUNK_BODIES, nbody);
+
+            failed |= nbFormatBodies(&chunks[c], ctx, st, nbf->outputCartesian, chunkFirst, chunkLast);
+        }
+
+        if (failed)
         {
-            fprintf(f,
-                    " %22.15f, %22.15f, %22.15f, %22.15f, %22.15f, %22.15f\n",
-                    X(Pos(p)), Y(Pos(p)), Z(Pos(p)),
-                    X(Vel(p)), Y(Vel(p)), Z(Vel(p)));
+            mw_printf("Failed to allocate body output buffer\n");
+            break;
         }
-        else
+
+        for (c = 0; c < nChunks; ++c)
         {
-            lbr = cartesianToLbr(Pos(p), ctx->sunGCDist);
-            fprintf(f,
-                    " %22.15f, %22.15f, %22.15f, %22.15f, %22.15f, %22.15f\n",
-                    L(lbr), B(lbr), R(lbr),
-                    X(Vel(p)), Y(Vel(p)), Z(Vel(p)));
+            if (fwrite(chunks[c].buf, 1, chunks[c].len, f) != chunks[c].len)
+            {
+                mwPerror("Writing bodies");
+                failed = TRUE;
+                break;
+            }
         }
     }
 
+    for (c = 0; c < NB_TEXT_CHUNKS; ++c)
+    {
+        free(chunks[c].buf);
+    }
+
+    if (failed)
+    {
+        return TRUE;
+    }
+
     if (fflush(f))
     {
         mwPerror("Body output flush");
@@ -101,6 +304,120 @@ static int nbOutputBodies(FILE* f, const NBodyCtx* ctx, const NBodyState* st, co
     return FALSE;
 }
 
+/* Store value v in column k of the chunk as little endian */
+static void nbPutBinaryColumn(double* cols, int k, int i, double v, int swap)
+{
+    if (swap)
+        nbPutF64((uint8_t*) &cols[k * NB_BINARY_CHUNK + i], v);
+    else
+        cols[k * NB_BINARY_CHUNK + i] = v;
+}
+
+/* Binary body output. Everything is little endian:
+
+     char[8]   "mwbodies"
+     uint32    version
+     uint32    flags: 1 if positions are cartesian, 2 if the milkyway
+               potential was used
+     uint64    nbody
+     float64   centerOfMass x, y, z
+     float64   sunGCDist
+     uint8     ignore[nbody], zero padded to a multiple of 8 bytes
+     float64   x or l [nbody]
+     float64   y or b [nbody]
+     float64   z or r [nbody]
+     float64   v_x [nbody]
+     float64   v_y [nbody]
+     float64   v_z [nbody]
+
+   Each column is contiguous, so the file can be mapped straight into
+   arrays. l and b are in degrees, as in the text output.
+
+   The bodies are converted a chunk at a time, all six columns at once
+   so each position is converted to l, b, r only once, and each column
+   of the chunk is then written at its own place in the file. */
+static int nbOutputBodiesBinary(FILE* f, const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* nbf)
+{
+    uint8_t header[56];
+    uint8_t* buf;
+    double* cols;
+    uint8_t pad[8] = { 0 };
+    mwvector cmPos = nbOutputCenterOfMass(st);
+    const int nbody = st->nbody;
+    const int cartesian = nbf->outputCartesian;
+    const int swap = nbHostIsBigEndian();
+    const uint64_t dataOffset = sizeof(header) + (((uint64_t) nbody + 7) & ~(uint64_t) 7);
+    int i, k, first, n;
+    int failed = FALSE;
+
+    memcpy(header, NBODY_BINARY_OUTPUT_MAGIC, 8);
+    nbPutU32(header + 8, NBODY_BINARY_OUTPUT_VERSION);
+    nbPutU32(header + 12, (cartesian ? 1 : 0) | (ctx->potentialType == EXTERNAL_POTENTIAL_DEFAULT ? 2 : 0));
+    nbPutU64(header + 16, (uint64_t) nbody);
+    nbPutF64(header + 24, X(cmPos));
+    nbPutF64(header + 32, Y(cmPos));
+    nbPutF64(header + 40, Z(cmPos));
+    nbPutF64(header + 48, ctx->sunGCDist);
+
+    buf = (uint8_t*) mwMalloc(6 * NB_BINARY_CHUNK * sizeof(double));
+    cols = (double*) buf;
+
+    failed |= (fwrite(header, 1, sizeof(header), f) != sizeof(header));
+
+    for (first = 0; first < nbody && !failed; first += NB_BINARY_CHUNK)
+    {
+        n = MIN(NB_BINARY_CHUNK, nbody - first);
+        for (i = 0; i < n; ++i)
+        {
+            buf[i] = (uint8_t) ignoreBody(&st->bodytab[first + i]);
+        }
+
+        failed |= (fwrite(buf, 1, n, f) != (size_t) n);
+    }
+
+    if (nbody % 8 != 0)
+    {
+        failed |= (fwrite(pad, 1, 8 - nbody % 8, f) != (size_t) (8 - nbody % 8));
+    }
+
+    for (first = 0; first < nbody && !failed; first += NB_BINARY_CHUNK)
+    {
+        n = MIN(NB_BINARY_CHUNK, nbody - first);
+
+      #ifdef _OPENMP
+        #pragma omp parallel for private(i) schedule(static)
+      #endif
+        for (i = 0; i < n; ++i)
+        {
+            const Body* p = &st->bodytab[first + i];
+            mwvector r = cartesian ? Pos(p) : cartesianToLbr(Pos(p), ctx->sunGCDist);
+
+            nbPutBinaryColumn(cols, 0, i, X(r), swap);
+            nbPutBinaryColumn(cols, 1, i, Y(r), swap);
+            nbPutBinaryColumn(cols, 2, i, Z(r), swap);
+            nbPutBinaryColumn(cols, 3, i, X(Vel(p)), swap);
+            nbPutBinaryColumn(cols, 4, i, Y(Vel(p)), swap);
+            nbPutBinaryColumn(cols, 5, i, Z(Vel(p)), swap);
+        }
+
+        for (k = 0; k < 6 && !failed; ++k)
+        {
+            failed |= nbSeekFile(f, dataOffset + ((uint64_t) k * nbody + first) * sizeof(double));
+            failed |= (fwrite(&cols[k * NB_BINARY_CHUNK], sizeof(double), n, f) != (size_t) n);
+        }
+    }
+
+    free(buf);
+
+    if (failed || fflush(f))
+    {
+        mwPerror("Writing binary body output");
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 int nbWriteBodies(const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* nbf)
 {
     FILE* f;
@@ -120,8 +437,7 @@ int nbWriteBodies(const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* n
 
     if (nbf->outputBinary)
     {
-        mw_printf("Binary output unimplemented\n");
-        return 1;
+        rc = nbOutputBodiesBinary(f, ctx, st, nbf);
     }
     else
     {
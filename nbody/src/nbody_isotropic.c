@@ -25,6 +25,8 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_lua.h"
 #include "nbody_lua_types.h"
 #include "nbody_isotropic.h"
+#include "nbody_model_util.h"
+#include "nbody_sampler.h"
 
 /* pickshell: pick a random point on a sphere of specified radius. */
 static inline mwvector pickShell(dsfmt_t* dsfmtState, real rad)
@@ -71,7 +73,24 @@ static inline real isotropicRandomR(dsfmt_t* dsfmtState, real scaleRad1, real sc
   return r;
 }
 
+typedef struct
+{
+    real scaleRad1;
+    real scaleRad2;
+    real Mass1;
+    real Mass2;
+} IsotropicDensityArgs;
+
+/* The density isotropicRandomR samples by rejection, for the
+ * tabulated sampler. The exponent there is written -5/2, which is an
+ * integer -2, and that is kept here so both give the same model. */
+static real isotropicRadiusDensity(real r, const void* args)
+{
+    const IsotropicDensityArgs* d = (const IsotropicDensityArgs*) args;
 
+    return 3.0 / (4.0 * M_PI) * (d->Mass1 / cube(d->scaleRad1) / sqr(1.0 + sqr(r) / sqr(d->scaleRad1))
+                                 + d->Mass2 / cube(d->scaleRad2) / sqr(1.0 + sqr(r) / sqr(d->scaleRad2)));
+}
 
 static inline real isotropicRandomV(real r, real scaleRad1, real scaleRad2,                                                                                                             				    real Mass1, real Mass2)  
 {
@@ -112,6 +131,50 @@ static inline mwvector isotropicBodyVelocity(dsfmt_t* dsfmtState,real r, mwvecto
  * etc).  See Aarseth, SJ, Henon, M, & Wielen, R (1974) Astr & Ap, 37,
  * 183.
  */
+typedef struct
+{
+    mwvector rShift;
+    mwvector vShift;
+    real radiusScale1;
+    real radiusScale2;
+    real mass1;
+    real mass2;
+    real velScale;
+    real mass;      /* Mass per particle */
+    body_t type;
+    const NBodySampler* radiusSampler;  /* NULL to sample radii by rejection */
+} IsotropicParams;
+
+static void isotropicFillBodies(dsfmt_t* prng, const NBodyModelOutput* out, unsigned int first, unsigned int n, const void* params)
+{
+    unsigned int i;
+    Body b;
+    real r;
+    const IsotropicParams* p = (const IsotropicParams*) params;
+
+    memset(&b, 0, sizeof(b));
+
+    b.bodynode.type = p->type;      /* Same for all in the model */
+    b.bodynode.mass = p->mass;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (p->radiusSampler)
+            r = nbSample(p->radiusSampler, prng);
+        else
+            r = isotropicRandomR(prng, p->radiusScale1, p->radiusScale2, p->mass1, p->mass2);
+
+        b.bodynode.pos = isotropicBodyPosition(prng, p->rShift, r);
+
+        b.vel = isotropicBodyVelocity(prng, r, p->vShift, p->velScale,
+                                      p->radiusScale1, p->radiusScale2, p->mass1, p->mass2);
+
+        assert(nbPositionValid(b.bodynode.pos));
+
+        nbStoreModelBody(out, first + i, &b);
+    }
+}
+
 static int nbGenerateIsotropicCore(lua_State* luaSt,
 
 				   dsfmt_t* prng,
@@ -120,52 +183,53 @@ static int nbGenerateIsotropicCore(lua_State* luaSt,
 				   real mass2,
 
 				   mwbool ignore,
-				   
+				   mwbool asBlock,
+				   unsigned int chunkSize,
+				   mwbool tabulated,
+
 				   mwvector rShift,
 				   mwvector vShift,
 				   real radiusScale1,
 				   real radiusScale2)
 {
-    unsigned int i;
-    int table;
-    Body b;
-    real r, velScale;
+    int rc;
+    IsotropicParams p;
+    IsotropicDensityArgs d;
+    NBodySampler* radiusSampler = NULL;
 
     real mass = mass1 + mass2;
     real radiusScale = mw_sqrt(mw_pow(radiusScale1,2) + mw_pow(radiusScale2,2));
-    memset(&b, 0, sizeof(b));
 
-    velScale =  mw_sqrt(mass / radiusScale);     /* and recip. speed scale */
-
-    b.bodynode.type = BODY(ignore);    /* Same for all in the model */
-    b.bodynode.mass = mass / nbody;    /* Mass per particle */
-
-    lua_createtable(luaSt, nbody, 0);
-    table = lua_gettop(luaSt);
-    
-    for (i = 0; i < nbody; ++i)
+    p.rShift = rShift;
+    p.vShift = vShift;
+    p.radiusScale1 = radiusScale1;
+    p.radiusScale2 = radiusScale2;
+    p.mass1 = mass1;
+    p.mass2 = mass2;
+    p.velScale = mw_sqrt(mass / radiusScale);     /* and recip. speed scale */
+    p.mass = mass / nbody;
+    p.type = BODY(ignore);
+
+    if (tabulated)
     {
-        do
+        /* Radii are sampled over [0, 3 (a1 + a2)] */
+        d.scaleRad1 = radiusScale1;
+        d.scaleRad2 = radiusScale2;
+        d.Mass1 = mass1;
+        d.Mass2 = mass2;
+        radiusSampler = (NBodySampler*) mwMalloc(sizeof(NBodySampler));
+        if (nbInitSampler(radiusSampler, isotropicRadiusDensity, &d, 0.0, 3.0 * (radiusScale1 + radiusScale2)))
         {
-	  r = isotropicRandomR(prng, radiusScale1, radiusScale2, mass1, mass2);
-	    /* FIXME: We should avoid the divide by 0.0 by multiplying
-             * the original random number by 0.9999.. but I'm too lazy
-             * to change the tests. Same with other models */
+            free(radiusSampler);
+            return luaL_error(luaSt, "Invalid isotropic model parameters");
         }
-        while (isinf(r));
-
-        b.bodynode.pos = isotropicBodyPosition(prng, rShift, r);
-
-        b.vel = isotropicBodyVelocity(prng, r, vShift, velScale, radiusScale1, radiusScale2, mass1, mass2);
-	
-        assert(nbPositionValid(b.bodynode.pos));
-
-        pushBody(luaSt, &b);
-	//	printf("Body %d is pushed. \n",i);
-        lua_rawseti(luaSt, table, i + 1);
     }
+    p.radiusSampler = radiusSampler;
 
-    return 1;
+    rc = nbPushModelBodies(luaSt, prng, nbody, chunkSize, asBlock, isotropicFillBodies, &p);
+    free(radiusSampler);
+
+    return rc;
 }
 
 int nbGenerateIsotropic(lua_State* luaSt)
@@ -174,8 +238,10 @@ int nbGenerateIsotropic(lua_State* luaSt)
     static const mwvector* position = NULL;
     static const mwvector* velocity = NULL;
     static mwbool ignore;
+    static mwbool asBlock;
+    static mwbool tabulated;
     static real mass1 = 0.0, nbodyf = 0.0, radiusScale1 = 0.0;
-    static real mass2 = 0.0, radiusScale2 = 0.0;
+    static real mass2 = 0.0, radiusScale2 = 0.0, chunkSizef = 0.0;
 
     static const MWNamedArg argTable[] =
         {
@@ -187,6 +253,9 @@ int nbGenerateIsotropic(lua_State* luaSt)
 	  { "position",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position    },
 	  { "velocity",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity    },
 	  { "ignore",       LUA_TBOOLEAN,  NULL,          FALSE, &ignore      },
+	  { "block",        LUA_TBOOLEAN,  NULL,          FALSE, &asBlock     },
+	  { "chunkSize",    LUA_TNUMBER,   NULL,          FALSE, &chunkSizef  },
+	  { "tabulated",    LUA_TBOOLEAN,  NULL,          FALSE, &tabulated   },
 	  { "prng",         LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng        },
 	  END_MW_NAMED_ARG
         };
@@ -194,9 +263,16 @@ int nbGenerateIsotropic(lua_State* luaSt)
     if (lua_gettop(luaSt) != 1)
         return luaL_argerror(luaSt, 1, "Expected 1 arguments");
 
+    asBlock = FALSE;
+    tabulated = FALSE;
+    chunkSizef = 0.0;
     handleNamedArgumentTable(luaSt, argTable, 1);
 
-    return nbGenerateIsotropicCore(luaSt, prng, (unsigned int) nbodyf, mass1, mass2, ignore,
+    if (chunkSizef < 0.0)
+        return luaL_argerror(luaSt, 1, "chunkSize must be >= 0");
+
+    return nbGenerateIsotropicCore(luaSt, prng, (unsigned int) nbodyf, mass1, mass2, ignore, asBlock,
+                                 (unsigned int) chunkSizef, tabulated,
                                  *position, *velocity, radiusScale1, radiusScale2);
 }
 
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "nbody_types.h"
+#include "nbody_lua_body.h"
+#include "nbody_lua_bodyblock.h"
+#include "milkyway_lua.h"
+#include "milkyway_util.h"
+
+NBodyBlock* checkBodyBlock(lua_State* luaSt, int idx)
+{
+    return (NBodyBlock*) mw_checknamedudata(luaSt, idx, NBODYBLOCK_TYPE);
+}
+
+NBodyBlock* toBodyBlock(lua_State* luaSt, int idx)
+{
+    return (NBodyBlock*) mw_tonamedudata(luaSt, idx, NBODYBLOCK_TYPE);
+}
+
+NBodyBlock* pushNewBodyBlock(lua_State* luaSt, int nbody)
+{
+    NBodyBlock block;
+
+    block.nbody = nbody;
+    block.bodies = nbody > 0 ? (Body*) mwCallocA(nbody, sizeof(Body)) : NULL;
+
+    pushType(luaSt, NBODYBLOCK_TYPE, sizeof(NBodyBlock), (void*) &block);
+    return (NBodyBlock*) lua_touserdata(luaSt, -1);
+}
+
+Body* nbTakeBodyBlock(NBodyBlock* block, int* nOut)
+{
+    Body* bodies = block->bodies;
+
+    if (nOut)
+        *nOut = block->nbody;
+
+    block->bodies = NULL;
+    block->nbody = 0;
+
+    return bodies;
+}
+
+/* Index of body argument, counting from 1 like a table */
+static int checkBodyBlockIndex(lua_State* luaSt, const NBodyBlock* block, int idx)
+{
+    int i = luaL_checkint(luaSt, idx);
+
+    luaL_argcheck(luaSt, i >= 1 && i <= block->nbody, idx, "Body index out of range");
+    return i - 1;
+}
+
+/* BodyBlock.create(table of bodies) */
+static int createBodyBlock(lua_State* luaSt)
+{
+    int i, n, table;
+    NBodyBlock* block;
+    const Body* b;
+
+    if (lua_gettop(luaSt) != 1)
+        return luaL_argerror(luaSt, 1, "Expected 1 argument");
+
+    luaL_checktype(luaSt, 1, LUA_TTABLE);
+    table = 1;
+    n = luaL_getn(luaSt, table);
+
+    block = pushNewBodyBlock(luaSt, n);
+
+    for (i = 0; i < n; ++i)
+    {
+        lua_rawgeti(luaSt, table, i + 1);
+        b = toBody(luaSt, lua_gettop(luaSt));
+        if (!b)
+            return luaL_error(luaSt, "Item %d of table is not a Body", i + 1);
+
+        block->bodies[i] = *b;
+        lua_pop(luaSt, 1);
+    }
+
+    return 1;
+}
+
+/* BodyBlock.concat(block1, block2, ...) */
+static int concatBodyBlocks(lua_State* luaSt)
+{
+    int i, n, total, nArgs;
+    NBodyBlock* block;
+    const NBodyBlock* src;
+
+    nArgs = lua_gettop(luaSt);
+    total = 0;
+    for (i = 1; i <= nArgs; ++i)
+    {
+        total += checkBodyBlock(luaSt, i)->nbody;
+    }
+
+    block = pushNewBodyBlock(luaSt, total);
+
+    n = 0;
+    for (i = 1; i <= nArgs; ++i)
+    {
+        src = toBodyBlock(luaSt, i);
+        if (src->nbody > 0)
+            memcpy(&block->bodies[n], src->bodies, src->nbody * sizeof(Body));
+        n += src->nbody;
+    }
+
+    return 1;
+}
+
+static int gcBodyBlock(lua_State* luaSt)
+{
+    NBodyBlock* block = checkBodyBlock(luaSt, 1);
+
+    mwFreeA(block->bodies);
+    block->bodies = NULL;
+    block->nbody = 0;
+
+    return 0;
+}
+
+static int lenBodyBlock(lua_State* luaSt)
+{
+    lua_pushinteger(luaSt, checkBodyBlock(luaSt, 1)->nbody);
+    return 1;
+}
+
+static int toStringBodyBlock(lua_State* luaSt)
+{
+    lua_pushfstring(luaSt, "BodyBlock { nbody = %d }", checkBodyBlock(luaSt, 1)->nbody);
+    return 1;
+}
+
+static int getBodyBlockItem(lua_State* luaSt)
+{
+    const NBodyBlock* block = checkBodyBlock(luaSt, 1);
+
+    return pushBody(luaSt, &block->bodies[checkBodyBlockIndex(luaSt, block, 2)]);
+}
+
+static int setBodyBlockItem(lua_State* luaSt)
+{
+    NBodyBlock* block = checkBodyBlock(luaSt, 1);
+
+    block->bodies[checkBodyBlockIndex(luaSt, block, 2)] = *checkBody(luaSt, 3);
+    return 0;
+}
+
+/* Copy out into a table of Body like the generators return by default */
+static int bodyBlockToTable(lua_State* luaSt)
+{
+    int i, table;
+    const NBodyBlock* block = checkBodyBlock(luaSt, 1);
+
+    lua_createtable(luaSt, block->nbody, 0);
+    table = lua_gettop(luaSt);
+
+    for (i = 0; i < block->nbody; ++i)
+    {
+        pushBody(luaSt, &block->bodies[i]);
+        lua_rawseti(luaSt, table, i + 1);
+    }
+
+    return 1;
+}
+
+/* block:translate(position shift, velocity shift) */
+static int translateBodyBlock(lua_State* luaSt)
+{
+    int i;
+    NBodyBlock* block = checkBodyBlock(luaSt, 1);
+    const mwvector dr = *checkVector(luaSt, 2);
+    const mwvector dv = *checkVector(luaSt, 3);
+
+    for (i = 0; i < block->nbody; ++i)
+    {
+        mw_incaddv(Pos(&block->bodies[i]), dr);
+        mw_incaddv(Vel(&block->bodies[i]), dv);
+    }
+
+    return 0;
+}
+
+static int scaleMassBodyBlock(lua_State* luaSt)
+{
+    int i;
+    NBodyBlock* block = checkBodyBlock(luaSt, 1);
+    const real f = (real) luaL_checknumber(luaSt, 2);
+
+    for (i = 0; i < block->nbody; ++i)
+    {
+        Mass(&block->bodies[i]) *= f;
+    }
+
+    return 0;
+}
+
+static int setIgnoreBodyBlock(lua_State* luaSt)
+{
+    int i;
+    NBodyBlock* block = checkBodyBlock(luaSt, 1);
+    const body_t type = BODY(mw_lua_checkboolean(luaSt, 2));
+
+    for (i = 0; i < block->nbody; ++i)
+    {
+        Type(&block->bodies[i]) = type;
+    }
+
+    return 0;
+}
+
+static const luaL_reg metaMethodsBodyBlock[] =
+{
+    { "__gc",       gcBodyBlock       },
+    { "__len",      lenBodyBlock      },
+    { "__concat",   concatBodyBlocks  },
+    { "__tostring", toStringBodyBlock },
+    { NULL, NULL }
+};
+
+static const luaL_reg methodsBodyBlock[] =
+{
+    { "create",    createBodyBlock     },
+    { "concat",    concatBodyBlocks    },
+    { "get",       getBodyBlockItem    },
+    { "set",       setBodyBlockItem    },
+    { "toTable",   bodyBlockToTable    },
+    { "translate", translateBodyBlock  },
+    { "scaleMass", scaleMassBodyBlock  },
+    { "setIgnore", setIgnoreBodyBlock  },
+    { NULL, NULL }
+};
+
+static const Xet_reg_pre gettersBodyBlock[] =
+{
+    { "nbody", getInt, offsetof(NBodyBlock, nbody) },
+    { NULL, NULL, 0 }
+};
+
+static const Xet_reg_pre settersBodyBlock[] =
+{
+    { NULL, NULL, 0 }
+};
+
+int registerBodyBlock(lua_State* luaSt)
+{
+    return registerStruct(luaSt,
+                          NBODYBLOCK_TYPE,
+                          gettersBodyBlock,
+                          settersBodyBlock,
+                          metaMethodsBodyBlock,
+                          methodsBodyBlock);
+}
@@ -51,6 +51,7 @@ static int createHistogramParams(lua_State* luaSt)
 {
     int nArgs;
     static HistogramParams hp = EMPTY_HISTOGRAM_PARAMS;
+    static const HistogramParams emptyHp = EMPTY_HISTOGRAM_PARAMS;
 
     static const MWNamedArg argTable[] =
         {
@@ -60,6 +61,17 @@ static int createHistogramParams(lua_State* luaSt)
             { "endRaw",   LUA_TNUMBER, NULL, TRUE, &hp.endRaw   },
             { "binSize",  LUA_TNUMBER, NULL, TRUE, &hp.binSize  },
             { "center",   LUA_TNUMBER, NULL, TRUE, &hp.center   },
+
+            { "betaStart",       LUA_TNUMBER,  NULL, FALSE, &hp.beta.start       },
+            { "betaEnd",         LUA_TNUMBER,  NULL, FALSE, &hp.beta.end         },
+            { "betaBinSize",     LUA_TNUMBER,  NULL, FALSE, &hp.beta.binSize     },
+            { "distanceStart",   LUA_TNUMBER,  NULL, FALSE, &hp.distance.start   },
+            { "distanceEnd",     LUA_TNUMBER,  NULL, FALSE, &hp.distance.end     },
+            { "distanceBinSize", LUA_TNUMBER,  NULL, FALSE, &hp.distance.binSize },
+            { "vlosStart",       LUA_TNUMBER,  NULL, FALSE, &hp.vlos.start       },
+            { "vlosEnd",         LUA_TNUMBER,  NULL, FALSE, &hp.vlos.end         },
+            { "vlosBinSize",     LUA_TNUMBER,  NULL, FALSE, &hp.vlos.binSize     },
+            { "sparse",          LUA_TBOOLEAN, NULL, FALSE, &hp.sparse           },
             END_MW_NAMED_ARG
         };
 
@@ -70,6 +82,8 @@ static int createHistogramParams(lua_State* luaSt)
     }
     else if (nArgs == 1)
     {
+        /* Optional arguments would otherwise keep the last call's values */
+        hp = emptyHp;
         handleNamedArgumentTable(luaSt, argTable, 1);
         pushHistogramParams(luaSt, &hp);
     }
@@ -125,6 +139,17 @@ static const Xet_reg_pre gettersHistogramParams[] =
     { "endRaw",   getNumber, offsetof(HistogramParams, endRaw)   },
     { "binSize",  getNumber, offsetof(HistogramParams, binSize)  },
     { "center",   getNumber, offsetof(HistogramParams, center)   },
+
+    { "betaStart",       getNumber, offsetof(HistogramParams, beta.start)       },
+    { "betaEnd",         getNumber, offsetof(HistogramParams, beta.end)         },
+    { "betaBinSize",     getNumber, offsetof(HistogramParams, beta.binSize)     },
+    { "distanceStart",   getNumber, offsetof(HistogramParams, distance.start)   },
+    { "distanceEnd",     getNumber, offsetof(HistogramParams, distance.end)     },
+    { "distanceBinSize", getNumber, offsetof(HistogramParams, distance.binSize) },
+    { "vlosStart",       getNumber, offsetof(HistogramParams, vlos.start)       },
+    { "vlosEnd",         getNumber, offsetof(HistogramParams, vlos.end)         },
+    { "vlosBinSize",     getNumber, offsetof(HistogramParams, vlos.binSize)     },
+    { "sparse",          getBool,   offsetof(HistogramParams, sparse)           },
     { NULL, NULL, 0 }
 };
 
@@ -136,6 +161,17 @@ static const Xet_reg_pre settersHistogramParams[] =
     { "endRaw",   setNumber, offsetof(HistogramParams, endRaw)   },
     { "binSize",  setNumber, offsetof(HistogramParams, binSize)  },
     { "center",   setNumber, offsetof(HistogramParams, center)   },
+
+    { "betaStart",       setNumber, offsetof(HistogramParams, beta.start)       },
+    { "betaEnd",         setNumber, offsetof(HistogramParams, beta.end)         },
+    { "betaBinSize",     setNumber, offsetof(HistogramParams, beta.binSize)     },
+    { "distanceStart",   setNumber, offsetof(HistogramParams, distance.start)   },
+    { "distanceEnd",     setNumber, offsetof(HistogramParams, distance.end)     },
+    { "distanceBinSize", setNumber, offsetof(HistogramParams, distance.binSize) },
+    { "vlosStart",       setNumber, offsetof(HistogramParams, vlos.start)       },
+    { "vlosEnd",         setNumber, offsetof(HistogramParams, vlos.end)         },
+    { "vlosBinSize",     setNumber, offsetof(HistogramParams, vlos.binSize)     },
+    { "sparse",          setBool,   offsetof(HistogramParams, sparse)           },
     { NULL, NULL, 0 }
 };
 
@@ -53,6 +53,20 @@ static int setCriterionT(lua_State* luaSt, void* v)
     return 0;
 }
 
+static int setTimestepLevels(lua_State* luaSt, void* v)
+{
+    int levels = luaL_checkint(luaSt, 3);
+
+    if (levels < 0 || levels > NB_MAX_TIMESTEP_LEVELS)
+    {
+        return luaL_argerror(luaSt, 3, lua_pushfstring(luaSt, "timestepLevels must be between 0 and %d",
+                                                       NB_MAX_TIMESTEP_LEVELS));
+    }
+
+    *(int*) v = levels;
+    return 0;
+}
+
 NBodyCtx* checkNBodyCtx(lua_State* luaSt, int idx)
 {
     return (NBodyCtx*) mw_checknamedudata(luaSt, idx, NBODYCTX_TYPE);
@@ -83,24 +97,39 @@ static int createNBodyCtx(lua_State* luaSt)
     static NBodyCtx ctx;
     static const char* criterionName = NULL;
     double nStepf = 0.0;
+    static real bodySortIntervalf = 0.0;
+    static real groupSizef = 0.0;
+    static real treeRebuildIntervalf = 0.0;
+    static real timestepLevelsf = 0.0;
 
     static const MWNamedArg argTable[] =
         {
-            { "timestep",    LUA_TNUMBER,  NULL, TRUE,  &ctx.timestep    },
-            { "timeEvolve",  LUA_TNUMBER,  NULL, TRUE,  &ctx.timeEvolve  },
-            { "theta",       LUA_TNUMBER,  NULL, FALSE, &ctx.theta       },
-            { "eps2",        LUA_TNUMBER,  NULL, TRUE,  &ctx.eps2        },
-            { "treeRSize",   LUA_TNUMBER,  NULL, FALSE, &ctx.treeRSize   },
-            { "sunGCDist",   LUA_TNUMBER,  NULL, FALSE, &ctx.sunGCDist   },
-            { "criterion",   LUA_TSTRING,  NULL, FALSE, &criterionName   },
-            { "useQuad",     LUA_TBOOLEAN, NULL, FALSE, &ctx.useQuad     },
-            { "allowIncest", LUA_TBOOLEAN, NULL, FALSE, &ctx.allowIncest },
-            { "quietErrors", LUA_TBOOLEAN, NULL, FALSE, &ctx.quietErrors },
+            { "timestep",         LUA_TNUMBER,  NULL, TRUE,  &ctx.timestep       },
+            { "timeEvolve",       LUA_TNUMBER,  NULL, TRUE,  &ctx.timeEvolve     },
+            { "theta",            LUA_TNUMBER,  NULL, FALSE, &ctx.theta          },
+            { "eps2",             LUA_TNUMBER,  NULL, TRUE,  &ctx.eps2           },
+            { "treeRSize",        LUA_TNUMBER,  NULL, FALSE, &ctx.treeRSize      },
+            { "sunGCDist",        LUA_TNUMBER,  NULL, FALSE, &ctx.sunGCDist      },
+            { "criterion",        LUA_TSTRING,  NULL, FALSE, &criterionName      },
+            { "useQuad",          LUA_TBOOLEAN, NULL, FALSE, &ctx.useQuad        },
+            { "allowIncest",      LUA_TBOOLEAN, NULL, FALSE, &ctx.allowIncest    },
+            { "quietErrors",      LUA_TBOOLEAN, NULL, FALSE, &ctx.quietErrors    },
+            { "parallelTree",     LUA_TBOOLEAN, NULL, FALSE, &ctx.parallelTree   },
+            { "bodySortInterval", LUA_TNUMBER,  NULL, FALSE, &bodySortIntervalf  },
+            { "flatTree",         LUA_TBOOLEAN, NULL, FALSE, &ctx.flatTree       },
+            { "groupSize",        LUA_TNUMBER,  NULL, FALSE, &groupSizef         },
+            { "treeRebuildInterval", LUA_TNUMBER, NULL, FALSE, &treeRebuildIntervalf },
+            { "timestepLevels",   LUA_TNUMBER,  NULL, FALSE, &timestepLevelsf    },
+            { "timestepEta",      LUA_TNUMBER,  NULL, FALSE, &ctx.timestepEta    },
             END_MW_NAMED_ARG
         };
 
     criterionName = NULL;
     ctx = defaultNBodyCtx;
+    bodySortIntervalf = (real) ctx.bodySortInterval;
+    groupSizef = (real) ctx.groupSize;
+    treeRebuildIntervalf = (real) ctx.treeRebuildInterval;
+    timestepLevelsf = (real) ctx.timestepLevels;
 
     if (lua_gettop(luaSt) != 1)
         return luaL_argerror(luaSt, 1, "Expected named argument table");
@@ -125,6 +154,36 @@ static int createNBodyCtx(lua_State* luaSt)
         ctx.useQuad = FALSE;
     }
 
+    if (bodySortIntervalf < 0.0 || bodySortIntervalf >= (real) INT_MAX)
+    {
+        return luaL_argerror(luaSt, 1, "bodySortInterval must be a non-negative number of steps");
+    }
+    ctx.bodySortInterval = (int) bodySortIntervalf;
+
+    if (groupSizef < 0.0 || groupSizef >= (real) INT_MAX)
+    {
+        return luaL_argerror(luaSt, 1, "groupSize must be a non-negative number of bodies");
+    }
+    ctx.groupSize = (int) groupSizef;
+
+    if (treeRebuildIntervalf < 0.0 || treeRebuildIntervalf >= (real) INT_MAX)
+    {
+        return luaL_argerror(luaSt, 1, "treeRebuildInterval must be a non-negative number of steps");
+    }
+    ctx.treeRebuildInterval = (int) treeRebuildIntervalf;
+
+    if (timestepLevelsf < 0.0 || timestepLevelsf > (real) NB_MAX_TIMESTEP_LEVELS)
+    {
+        return luaL_argerror(luaSt, 1, lua_pushfstring(luaSt, "timestepLevels must be between 0 and %d",
+                                                       NB_MAX_TIMESTEP_LEVELS));
+    }
+    ctx.timestepLevels = (int) timestepLevelsf;
+
+    if (!(ctx.timestepEta > 0.0))
+    {
+        return luaL_argerror(luaSt, 1, "timestepEta must be positive");
+    }
+
     nStepf = mw_ceil(ctx.timeEvolve / ctx.timestep);
     if (nStepf >= (double) UINT_MAX)
     {
@@ -202,31 +261,45 @@ static const luaL_reg methodsNBodyCtx[] =
 
 static const Xet_reg_pre gettersNBodyCtx[] =
 {
-    { "timestep",        getNumber,     offsetof(NBodyCtx, timestep)    },
-    { "timeEvolve",      getNumber,     offsetof(NBodyCtx, timeEvolve)  },
-    { "theta",           getNumber,     offsetof(NBodyCtx, theta)       },
-    { "eps2",            getNumber,     offsetof(NBodyCtx, eps2)        },
-    { "treeRSize",       getNumber,     offsetof(NBodyCtx, treeRSize)   },
-    { "sunGCDist",       getNumber,     offsetof(NBodyCtx, sunGCDist)   },
-    { "criterion",       getCriterionT, offsetof(NBodyCtx, criterion)   },
-    { "useQuad",         getBool,       offsetof(NBodyCtx, useQuad)     },
-    { "allowIncest",     getBool,       offsetof(NBodyCtx, allowIncest) },
-    { "quietErrors",     getBool,       offsetof(NBodyCtx, quietErrors) },
+    { "timestep",         getNumber,     offsetof(NBodyCtx, timestep)         },
+    { "timeEvolve",       getNumber,     offsetof(NBodyCtx, timeEvolve)       },
+    { "theta",            getNumber,     offsetof(NBodyCtx, theta)            },
+    { "eps2",             getNumber,     offsetof(NBodyCtx, eps2)             },
+    { "treeRSize",        getNumber,     offsetof(NBodyCtx, treeRSize)        },
+    { "sunGCDist",        getNumber,     offsetof(NBodyCtx, sunGCDist)        },
+    { "criterion",        getCriterionT, offsetof(NBodyCtx, criterion)        },
+    { "useQuad",          getBool,       offsetof(NBodyCtx, useQuad)          },
+    { "allowIncest",      getBool,       offsetof(NBodyCtx, allowIncest)      },
+    { "quietErrors",      getBool,       offsetof(NBodyCtx, quietErrors)      },
+    { "parallelTree",     getBool,       offsetof(NBodyCtx, parallelTree)     },
+    { "bodySortInterval", getInt,        offsetof(NBodyCtx, bodySortInterval) },
+    { "flatTree",         getBool,       offsetof(NBodyCtx, flatTree)         },
+    { "groupSize",        getInt,        offsetof(NBodyCtx, groupSize)        },
+    { "treeRebuildInterval", getInt,     offsetof(NBodyCtx, treeRebuildInterval) },
+    { "timestepLevels",   getInt,        offsetof(NBodyCtx, timestepLevels)   },
+    { "timestepEta",      getNumber,     offsetof(NBodyCtx, timestepEta)      },
     { NULL, NULL, 0 }
 };
 
 static const Xet_reg_pre settersNBodyCtx[] =
 {
-    { "timestep",        setNumber,     offsetof(NBodyCtx, timestep)    },
-    { "timeEvolve",      setNumber,     offsetof(NBodyCtx, timeEvolve)  },
-    { "theta",           setNumber,     offsetof(NBodyCtx, theta)       },
-    { "eps2",            setNumber,     offsetof(NBodyCtx, eps2)        },
-    { "treeRSize",       setNumber,     offsetof(NBodyCtx, treeRSize)   },
-    { "sunGCDist",       setNumber,     offsetof(NBodyCtx, sunGCDist)   },
-    { "criterion",       setCriterionT, offsetof(NBodyCtx, criterion)   },
-    { "useQuad",         setBool,       offsetof(NBodyCtx, useQuad)     },
-    { "allowIncest",     setBool,       offsetof(NBodyCtx, allowIncest) },
-    { "quietErrors",     setBool,       offsetof(NBodyCtx, quietErrors) },
+    { "timestep",         setNumber,     offsetof(NBodyCtx, timestep)         },
+    { "timeEvolve",       setNumber,     offsetof(NBodyCtx, timeEvolve)       },
+    { "theta",            setNumber,     offsetof(NBodyCtx, theta)            },
+    { "eps2",             setNumber,     offsetof(NBodyCtx, eps2)             },
+    { "treeRSize",        setNumber,     offsetof(NBodyCtx, treeRSize)        },
+    { "sunGCDist",        setNumber,     offsetof(NBodyCtx, sunGCDist)        },
+    { "criterion",        setCriterionT, offsetof(NBodyCtx, criterion)        },
+    { "useQuad",          setBool,       offsetof(NBodyCtx, useQuad)          },
+    { "allowIncest",      setBool,       offsetof(NBodyCtx, allowIncest)      },
+    { "quietErrors",      setBool,       offsetof(NBodyCtx, quietErrors)      },
+    { "parallelTree",     setBool,       offsetof(NBodyCtx, parallelTree)     },
+    { "bodySortInterval", setInt,        offsetof(NBodyCtx, bodySortInterval) },
+    { "flatTree",         setBool,       offsetof(NBodyCtx, flatTree)         },
+    { "groupSize",        setInt,        offsetof(NBodyCtx, groupSize)        },
+    { "treeRebuildInterval", setInt,     offsetof(NBodyCtx, treeRebuildInterval) },
+    { "timestepLevels",   setTimestepLevels, offsetof(NBodyCtx, timestepLevels) },
+    { "timestepEta",      setNumber,     offsetof(NBodyCtx, timestepEta)      },
     { NULL, NULL, 0 }
 };
 
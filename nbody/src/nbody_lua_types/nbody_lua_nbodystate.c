@@ -151,6 +151,7 @@ static int luaWriteCheckpoint(lua_State* luaSt)
     char tmpPath[256];
     int pid;
     int failed;
+    mwbool compress;
 
     st = checkNBodyState(luaSt, 1);
     ctx = checkNBodyCtx(luaSt, 2);
@@ -161,10 +162,13 @@ static int luaWriteCheckpoint(lua_State* luaSt)
     snprintf(tmpPath, sizeof(tmpPath), "nbody_checkpoint_tmp_%d", pid);
 
     st->checkpointResolved = strdup(luaL_optstring(luaSt, 3, DEFAULT_CHECKPOINT_FILE));
+    compress = st->compressCheckpoint;
+    st->compressCheckpoint = mw_lua_optboolean(luaSt, 5, compress);
 
     failed = nbWriteCheckpointWithTmpFile(ctx, st, luaL_optstring(luaSt, 4, tmpPath));
     free(st->checkpointResolved);
     st->checkpointResolved = NULL;
+    st->compressCheckpoint = compress;
 
     return failed ? luaL_error(luaSt, "Error writing checkpoint") : 0;
 }
@@ -189,12 +193,16 @@ static int luaReadCheckpoint(lua_State* luaSt)
 
     st.checkpointResolved = strdup(luaL_optstring(luaSt, 1, DEFAULT_CHECKPOINT_FILE));
     failed = nbReadCheckpoint(&ctx, &st);
-    free(st.checkpointResolved);
     if (failed)
     {
-        return luaL_error(luaSt, "Error reading checkpoint '%s'", st.checkpointResolved);
+        luaL_where(luaSt, 1);
+        lua_pushfstring(luaSt, "Error reading checkpoint '%s'", st.checkpointResolved);
+        lua_concat(luaSt, 2);
+        free(st.checkpointResolved);
+        return lua_error(luaSt);
     }
 
+    free(st.checkpointResolved);
     st.checkpointResolved = NULL;
 
     /* Run the prestep so the accelerations are ready for the resumed state */
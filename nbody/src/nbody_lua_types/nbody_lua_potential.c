@@ -62,18 +62,71 @@ int setPotential(lua_State* luaSt, void* v)
     return 0;
 }
 
+static void tooManyComponentsError(lua_State* luaSt, const char* kind)
+{
+    luaL_error(luaSt, "Too many extra %s components in potential (maximum %d)",
+               kind, NB_MAX_EXTRA_COMPONENTS);
+}
+
+/* Read the array of additional Spherical, Disk and Halo components at
+ * idx into p */
+static void readExtraComponents(lua_State* luaSt, Potential* p, int idx)
+{
+    int i, n, item;
+    const Spherical* s;
+    const Disk* d;
+    const Halo* h;
+
+    luaL_checktype(luaSt, idx, LUA_TTABLE);
+    n = luaL_getn(luaSt, idx);
+
+    for (i = 1; i <= n; ++i)
+    {
+        lua_rawgeti(luaSt, idx, i);
+        item = lua_gettop(luaSt);
+
+        if ((s = (const Spherical*) mw_tonamedudata(luaSt, item, SPHERICAL_TYPE)))
+        {
+            if (p->nExtraSphere >= NB_MAX_EXTRA_COMPONENTS)
+                tooManyComponentsError(luaSt, "spherical");
+            p->extraSphere[p->nExtraSphere++] = *s;
+        }
+        else if ((d = (const Disk*) mw_tonamedudata(luaSt, item, DISK_TYPE)))
+        {
+            if (p->nExtraDisk >= NB_MAX_EXTRA_COMPONENTS)
+                tooManyComponentsError(luaSt, "disk");
+            p->extraDisk[p->nExtraDisk++] = *d;
+        }
+        else if ((h = (const Halo*) mw_tonamedudata(luaSt, item, HALO_TYPE)))
+        {
+            if (p->nExtraHalo >= NB_MAX_EXTRA_COMPONENTS)
+                tooManyComponentsError(luaSt, "halo");
+            p->extraHalo[p->nExtraHalo++] = *h;
+        }
+        else
+        {
+            luaL_error(luaSt, "Extra potential component #%d must be a Spherical, Disk or Halo (got %s)",
+                       i, luaL_typename(luaSt, item));
+        }
+
+        lua_pop(luaSt, 1);
+    }
+}
+
 static int createPotential(lua_State* luaSt)
 {
     Potential p = EMPTY_POTENTIAL;
     const Spherical* s = NULL;
     const Disk* d = NULL;
     const Halo* h = NULL;
+    int extra = LUA_NOREF;
 
     const MWNamedArg argTable[] =
         {
-            { "spherical", LUA_TUSERDATA, SPHERICAL_TYPE, TRUE,  &s },
-            { "halo",      LUA_TUSERDATA, HALO_TYPE,      TRUE,  &h },
-            { "disk",      LUA_TUSERDATA, DISK_TYPE,      TRUE,  &d },
+            { "spherical", LUA_TUSERDATA,     SPHERICAL_TYPE, TRUE,  &s     },
+            { "halo",      LUA_TUSERDATA,     HALO_TYPE,      TRUE,  &h     },
+            { "disk",      LUA_TUSERDATA,     DISK_TYPE,      TRUE,  &d     },
+            { "extra",     MW_LUA_TTABLE_REF, NULL,           FALSE, &extra },
             END_MW_NAMED_ARG
         };
 
@@ -84,19 +137,33 @@ static int createPotential(lua_State* luaSt)
             break;
 
         case 3:
+        case 4:
             s = checkSpherical(luaSt, 1);
             d = checkDisk(luaSt, 2);
             h = checkHalo(luaSt, 3);
+            if (!lua_isnoneornil(luaSt, 4))
+            {
+                lua_pushvalue(luaSt, 4);
+                extra = luaL_ref(luaSt, LUA_REGISTRYINDEX);
+            }
             break;
 
         default:
-            return luaL_argerror(luaSt, 1, "Expected 1 or 3 arguments");
+            return luaL_argerror(luaSt, 1, "Expected 1, 3 or 4 arguments");
     }
 
     p.sphere[0] = *s;
     p.disk = *d;
     p.halo = *h;
 
+    if (extra != LUA_NOREF)
+    {
+        lua_rawgeti(luaSt, LUA_REGISTRYINDEX, extra);
+        luaL_unref(luaSt, LUA_REGISTRYINDEX, extra);
+        readExtraComponents(luaSt, &p, lua_gettop(luaSt));
+        lua_pop(luaSt, 1);
+    }
+
     pushPotential(luaSt, &p);
     return 1;
 }
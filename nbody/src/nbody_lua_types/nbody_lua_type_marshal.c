@@ -26,6 +26,15 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_util.h"
 #include "nbody_show.h"
 
+/* Number of bodies in a model, which is either a table of bodies or a BodyBlock */
+static int modelBodies(lua_State* luaSt, int idx)
+{
+    const NBodyBlock* block;
+
+    block = toBodyBlock(luaSt, idx);
+    return block ? block->nbody : luaL_getn(luaSt, idx);
+}
+
 static int totalBodies(lua_State* luaSt, int nModels)
 {
     int top, i, n = 0;
@@ -33,13 +42,13 @@ static int totalBodies(lua_State* luaSt, int nModels)
     top = lua_gettop(luaSt);
     for (i = top; i > top - nModels; --i)
     {
-        if (expectTable(luaSt, i))
+        if (!toBodyBlock(luaSt, i) && expectTable(luaSt, i))
         {
             mw_lua_perror(luaSt, "Error reading body table");
             return 0;
         }
 
-        n += luaL_getn(luaSt, i);
+        n += modelBodies(luaSt, i);
     }
 
     return n;
@@ -73,6 +82,7 @@ Body* readModels(lua_State* luaSt, int nModels, int* nOut)
     int i, n, totalN, top;
     Body* allBodies;
     Body* bodies;
+    NBodyBlock* block;
 
     totalN = totalBodies(luaSt, nModels);
     if (totalN == 0)
@@ -81,14 +91,27 @@ Body* readModels(lua_State* luaSt, int nModels, int* nOut)
         return NULL;
     }
 
+    /* A single block is adopted as is rather than copied */
+    if (nModels == 1 && (block = toBodyBlock(luaSt, lua_gettop(luaSt))))
+    {
+        allBodies = nbTakeBodyBlock(block, nOut);
+        lua_pop(luaSt, 1);
+        return allBodies;
+    }
+
     bodies = allBodies = (Body*) mwCallocA(totalN, sizeof(Body));
 
     for (i = 0; i < nModels; ++i)
     {
         top = lua_gettop(luaSt);
-        n = luaL_getn(luaSt, top);
+        n = modelBodies(luaSt, top);
 
-        if (readBodyArray(luaSt, top, bodies, n))
+        block = toBodyBlock(luaSt, top);
+        if (block)
+        {
+            memcpy(bodies, block->bodies, n * sizeof(Body));
+        }
+        else if (readBodyArray(luaSt, top, bodies, n))
         {
             mw_printf("Error reading body array %d\n", i);
             free(allBodies);
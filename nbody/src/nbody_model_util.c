@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "nbody_priv.h"
+#include "milkyway_util.h"
+#include "nbody_lua_types.h"
+#include "nbody_model_util.h"
+
+void nbStoreModelBody(const NBodyModelOutput* out, unsigned int i, const Body* b)
+{
+    if (out->bodies)
+    {
+        out->bodies[i] = *b;
+        return;
+    }
+
+    pushBody(out->luaSt, b);
+    lua_rawseti(out->luaSt, out->table, i + 1);
+}
+
+/* With chunkSize == 0 the whole model is drawn from prng in order,
+ * exactly as before. Otherwise bodies are split into chunks of
+ * chunkSize, and chunk c draws from its own dSFMT stream seeded with
+ * { seed, c }, where seed is a single draw from prng. The streams don't
+ * depend on which thread runs a chunk, so the result is identical for
+ * any number of threads; it does depend on chunkSize. */
+static void nbFillModelBodies(dsfmt_t* prng,
+                              const NBodyModelOutput* out,
+                              unsigned int nbody,
+                              unsigned int chunkSize,
+                              NBodyModelFill fill,
+                              const void* params)
+{
+    int c, nChunk;
+    uint32_t seed;
+
+    if (chunkSize == 0 || chunkSize >= nbody)
+    {
+        fill(prng, out, 0, nbody, params);
+        return;
+    }
+
+    seed = dsfmt_genrand_uint32(prng);
+    nChunk = (int) ((nbody + chunkSize - 1) / chunkSize);
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(c) schedule(dynamic)
+  #endif
+    for (c = 0; c < nChunk; ++c)
+    {
+        dsfmt_t chunkPrng;
+        uint32_t key[2];
+        unsigned int start = (unsigned int) c * chunkSize;
+        unsigned int n = nbody - start < chunkSize ? nbody - start : chunkSize;
+
+        key[0] = seed;
+        key[1] = (uint32_t) c;
+        dsfmt_init_by_array(&chunkPrng, key, 2);
+
+        fill(&chunkPrng, out, start, n, params);
+    }
+}
+
+/* A model drawn in order goes straight into its BodyBlock or table.
+ * Chunks are generated in parallel, so for a table they are gathered
+ * into a scratch array first, since Lua can't be used from several
+ * threads. */
+int nbPushModelBodies(lua_State* luaSt,
+                      dsfmt_t* prng,
+                      unsigned int nbody,
+                      unsigned int chunkSize,
+                      mwbool asBlock,
+                      NBodyModelFill fill,
+                      const void* params)
+{
+    unsigned int i;
+    NBodyModelOutput out;
+    const mwbool chunked = chunkSize != 0 && chunkSize < nbody;
+
+    out.bodies = NULL;
+    out.luaSt = luaSt;
+    out.table = 0;
+
+    if (asBlock)
+    {
+        out.bodies = pushNewBodyBlock(luaSt, (int) nbody)->bodies;
+        nbFillModelBodies(prng, &out, nbody, chunkSize, fill, params);
+        return 1;
+    }
+
+    lua_createtable(luaSt, nbody, 0);
+    out.table = lua_gettop(luaSt);
+
+    if (!chunked)
+    {
+        nbFillModelBodies(prng, &out, nbody, chunkSize, fill, params);
+        return 1;
+    }
+
+    out.bodies = (Body*) mwCalloc(nbody, sizeof(Body));
+    nbFillModelBodies(prng, &out, nbody, chunkSize, fill, params);
+
+    for (i = 0; i < nbody; ++i)
+    {
+        pushBody(luaSt, &out.bodies[i]);
+        lua_rawseti(luaSt, out.table, i + 1);
+    }
+
+    free(out.bodies);
+
+    return 1;
+}
@@ -24,6 +24,7 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_lua.h"
 #include "nbody_lua_types.h"
 #include "nbody_nfw.h"
+#include "nbody_model_util.h"
 
 static real nfwMassInsideRadius(real radius, real rho_0, real R_S)
 {
@@ -37,20 +38,166 @@ static real nfwMassInsideRadius(real radius, real rho_0, real R_S)
 
 }
 
-static real nfwNextRadius(real start_radius, real goal_mass, real rho_0, real R_S)
+/* The enclosed mass is 4 pi rho_0 R_S^3 nfwMassShape(r / R_S), so one
+ * table of the dimensionless shape serves every rho_0 and R_S. It is
+ * built by the first call to the generator, before any chunks are
+ * generated in parallel, and kept for the life of the process. */
+#define NFW_TABLE_SIZE 512
+#define NFW_TABLE_XMIN ((real) 1.0e-4)
+#define NFW_TABLE_XMAX ((real) 1.0e4)
+
+static real nfwTableX[NFW_TABLE_SIZE];
+static real nfwTableG[NFW_TABLE_SIZE];
+static real nfwTableLogX[NFW_TABLE_SIZE];
+static real nfwTableLogG[NFW_TABLE_SIZE];
+static mwbool nfwTableReady = FALSE;
+
+static real nfwMassShape(real x)
 {
-    // This is a scary function which returns the next radius limit
-    // Do not use this code on client computers. It is slow inneficient
-    // and well just dirty.
-    real test_radius;
+    return cube(x) * (mw_log(1.0 + x) - x / (1.0 + x));
+}
+
+static void nfwInitTable(void)
+{
+    int i;
+    real step = mw_log(NFW_TABLE_XMAX / NFW_TABLE_XMIN) / (NFW_TABLE_SIZE - 1);
 
-    for (test_radius = start_radius;; test_radius += (real)0.0001)
+    for (i = 0; i < NFW_TABLE_SIZE; ++i)
     {
-        if (nfwMassInsideRadius(test_radius, rho_0, R_S) >= goal_mass)
+        nfwTableX[i] = NFW_TABLE_XMIN * mw_exp(step * i);
+        nfwTableG[i] = nfwMassShape(nfwTableX[i]);
+        nfwTableLogX[i] = mw_log(nfwTableX[i]);
+        nfwTableLogG[i] = mw_log(nfwTableG[i]);
+    }
+
+    nfwTableReady = TRUE;
+}
+
+/* A previous root of nfwMassShape(x) = g and the slope there */
+typedef struct
+{
+    real x;
+    real g;
+    real dg;
+} NFWRoot;
+
+/* nfwMassShape(x) - g, and its derivative in df */
+static real nfwMassShapeResidual(real x, real g, real* df)
+{
+    real lg = mw_log(1.0 + x) - x / (1.0 + x);
+
+    *df = 3.0 * sqr(x) * lg + sqr(sqr(x)) / sqr(1.0 + x);
+    return cube(x) * lg - g;
+}
+
+/* Find x with nfwMassShape(x) = g by Newton's method. It converges
+ * quadratically, so stopping once the step is below sqrt(epsilon)
+ * leaves the result good to epsilon.
+ *
+ * Successive shells are close together, so first try a few steps
+ * starting from the previous root in prev, which usually finish after
+ * a single evaluation. If that doesn't settle, the table brackets the
+ * root, interpolating log g against log x gives the start, and
+ * bisection takes over whenever a step would leave the bracket. prev
+ * is updated with the new root. */
+static real nfwInverseMassShape(real g, NFWRoot* prev)
+{
+    int i, lo, hi, mid;
+    real xLo, xHi, x, xNew, f, df;
+
+    if (g <= 0.0)
+        return 0.0;
+
+    if (prev->x > 0.0 && g >= prev->g)
+    {
+        x = prev->x + (g - prev->g) / prev->dg;
+        for (i = 0; i < 3; ++i)
         {
-            return test_radius;
+            f = nfwMassShapeResidual(x, g, &df);
+            xNew = x - f / df;
+            if (mw_abs(xNew - x) <= mw_sqrt(REAL_EPSILON) * x)
+            {
+                if (xNew < prev->x)
+                    break;
+
+                prev->x = xNew;
+                prev->g = g;
+                prev->dg = df;
+                return xNew;
+            }
+
+            x = xNew;
         }
     }
+
+    if (g < nfwTableG[0])
+    {
+        /* nfwMassShape(x) ~ x^5 / 2 for small x */
+        xLo = 0.0;
+        xHi = nfwTableX[0];
+        x = mw_fmin(mw_pow(2.0 * g, 0.2), xHi);
+    }
+    else if (g >= nfwTableG[NFW_TABLE_SIZE - 1])
+    {
+        xLo = nfwTableX[NFW_TABLE_SIZE - 1];
+        xHi = 2.0 * xLo;
+        while (nfwMassShape(xHi) < g)
+        {
+            xLo = xHi;
+            xHi *= 2.0;
+        }
+        x = 0.5 * (xLo + xHi);
+    }
+    else
+    {
+        lo = 0;
+        hi = NFW_TABLE_SIZE - 1;
+        while (hi - lo > 1)
+        {
+            mid = (lo + hi) / 2;
+            if (nfwTableG[mid] <= g)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        xLo = nfwTableX[lo];
+        xHi = nfwTableX[hi];
+        x = mw_exp(nfwTableLogX[lo] + (nfwTableLogX[hi] - nfwTableLogX[lo])
+                                    * (mw_log(g) - nfwTableLogG[lo])
+                                    / (nfwTableLogG[hi] - nfwTableLogG[lo]));
+    }
+
+    for (i = 0; i < 100; ++i)
+    {
+        f = nfwMassShapeResidual(x, g, &df);
+
+        if (f > 0.0)
+            xHi = x;
+        else
+            xLo = x;
+
+        xNew = x - f / df;
+        if (mw_abs(xNew - x) <= mw_sqrt(REAL_EPSILON) * x)
+            break;
+
+        if (!(xNew > xLo && xNew < xHi))
+            xNew = 0.5 * (xLo + xHi);
+
+        x = xNew;
+    }
+
+    prev->x = xNew;
+    prev->g = g;
+    prev->dg = df;
+
+    return xNew;
+}
+
+/* Radius enclosing goal_mass */
+static real nfwRadiusForMass(real goal_mass, real rho_0, real R_S, NFWRoot* prev)
+{
+    return R_S * nfwInverseMassShape(goal_mass / (4.0 * M_PI * rho_0 * cube(R_S)), prev);
 }
 
 /* nfwPickShell: pick a random point on a sphere of specified radius. */
@@ -83,20 +230,6 @@ static real nfwRandomR(dsfmt_t* dsfmtState, real startradius, real endradius)
     return (endradius - startradius) * rnd + startradius;
 }
 
-static real nfwSelectFromG(dsfmt_t* dsfmtState)
-{
-    real x, y;
-
-    do                      /* select from fn g(x) */
-    {
-        x = mwXrandom(dsfmtState, 0.0, 1.0);      /* for x in range 0:1 */
-        y = mwXrandom(dsfmtState, 0.0, 0.1);      /* max of g(x) is 0.092 */
-    }   /* using von Neumann tech */
-    while (y > sqr(x) * mw_pow(1.0 - sqr(x), 3.5));
-
-    return x;
-}
-
 static real nfwCalculateV(real r, real rho_0, real R_S)
 {
     real v;
@@ -128,48 +261,36 @@ static mwvector nfwBodyVelocity(dsfmt_t* dsfmtState, mwvector vshift, real r, re
     return vel;
 }
 
-/* generatenfw: generate nfw model initial conditions
- * Extremely hacky. If you actually want to use this
- * talk to Colin Rice before you do anything. Seriously.
- */
-static int nbGenerateNFWCore(lua_State* luaSt,
-
-                             dsfmt_t* prng,
-                             unsigned int nbody,
-                             real mass,
-
-                             mwbool ignore,
-
-                             mwvector rShift,
-                             mwvector vShift,
-                             real rho_0,
-                             real R_S)
+typedef struct
+{
+    mwvector rShift;
+    mwvector vShift;
+    real rho_0;
+    real R_S;
+    real massEpsilon;   /* The amount of mass we increase for each particle */
+    body_t type;
+} NFWParams;
+
+/* Body i is placed between the radii enclosing (i + 0.5) and (i + 1.5)
+ * mass epsilons, with the first starting from the center. */
+static void nfwFillBodies(dsfmt_t* prng, const NBodyModelOutput* out, unsigned int first, unsigned int n, const void* params)
 {
     unsigned int i;
-    int table;
     Body b;
-    real r;
-    real totalMass = 0.0;
-    real radius = 0.0;
-    real massEpsilon = mass / nbody;    /* The amount of mass we increase for
-                                          each particle */
+    real r, radius, endradius;
+    const NFWParams* p = (const NFWParams*) params;
+    NFWRoot prev = { 0.0, 0.0, 0.0 };
 
     memset(&b, 0, sizeof(b));
 
-    b.bodynode.type = BODY(ignore);    /* Same for all in the model */
-    b.bodynode.mass = mass / nbody;    /* Mass per particle */
-
-
-    lua_createtable(luaSt, nbody, 0);
-    table = lua_gettop(luaSt);
-
+    b.bodynode.type = p->type;          /* Same for all in the model */
+    b.bodynode.mass = p->massEpsilon;   /* Mass per particle */
 
-    /* Start with half an epsilon */
-    totalMass = 0.5 * massEpsilon;
+    radius = first == 0 ? 0.0 : nfwRadiusForMass((first + 0.5) * p->massEpsilon, p->rho_0, p->R_S, &prev);
 
-    for (i = 0; i < nbody; ++i)
+    for (i = 0; i < n; ++i)
     {
-        real endradius = nfwNextRadius(radius, totalMass + massEpsilon, rho_0, R_S);
+        endradius = nfwRadiusForMass((first + i + 1.5) * p->massEpsilon, p->rho_0, p->R_S, &prev);
 
         do
         {
@@ -178,17 +299,47 @@ static int nbGenerateNFWCore(lua_State* luaSt,
         while (isinf(r));
 
         radius = endradius;
-        totalMass += massEpsilon;
 
-        b.bodynode.pos = nfwBodyPosition(prng, rShift, 1, r);
-        b.vel = nfwBodyVelocity(prng, vShift, r, rho_0, R_S);
+        b.bodynode.pos = nfwBodyPosition(prng, p->rShift, 1, r);
+        b.vel = nfwBodyVelocity(prng, p->vShift, r, p->rho_0, p->R_S);
         assert(nbPositionValid(b.bodynode.pos));
 
-        pushBody(luaSt, &b);
-        lua_rawseti(luaSt, table, i + 1);
+        nbStoreModelBody(out, first + i, &b);
     }
+}
+
+/* generatenfw: generate nfw model initial conditions
+ * Extremely hacky. If you actually want to use this
+ * talk to Colin Rice before you do anything. Seriously.
+ */
+static int nbGenerateNFWCore(lua_State* luaSt,
+
+                             dsfmt_t* prng,
+                             unsigned int nbody,
+                             real mass,
 
-    return 1;
+                             mwbool ignore,
+                             mwbool asBlock,
+                             unsigned int chunkSize,
+
+                             mwvector rShift,
+                             mwvector vShift,
+                             real rho_0,
+                             real R_S)
+{
+    NFWParams p;
+
+    p.rShift = rShift;
+    p.vShift = vShift;
+    p.rho_0 = rho_0;
+    p.R_S = R_S;
+    p.massEpsilon = mass / nbody;
+    p.type = BODY(ignore);
+
+    if (!nfwTableReady)
+        nfwInitTable();
+
+    return nbPushModelBodies(luaSt, prng, nbody, chunkSize, asBlock, nfwFillBodies, &p);
 }
 
 int nbGenerateNFW(lua_State* luaSt)
@@ -197,27 +348,36 @@ int nbGenerateNFW(lua_State* luaSt)
     static const mwvector* position = NULL;
     static const mwvector* velocity = NULL;
     static mwbool ignore;
-    static real mass = 0.0, nbodyf = 0.0, rho_0 = 0.0, R_S = 0.0;
+    static mwbool asBlock;
+    static real mass = 0.0, nbodyf = 0.0, rho_0 = 0.0, R_S = 0.0, chunkSizef = 0.0;
 
     static const MWNamedArg argTable[] =
         {
-            { "nbody",        LUA_TNUMBER,   NULL,          TRUE,  &nbodyf   },
-            { "mass",         LUA_TNUMBER,   NULL,          TRUE,  &mass     },
-            { "rho_0",        LUA_TNUMBER,   NULL,          TRUE,  &rho_0    },
-            { "scaledRadius", LUA_TNUMBER,   NULL,          TRUE,  &R_S      },
-            { "position",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position },
-            { "velocity",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity },
-            { "ignore",       LUA_TBOOLEAN,  NULL,          FALSE, &ignore   },
-            { "prng",         LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng     },
+            { "nbody",        LUA_TNUMBER,   NULL,          TRUE,  &nbodyf     },
+            { "mass",         LUA_TNUMBER,   NULL,          TRUE,  &mass       },
+            { "rho_0",        LUA_TNUMBER,   NULL,          TRUE,  &rho_0      },
+            { "scaledRadius", LUA_TNUMBER,   NULL,          TRUE,  &R_S        },
+            { "position",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position   },
+            { "velocity",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity   },
+            { "ignore",       LUA_TBOOLEAN,  NULL,          FALSE, &ignore     },
+            { "block",        LUA_TBOOLEAN,  NULL,          FALSE, &asBlock    },
+            { "chunkSize",    LUA_TNUMBER,   NULL,          FALSE, &chunkSizef },
+            { "prng",         LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng       },
             END_MW_NAMED_ARG
         };
 
     if (lua_gettop(luaSt) != 1)
         return luaL_argerror(luaSt, 1, "Expected 1 arguments");
 
+    asBlock = FALSE;
+    chunkSizef = 0.0;
     handleNamedArgumentTable(luaSt, argTable, 1);
 
-    return nbGenerateNFWCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore,
+    if (chunkSizef < 0.0)
+        return luaL_argerror(luaSt, 1, "chunkSize must be >= 0");
+
+    return nbGenerateNFWCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore, asBlock,
+                             (unsigned int) chunkSizef,
                                  *position, *velocity, rho_0, R_S);
 }
 
@@ -24,7 +24,9 @@
 #include "nbody_defaults.h"
 #include "nbody_util.h"
 #include "nbody_checkpoint.h"
+#include "nbody_snapshot.h"
 #include "nbody_grav.h"
+#include "nbody_sort.h"
 
 static void nbReportProgress(const NBodyCtx* ctx, NBodyState* st)
 {
@@ -47,14 +49,58 @@ static void nbReportProgress(const NBodyCtx* ctx, NBodyState* st)
 
 static NBodyStatus nbCheckpoint(const NBodyCtx* ctx, NBodyState* st)
 {
+    mwbool finished;
+
+    /* Report a background write as soon as it is done */
+    if (nbFinishCheckpointWrite(st, FALSE, &finished))
+    {
+        return NBODY_CHECKPOINT_ERROR;
+    }
+
+    if (finished)
+    {
+        mw_checkpoint_completed();
+    }
+
     if (nbTimeToCheckpoint(ctx, st))
     {
-        if (nbWriteCheckpoint(ctx, st))
+        if (st->asyncCheckpoint)
         {
-            return NBODY_CHECKPOINT_ERROR;
+            /* Only waits if the last write is still going */
+            if (nbFinishCheckpointWrite(st, TRUE, &finished))
+            {
+                return NBODY_CHECKPOINT_ERROR;
+            }
+
+            if (finished)
+            {
+                mw_checkpoint_completed();
+            }
+
+            if (nbStartCheckpointWrite(ctx, st))
+            {
+                return NBODY_CHECKPOINT_ERROR;
+            }
         }
+        else
+        {
+            if (nbWriteCheckpoint(ctx, st))
+            {
+                return NBODY_CHECKPOINT_ERROR;
+            }
 
-        mw_checkpoint_completed();
+            mw_checkpoint_completed();
+        }
+    }
+
+    return NBODY_SUCCESS;
+}
+
+static NBodyStatus nbSnapshot(const NBodyCtx* ctx, NBodyState* st)
+{
+    if (nbTimeToSnapshot(ctx, st) && nbAppendSnapshotFrame(ctx, st))
+    {
+        return NBODY_IO_ERROR;
     }
 
     return NBODY_SUCCESS;
@@ -112,12 +158,150 @@ static inline void advanceVelocities(NBodyState* st, const int nbody, const real
     }
 }
 
+static inline void advancePositions(NBodyState* st, const int nbody, const real dt)
+{
+    int i;
+    Body* bodies = mw_assume_aligned(st->bodytab, 16);
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i) schedule(dynamic, 4096 / sizeof(bodies[0]))
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        bodyAdvancePos(&bodies[i], dt);
+    }
+}
+
+/* Choose the timestep of each body for the next full step. A body
+ * at level k takes steps of timestep / 2^k, where k is the smallest
+ * level with a step no larger than sqrt(2 eta eps / |a|). The step of
+ * each body is stored as a number of substeps of the smallest level.
+ * Returns the smallest step used by any body. */
+static int nbAssignTimestepLevels(const NBodyCtx* ctx, NBodyState* st)
+{
+    int i, k;
+    int minStride;
+    const int nbody = st->nbody;
+    const int levels = ctx->timestepLevels;
+    const real dt = ctx->timestep;
+    const real eps = mw_sqrt(ctx->eps2);
+    const mwvector* accs = st->acctab;
+    real a, dtBody, dtLevel;
+
+    if (!st->bodyStride)
+    {
+        st->bodyStride = (int*) mwMalloc(nbody * sizeof(int));
+        st->activeBodies = (int*) mwMalloc(nbody * sizeof(int));
+    }
+
+    minStride = 1 << levels;
+    for (i = 0; i < nbody; ++i)
+    {
+        a = mw_absv(accs[i]);
+        dtBody = a > 0.0 ? mw_sqrt(2.0 * ctx->timestepEta * eps / a) : dt;
+
+        k = 0;
+        dtLevel = dt;
+        while (k < levels && dtLevel > dtBody)
+        {
+            dtLevel *= 0.5;
+            ++k;
+        }
+
+        st->bodyStride[i] = 1 << (levels - k);
+        minStride = MIN(minStride, st->bodyStride[i]);
+    }
+
+    return minStride;
+}
+
+/* Give the active bodies a kick of half their own timestep. */
+static inline void advanceActiveVelocities(NBodyState* st, int nActive, const real dtSub)
+{
+    int i, k;
+    const int* active = st->activeBodies;
+    const int* stride = st->bodyStride;
+    Body* bodies = mw_assume_aligned(st->bodytab, 16);
+    const mwvector* accs = mw_assume_aligned(st->acctab, 16);
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, k) schedule(dynamic, 4096 / sizeof(accs[0]))
+  #endif
+    for (i = 0; i < nActive; ++i)
+    {
+        k = active[i];
+        bodyAdvanceVel(&bodies[k], accs[k], 0.5 * dtSub * (real) stride[k]);
+    }
+}
+
+/* Advance the system one full timestep using block timesteps. The
+ * full step is split into 2^timestepLevels substeps. All bodies drift
+ * together, but a body is only kicked, and only has its force found,
+ * at the end of each of its own steps. Every body finishes at the end
+ * of the full step, so the state between full steps is the same as
+ * with a single timestep, and checkpoints don't need anything extra. */
+static NBodyStatus nbStepSystemBlock(const NBodyCtx* ctx, NBodyState* st)
+{
+    NBodyStatus rc = NBODY_SUCCESS;
+    int i, t, tLast, nActive, minStride;
+    const int nbody = st->nbody;
+    const int nSub = 1 << ctx->timestepLevels;
+    const real dtSub = ctx->timestep / (real) nSub;
+
+    minStride = nbAssignTimestepLevels(ctx, st);
+
+    /* Opening half kick for every body */
+    for (i = 0; i < nbody; ++i)
+    {
+        st->activeBodies[i] = i;
+    }
+    advanceActiveVelocities(st, nbody, dtSub);
+
+    /* Drifts are only done when some body needs its force */
+    tLast = 0;
+    for (t = minStride; t <= nSub; t += minStride)
+    {
+        nActive = 0;
+        for (i = 0; i < nbody; ++i)
+        {
+            if (t % st->bodyStride[i] == 0)
+                st->activeBodies[nActive++] = i;
+        }
+
+        if (nActive == 0)
+            continue;
+
+        advancePositions(st, nbody, dtSub * (real) (t - tLast));
+        tLast = t;
+
+        rc |= nbGravMapActive(ctx, st, st->activeBodies, nActive);
+        if (nbStatusIsFatal(rc))
+            return rc;
+
+        /* Closing half kick, and the opening half kick of the next
+         * step of each active body if the full step isn't finished */
+        advanceActiveVelocities(st, nActive, dtSub);
+        if (t < nSub)
+            advanceActiveVelocities(st, nActive, dtSub);
+    }
+
+    st->step++;
+
+    return rc;
+}
+
 /* stepSystem: advance N-body system one time-step. */
 NBodyStatus nbStepSystemPlain(const NBodyCtx* ctx, NBodyState* st)
 {
     NBodyStatus rc;
     const real dt = ctx->timestep;
 
+    if (ctx->bodySortInterval > 0 && st->step % ctx->bodySortInterval == 0)
+        nbSortBodies(st);
+
+    if (ctx->timestepLevels > 0)
+        return nbStepSystemBlock(ctx, st);
+
     advancePosVel(st, st->nbody, dt);
 
     rc = nbGravMap(ctx, st);
@@ -136,12 +320,21 @@ NBodyStatus nbRunSystemPlain(const NBodyCtx* ctx, NBodyState* st)
     if (nbStatusIsFatal(rc))
         return rc;
 
+    rc |= nbSnapshot(ctx, st);  /* Initial state, unless this is a resume */
+    if (nbStatusIsFatal(rc))
+        return rc;
+
     while (st->step < ctx->nStep)
     {
         rc |= nbStepSystemPlain(ctx, st);
         if (nbStatusIsFatal(rc))   /* advance N-body system */
             return rc;
 
+        /* Before the checkpoint, so a resume never misses a frame */
+        rc |= nbSnapshot(ctx, st);
+        if (nbStatusIsFatal(rc))
+            return rc;
+
         rc |= nbCheckpoint(ctx, st);
         if (nbStatusIsFatal(rc))
             return rc;
@@ -152,6 +345,8 @@ NBodyStatus nbRunSystemPlain(const NBodyCtx* ctx, NBodyState* st)
         nbUpdateDisplayedBodies(ctx, st);
     }
 
+    nbRestoreBodyOrder(st);
+
     return nbWriteFinalCheckpoint(ctx, st);
 }
 
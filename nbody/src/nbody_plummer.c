@@ -24,6 +24,8 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "milkyway_lua.h"
 #include "nbody_lua_types.h"
 #include "nbody_plummer.h"
+#include "nbody_model_util.h"
+#include "nbody_sampler.h"
 
 /* pickshell: pick a random point on a sphere of specified radius. */
 static inline mwvector pickShell(dsfmt_t* dsfmtState, real rad)
@@ -69,11 +71,22 @@ static inline real plummerSelectFromG(dsfmt_t* dsfmtState)
     return x;
 }
 
-static inline real plummerRandomV(dsfmt_t* dsfmtState, real r)
+/* Distribution of x = v / v_escape */
+static real plummerG(real x, const void* args)
+{
+    (void) args;
+    return sqr(x) * mw_pow(1.0 - sqr(x), 3.5);
+}
+
+/* Tabulated once, before any chunks are generated in parallel */
+static NBodySampler plummerGSampler;
+static mwbool plummerGSamplerReady = FALSE;
+
+static inline real plummerRandomV(dsfmt_t* dsfmtState, real r, mwbool tabulated)
 {
     real x, v;
 
-    x = plummerSelectFromG(dsfmtState);
+    x = tabulated ? nbSample(&plummerGSampler, dsfmtState) : plummerSelectFromG(dsfmtState);
     v = M_SQRT2 * x / mw_sqrt(mw_sqrt(1.0 + sqr(r)));   /* find v in struct units */
 
     return v;
@@ -89,12 +102,12 @@ static inline mwvector plummerBodyPosition(dsfmt_t* dsfmtState, mwvector rshift,
     return pos;
 }
 
-static inline mwvector plummerBodyVelocity(dsfmt_t* dsfmtState, mwvector vshift, real vsc, real r)
+static inline mwvector plummerBodyVelocity(dsfmt_t* dsfmtState, mwvector vshift, real vsc, real r, mwbool tabulated)
 {
     mwvector vel;
     real v;
 
-    v = plummerRandomV(dsfmtState, r);
+    v = plummerRandomV(dsfmtState, r, tabulated);
     vel = pickShell(dsfmtState, vsc * v);   /* pick scaled velocity */
     mw_incaddv(vel, vshift);                /* move the velocity */
 
@@ -106,54 +119,79 @@ static inline mwvector plummerBodyVelocity(dsfmt_t* dsfmtState, mwvector vshift,
  * etc).  See Aarseth, SJ, Henon, M, & Wielen, R (1974) Astr & Ap, 37,
  * 183.
  */
-static int nbGeneratePlummerCore(lua_State* luaSt,
-
-                                 dsfmt_t* prng,
-                                 unsigned int nbody,
-                                 real mass,
-
-                                 mwbool ignore,
-
-                                 mwvector rShift,
-                                 mwvector vShift,
-                                 real radiusScale)
+typedef struct
+{
+    mwvector rShift;
+    mwvector vShift;
+    real radiusScale;
+    real velScale;
+    real mass;      /* Mass per particle */
+    body_t type;
+    mwbool tabulated;  /* Draw speeds from plummerGSampler */
+} PlummerParams;
+
+static void plummerFillBodies(dsfmt_t* prng, const NBodyModelOutput* out, unsigned int first, unsigned int n, const void* params)
 {
     unsigned int i;
-    int table;
     Body b;
-    real r, velScale;
+    real r;
+    const PlummerParams* p = (const PlummerParams*) params;
 
     memset(&b, 0, sizeof(b));
 
-    velScale = mw_sqrt(mass / radiusScale);     /* and recip. speed scale */
-
-    b.bodynode.type = BODY(ignore);    /* Same for all in the model */
-    b.bodynode.mass = mass / nbody;    /* Mass per particle */
+    b.bodynode.type = p->type;      /* Same for all in the model */
+    b.bodynode.mass = p->mass;
 
-    lua_createtable(luaSt, nbody, 0);
-    table = lua_gettop(luaSt);
-
-    for (i = 0; i < nbody; ++i)
+    for (i = 0; i < n; ++i)
     {
         do
         {
+            /* A number just below 1 gives r = inf */
             r = plummerRandomR(prng);
-            /* FIXME: We should avoid the divide by 0.0 by multiplying
-             * the original random number by 0.9999.. but I'm too lazy
-             * to change the tests. Same with other models */
         }
         while (isinf(r));
 
-        b.bodynode.pos = plummerBodyPosition(prng, rShift, radiusScale, r);
-        b.vel = plummerBodyVelocity(prng, vShift, velScale, r);
+        b.bodynode.pos = plummerBodyPosition(prng, p->rShift, p->radiusScale, r);
+        b.vel = plummerBodyVelocity(prng, p->vShift, p->velScale, r, p->tabulated);
 
         assert(nbPositionValid(b.bodynode.pos));
 
-        pushBody(luaSt, &b);
-        lua_rawseti(luaSt, table, i + 1);
+        nbStoreModelBody(out, first + i, &b);
     }
+}
 
-    return 1;
+static int nbGeneratePlummerCore(lua_State* luaSt,
+
+                                 dsfmt_t* prng,
+                                 unsigned int nbody,
+                                 real mass,
+
+                                 mwbool ignore,
+                                 mwbool asBlock,
+                                 unsigned int chunkSize,
+                                 mwbool tabulated,
+
+                                 mwvector rShift,
+                                 mwvector vShift,
+                                 real radiusScale)
+{
+    PlummerParams p;
+
+    p.rShift = rShift;
+    p.vShift = vShift;
+    p.radiusScale = radiusScale;
+    p.velScale = mw_sqrt(mass / radiusScale);     /* and recip. speed scale */
+    p.mass = mass / nbody;
+    p.type = BODY(ignore);
+    p.tabulated = tabulated;
+
+    if (tabulated && !plummerGSamplerReady)
+    {
+        nbInitSampler(&plummerGSampler, plummerG, NULL, 0.0, 1.0);
+        plummerGSamplerReady = TRUE;
+    }
+
+    return nbPushModelBodies(luaSt, prng, nbody, chunkSize, asBlock, plummerFillBodies, &p);
 }
 
 int nbGeneratePlummer(lua_State* luaSt)
@@ -162,7 +200,9 @@ int nbGeneratePlummer(lua_State* luaSt)
     static const mwvector* position = NULL;
     static const mwvector* velocity = NULL;
     static mwbool ignore;
-    static real mass = 0.0, nbodyf = 0.0, radiusScale = 0.0;
+    static mwbool asBlock;
+    static mwbool tabulated;
+    static real mass = 0.0, nbodyf = 0.0, radiusScale = 0.0, chunkSizef = 0.0;
 
     static const MWNamedArg argTable[] =
         {
@@ -172,6 +212,9 @@ int nbGeneratePlummer(lua_State* luaSt)
             { "position",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &position    },
             { "velocity",     LUA_TUSERDATA, MWVECTOR_TYPE, TRUE,  &velocity    },
             { "ignore",       LUA_TBOOLEAN,  NULL,          FALSE, &ignore      },
+            { "block",        LUA_TBOOLEAN,  NULL,          FALSE, &asBlock     },
+            { "chunkSize",    LUA_TNUMBER,   NULL,          FALSE, &chunkSizef  },
+            { "tabulated",    LUA_TBOOLEAN,  NULL,          FALSE, &tabulated   },
             { "prng",         LUA_TUSERDATA, DSFMT_TYPE,    TRUE,  &prng        },
             END_MW_NAMED_ARG
         };
@@ -179,9 +222,16 @@ int nbGeneratePlummer(lua_State* luaSt)
     if (lua_gettop(luaSt) != 1)
         return luaL_argerror(luaSt, 1, "Expected 1 arguments");
 
+    asBlock = FALSE;
+    tabulated = FALSE;
+    chunkSizef = 0.0;
     handleNamedArgumentTable(luaSt, argTable, 1);
 
-    return nbGeneratePlummerCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore,
+    if (chunkSizef < 0.0)
+        return luaL_argerror(luaSt, 1, "chunkSize must be >= 0");
+
+    return nbGeneratePlummerCore(luaSt, prng, (unsigned int) nbodyf, mass, ignore, asBlock,
+                                 (unsigned int) chunkSizef, tabulated,
                                  *position, *velocity, radiusScale);
 }
 
@@ -116,44 +116,367 @@ static inline mwvector triaxialHaloAccel(const Halo* h, mwvector pos, real r)
     return acc;
 }
 
-mwvector nbExtAcceleration(const Potential* pot, mwvector pos)
+static inline mwvector diskAccel(const Disk* disk, mwvector pos, real r)
 {
-    mwvector acc, acctmp;
-    const real r = mw_absv(pos);
+    mwvector acc;
 
-    switch (pot->disk.type)
+    switch (disk->type)
     {
         case ExponentialDisk:
-            acc = exponentialDiskAccel(&pot->disk, pos, r);
+            acc = exponentialDiskAccel(disk, pos, r);
             break;
         case MiyamotoNagaiDisk:
-            acc = miyamotoNagaiDiskAccel(&pot->disk, pos, r);
+            acc = miyamotoNagaiDiskAccel(disk, pos, r);
             break;
         case InvalidDisk:
         default:
             mw_fail("Invalid disk type in external acceleration\n");
     }
 
-    switch (pot->halo.type)
+    return acc;
+}
+
+static inline mwvector haloAccel(const Halo* halo, mwvector pos, real r)
+{
+    mwvector acc;
+
+    switch (halo->type)
     {
         case LogarithmicHalo:
-            acctmp = logHaloAccel(&pot->halo, pos, r);
+            acc = logHaloAccel(halo, pos, r);
             break;
         case NFWHalo:
-            acctmp = nfwHaloAccel(&pot->halo, pos, r);
+            acc = nfwHaloAccel(halo, pos, r);
             break;
         case TriaxialHalo:
-            acctmp = triaxialHaloAccel(&pot->halo, pos, r);
+            acc = triaxialHaloAccel(halo, pos, r);
             break;
         case InvalidHalo:
         default:
             mw_fail("Invalid halo type in external acceleration\n");
     }
 
+    return acc;
+}
+
+mwvector nbExtAcceleration(const Potential* pot, mwvector pos)
+{
+    int i;
+    mwvector acc, acctmp;
+    const real r = mw_absv(pos);
+
+    acc = diskAccel(&pot->disk, pos, r);
+    acctmp = haloAccel(&pot->halo, pos, r);
     mw_incaddv(acc, acctmp);
     acctmp = sphericalAccel(&pot->sphere[0], pos, r);
     mw_incaddv(acc, acctmp);
 
+    /* Extra components of a composite potential */
+    for (i = 0; i < pot->nExtraDisk; ++i)
+    {
+        acctmp = diskAccel(&pot->extraDisk[i], pos, r);
+        mw_incaddv(acc, acctmp);
+    }
+
+    for (i = 0; i < pot->nExtraHalo; ++i)
+    {
+        acctmp = haloAccel(&pot->extraHalo[i], pos, r);
+        mw_incaddv(acc, acctmp);
+    }
+
+    for (i = 0; i < pot->nExtraSphere; ++i)
+    {
+        acctmp = sphericalAccel(&pot->extraSphere[i], pos, r);
+        mw_incaddv(acc, acctmp);
+    }
+
     return acc;
 }
 
+
+/* The batched versions below take positions as separate coordinate
+ * arrays, and look at the potential types once for the whole block
+ * instead of once per body. The loops are kept simple so the compiler
+ * can vectorize them; exp and log are done in their own loops. The
+ * expressions are the same as above, so the results are identical to
+ * nbExtAcceleration. */
+
+/* Positions handled at a time, for the scratch arrays */
+#define NB_EXT_BLOCK 64
+
+static void miyamotoNagaiDiskAccelBlock(const Disk* disk,
+                                        int n,
+                                        const real* RESTRICT x,
+                                        const real* RESTRICT y,
+                                        const real* RESTRICT z,
+                                        real* RESTRICT ax,
+                                        real* RESTRICT ay,
+                                        real* RESTRICT az)
+{
+    int i;
+    const real a = disk->scaleLength;
+    const real b = disk->scaleHeight;
+
+    for (i = 0; i < n; ++i)
+    {
+        const real zp  = mw_sqrt(sqr(z[i]) + sqr(b));
+        const real azp = a + zp;
+
+        const real rp  = sqr(x[i]) + sqr(y[i]) + sqr(azp);
+        const real rth = mw_sqrt(cube(rp));  /* rp ^ (3/2) */
+
+        ax[i] += -disk->mass * x[i] / rth;
+        ay[i] += -disk->mass * y[i] / rth;
+        az[i] += -disk->mass * z[i] * azp / (zp * rth);
+    }
+}
+
+static void exponentialDiskAccelBlock(const Disk* disk,
+                                      int n,
+                                      const real* RESTRICT x,
+                                      const real* RESTRICT y,
+                                      const real* RESTRICT z,
+                                      const real* RESTRICT r,
+                                      real* RESTRICT ax,
+                                      real* RESTRICT ay,
+                                      real* RESTRICT az)
+{
+    int i;
+    real ex[NB_EXT_BLOCK];
+    const real b = disk->scaleLength;
+
+    for (i = 0; i < n; ++i)
+    {
+        ex[i] = mw_exp(-r[i] / b);
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        const real expPiece = ex[i] * (r[i] + b) / b;
+        const real factor   = disk->mass * (expPiece - 1.0) / cube(r[i]);
+
+        ax[i] += factor * x[i];
+        ay[i] += factor * y[i];
+        az[i] += factor * z[i];
+    }
+}
+
+static void logHaloAccelBlock(const Halo* halo,
+                              int n,
+                              const real* RESTRICT x,
+                              const real* RESTRICT y,
+                              const real* RESTRICT z,
+                              real* RESTRICT ax,
+                              real* RESTRICT ay,
+                              real* RESTRICT az)
+{
+    int i;
+    const real tvsqr = -2.0 * sqr(halo->vhalo);
+    const real qsqr  = sqr(halo->flattenZ);
+    const real d     = halo->scaleLength;
+
+    for (i = 0; i < n; ++i)
+    {
+        const real zsqr  = sqr(z[i]);
+
+        const real arst  = sqr(d) + sqr(x[i]) + sqr(y[i]);
+        const real denom = (zsqr / qsqr) +  arst;
+
+        ax[i] += tvsqr * x[i] / denom;
+        ay[i] += tvsqr * y[i] / denom;
+        az[i] += tvsqr * z[i] / ((qsqr * arst) + zsqr);
+    }
+}
+
+static void nfwHaloAccelBlock(const Halo* halo,
+                              int n,
+                              const real* RESTRICT x,
+                              const real* RESTRICT y,
+                              const real* RESTRICT z,
+                              const real* RESTRICT r,
+                              real* RESTRICT ax,
+                              real* RESTRICT ay,
+                              real* RESTRICT az)
+{
+    int i;
+    real lg[NB_EXT_BLOCK];
+    const real a = halo->scaleLength;
+
+    for (i = 0; i < n; ++i)
+    {
+        lg[i] = mw_log((r[i] + a) / a);
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        const real ar = a + r[i];
+        const real c  = a * sqr(halo->vhalo) * (r[i] - ar * lg[i]) / (0.2162165954 * cube(r[i]) * ar);
+
+        ax[i] += c * x[i];
+        ay[i] += c * y[i];
+        az[i] += c * z[i];
+    }
+}
+
+static void triaxialHaloAccelBlock(const Halo* h,
+                                   int n,
+                                   const real* RESTRICT x,
+                                   const real* RESTRICT y,
+                                   const real* RESTRICT z,
+                                   real* RESTRICT ax,
+                                   real* RESTRICT ay,
+                                   real* RESTRICT az)
+{
+    int i;
+    const real qzs      = sqr(h->flattenZ);
+    const real rhalosqr = sqr(h->scaleLength);
+    const real mvsqr    = -sqr(h->vhalo);
+
+    for (i = 0; i < n; ++i)
+    {
+        const real xsqr = sqr(x[i]);
+        const real ysqr = sqr(y[i]);
+        const real zsqr = sqr(z[i]);
+
+        const real arst  = rhalosqr + (h->c1 * xsqr) + (h->c3 * x[i] * y[i]) + (h->c2 * ysqr);
+        const real arst2 = (zsqr / qzs) + arst;
+
+        ax[i] += mvsqr * (((2.0 * h->c1) * x[i]) + (h->c3 * y[i]) ) / arst2;
+
+        ay[i] += mvsqr * (((2.0 * h->c2) * y[i]) + (h->c3 * x[i]) ) / arst2;
+
+        az[i] += (2.0 * mvsqr * z[i]) / ((qzs * arst) + zsqr);
+    }
+}
+
+static void sphericalAccelBlock(const Spherical* sph,
+                                int n,
+                                const real* RESTRICT x,
+                                const real* RESTRICT y,
+                                const real* RESTRICT z,
+                                const real* RESTRICT r,
+                                real* RESTRICT ax,
+                                real* RESTRICT ay,
+                                real* RESTRICT az)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        const real tmp = sph->scale + r[i];
+        const real s   = -sph->mass / (r[i] * sqr(tmp));
+
+        ax[i] += s * x[i];
+        ay[i] += s * y[i];
+        az[i] += s * z[i];
+    }
+}
+
+static void diskAccelBlock(const Disk* disk,
+                           int n,
+                           const real* x,
+                           const real* y,
+                           const real* z,
+                           const real* r,
+                           real* ax,
+                           real* ay,
+                           real* az)
+{
+    switch (disk->type)
+    {
+        case ExponentialDisk:
+            exponentialDiskAccelBlock(disk, n, x, y, z, r, ax, ay, az);
+            break;
+        case MiyamotoNagaiDisk:
+            miyamotoNagaiDiskAccelBlock(disk, n, x, y, z, ax, ay, az);
+            break;
+        case InvalidDisk:
+        default:
+            mw_fail("Invalid disk type in external acceleration\n");
+    }
+}
+
+static void haloAccelBlock(const Halo* halo,
+                           int n,
+                           const real* x,
+                           const real* y,
+                           const real* z,
+                           const real* r,
+                           real* ax,
+                           real* ay,
+                           real* az)
+{
+    switch (halo->type)
+    {
+        case LogarithmicHalo:
+            logHaloAccelBlock(halo, n, x, y, z, ax, ay, az);
+            break;
+        case NFWHalo:
+            nfwHaloAccelBlock(halo, n, x, y, z, r, ax, ay, az);
+            break;
+        case TriaxialHalo:
+            triaxialHaloAccelBlock(halo, n, x, y, z, ax, ay, az);
+            break;
+        case InvalidHalo:
+        default:
+            mw_fail("Invalid halo type in external acceleration\n");
+    }
+}
+
+static void nbExtAccelerationBlock(const Potential* pot,
+                                   int n,
+                                   const real* x,
+                                   const real* y,
+                                   const real* z,
+                                   real* ax,
+                                   real* ay,
+                                   real* az)
+{
+    int i;
+    real r[NB_EXT_BLOCK];
+
+    for (i = 0; i < n; ++i)
+    {
+        r[i] = mw_sqrt(mw_mad(z[i], z[i], mw_mad(y[i], y[i], x[i] * x[i])));
+        ax[i] = 0.0;
+        ay[i] = 0.0;
+        az[i] = 0.0;
+    }
+
+    diskAccelBlock(&pot->disk, n, x, y, z, r, ax, ay, az);
+    haloAccelBlock(&pot->halo, n, x, y, z, r, ax, ay, az);
+    sphericalAccelBlock(&pot->sphere[0], n, x, y, z, r, ax, ay, az);
+
+    for (i = 0; i < pot->nExtraDisk; ++i)
+    {
+        diskAccelBlock(&pot->extraDisk[i], n, x, y, z, r, ax, ay, az);
+    }
+
+    for (i = 0; i < pot->nExtraHalo; ++i)
+    {
+        haloAccelBlock(&pot->extraHalo[i], n, x, y, z, r, ax, ay, az);
+    }
+
+    for (i = 0; i < pot->nExtraSphere; ++i)
+    {
+        sphericalAccelBlock(&pot->extraSphere[i], n, x, y, z, r, ax, ay, az);
+    }
+}
+
+void nbExtAccelerationBatch(const Potential* pot,
+                            int n,
+                            const real* x,
+                            const real* y,
+                            const real* z,
+                            real* ax,
+                            real* ay,
+                            real* az)
+{
+    int i, nBlock;
+
+    for (i = 0; i < n; i += NB_EXT_BLOCK)
+    {
+        nBlock = MIN(NB_EXT_BLOCK, n - i);
+        nbExtAccelerationBlock(pot, nBlock, &x[i], &y[i], &z[i], &ax[i], &ay[i], &az[i]);
+    }
+}
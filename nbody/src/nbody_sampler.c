@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody_priv.h"
+#include "milkyway_util.h"
+#include "nbody_sampler.h"
+
+/* Tabulate the density and build the alias table with Vose's method.
+ * Returns nonzero if the density is negative, not finite or
+ * integrates to 0 on the interval. */
+int nbInitSampler(NBodySampler* s, NBodyDensity density, const void* args, real xMin, real xMax)
+{
+    int i, l, g, nSmall, nLarge;
+    real total = 0.0;
+    real w[NB_SAMPLER_BINS];
+    int small[NB_SAMPLER_BINS];
+    int large[NB_SAMPLER_BINS];
+
+    s->xMin = xMin;
+    s->binWidth = (xMax - xMin) / NB_SAMPLER_BINS;
+
+    for (i = 0; i <= NB_SAMPLER_BINS; ++i)
+    {
+        s->y[i] = density(xMin + i * s->binWidth, args);
+        if (!isfinite(s->y[i]) || s->y[i] < 0.0)
+        {
+            mw_printf("Invalid density %f at %f for sampler\n", s->y[i], xMin + i * s->binWidth);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < NB_SAMPLER_BINS; ++i)
+    {
+        w[i] = 0.5 * (s->y[i] + s->y[i + 1]);
+        total += w[i];
+    }
+
+    if (total <= 0.0)
+    {
+        mw_printf("Density for sampler integrates to 0\n");
+        return 1;
+    }
+
+    nSmall = nLarge = 0;
+    for (i = 0; i < NB_SAMPLER_BINS; ++i)
+    {
+        w[i] *= NB_SAMPLER_BINS / total;    /* Mean weight 1 */
+        s->alias[i] = i;
+        if (w[i] < 1.0)
+            small[nSmall++] = i;
+        else
+            large[nLarge++] = i;
+    }
+
+    while (nSmall > 0 && nLarge > 0)
+    {
+        l = small[--nSmall];
+        g = large[--nLarge];
+
+        s->prob[l] = w[l];
+        s->alias[l] = g;
+
+        w[g] -= 1.0 - w[l];
+        if (w[g] < 1.0)
+            small[nSmall++] = g;
+        else
+            large[nLarge++] = g;
+    }
+
+    /* Whatever is left is 1 up to rounding */
+    while (nLarge > 0)
+        s->prob[large[--nLarge]] = 1.0;
+    while (nSmall > 0)
+        s->prob[small[--nSmall]] = 1.0;
+
+    return 0;
+}
+
+real nbSample(const NBodySampler* s, dsfmt_t* prng)
+{
+    int i;
+    real u, t, y0, y1, d;
+
+    u = (real) dsfmt_genrand_close_open(prng) * NB_SAMPLER_BINS;
+    i = (int) u;
+    if (i >= NB_SAMPLER_BINS)   /* Rounding in single precision */
+        i = NB_SAMPLER_BINS - 1;
+    if (u - i >= s->prob[i])
+        i = s->alias[i];
+
+    /* Invert the CDF of the linear density from y0 to y1 across the bin */
+    y0 = s->y[i];
+    y1 = s->y[i + 1];
+    u = (real) dsfmt_genrand_close_open(prng);
+    d = y0 + mw_sqrt(sqr(y0) + u * (sqr(y1) - sqr(y0)));
+    t = d > 0.0 ? u * (y0 + y1) / d : u;
+
+    return s->xMin + (i + t) * s->binWidth;
+}
+
@@ -26,6 +26,7 @@
 #include "nbody_lua.h"
 #include "nbody_shmem.h"
 #include "nbody_defaults.h"
+#include "nbody_stream.h"
 
 #if NBODY_OPENCL
   #include "nbody_cl.h"
@@ -56,11 +57,21 @@
 
 #define MAX_INSTANCES 256
 
-static void nbPrepareSceneFromState(const NBodyCtx* ctx, const NBodyState* st)
+/* Number of bodies in each snapshot when taking every stride'th body */
+static int nbSceneBodyCount(const NBodyState* st, const NBodyFlags* nbf)
+{
+    return (st->nbody + nbf->visStride - 1) / nbf->visStride;
+}
+
+static void nbPrepareSceneFromState(const NBodyCtx* ctx, const NBodyState* st, const NBodyFlags* nbf)
 {
     st->scene->nbodyMajorVersion = NBODY_VERSION_MAJOR;
     st->scene->nbodyMinorVersion = NBODY_VERSION_MINOR;
-    st->scene->nbody = st->nbody;
+    st->scene->nbody = nbSceneBodyCount(st, nbf);
+    st->scene->nbodyTotal = st->nbody;
+    st->scene->stride = nbf->visStride;
+    st->scene->quantized = nbf->visQuantize;
+    st->scene->queue.size = nbf->visQueueSize;
     st->scene->nSteps = ctx->nStep;
     st->scene->hasInfo = TRUE;
     st->scene->hasGalaxy = (ctx->potentialType == EXTERNAL_POTENTIAL_DEFAULT);
@@ -257,9 +268,9 @@ static scene_t* nbOpenMappedSharedSegment(const char* name, size_t size)
 
 #if USE_BOINC_SHMEM
 
-int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx)
+int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx, const NBodyFlags* nbf)
 {
-    size_t size = nbFindShmemSize(st->nbody, ctx->nStep);
+    size_t size = nbFindShmemSize(nbSceneBodyCount(st, nbf), ctx->nStep, nbf->visQueueSize, nbf->visQuantize);
 
     st->scene = (scene_t*) mw_graphics_make_shmem(NBODY_BIN_NAME, (int) size);
     if (!st->scene)
@@ -270,7 +281,7 @@ int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx)
 
     memset(st->scene, 0, sizeof(scene_t));
     OPA_store_int(&st->scene->ownerPID, (int) getpid());
-    nbPrepareSceneFromState(ctx, st);
+    nbPrepareSceneFromState(ctx, st, nbf);
 
     return 0;
 }
@@ -278,13 +289,13 @@ int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx)
 #else
 
 /* Create the next available segment of the form /milkyway_nbody_n n = 0 .. 127 */
-int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx)
+int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx, const NBodyFlags* nbf)
 {
     int pid;
     int instanceId;
     char name[NAME_MAX + 1];
     scene_t* scene = NULL;
-    size_t size = nbFindShmemSize(st->nbody, ctx->nStep);
+    size_t size = nbFindShmemSize(nbSceneBodyCount(st, nbf), ctx->nStep, nbf->visQueueSize, nbf->visQuantize);
 
     /* Try looking for the next available segment of the form /milkyway_nbody_<n> */
     for (instanceId = 0; instanceId < MAX_INSTANCES; ++instanceId)
@@ -315,7 +326,7 @@ int nbCreateSharedScene(NBodyState* st, const NBodyCtx* ctx)
     st->scene->instanceId = instanceId;
     OPA_store_int(&st->scene->ownerPID, pid);
     strncpy(st->scene->shmemName, name, sizeof(st->scene->shmemName));
-    nbPrepareSceneFromState(ctx, st);
+    nbPrepareSceneFromState(ctx, st, nbf);
 
     return 0;
 }
@@ -501,14 +512,8 @@ void nbLaunchVisualizer(NBodyState* st, const char* graphicsBin, const char* vis
 
 #endif /* _WIN32 */
 
-static void nbWriteSnapshot(NBodyCircularQueue* queue, int buffer, const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos)
+static void nbWriteSnapshotInfo(SceneInfo* info, const NBodyCtx* ctx, const NBodyState* st, const mwvector* cmPos)
 {
-    int i;
-    const Body* b;
-    int nbody = st->nbody;
-    SceneInfo* info = &queue->info[buffer];
-    FloatPos* r = nbSceneGetQueueBuffer(st->scene, buffer);
-
     info->currentStep = st->step;
     info->currentTime = (float) (st->step * ctx->timestep);
     info->timeEvolve = (float) ctx->timeEvolve;
@@ -516,44 +521,205 @@ static void nbWriteSnapshot(NBodyCircularQueue* queue, int buffer, const NBodyCt
     info->rootCenterOfMass[0] = (float) cmPos->x;
     info->rootCenterOfMass[1] = (float) cmPos->y;
     info->rootCenterOfMass[2] = (float) cmPos->z;
+    info->positionScale = 0.0f;
+}
+
+/* Position in the snapshot of bodytab[i], or -1 if the stride skips
+ * it. This follows the original body order so the same bodies are
+ * shown in every frame even after the bodies are sorted. */
+static inline int nbSceneBodySlot(const NBodyState* st, int stride, int i)
+{
+    int orig = st->bodyOrder[i];
+    return orig % stride == 0 ? orig / stride : -1;
+}
+
+static inline void nbSetFloatPos(FloatPos* r, const Body* b)
+{
+    r->x = (float) X(Pos(b));
+    r->y = (float) Y(Pos(b));
+    r->z = (float) Z(Pos(b));
+    r->ignore = ignoreBody(b);
+}
+
+static void nbWriteSnapshot(scene_t* scene, int buffer, const NBodyState* st)
+{
+    int i, j;
+    int nbody = st->nbody;
+    int stride = scene->stride;
+    int nShown = scene->nbody;
+    FloatPos* r = nbSceneGetQueueBuffer(scene, buffer);
+
+    if (!st->bodyOrder)
+    {
+      #ifdef _OPENMP
+        #pragma omp parallel for private(j) schedule(static)
+      #endif
+        for (j = 0; j < nShown; ++j)
+        {
+            nbSetFloatPos(&r[j], &st->bodytab[j * stride]);
+        }
+
+        return;
+    }
 
   #ifdef _OPENMP
-    #pragma omp parallel for private(i, b) schedule(guided, 4096 / sizeof(Body))
+    #pragma omp parallel for private(i, j) schedule(guided, 4096 / sizeof(Body))
   #endif
     for (i = 0; i < nbody; ++i)
     {
-        b = &st->bodytab[i];
-        r[i].x = (float) X(Pos(b));
-        r[i].y = (float) Y(Pos(b));
-        r[i].z = (float) Z(Pos(b));
-        r[i].ignore = ignoreBody(b);
+        j = nbSceneBodySlot(st, stride, i);
+        if (j >= 0)
+        {
+            nbSetFloatPos(&r[j], &st->bodytab[i]);
+        }
     }
 }
 
-/* FIXME: Copies all the steps every step */
-static inline void nbUpdateDisplayedOrbitTrace(FloatPos* sceneTrace, const mwvector* trace, int n)
+static inline real nbBodyExtent(const Body* b, const mwvector* cmPos)
+{
+    real extent = mw_abs(X(Pos(b)) - X(*cmPos));
+    extent = mw_fmax(extent, mw_abs(Y(Pos(b)) - Y(*cmPos)));
+    return mw_fmax(extent, mw_abs(Z(Pos(b)) - Z(*cmPos)));
+}
+
+/* Largest distance along any axis of a displayed body from the center of mass */
+static real nbFindSnapshotExtent(const scene_t* scene, const NBodyState* st, const mwvector* cmPos)
 {
     int i;
+    int nbody = st->nbody;
+    int stride = scene->stride;
+    int nShown = scene->nbody;
+    real extent = 0.0;
+
+  #ifdef _OPENMP
+    #pragma omp parallel private(i)
+  #endif
+    {
+        real threadExtent = 0.0;
+
+        if (!st->bodyOrder)
+        {
+          #ifdef _OPENMP
+            #pragma omp for schedule(static)
+          #endif
+            for (i = 0; i < nShown; ++i)
+            {
+                threadExtent = mw_fmax(threadExtent, nbBodyExtent(&st->bodytab[i * stride], cmPos));
+            }
+        }
+        else
+        {
+          #ifdef _OPENMP
+            #pragma omp for schedule(static)
+          #endif
+            for (i = 0; i < nbody; ++i)
+            {
+                if (nbSceneBodySlot(st, stride, i) >= 0)
+                {
+                    threadExtent = mw_fmax(threadExtent, nbBodyExtent(&st->bodytab[i], cmPos));
+                }
+            }
+        }
+
+      #ifdef _OPENMP
+        #pragma omp critical
+      #endif
+        {
+            extent = mw_fmax(extent, threadExtent);
+        }
+    }
+
+    return extent;
+}
+
+static inline void nbSetQuantPos(QuantPos* q, const Body* b, const mwvector* cmPos, real invScale)
+{
+    q->x = (int16_t) mw_round((X(Pos(b)) - X(*cmPos)) * invScale);
+    q->y = (int16_t) mw_round((Y(Pos(b)) - Y(*cmPos)) * invScale);
+    q->z = (int16_t) mw_round((Z(Pos(b)) - Z(*cmPos)) * invScale);
+    q->ignore = (int16_t) ignoreBody(b);
+}
+
+/* Write positions as 16 bit steps of positionScale from the center of mass */
+static void nbWriteQuantizedSnapshot(scene_t* scene, int buffer, const NBodyState* st, const mwvector* cmPos)
+{
+    int i, j;
+    int nbody = st->nbody;
+    int stride = scene->stride;
+    int nShown = scene->nbody;
+    QuantPos* q = nbSceneGetQuantizedQueueBuffer(scene, buffer);
+    real extent = nbFindSnapshotExtent(scene, st, cmPos);
+    real invScale = extent > 0.0 ? NBODY_QUANT_MAX / extent : 0.0;
+
+    scene->queue.info[buffer].positionScale = (float) (extent / NBODY_QUANT_MAX);
+
+    if (!st->bodyOrder)
+    {
+      #ifdef _OPENMP
+        #pragma omp parallel for private(j) schedule(static)
+      #endif
+        for (j = 0; j < nShown; ++j)
+        {
+            nbSetQuantPos(&q[j], &st->bodytab[j * stride], cmPos, invScale);
+        }
+
+        return;
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, j) schedule(guided, 4096 / sizeof(Body))
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        j = nbSceneBodySlot(st, stride, i);
+        if (j >= 0)
+        {
+            nbSetQuantPos(&q[j], &st->bodytab[i], cmPos, invScale);
+        }
+    }
+}
 
-    for (i = 0; i < n; ++i)
+/* Append the steps of the orbit trace the scene doesn't have yet */
+static inline void nbUpdateDisplayedOrbitTrace(scene_t* scene, const mwvector* trace, unsigned int n)
+{
+    unsigned int i;
+    FloatPos* sceneTrace = nbSceneGetOrbitTrace(scene);
+
+    for (i = scene->traceLength; i < n; ++i)
     {
         sceneTrace[i].x = (float) trace[i].x;
         sceneTrace[i].y = (float) trace[i].y;
         sceneTrace[i].z = (float) trace[i].z;
     }
+
+    if (n > scene->traceLength)
+    {
+        scene->traceLength = n;
+    }
 }
 
-static int nbPushCircularQueue(NBodyCircularQueue* queue, const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos)
+static int nbPushCircularQueue(scene_t* scene, const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos)
 {
     int head, tail, nextTail;
+    NBodyCircularQueue* queue = &scene->queue;
+
     tail = OPA_load_int(&queue->tail);
     head = OPA_load_int(&queue->head);
 
-    nextTail = (tail + 1) % NBODY_CIRC_QUEUE_SIZE;
+    nextTail = (tail + 1) % queue->size;
     if (nextTail != head)
     {
-        nbWriteSnapshot(queue, tail, ctx, st, cmPos);
-        nbUpdateDisplayedOrbitTrace(nbSceneGetOrbitTrace(st->scene), st->orbitTrace, st->step);
+        nbWriteSnapshotInfo(&queue->info[tail], ctx, st, cmPos);
+        if (scene->quantized)
+        {
+            nbWriteQuantizedSnapshot(scene, tail, st, cmPos);
+        }
+        else
+        {
+            nbWriteSnapshot(scene, tail, st);
+        }
+
+        nbUpdateDisplayedOrbitTrace(scene, st->orbitTrace, st->step);
 
         OPA_store_int(&queue->tail, nextTail);
         return TRUE;
@@ -604,11 +770,15 @@ static int nbFindCenterOfMass(mwvector* cmPos, NBodyState* st)
 NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
 {
     int pid;
+    int streaming;
     int updatePeriod;
     mwvector cmPos;
     scene_t* scene = st->scene;
 
-    if (!scene)
+    /* Finding the center of mass costs a pass over the bodies, so
+     * skip it when nothing would see the result */
+    streaming = nbStreamHasClients(st);
+    if (!scene && !streaming)
     {
         return NBODY_SUCCESS;
     }
@@ -623,6 +793,16 @@ NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
         st->orbitTrace[st->step] = cmPos;
     }
 
+    if (streaming)
+    {
+        nbPublishStreamFrame(ctx, st, &cmPos);
+    }
+
+    if (!scene)
+    {
+        return NBODY_SUCCESS;
+    }
+
     /* No copying when no screensaver attached */
     pid = OPA_load_int(&scene->attachedPID);
     if (pid == 0)
@@ -646,7 +826,7 @@ NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
 
             /* Keep trying to push to the queue as long as the
              * process is still attached. */
-            while (   !(updated = nbPushCircularQueue(&scene->queue, ctx, st, &cmPos))
+            while (   !(updated = nbPushCircularQueue(scene, ctx, st, &cmPos))
                    && ((pid = OPA_load_int(&scene->attachedPID)) != 0)
                    && (attempt < NBODY_QUEUE_WAIT_PERIODS))
             {
@@ -699,7 +879,7 @@ NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
 
         if (now - lastTime >= updatePeriod)
         {
-            if (nbPushCircularQueue(&scene->queue, ctx, st, &cmPos))
+            if (nbPushCircularQueue(scene, ctx, st, &cmPos))
             {
                 OPA_store_int(&scene->lastUpdateTime, now);
             }
@@ -709,7 +889,7 @@ NBodyStatus nbUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
     }
     else
     {
-        nbPushCircularQueue(&scene->queue, ctx, st, &cmPos);
+        nbPushCircularQueue(scene, ctx, st, &cmPos);
         return NBODY_SUCCESS;
     }
 }
@@ -737,7 +917,7 @@ NBodyStatus nbForceUpdateDisplayedBodies(const NBodyCtx* ctx, NBodyState* st)
         st->orbitTrace[st->step] = cmPos;
     }
 
-    return nbPushCircularQueue(&scene->queue, ctx, st, &cmPos) ? NBODY_SUCCESS : NBODY_ERROR;
+    return nbPushCircularQueue(scene, ctx, st, &cmPos) ? NBODY_SUCCESS : NBODY_ERROR;
 }
 
 /* Report the simulation has ended as a hint to the graphics to quit */
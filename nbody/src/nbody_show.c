@@ -22,6 +22,7 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "nbody_types.h"
 #include "milkyway_util.h"
 #include "nbody_show.h"
+#include "nbody_tree.h"
 
 /* A bunch of boilerplate for debug printing */
 
@@ -423,11 +424,17 @@ char* showPotential(const Potential* p)
                   "    disk = %s\n"
                   "    halo = %s\n"
                   "    rings  = { unused pointer %p }\n"
+                  "    nExtraSphere = %d\n"
+                  "    nExtraDisk = %d\n"
+                  "    nExtraHalo = %d\n"
                   "  };\n",
                   sphBuf,
                   diskBuf,
                   haloBuf,
-                  p->rings);
+                  p->rings,
+                  p->nExtraSphere,
+                  p->nExtraDisk,
+                  p->nExtraHalo);
     if (rc < 0)
         mw_fail("asprintf() failed\n");
 
@@ -459,9 +466,16 @@ char* showNBodyCtx(const NBodyCtx* ctx)
                      "  timeEvolve      = %f\n"
                      "  treeRSize       = %f\n"
                      "  sunGCDist       = %f\n"
+                     "  timestepEta     = %f\n"
                      "  criterion       = %s\n"
                      "  useQuad         = %s\n"
                      "  allowIncest     = %s\n"
+                     "  parallelTree    = %s\n"
+                     "  bodySortInterval = %d\n"
+                     "  flatTree        = %s\n"
+                     "  groupSize       = %d\n"
+                     "  treeRebuildInterval = %d\n"
+                     "  timestepLevels  = %d\n"
                      "  checkpointT     = %d\n"
                      "  nStep           = %u\n"
                      "  potentialType   = %s\n"
@@ -473,9 +487,16 @@ char* showNBodyCtx(const NBodyCtx* ctx)
                      ctx->timeEvolve,
                      ctx->treeRSize,
                      ctx->sunGCDist,
+                     ctx->timestepEta,
                      showCriterionT(ctx->criterion),
                      showBool(ctx->useQuad),
                      showBool(ctx->allowIncest),
+                     showBool(ctx->parallelTree),
+                     ctx->bodySortInterval,
+                     showBool(ctx->flatTree),
+                     ctx->groupSize,
+                     ctx->treeRebuildInterval,
+                     ctx->timestepLevels,
                      (int) ctx->checkpointT,
                      ctx->nStep,
                      showExternalPotentialType(ctx->potentialType),
@@ -509,6 +530,10 @@ char* showHistogramParams(const HistogramParams* hp)
                      "  endRaw   = %g\n"
                      "  binSize  = %g\n"
                      "  center   = %g\n"
+                     "  beta     = { %g, %g, %g }\n"
+                     "  distance = { %g, %g, %g }\n"
+                     "  vlos     = { %g, %g, %g }\n"
+                     "  sparse   = %s\n"
                      "};\n",
                      hp->phi,
                      hp->theta,
@@ -516,7 +541,11 @@ char* showHistogramParams(const HistogramParams* hp)
                      hp->startRaw,
                      hp->endRaw,
                      hp->binSize,
-                     hp->center))
+                     hp->center,
+                     hp->beta.start, hp->beta.end, hp->beta.binSize,
+                     hp->distance.start, hp->distance.end, hp->distance.binSize,
+                     hp->vlos.start, hp->vlos.end, hp->vlos.binSize,
+                     showBool(hp->sparse)))
 
     {
         mw_fail("asprintf() failed\n");
@@ -608,7 +637,7 @@ char* showNBodyState(const NBodyState* st)
     if (0 > asprintf(&buf,
                      "NBodyState %p = {\n"
                      "  tree           = %s\n"
-                     "  freeCell       = %p\n"
+                     "  cellArena      = %p (%u cells, %u high water)\n"
                      "  lastCheckpoint = %d\n"
                      "  step           = %u\n"
                      "  nbody          = %u\n"
@@ -618,7 +647,9 @@ char* showNBodyState(const NBodyState* st)
                      "};\n",
                      st,
                      treeBuf,
-                     st->freeCell,
+                     st->cellArena.cells,
+                     st->cellArena.maxCell,
+                     nbCellArenaHighWater(&st->cellArena),
                      (int) st->lastCheckpoint,
                      st->step,
                      st->nbody,
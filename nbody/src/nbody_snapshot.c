@@ -0,0 +1,749 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <unistd.h>
+#endif
+
+#include "nbody_snapshot.h"
+#include "nbody_binary_io.h"
+#include "milkyway_util.h"
+
+/* Snapshot file. Everything is little endian.
+
+     char[8]   "mwnbsnap"
+     uint32    version
+     uint32    fields stored as float32 (NBodySnapshotFields)
+     uint64    nbody
+     uint64    frame size in bytes
+     uint64    offset of the first frame
+     uint64    number of frames, 0 until the file is closed
+     uint64    offset of the index, 0 until the file is closed
+     uint64    reserved
+
+     uint8     ignore[nbody], zero padded to a multiple of 8 bytes
+     float64   mass[nbody]
+
+   then frames, all the same size:
+
+     uint64    step
+     float64   time
+     x, y, z positions then x, y, z velocities, each as an array of
+     nbody float32 or float64, zero padded to a multiple of 8 bytes
+
+   and when the file is closed, the index:
+
+     { uint64 step, float64 time, uint64 offset } for each frame
+
+   Bodies are always in their original order. If a run is killed
+   before the index is written, the frames can still be found from
+   their fixed size. */
+
+#define NB_SNAPSHOT_HEADER_SIZE 64
+#define NB_SNAPSHOT_FRAME_HEADER_SIZE 16
+#define NB_SNAPSHOT_INDEX_ENTRY_SIZE 24
+#define NB_SNAPSHOT_CHUNK 65536
+
+struct NBodySnapshotWriter
+{
+    FILE* f;
+    unsigned int interval;
+    real timeInterval;
+    unsigned int floatFields;
+    uint64_t frameSize;
+    uint64_t dataOffset;
+
+    uint64_t nFrames;
+    uint64_t maxFrames;
+    uint64_t* steps;
+    double* times;
+
+    uint8_t* buf;       /* One chunk of a column */
+    int* bodyIndex;     /* Where each body in original order currently is */
+};
+
+
+static uint64_t nbRoundUp8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t) 7;
+}
+
+static void nbPutReal(uint8_t* p, double d, size_t size)
+{
+    float x;
+    uint32_t u;
+
+    if (size == sizeof(double))
+    {
+        nbPutF64(p, d);
+        return;
+    }
+
+    x = (float) d;
+    memcpy(&u, &x, sizeof(u));
+    nbPutU32(p, u);
+}
+
+static double nbGetReal(const uint8_t* p, size_t size)
+{
+    float x;
+    uint32_t u;
+
+    if (size == sizeof(double))
+    {
+        return nbGetF64(p);
+    }
+
+    u = nbGetU32(p);
+    memcpy(&x, &u, sizeof(x));
+    return (double) x;
+}
+
+static uint64_t nbSnapshotFileSize(FILE* f)
+{
+  #ifdef _WIN32
+    _fseeki64(f, 0, SEEK_END);
+    return (uint64_t) _ftelli64(f);
+  #else
+    fseeko(f, 0, SEEK_END);
+    return (uint64_t) ftello(f);
+  #endif
+}
+
+static int nbSnapshotTruncate(FILE* f, uint64_t size)
+{
+    if (fflush(f))
+        return 1;
+
+  #ifdef _WIN32
+    return _chsize_s(_fileno(f), (__int64) size) != 0;
+  #else
+    return ftruncate(fileno(f), (off_t) size) != 0;
+  #endif
+}
+
+static size_t nbPositionSize(unsigned int floatFields)
+{
+    return (floatFields & NBODY_SNAPSHOT_POSITION_FLOAT) ? sizeof(float) : sizeof(double);
+}
+
+static size_t nbVelocitySize(unsigned int floatFields)
+{
+    return (floatFields & NBODY_SNAPSHOT_VELOCITY_FLOAT) ? sizeof(float) : sizeof(double);
+}
+
+static uint64_t nbSnapshotFrameSize(uint64_t nbody, unsigned int floatFields)
+{
+    return NB_SNAPSHOT_FRAME_HEADER_SIZE
+        + 3 * nbRoundUp8(nbody * nbPositionSize(floatFields))
+        + 3 * nbRoundUp8(nbody * nbVelocitySize(floatFields));
+}
+
+static uint64_t nbSnapshotDataOffset(uint64_t nbody)
+{
+    return NB_SNAPSHOT_HEADER_SIZE + nbRoundUp8(nbody) + nbody * sizeof(double);
+}
+
+int nbParseSnapshotFields(const char* list, unsigned int* fields)
+{
+    const char* p = list;
+    size_t len;
+
+    *fields = 0;
+
+    while (p && *p)
+    {
+        len = strcspn(p, ",");
+
+        if (len == strlen("position") && !strncmp(p, "position", len))
+        {
+            *fields |= NBODY_SNAPSHOT_POSITION_FLOAT;
+        }
+        else if (len == strlen("velocity") && !strncmp(p, "velocity", len))
+        {
+            *fields |= NBODY_SNAPSHOT_VELOCITY_FLOAT;
+        }
+        else
+        {
+            mw_printf("Unknown snapshot field '%.*s'. Expected 'position' or 'velocity'\n", (int) len, p);
+            return 1;
+        }
+
+        p += len;
+        if (*p == ',')
+            ++p;
+    }
+
+    return 0;
+}
+
+/* Find where each body in the original order is in bodytab. Returns
+ * NULL if the bodies haven't been reordered. */
+static const int* nbSnapshotBodyIndex(NBodySnapshotWriter* w, const NBodyState* st)
+{
+    int i;
+
+    if (!st->bodyOrder)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        w->bodyIndex[st->bodyOrder[i]] = i;
+    }
+
+    return w->bodyIndex;
+}
+
+static const Body* nbSnapshotBody(const NBodyState* st, const int* bodyIndex, int i)
+{
+    return &st->bodytab[bodyIndex ? bodyIndex[i] : i];
+}
+
+static int nbWriteSnapshotPadding(FILE* f, uint64_t n)
+{
+    static const uint8_t zeros[8] = { 0 };
+    return n % 8 != 0 && fwrite(zeros, 1, 8 - n % 8, f) != 8 - n % 8;
+}
+
+static int nbWriteSnapshotHeader(NBodySnapshotWriter* w, const NBodyState* st)
+{
+    uint8_t header[NB_SNAPSHOT_HEADER_SIZE];
+    const int* bodyIndex = nbSnapshotBodyIndex(w, st);
+    int failed = FALSE;
+    int i, first, n;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, NBODY_SNAPSHOT_MAGIC, 8);
+    nbPutU32(header + 8, NBODY_SNAPSHOT_VERSION);
+    nbPutU32(header + 12, w->floatFields);
+    nbPutU64(header + 16, (uint64_t) st->nbody);
+    nbPutU64(header + 24, w->frameSize);
+    nbPutU64(header + 32, w->dataOffset);
+
+    failed |= (fwrite(header, 1, sizeof(header), w->f) != sizeof(header));
+
+    for (first = 0; first < st->nbody && !failed; first += NB_SNAPSHOT_CHUNK)
+    {
+        n = MIN(NB_SNAPSHOT_CHUNK, st->nbody - first);
+        for (i = 0; i < n; ++i)
+        {
+            w->buf[i] = (uint8_t) ignoreBody(nbSnapshotBody(st, bodyIndex, first + i));
+        }
+
+        failed |= (fwrite(w->buf, 1, n, w->f) != (size_t) n);
+    }
+
+    failed |= nbWriteSnapshotPadding(w->f, (uint64_t) st->nbody);
+
+    for (first = 0; first < st->nbody && !failed; first += NB_SNAPSHOT_CHUNK)
+    {
+        n = MIN(NB_SNAPSHOT_CHUNK, st->nbody - first);
+        for (i = 0; i < n; ++i)
+        {
+            nbPutF64(&w->buf[i * sizeof(double)], Mass(nbSnapshotBody(st, bodyIndex, first + i)));
+        }
+
+        failed |= (fwrite(w->buf, sizeof(double), n, w->f) != (size_t) n);
+    }
+
+    return failed;
+}
+
+static int nbAddSnapshotIndexEntry(NBodySnapshotWriter* w, uint64_t step, double time)
+{
+    uint64_t* steps;
+    double* times;
+
+    if (w->nFrames == w->maxFrames)
+    {
+        w->maxFrames = 2 * w->maxFrames + 16;
+        steps = (uint64_t*) realloc(w->steps, w->maxFrames * sizeof(uint64_t));
+        times = (double*) realloc(w->times, w->maxFrames * sizeof(double));
+        if (steps)
+            w->steps = steps;
+        if (times)
+            w->times = times;
+        if (!steps || !times)
+            return 1;
+    }
+
+    w->steps[w->nFrames] = step;
+    w->times[w->nFrames] = time;
+    ++w->nFrames;
+
+    return 0;
+}
+
+/* Keep the frames of an existing file up to the step being resumed
+ * from, so the frames written after it can be redone */
+static int nbResumeSnapshotFile(NBodySnapshotWriter* w, const NBodyState* st, const char* filename)
+{
+    uint8_t header[NB_SNAPSHOT_HEADER_SIZE];
+    uint8_t frameHeader[NB_SNAPSHOT_FRAME_HEADER_SIZE];
+    uint64_t nOnDisk, k, step, size;
+
+    if (fread(header, 1, sizeof(header), w->f) != sizeof(header)
+        || memcmp(header, NBODY_SNAPSHOT_MAGIC, 8)
+        || nbGetU32(header + 8) != NBODY_SNAPSHOT_VERSION
+        || nbGetU32(header + 12) != w->floatFields
+        || nbGetU64(header + 16) != (uint64_t) st->nbody
+        || nbGetU64(header + 24) != w->frameSize
+        || nbGetU64(header + 32) != w->dataOffset)
+    {
+        mw_printf("Snapshot file '%s' does not match the resumed simulation\n", filename);
+        return 1;
+    }
+
+    if (nbGetU64(header + 48) != 0)
+    {
+        nOnDisk = nbGetU64(header + 40);
+    }
+    else
+    {
+        size = nbSnapshotFileSize(w->f);
+        nOnDisk = size > w->dataOffset ? (size - w->dataOffset) / w->frameSize : 0;
+    }
+
+    for (k = 0; k < nOnDisk; ++k)
+    {
+        if (   nbSeekFile(w->f, w->dataOffset + k * w->frameSize)
+            || fread(frameHeader, 1, sizeof(frameHeader), w->f) != sizeof(frameHeader))
+        {
+            break;
+        }
+
+        step = nbGetU64(frameHeader);
+        if (step > st->step || (w->nFrames > 0 && step <= w->steps[w->nFrames - 1]))
+        {
+            break;
+        }
+
+        if (nbAddSnapshotIndexEntry(w, step, nbGetF64(frameHeader + 8)))
+        {
+            return 1;
+        }
+    }
+
+    /* Mark the file as being written until the index is back, and
+     * drop the frames being redone along with the old index, so none
+     * are left after the new frames if fewer are written */
+    memset(header, 0, 16);
+    if (   nbSeekFile(w->f, 40)
+        || fwrite(header, 1, 16, w->f) != 16
+        || nbSnapshotTruncate(w->f, w->dataOffset + w->nFrames * w->frameSize)
+        || nbSeekFile(w->f, w->dataOffset + w->nFrames * w->frameSize))
+    {
+        mwPerror("Resuming snapshot file '%s'", filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+int nbCreateSnapshotWriter(NBodyState* st,
+                           const char* filename,
+                           unsigned int interval,
+                           real timeInterval,
+                           unsigned int floatFields)
+{
+    NBodySnapshotWriter* w;
+    char resolved[4096];
+    int rc;
+
+    if (mw_resolve_filename(filename, resolved, sizeof(resolved)))
+    {
+        mw_printf("Error resolving snapshot file '%s'\n", filename);
+        return 1;
+    }
+
+    w = (NBodySnapshotWriter*) mwCalloc(1, sizeof(NBodySnapshotWriter));
+    w->interval = interval;
+    w->timeInterval = timeInterval;
+    w->floatFields = floatFields;
+    w->frameSize = nbSnapshotFrameSize((uint64_t) st->nbody, floatFields);
+    w->dataOffset = nbSnapshotDataOffset((uint64_t) st->nbody);
+    w->buf = (uint8_t*) mwMalloc(NB_SNAPSHOT_CHUNK * sizeof(double));
+    w->bodyIndex = (int*) mwMalloc(st->nbody * sizeof(int));
+    st->snapshotWriter = w;
+
+    /* Frames from before the checkpoint are kept when resuming */
+    w->f = st->step > 0 ? mw_fopen(resolved, "r+b") : NULL;
+    if (w->f)
+    {
+        rc = nbResumeSnapshotFile(w, st, resolved);
+    }
+    else
+    {
+        w->f = mw_fopen(resolved, "wb");
+        if (!w->f)
+        {
+            mwPerror("Opening snapshot file '%s'", resolved);
+            return 1;
+        }
+
+        rc = nbWriteSnapshotHeader(w, st);
+        if (rc)
+        {
+            mwPerror("Writing snapshot file header");
+        }
+    }
+
+    return rc;
+}
+
+int nbTimeToSnapshot(const NBodyCtx* ctx, const NBodyState* st)
+{
+    const NBodySnapshotWriter* w = st->snapshotWriter;
+    real t, tPrev;
+
+    if (!w)
+    {
+        return FALSE;
+    }
+
+    /* Already have this one, from before a resumed checkpoint */
+    if (w->nFrames > 0 && w->steps[w->nFrames - 1] >= st->step)
+    {
+        return FALSE;
+    }
+
+    /* Always include the initial and final states */
+    if (st->step == 0 || st->step >= ctx->nStep)
+    {
+        return TRUE;
+    }
+
+    if (w->interval > 0 && st->step % w->interval == 0)
+    {
+        return TRUE;
+    }
+
+    if (w->timeInterval > 0.0)
+    {
+        t = (real) st->step * ctx->timestep;
+        tPrev = (real) (st->step - 1) * ctx->timestep;
+        return (uint64_t) (t / w->timeInterval) != (uint64_t) (tPrev / w->timeInterval);
+    }
+
+    return FALSE;
+}
+
+static int nbWriteSnapshotColumn(NBodySnapshotWriter* w,
+                                 const NBodyState* st,
+                                 const int* bodyIndex,
+                                 int k,
+                                 size_t size)
+{
+    int i, first, n;
+    int failed = FALSE;
+    uint8_t* buf = w->buf;
+
+    for (first = 0; first < st->nbody && !failed; first += NB_SNAPSHOT_CHUNK)
+    {
+        n = MIN(NB_SNAPSHOT_CHUNK, st->nbody - first);
+
+      #ifdef _OPENMP
+        #pragma omp parallel for private(i) schedule(static)
+      #endif
+        for (i = 0; i < n; ++i)
+        {
+            const Body* p = nbSnapshotBody(st, bodyIndex, first + i);
+            mwvector v = k < 3 ? Pos(p) : Vel(p);
+            int c = k % 3;
+
+            nbPutReal(&buf[i * size], c == 0 ? X(v) : (c == 1 ? Y(v) : Z(v)), size);
+        }
+
+        failed |= (fwrite(buf, size, n, w->f) != (size_t) n);
+    }
+
+    failed |= nbWriteSnapshotPadding(w->f, (uint64_t) st->nbody * size);
+
+    return failed;
+}
+
+int nbAppendSnapshotFrame(const NBodyCtx* ctx, const NBodyState* st)
+{
+    NBodySnapshotWriter* w = st->snapshotWriter;
+    uint8_t frameHeader[NB_SNAPSHOT_FRAME_HEADER_SIZE];
+    const int* bodyIndex;
+    const double time = (double) st->step * ctx->timestep;
+    int k;
+    int failed = FALSE;
+
+    bodyIndex = nbSnapshotBodyIndex(w, st);
+
+    nbPutU64(frameHeader, (uint64_t) st->step);
+    nbPutF64(frameHeader + 8, time);
+    failed |= (fwrite(frameHeader, 1, sizeof(frameHeader), w->f) != sizeof(frameHeader));
+
+    for (k = 0; k < 6 && !failed; ++k)
+    {
+        failed |= nbWriteSnapshotColumn(w, st, bodyIndex, k,
+                                        k < 3 ? nbPositionSize(w->floatFields) : nbVelocitySize(w->floatFields));
+    }
+
+    /* Make sure a frame is on disk before any checkpoint after it */
+    failed |= fflush(w->f);
+
+    if (failed)
+    {
+        mwPerror("Writing snapshot frame at step %u", st->step);
+        return 1;
+    }
+
+    return nbAddSnapshotIndexEntry(w, (uint64_t) st->step, time);
+}
+
+int nbCloseSnapshotWriter(NBodyState* st)
+{
+    NBodySnapshotWriter* w = st->snapshotWriter;
+    uint8_t entry[NB_SNAPSHOT_INDEX_ENTRY_SIZE];
+    uint8_t counts[16];
+    uint64_t k, indexOffset;
+    int failed = FALSE;
+
+    if (!w)
+    {
+        return 0;
+    }
+
+    if (w->f)
+    {
+        indexOffset = w->dataOffset + w->nFrames * w->frameSize;
+        failed |= nbSeekFile(w->f, indexOffset);
+
+        for (k = 0; k < w->nFrames && !failed; ++k)
+        {
+            nbPutU64(entry, w->steps[k]);
+            nbPutF64(entry + 8, w->times[k]);
+            nbPutU64(entry + 16, w->dataOffset + k * w->frameSize);
+            failed |= (fwrite(entry, 1, sizeof(entry), w->f) != sizeof(entry));
+        }
+
+        /* Only point at the index once it's all there */
+        nbPutU64(counts, w->nFrames);
+        nbPutU64(counts + 8, indexOffset);
+        failed |= fflush(w->f);
+        failed |= nbSeekFile(w->f, 40);
+        failed |= (fwrite(counts, 1, sizeof(counts), w->f) != sizeof(counts));
+
+        if (failed)
+        {
+            mwPerror("Writing snapshot index");
+        }
+
+        if (fclose(w->f))
+        {
+            mwPerror("Closing snapshot file");
+            failed = TRUE;
+        }
+    }
+
+    free(w->steps);
+    free(w->times);
+    free(w->buf);
+    free(w->bodyIndex);
+    free(w);
+    st->snapshotWriter = NULL;
+
+    return failed;
+}
+
+
+int nbOpenSnapshotReader(NBodySnapshotReader* r, const char* filename)
+{
+    uint8_t header[NB_SNAPSHOT_HEADER_SIZE];
+    uint8_t entry[NB_SNAPSHOT_INDEX_ENTRY_SIZE];
+    uint64_t k, indexOffset, size;
+
+    memset(r, 0, sizeof(*r));
+
+    r->f = mw_fopen(filename, "rb");
+    if (!r->f)
+    {
+        mwPerror("Opening snapshot file '%s'", filename);
+        return 1;
+    }
+
+    if (   fread(header, 1, sizeof(header), r->f) != sizeof(header)
+        || memcmp(header, NBODY_SNAPSHOT_MAGIC, 8)
+        || nbGetU32(header + 8) != NBODY_SNAPSHOT_VERSION)
+    {
+        mw_printf("'%s' is not a snapshot file\n", filename);
+        nbCloseSnapshotReader(r);
+        return 1;
+    }
+
+    r->floatFields = nbGetU32(header + 12);
+    r->nbody = nbGetU64(header + 16);
+    r->frameSize = nbGetU64(header + 24);
+    r->dataOffset = nbGetU64(header + 32);
+    r->nFrames = nbGetU64(header + 40);
+    indexOffset = nbGetU64(header + 48);
+
+    if (   r->frameSize != nbSnapshotFrameSize(r->nbody, r->floatFields)
+        || r->dataOffset != nbSnapshotDataOffset(r->nbody))
+    {
+        mw_printf("Snapshot file '%s' has an invalid header\n", filename);
+        nbCloseSnapshotReader(r);
+        return 1;
+    }
+
+    /* Without an index, count the whole frames in the file */
+    if (indexOffset == 0)
+    {
+        size = nbSnapshotFileSize(r->f);
+        r->nFrames = size > r->dataOffset ? (size - r->dataOffset) / r->frameSize : 0;
+    }
+
+    r->steps = (uint64_t*) mwMalloc((r->nFrames + 1) * sizeof(uint64_t));
+    r->times = (double*) mwMalloc((r->nFrames + 1) * sizeof(double));
+    r->offsets = (uint64_t*) mwMalloc((r->nFrames + 1) * sizeof(uint64_t));
+
+    for (k = 0; k < r->nFrames; ++k)
+    {
+        if (indexOffset != 0)
+        {
+            if (   nbSeekFile(r->f, indexOffset + k * sizeof(entry))
+                || fread(entry, 1, sizeof(entry), r->f) != sizeof(entry))
+            {
+                break;
+            }
+
+            r->steps[k] = nbGetU64(entry);
+            r->times[k] = nbGetF64(entry + 8);
+            r->offsets[k] = nbGetU64(entry + 16);
+        }
+        else
+        {
+            r->offsets[k] = r->dataOffset + k * r->frameSize;
+            if (   nbSeekFile(r->f, r->offsets[k])
+                || fread(entry, 1, NB_SNAPSHOT_FRAME_HEADER_SIZE, r->f) != NB_SNAPSHOT_FRAME_HEADER_SIZE)
+            {
+                break;
+            }
+
+            r->steps[k] = nbGetU64(entry);
+            r->times[k] = nbGetF64(entry + 8);
+
+            /* Left over from before a resume that wrote fewer frames */
+            if (k > 0 && r->steps[k] <= r->steps[k - 1])
+            {
+                break;
+            }
+        }
+    }
+
+    r->nFrames = k;
+
+    return 0;
+}
+
+void nbCloseSnapshotReader(NBodySnapshotReader* r)
+{
+    if (r->f)
+    {
+        fclose(r->f);
+    }
+
+    free(r->steps);
+    free(r->times);
+    free(r->offsets);
+    memset(r, 0, sizeof(*r));
+}
+
+static int nbReadSnapshotColumn(NBodySnapshotReader* r, mwvector* out, int c, size_t size)
+{
+    uint8_t buf[4096];
+    uint64_t i, j, n;
+    const uint64_t perChunk = sizeof(buf) / size;
+    real x;
+
+    for (i = 0; i < r->nbody; i += n)
+    {
+        n = MIN(perChunk, r->nbody - i);
+        if (fread(buf, size, (size_t) n, r->f) != (size_t) n)
+        {
+            return 1;
+        }
+
+        if (!out)
+        {
+            continue;
+        }
+
+        for (j = 0; j < n; ++j)
+        {
+            x = (real) nbGetReal(&buf[j * size], size);
+            if (c == 0)
+                X(out[i + j]) = x;
+            else if (c == 1)
+                Y(out[i + j]) = x;
+            else
+                Z(out[i + j]) = x;
+        }
+    }
+
+    if (r->nbody * size % 8 != 0)
+    {
+        return fread(buf, 1, 8 - r->nbody * size % 8, r->f) != 8 - r->nbody * size % 8;
+    }
+
+    return 0;
+}
+
+int nbReadSnapshotFrame(NBodySnapshotReader* r, uint64_t k, mwvector* pos, mwvector* vel)
+{
+    const size_t posSize = nbPositionSize(r->floatFields);
+    const size_t velSize = nbVelocitySize(r->floatFields);
+    int c;
+
+    if (k >= r->nFrames)
+    {
+        mw_printf("Snapshot frame "LLU" out of range ("LLU" frames)\n", k, r->nFrames);
+        return 1;
+    }
+
+    if (nbSeekFile(r->f, r->offsets[k] + NB_SNAPSHOT_FRAME_HEADER_SIZE))
+    {
+        return 1;
+    }
+
+    for (c = 0; c < 3; ++c)
+    {
+        if (nbReadSnapshotColumn(r, pos, c, posSize))
+            return 1;
+    }
+
+    for (c = 0; c < 3 && vel; ++c)
+    {
+        if (nbReadSnapshotColumn(r, vel, c, velSize))
+            return 1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Sorting the bodies along a space filling curve makes neighbouring
+ * iterations of the force calculation walk mostly the same parts of
+ * the tree. The forces don't depend on the order of the bodies, but
+ * everything written out does, so st->bodyOrder remembers where each
+ * body came from.
+ */
+
+#include "nbody_priv.h"
+#include "nbody_sort.h"
+#include "nbody_tree.h"
+#include "nbody_util.h"
+#include "milkyway_util.h"
+
+#define MORTON_BITS 21           /* bits per dimension in a 64 bit key */
+#define MORTON_RADIX_BITS 11     /* 6 passes cover the 63 bit key */
+#define MORTON_RADIX (1 << MORTON_RADIX_BITS)
+
+
+/* Spread the low 21 bits of x so there are 2 zero bits between each */
+static inline uint64_t nbSpreadBits(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | (x << 32)) & 0x1f00000000ffffULL;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+    x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+    return x;
+}
+
+static inline uint64_t nbMortonCoord(real x, real lo, real scale)
+{
+    real c = (x - lo) * scale;
+
+    /* Also catches nan */
+    if (!(c > 0.0))
+        return 0;
+    if (c >= (real) ((1 << MORTON_BITS) - 1))
+        return (1 << MORTON_BITS) - 1;
+
+    return (uint64_t) c;
+}
+
+static inline uint64_t nbMortonKey(const Body* b, mwvector lo, real scale)
+{
+    return (nbSpreadBits(nbMortonCoord(X(Pos(b)), X(lo), scale)) << 2)
+         | (nbSpreadBits(nbMortonCoord(Y(Pos(b)), Y(lo), scale)) << 1)
+         |  nbSpreadBits(nbMortonCoord(Z(Pos(b)), Z(lo), scale));
+}
+
+/* Stable LSD radix sort of idx by key. There is an even number of
+   passes, so the result ends up back in key and idx */
+static void nbRadixSortKeys(uint64_t* key, int* idx, uint64_t* keyTmp, int* idxTmp, int n)
+{
+    unsigned int count[MORTON_RADIX + 1];
+    unsigned int pass, d;
+    int i;
+    uint64_t* tk;
+    int* ti;
+
+    for (pass = 0; pass < 3 * MORTON_BITS; pass += MORTON_RADIX_BITS)
+    {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; ++i)
+        {
+            ++count[((key[i] >> pass) & (MORTON_RADIX - 1)) + 1];
+        }
+
+        for (i = 0; i < MORTON_RADIX; ++i)
+        {
+            count[i + 1] += count[i];
+        }
+
+        for (i = 0; i < n; ++i)
+        {
+            d = count[(key[i] >> pass) & (MORTON_RADIX - 1)]++;
+            keyTmp[d] = key[i];
+            idxTmp[d] = idx[i];
+        }
+
+        tk = key; key = keyTmp; keyTmp = tk;
+        ti = idx; idx = idxTmp; idxTmp = ti;
+    }
+}
+
+void nbSortBodies(NBodyState* st)
+{
+    int i;
+    int nbody = st->nbody;
+    mwvector lo, hi;
+    real extent, scale;
+    uint64_t* key;
+    uint64_t* keyTmp;
+    int* idx;
+    int* idxTmp;
+    Body* bodies;
+    mwvector* accels;
+    int* order;
+
+    if (nbody <= 1)
+        return;
+
+    /* Bounding box of the bodies */
+    lo = hi = Pos(&st->bodytab[0]);
+    for (i = 1; i < nbody; ++i)
+    {
+        const mwvector r = Pos(&st->bodytab[i]);
+
+        X(lo) = mw_fmin(X(lo), X(r));
+        Y(lo) = mw_fmin(Y(lo), Y(r));
+        Z(lo) = mw_fmin(Z(lo), Z(r));
+
+        X(hi) = mw_fmax(X(hi), X(r));
+        Y(hi) = mw_fmax(Y(hi), Y(r));
+        Z(hi) = mw_fmax(Z(hi), Z(r));
+    }
+
+    extent = mw_fmax(X(hi) - X(lo), mw_fmax(Y(hi) - Y(lo), Z(hi) - Z(lo)));
+    scale = extent > 0.0 ? (real) ((1 << MORTON_BITS) - 1) / extent : 0.0;
+
+    key = (uint64_t*) mwMalloc(2 * nbody * sizeof(uint64_t));
+    keyTmp = key + nbody;
+    idx = (int*) mwMalloc(2 * nbody * sizeof(int));
+    idxTmp = idx + nbody;
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i) schedule(static)
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        key[i] = nbMortonKey(&st->bodytab[i], lo, scale);
+        idx[i] = i;
+    }
+
+    nbRadixSortKeys(key, idx, keyTmp, idxTmp, nbody);
+    nbReclaimTree(st);
+
+    bodies = (Body*) mwMallocA(nbody * sizeof(Body));
+    accels = (mwvector*) mwMallocA(nbody * sizeof(mwvector));
+    order = (int*) mwMalloc(nbody * sizeof(int));
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i) schedule(static)
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        bodies[i] = st->bodytab[idx[i]];
+        accels[i] = st->acctab[idx[i]];
+        order[i] = st->bodyOrder ? st->bodyOrder[idx[i]] : idx[i];
+    }
+
+    mwFreeA(st->bodytab);
+    mwFreeA(st->acctab);
+    free(st->bodyOrder);
+
+    st->bodytab = bodies;
+    st->acctab = accels;
+    st->bodyOrder = order;
+
+    free(key);
+    free(idx);
+}
+
+void nbRestoreBodyOrder(NBodyState* st)
+{
+    int i;
+    int nbody = st->nbody;
+    Body* bodies;
+    mwvector* accels;
+
+    if (!st->bodyOrder)
+        return;
+
+    nbReclaimTree(st);
+
+    bodies = (Body*) mwMallocA(nbody * sizeof(Body));
+    accels = (mwvector*) mwMallocA(nbody * sizeof(mwvector));
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i) schedule(static)
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        bodies[st->bodyOrder[i]] = st->bodytab[i];
+        accels[st->bodyOrder[i]] = st->acctab[i];
+    }
+
+    mwFreeA(st->bodytab);
+    mwFreeA(st->acctab);
+    free(st->bodyOrder);
+
+    st->bodytab = bodies;
+    st->acctab = accels;
+    st->bodyOrder = NULL;
+}
+
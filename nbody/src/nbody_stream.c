@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "nbody_stream.h"
+#include "milkyway_util.h"
+
+#ifndef _WIN32
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+#endif
+
+/* Frame sent for each published step. Numbers are in the byte order
+   of the machine running the simulation, since the socket is local.
+
+     char[8]   "mwnbstrm"
+     uint32    version
+     uint32    number of bodies in the frame
+     uint32    number of bodies in the simulation
+     uint32    stride
+     uint64    step
+     float64   time
+     float64   time to evolve
+     float64   center of mass x, y, z
+     float32   x, y, z position of each body in the frame
+     uint8     ignore flag of each body in the frame
+
+   The frame holds bodies 0, stride, 2 * stride, ... in their original
+   order. A client which can't keep up misses frames rather than
+   slowing the simulation, but always gets whole frames. */
+
+#define NB_STREAM_HEADER_SIZE 72
+
+#ifndef _WIN32
+
+typedef struct
+{
+    int fd;
+    uint8_t* pending;     /* Rest of a frame the socket didn't take at once */
+    size_t pendingSize;
+    size_t pendingSent;
+} NBodyStreamClient;
+
+struct NBodyStreamServer
+{
+    int fd;
+    char* path;
+    unsigned int stride;
+    uint32_t nbody;       /* Bodies in each frame */
+
+    unsigned int nClients;
+    NBodyStreamClient clients[NBODY_STREAM_MAX_CLIENTS];
+
+    uint8_t* frame;
+    size_t frameSize;
+    int* bodyIndex;       /* Where each body in original order currently is */
+};
+
+static int nbStreamSetFlags(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return 1;
+    }
+
+    /* Don't hand the socket to a launched visualizer */
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+    {
+        return 1;
+    }
+
+  #ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+  #endif
+
+    return 0;
+}
+
+static ssize_t nbStreamSend(int fd, const uint8_t* buf, size_t size)
+{
+    ssize_t n;
+
+    do
+    {
+      #ifdef MSG_NOSIGNAL
+        n = send(fd, buf, size, MSG_NOSIGNAL);
+      #else
+        n = send(fd, buf, size, 0);
+      #endif
+    }
+    while (n < 0 && errno == EINTR);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    return n;
+}
+
+static void nbStreamDropClient(NBodyStreamServer* s, unsigned int k)
+{
+    close(s->clients[k].fd);
+    free(s->clients[k].pending);
+
+    s->clients[k] = s->clients[--s->nClients];
+}
+
+static void nbStreamAcceptClients(NBodyStreamServer* s)
+{
+    int fd;
+
+    while (s->nClients < NBODY_STREAM_MAX_CLIENTS)
+    {
+        fd = accept(s->fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                mwPerror("Accepting stream client");
+            }
+
+            return;
+        }
+
+        if (nbStreamSetFlags(fd))
+        {
+            mwPerror("Setting up stream client");
+            close(fd);
+            continue;
+        }
+
+        memset(&s->clients[s->nClients], 0, sizeof(NBodyStreamClient));
+        s->clients[s->nClients].fd = fd;
+        ++s->nClients;
+    }
+}
+
+/* Send what's left of a client's last frame. Returns nonzero if the
+ * client went away. */
+static int nbStreamFlushClient(NBodyStreamClient* c)
+{
+    ssize_t n;
+
+    if (c->pendingSent == c->pendingSize)
+    {
+        return 0;
+    }
+
+    n = nbStreamSend(c->fd, c->pending + c->pendingSent, c->pendingSize - c->pendingSent);
+    if (n < 0)
+    {
+        return 1;
+    }
+
+    c->pendingSent += (size_t) n;
+    return 0;
+}
+
+/* Start sending the current frame. Returns nonzero if the client went away. */
+static int nbStreamSendFrame(NBodyStreamServer* s, NBodyStreamClient* c)
+{
+    ssize_t n = nbStreamSend(c->fd, s->frame, s->frameSize);
+
+    if (n < 0)
+    {
+        return 1;
+    }
+
+    if (n > 0 && (size_t) n < s->frameSize)
+    {
+        /* Keep the rest for next time so the client never sees half a frame */
+        if (!c->pending)
+        {
+            c->pending = (uint8_t*) mwMalloc(s->frameSize);
+        }
+
+        c->pendingSize = s->frameSize - (size_t) n;
+        c->pendingSent = 0;
+        memcpy(c->pending, s->frame + n, c->pendingSize);
+    }
+
+    return 0;
+}
+
+static const int* nbStreamBodyIndex(NBodyStreamServer* s, const NBodyState* st)
+{
+    int i;
+
+    if (!st->bodyOrder)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        s->bodyIndex[st->bodyOrder[i]] = i;
+    }
+
+    return s->bodyIndex;
+}
+
+static void nbStreamBuildFrame(NBodyStreamServer* s, const NBodyCtx* ctx, const NBodyState* st, const mwvector* cmPos)
+{
+    int i;
+    const Body* b;
+    int nbody = (int) s->nbody;
+    int stride = (int) s->stride;
+    const int* bodyIndex = nbStreamBodyIndex(s, st);
+    uint8_t* p = s->frame;
+    float* pos = (float*) (s->frame + NB_STREAM_HEADER_SIZE);
+    uint8_t* ignore = s->frame + NB_STREAM_HEADER_SIZE + 3 * sizeof(float) * s->nbody;
+    uint32_t counts[4];
+    uint64_t step = st->step;
+    double times[5];
+
+    counts[0] = NBODY_STREAM_VERSION;
+    counts[1] = s->nbody;
+    counts[2] = (uint32_t) st->nbody;
+    counts[3] = s->stride;
+
+    times[0] = st->step * ctx->timestep;
+    times[1] = ctx->timeEvolve;
+    times[2] = X(*cmPos);
+    times[3] = Y(*cmPos);
+    times[4] = Z(*cmPos);
+
+    memcpy(p, NBODY_STREAM_MAGIC, 8);
+    memcpy(p + 8, counts, sizeof(counts));
+    memcpy(p + 24, &step, sizeof(step));
+    memcpy(p + 32, times, sizeof(times));
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(i, b) schedule(static)
+  #endif
+    for (i = 0; i < nbody; ++i)
+    {
+        b = &st->bodytab[bodyIndex ? bodyIndex[i * stride] : i * stride];
+        pos[3 * i + 0] = (float) X(Pos(b));
+        pos[3 * i + 1] = (float) Y(Pos(b));
+        pos[3 * i + 2] = (float) Z(Pos(b));
+        ignore[i] = (uint8_t) ignoreBody(b);
+    }
+}
+
+int nbStreamHasClients(NBodyState* st)
+{
+    NBodyStreamServer* s = st->streamServer;
+
+    if (!s)
+    {
+        return FALSE;
+    }
+
+    nbStreamAcceptClients(s);
+
+    return s->nClients > 0;
+}
+
+void nbPublishStreamFrame(const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos)
+{
+    unsigned int k;
+    int built = FALSE;
+    NBodyStreamServer* s = st->streamServer;
+
+    if (!s)
+    {
+        return;
+    }
+
+    for (k = 0; k < s->nClients; )
+    {
+        NBodyStreamClient* c = &s->clients[k];
+        int gone = nbStreamFlushClient(c);
+
+        /* Clients still sending an earlier frame skip this one */
+        if (!gone && c->pendingSent == c->pendingSize)
+        {
+            if (!built)
+            {
+                nbStreamBuildFrame(s, ctx, st, cmPos);
+                built = TRUE;
+            }
+
+            gone = nbStreamSendFrame(s, c);
+        }
+
+        if (gone)
+        {
+            nbStreamDropClient(s, k);
+        }
+        else
+        {
+            ++k;
+        }
+    }
+}
+
+int nbCreateStreamServer(NBodyState* st, const char* path, unsigned int stride)
+{
+    NBodyStreamServer* s;
+    struct sockaddr_un addr;
+    struct stat sb;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        mw_printf("Stream socket path '%s' is too long\n", path);
+        return 1;
+    }
+
+    /* Replace a socket left behind by an earlier run, but nothing else */
+    if (stat(path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+    {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        mwPerror("Creating stream socket");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (   bind(fd, (const struct sockaddr*) &addr, sizeof(addr)) < 0
+        || listen(fd, NBODY_STREAM_MAX_CLIENTS) < 0
+        || nbStreamSetFlags(fd))
+    {
+        mwPerror("Listening on stream socket '%s'", path);
+        close(fd);
+        return 1;
+    }
+
+    s = (NBodyStreamServer*) mwCalloc(1, sizeof(NBodyStreamServer));
+    s->fd = fd;
+    s->path = strdup(path);
+    s->stride = stride;
+    s->nbody = (uint32_t) ((st->nbody + stride - 1) / stride);
+    s->frameSize = NB_STREAM_HEADER_SIZE + (3 * sizeof(float) + 1) * s->nbody;
+    s->frame = (uint8_t*) mwMalloc(s->frameSize);
+    s->bodyIndex = (int*) mwMalloc(st->nbody * sizeof(int));
+    st->streamServer = s;
+
+    mw_report("Streaming snapshots on '%s'\n", path);
+
+    return 0;
+}
+
+void nbCloseStreamServer(NBodyState* st)
+{
+    NBodyStreamServer* s = st->streamServer;
+
+    if (!s)
+    {
+        return;
+    }
+
+    while (s->nClients > 0)
+    {
+        nbStreamDropClient(s, s->nClients - 1);
+    }
+
+    close(s->fd);
+    unlink(s->path);
+
+    free(s->path);
+    free(s->frame);
+    free(s->bodyIndex);
+    free(s);
+    st->streamServer = NULL;
+}
+
+#else
+
+int nbCreateStreamServer(NBodyState* st, const char* path, unsigned int stride)
+{
+    (void) st;
+    (void) path;
+    (void) stride;
+
+    mw_printf("Snapshot streaming is not supported on Windows\n");
+    return 1;
+}
+
+void nbCloseStreamServer(NBodyState* st)
+{
+    (void) st;
+}
+
+int nbStreamHasClients(NBodyState* st)
+{
+    (void) st;
+    return FALSE;
+}
+
+void nbPublishStreamFrame(const NBodyCtx* ctx, NBodyState* st, const mwvector* cmPos)
+{
+    (void) ctx;
+    (void) st;
+    (void) cmPos;
+}
+
+#endif /* _WIN32 */
+
@@ -63,18 +63,48 @@ static inline void nbIncAddNBodyQuadMatrix(NBodyQuadMatrix* RESTRICT a, NBodyQua
     a->zz += b->zz;
 }
 
-/* hackQuad: descend tree, evaluating quadrupole moments.  Note that this
- * routine is coded so that the Subp() and Quad() components of a cell can
- * share the same memory locations.
+/* Add the moment of subnode q about the center of mass of cell p */
+static inline void nbAddSubnodeQuad(NBodyCell* p, const NBodyNode* q)
+{
+    mwvector dr;
+    real drsq;
+    NBodyQuadMatrix quad;
+
+    dr = mw_subv(Pos(q), Pos(p));               /* find displacement vect.  */
+    drsq = mw_sqrv(dr);                         /* and dot prod. (dr . dr)  */
+
+    /* Outer product scaled by 3, then subtract drsq off the
+     * diagonal to form quad moment*/
+    {
+        real m = Mass(q);   /* from CM of subnode */
+
+        quad.xx = m * (3.0 * (X(dr) * X(dr)) - drsq);
+        quad.xy = m * (3.0 * (X(dr) * Y(dr)));
+        quad.xz = m * (3.0 * (X(dr) * Z(dr)));
+
+        quad.yy = m * (3.0 * (Y(dr) * Y(dr)) - drsq);
+        quad.yz = m * (3.0 * (Y(dr) * Z(dr)));
+
+        quad.zz = m * (3.0 * (Z(dr) * Z(dr)) - drsq);
+    }
+
+    if (isCell(q)) /* if subnode is cell       */
+    {
+        nbIncAddNBodyQuadMatrix(&quad, &Quad(q));     /* then include its moment  */
+    }
+
+    nbIncAddNBodyQuadMatrix(&Quad(p), &quad); /* increment moment of cell */
+}
+
+/* cellQuad: evaluate the quadrupole moment of cell p from its
+ * immediate descendents, whose own moments must already be known.
+ * Note that this routine is coded so that the Subp() and Quad()
+ * components of a cell can share the same memory locations.
  */
-static void hackQuad(NBodyCell* p)
+static void nbCellQuad(NBodyCell* p)
 {
     unsigned int ndesc, i;
     NBodyNode* desc[NSUB];
-    NBodyNode* q;
-    mwvector dr;
-    real drsq;
-    NBodyQuadMatrix quad = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
 
     ndesc = 0;                                  /* count occupied subnodes  */
     for (i = 0; i < NSUB; ++i)                  /* loop over all subnodes   */
@@ -87,37 +117,24 @@ static void hackQuad(NBodyCell* p)
 
     for (i = 0; i < ndesc; ++i)                 /* loop over real subnodes  */
     {
-        q = desc[i];                            /* access each one in turn  */
-        if (isCell(q))                          /* if it's also a cell      */
-        {
-            hackQuad((NBodyCell*) q);           /* then process it first    */
-        }
-
-        dr = mw_subv(Pos(q), Pos(p));           /* find displacement vect.  */
-        drsq = mw_sqrv(dr);                     /* and dot prod. (dr . dr)  */
-
-        /* Outer product scaled by 3, then subtract drsq off the
-         * diagonal to form quad moment*/
-        {
-            real m = Mass(q);   /* from CM of subnode */
-
-            quad.xx = m * (3.0 * (X(dr) * X(dr)) - drsq);
-            quad.xy = m * (3.0 * (X(dr) * Y(dr)));
-            quad.xz = m * (3.0 * (X(dr) * Z(dr)));
-
-            quad.yy = m * (3.0 * (Y(dr) * Y(dr)) - drsq);
-            quad.yz = m * (3.0 * (Y(dr) * Z(dr)));
+        nbAddSubnodeQuad(p, desc[i]);
+    }
+}
 
-            quad.zz = m * (3.0 * (Z(dr) * Z(dr)) - drsq);
-        }
+/* hackQuad: descend tree, evaluating quadrupole moments. */
+static void hackQuad(NBodyCell* p)
+{
+    unsigned int i;
 
-        if (isCell(q)) /* if subnode is cell       */
+    for (i = 0; i < NSUB; ++i)                  /* process subcells first */
+    {
+        if (Subp(p)[i] != NULL && isCell(Subp(p)[i]))
         {
-            nbIncAddNBodyQuadMatrix(&quad, &Quad(q));     /* then include its moment  */
+            hackQuad((NBodyCell*) Subp(p)[i]);
         }
-
-        nbIncAddNBodyQuadMatrix(&Quad(p), &quad); /* increment moment of cell */
     }
+
+    nbCellQuad(p);
 }
 
 
@@ -149,6 +166,31 @@ static void threadTree(NBodyNode* p, NBodyNode* n)
     }
 }
 
+/* threadCell: install the More link of cell p and the Next links
+ * of its children, without descending further. Next(p) must already
+ * be set.
+ */
+static void nbThreadCell(NBodyCell* p)
+{
+    unsigned int ndesc, i;
+    NBodyNode* desc[NSUB+1];
+
+    ndesc = 0;
+    for (i = 0; i < NSUB; ++i)
+    {
+        if (Subp(p)[i] != NULL)
+        {
+            desc[ndesc++] = Subp(p)[i];
+        }
+    }
+    More(p) = desc[0];
+    desc[ndesc] = Next(p);
+    for (i = 0; i < ndesc; ++i)
+    {
+        Next(desc[i]) = desc[i + 1];
+    }
+}
+
 /* expandBox: find range of coordinate values (with respect to root)
  * and expand root cell to fit. The size is doubled at each step to
  * take advantage of exact representation of powers of two.
@@ -175,50 +217,208 @@ static void expandBox(NBodyTree* t, const Body* btab, int nbody)
     }
 }
 
-/* makecell: return pointer to free cell. */
-static NBodyCell* nbMakeCell(NBodyState* st, NBodyTree* t)
+/* Cells and bookkeeping for inserting bodies into a tree. A loader
+ * takes runs of cells from the state's arena in batches, so each
+ * thread of the parallel builder can have its own.
+ */
+typedef struct
+{
+    NBodyCell* nextCell;        /* cells available to this loader */
+    NBodyCell* endCell;
+    NBodyCellArena* arena;      /* arena to refill from */
+    unsigned int cellUsed;      /* count of cells made */
+    unsigned int maxDepth;      /* deepest level reached */
+    int structureError;
+} NBodyTreeLoader;
+
+#define NB_CELL_BATCH 256
+#define NB_CELL_ARENA_BLOCK 4096
+
+static void nbInitLoader(NBodyTreeLoader* ld, NBodyCellArena* arena)
+{
+    ld->nextCell = NULL;
+    ld->endCell = NULL;
+    ld->arena = arena;
+    ld->cellUsed = 0;
+    ld->maxDepth = 0;
+    ld->structureError = FALSE;
+}
+
+/* Number of cells handed out for the current tree */
+static unsigned int nbCellArenaUsed(const NBodyCellArena* a)
+{
+    unsigned int used = a->nUsed;
+
+    if (a->nOverflow > 0)
+    {
+        used += (a->nOverflow - 1) * NB_CELL_ARENA_BLOCK + a->overflowUsed;
+    }
+
+    return used;
+}
+
+unsigned int nbCellArenaHighWater(const NBodyCellArena* a)
+{
+    return MAX(a->highWater, nbCellArenaUsed(a));
+}
+
+/* Hand out a run of up to n cells. Only the main block is used unless
+ * it is full, so a tree that fits in it has all of its cells together. */
+static NBodyCell* nbCellArenaAlloc(NBodyCellArena* a, unsigned int n, unsigned int* nGot)
 {
     NBodyCell* c;
 
-    if (st->freeCell == NULL)                   /* no free cells left? */
+    if (a->nUsed < a->maxCell)
     {
-        c = (NBodyCell*) mwMallocA(sizeof(*c)); /* allocate a new one */
+        *nGot = MIN(n, a->maxCell - a->nUsed);
+        c = &a->cells[a->nUsed];
+        a->nUsed += *nGot;
+        return c;
     }
-    else                                        /* use existing free cell */
+
+    if (a->nOverflow == 0 || a->overflowUsed == NB_CELL_ARENA_BLOCK)
     {
-        c = (NBodyCell*) st->freeCell;          /* take one on front */
-        st->freeCell = Next(c);                 /* go on to next one */
+        a->overflow = (NBodyCell**) mwRealloc(a->overflow, (a->nOverflow + 1) * sizeof(NBodyCell*));
+        a->overflow[a->nOverflow++] = (NBodyCell*) mwMallocA(NB_CELL_ARENA_BLOCK * sizeof(NBodyCell));
+        a->overflowUsed = 0;
     }
-    Type(c) = CELL(0);                          /* initialize cell type */
-    More(c) = NULL;
-    memset(&c->stuff, 0, sizeof(c->stuff));     /* empty sub cells */
-    t->cellUsed++;                              /* count one more cell */
+
+    *nGot = MIN(n, NB_CELL_ARENA_BLOCK - a->overflowUsed);
+    c = &a->overflow[a->nOverflow - 1][a->overflowUsed];
+    a->overflowUsed += *nGot;
     return c;
 }
 
-/* reclaim cells in tree, prepare to build new one. */
-static void nbNewTree(NBodyState* st, NBodyTree* t)
+/* Give back the end of the last run handed out, if it still is the last */
+static void nbCellArenaRelease(NBodyCellArena* a, NBodyCell* c, NBodyCell* end)
 {
-    NBodyNode* p = (NBodyNode*) t->root;              /* start with the root */
+    unsigned int n = (unsigned int) (end - c);
 
-    while (p != NULL)                       /* loop scanning tree */
+    if (a->nOverflow > 0)
     {
-        if (isCell(p))                      /* found cell to free? */
-        {
-            Next(p) = st->freeCell;         /* link to front of */
-            st->freeCell = p;               /* ...existing list */
-            p = More(p);                    /* scan down tree */
-        }
-        else                                /* skip over bodies */
+        if (end == &a->overflow[a->nOverflow - 1][a->overflowUsed])
+            a->overflowUsed -= n;
+    }
+    else if (a->cells && end == &a->cells[a->nUsed])
+    {
+        a->nUsed -= n;
+    }
+}
+
+/* Throw away all cells. If overflow blocks were needed, replace them
+ * with a main block big enough for the biggest tree so far. */
+static void nbResetCellArena(NBodyCellArena* a)
+{
+    unsigned int i;
+
+    a->highWater = nbCellArenaHighWater(a);
+
+    if (a->nOverflow > 0)
+    {
+        for (i = 0; i < a->nOverflow; ++i)
         {
-            p = Next(p);                    /* go on to next */
+            mwFreeA(a->overflow[i]);
         }
+        free(a->overflow);
+        a->overflow = NULL;
+        a->nOverflow = 0;
+        a->overflowUsed = 0;
+
+        mwFreeA(a->cells);
+        a->maxCell = a->highWater + a->highWater / 4;
+        a->cells = (NBodyCell*) mwMallocA(a->maxCell * sizeof(NBodyCell));
+    }
+
+    a->nUsed = 0;
+}
+
+void nbFreeCellArena(NBodyCellArena* a)
+{
+    unsigned int i;
+
+    for (i = 0; i < a->nOverflow; ++i)
+    {
+        mwFreeA(a->overflow[i]);
+    }
+    free(a->overflow);
+    mwFreeA(a->cells);
+
+    a->cells = NULL;
+    a->overflow = NULL;
+    a->nUsed = a->maxCell = 0;
+    a->nOverflow = a->overflowUsed = 0;
+}
+
+/* Take a batch of cells from the arena */
+static void nbRefillLoader(NBodyTreeLoader* ld)
+{
+    unsigned int n;
+
+  #ifdef _OPENMP
+    #pragma omp critical (nbFreeCell)
+  #endif
+    {
+        ld->nextCell = nbCellArenaAlloc(ld->arena, NB_CELL_BATCH, &n);
+    }
+
+    ld->endCell = ld->nextCell + n;
+}
+
+/* Return unused cells and counts of a loader to the tree and arena */
+static void nbMergeLoader(NBodyTree* t, NBodyTreeLoader* ld)
+{
+    if (ld->nextCell != ld->endCell)
+    {
+        nbCellArenaRelease(ld->arena, ld->nextCell, ld->endCell);
+        ld->nextCell = ld->endCell = NULL;
     }
 
+    t->cellUsed += ld->cellUsed;
+    t->maxDepth = MAX(t->maxDepth, ld->maxDepth);
+    t->structureError |= ld->structureError;
+}
+
+/* makecell: return pointer to free cell. */
+static NBodyCell* nbMakeCell(NBodyTreeLoader* ld)
+{
+    NBodyCell* c;
+
+    if (ld->nextCell == ld->endCell)            /* no free cells left? */
+    {
+        nbRefillLoader(ld);
+    }
+
+    c = ld->nextCell++;                         /* take one on front */
+    Type(c) = CELL(0);                          /* initialize cell type */
+    More(c) = NULL;
+    memset(&c->stuff, 0, sizeof(c->stuff));     /* empty sub cells */
+    ld->cellUsed++;                             /* count one more cell */
+    return c;
+}
+
+/* reclaim cells in tree. The tree must be thrown away before the
+ * bodies it points to are moved. */
+void nbReclaimTree(NBodyState* st)
+{
+    NBodyTree* t = &st->tree;
+
+    nbResetCellArena(&st->cellArena);
+
+    t->root = NULL;
     t->cellUsed = 0;   /* init count of cells, levels */
     t->maxDepth = 0;
+}
 
-    t->root = nbMakeCell(st, t);      /* allocate the root cell */
+/* reclaim cells in tree, prepare to build new one. */
+static void nbNewTree(NBodyState* st, NBodyTree* t)
+{
+    NBodyTreeLoader ld;
+
+    nbReclaimTree(st);
+
+    nbInitLoader(&ld, &st->cellArena);
+    t->root = nbMakeCell(&ld);        /* allocate the root cell */
+    nbMergeLoader(t, &ld);
     mw_zerov(Pos(t->root));           /* initialize the midpoint */
 }
 
@@ -238,34 +438,34 @@ static inline void nbInitMidpoint(NBodyCell* c, const Body* p, const NBodyCell*
     Z(Pos(c)) = calcOffset(Z(Pos(p)), Z(Pos(q)), qsize);
 }
 
-/* loadBody: descend tree and insert body p in appropriate place. */
-static void nbLoadBody(NBodyState* st, NBodyTree* t, Body* p)
+static void nbCellSizeError(NBodyTreeLoader* ld, const NBodyTree* t, real qsize, unsigned int lev)
+{
+    if (!ld->structureError)
+    {
+        mw_printf("qsize (= %.15f) <= epsilon at level %u (initial root = %.15f)\n", qsize, lev, t->rsize);
+        ld->structureError = TRUE; /* FIXME: Not quite the same as the other structure error */
+    }
+}
+
+/* loadBody: descend tree from cell q of size qsize at level lev and
+ * insert body p in appropriate place. */
+static void nbLoadBody(NBodyTreeLoader* ld, const NBodyTree* t, Body* p, NBodyCell* q, real qsize, unsigned int lev)
 {
-    NBodyCell* q;
     NBodyCell* c;
     size_t qind;
-    unsigned int lev;
-    real qsize;
 
-    q = t->root;                                /* start with tree t.root */
     qind = nbSubIndex(p, q);                    /* get index of subcell */
-    qsize = t->rsize;                           /* keep track of cell size */
-    lev = 0;                                    /* count levels descended */
     while (Subp(q)[qind] != NULL)               /* loop descending tree */
     {
         if (qsize <= REAL_EPSILON)
         {
-            if (!t->structureError)
-            {
-                mw_printf("qsize (= %.15f) <= epsilon at level %u (initial root = %.15f)\n", qsize, lev, t->rsize);
-                t->structureError = TRUE; /* FIXME: Not quite the same as the other structure error */
-            }
+            nbCellSizeError(ld, t, qsize, lev);
             return;
         }
 
         if (isBody(Subp(q)[qind]))              /* reached a "leaf"? */
         {
-            c = nbMakeCell(st, t);             /* allocate new cell */
+            c = nbMakeCell(ld);                /* allocate new cell */
             nbInitMidpoint(c, p, q, qsize);    /* initialize midpoint */
 
             Subp(c)[nbSubIndex((Body*) Subp(q)[qind], c)] = Subp(q)[qind];
@@ -278,7 +478,7 @@ static void nbLoadBody(NBodyState* st, NBodyTree* t, Body* p)
         ++lev;                            /* count another level */
     }
     Subp(q)[qind] = (NBodyNode*) p;            /* found place, store p */
-    t->maxDepth = MAX(t->maxDepth, lev);  /* remember maximum level */
+    ld->maxDepth = MAX(ld->maxDepth, lev);     /* remember maximum level */
 }
 
 ALWAYS_INLINE
@@ -380,10 +580,11 @@ static inline void nbCheckTreeStructure(NBodyTree* tree, const mwvector pPos, co
 }
 
 
-/* hackCofM: descend tree finding center-of-mass coordinates and
- * setting critical cell radii.
+/* cellCofM: find center-of-mass coordinates of cell p from its
+ * immediate descendents and set its critical radius. Subcells must
+ * already have been processed.
  */
-static void hackCofM(const NBodyCtx* ctx, NBodyTree* tree, NBodyCell* p, real psize)
+static void nbCellCofM(const NBodyCtx* ctx, NBodyTree* tree, NBodyCell* p, real psize)
 {
     int i;
     NBodyNode* q;
@@ -396,11 +597,6 @@ static void hackCofM(const NBodyCtx* ctx, NBodyTree* tree, NBodyCell* p, real ps
     {
         if ((q = Subp(p)[i]) != NULL)           /* does subnode exist? */
         {
-            if (isCell(q))                     /* and is it a cell? */
-            {
-                hackCofM(ctx, tree, (NBodyCell*) q, 0.5 * psize); /* find subcell cm */
-            }
-
             Mass(p) += Mass(q);                       /* sum total mass */
                                                       /* weight pos by mass */
             mw_incaddv_s(cmpos, Pos(q), Mass(q));     /* sum c-of-m position */
@@ -420,26 +616,389 @@ static void hackCofM(const NBodyCtx* ctx, NBodyTree* tree, NBodyCell* p, real ps
     nbCheckTreeStructure(tree, Pos(p), cmpos, psize);
 
     Rcrit2(p) = findRCrit(ctx, p, tree->rsize, cmpos, psize);            /* set critical radius */
+    Center(p) = Pos(p);         /* remember geometric center */
     Pos(p) = cmpos;             /* and center-of-mass pos */
 }
 
-/* nbMakeTree: initialize tree structure for hierarchical force calculation
- * from body array btab, which contains ctx.nbody bodies.
+/* hackCofM: descend tree finding center-of-mass coordinates and
+ * setting critical cell radii.
  */
-NBodyStatus nbMakeTree(const NBodyCtx* ctx, NBodyState* st)
+static void hackCofM(const NBodyCtx* ctx, NBodyTree* tree, NBodyCell* p, real psize)
+{
+    int i;
+    NBodyNode* q;
+
+    for (i = 0; i < NSUB; ++i)                  /* loop over subnodes */
+    {
+        if ((q = Subp(p)[i]) != NULL && isCell(q))
+        {
+            hackCofM(ctx, tree, (NBodyCell*) q, 0.5 * psize); /* find subcell cm */
+        }
+    }
+
+    nbCellCofM(ctx, tree, p, psize);
+}
+
+
+/* The parallel builder sorts the bodies by the path they take down the
+ * first levels of the tree. The top of the tree is built serially from
+ * the sorted ranges until they are small enough, and each remaining
+ * range is loaded into its own subtree by a single thread. The result
+ * is the same tree the serial builder makes.
+ */
+
+#define NB_TREE_KEY_LEVELS 10  /* 3 bits per level */
+#define NB_TREE_KEY_RADIX_BITS 10
+#define NB_TREE_MIN_TASK 64
+
+/* A subtree hanging from subcell sub of cell, loaded by one thread */
+typedef struct
+{
+    NBodyCell* cell;
+    real qsize;            /* size of cell */
+    unsigned int lev;      /* level of cell */
+    unsigned int sub;
+    unsigned int lo, hi;   /* range of sorted bodies */
+} NBodyTreeTask;
+
+/* Cell built serially, in preorder */
+typedef struct
+{
+    NBodyCell* cell;
+    real psize;
+} NBodyTopCell;
+
+typedef struct
+{
+    Body* btab;
+    const unsigned int* key;
+    const unsigned int* idx;
+    unsigned int minTask;
+
+    NBodyTreeTask* tasks;
+    unsigned int nTask, maxTask;
+
+    NBodyTopCell* top;
+    unsigned int nTop, maxTop;
+} NBodyTreeSplit;
+
+/* Find the subcell indices of body p for the first levels of the tree,
+ * using the same midpoints nbLoadBody would */
+static inline unsigned int nbTreeKey(const NBodyTree* t, const Body* p)
+{
+    unsigned int lev;
+    unsigned int key = 0;
+    real qsize = t->rsize;
+    mwvector q = Pos(t->root);
+
+    for (lev = 0; lev < NB_TREE_KEY_LEVELS; ++lev)
+    {
+        key <<= 3;
+        if (X(q) <= X(Pos(p)))
+            key += NSUB >> (0 + 1);
+        if (Y(q) <= Y(Pos(p)))
+            key += NSUB >> (1 + 1);
+        if (Z(q) <= Z(Pos(p)))
+            key += NSUB >> (2 + 1);
+
+        X(q) = calcOffset(X(Pos(p)), X(q), qsize);
+        Y(q) = calcOffset(Y(Pos(p)), Y(q), qsize);
+        Z(q) = calcOffset(Z(Pos(p)), Z(q), qsize);
+        qsize *= 0.5;
+    }
+
+    return key;
+}
+
+/* Stable LSD radix sort of idx by key. Results end up in key and idx */
+static void nbSortTreeKeys(unsigned int* key, unsigned int* idx,
+                           unsigned int* keyTmp, unsigned int* idxTmp,
+                           unsigned int n)
+{
+    unsigned int count[(1 << NB_TREE_KEY_RADIX_BITS) + 1];
+    unsigned int i, pass, d;
+    unsigned int* t;
+    const unsigned int mask = (1 << NB_TREE_KEY_RADIX_BITS) - 1;
+
+    for (pass = 0; pass < 3 * NB_TREE_KEY_LEVELS; pass += NB_TREE_KEY_RADIX_BITS)
+    {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; ++i)
+        {
+            ++count[((key[i] >> pass) & mask) + 1];
+        }
+
+        for (i = 0; i < (1 << NB_TREE_KEY_RADIX_BITS); ++i)
+        {
+            count[i + 1] += count[i];
+        }
+
+        for (i = 0; i < n; ++i)
+        {
+            d = count[(key[i] >> pass) & mask]++;
+            keyTmp[d] = key[i];
+            idxTmp[d] = idx[i];
+        }
+
+        t = key; key = keyTmp; keyTmp = t;
+        t = idx; idx = idxTmp; idxTmp = t;
+    }
+
+    /* 3 passes leave the result in the temporaries */
+    memcpy(keyTmp, key, n * sizeof(unsigned int));
+    memcpy(idxTmp, idx, n * sizeof(unsigned int));
+}
+
+static void nbAddTreeTask(NBodyTreeSplit* s, NBodyCell* q, real qsize, unsigned int lev,
+                          unsigned int sub, unsigned int lo, unsigned int hi)
+{
+    NBodyTreeTask* task;
+
+    if (s->nTask == s->maxTask)
+    {
+        s->maxTask = 2 * s->maxTask + NSUB;
+        s->tasks = (NBodyTreeTask*) mwRealloc(s->tasks, s->maxTask * sizeof(NBodyTreeTask));
+    }
+
+    task = &s->tasks[s->nTask++];
+    task->cell = q;
+    task->qsize = qsize;
+    task->lev = lev;
+    task->sub = sub;
+    task->lo = lo;
+    task->hi = hi;
+}
+
+/* Build cell q of size qsize at level lev from sorted bodies [lo, hi),
+ * splitting off ranges small enough to be loaded as separate tasks */
+static void nbBuildTreeTop(NBodyTreeSplit* s, NBodyTreeLoader* ld, const NBodyTree* t,
+                           NBodyCell* q, real qsize, unsigned int lev,
+                           unsigned int lo, unsigned int hi)
+{
+    unsigned int i, j, sub;
+    const unsigned int shift = 3 * (NB_TREE_KEY_LEVELS - 1 - lev);
+    NBodyCell* c;
+    Body* p;
+
+    if (s->nTop == s->maxTop)
+    {
+        s->maxTop = 2 * s->maxTop + 1;
+        s->top = (NBodyTopCell*) mwRealloc(s->top, s->maxTop * sizeof(NBodyTopCell));
+    }
+
+    s->top[s->nTop].cell = q;
+    s->top[s->nTop].psize = qsize;
+    ++s->nTop;
+
+    for (i = lo; i < hi; i = j)
+    {
+        sub = (s->key[i] >> shift) & (NSUB - 1);
+        for (j = i + 1; j < hi && ((s->key[j] >> shift) & (NSUB - 1)) == sub; ++j)
+            ;
+
+        p = &s->btab[s->idx[i]];
+        if (j - i == 1)
+        {
+            Subp(q)[sub] = (NBodyNode*) p;
+            ld->maxDepth = MAX(ld->maxDepth, lev);
+        }
+        else if (qsize <= REAL_EPSILON)
+        {
+            nbCellSizeError(ld, t, qsize, lev);
+            return;
+        }
+        else if (j - i > s->minTask && lev + 1 < NB_TREE_KEY_LEVELS)
+        {
+            c = nbMakeCell(ld);
+            nbInitMidpoint(c, p, q, qsize);
+            Subp(q)[sub] = (NBodyNode*) c;
+            nbBuildTreeTop(s, ld, t, c, 0.5 * qsize, lev + 1, i, j);
+        }
+        else
+        {
+            nbAddTreeTask(s, q, qsize, lev, sub, i, j);
+        }
+    }
+}
+
+static NBodyStatus nbMakeTreeParallel(const NBodyCtx* ctx, NBodyState* st)
+{
+    NBodyTree* t = &st->tree;
+    NBodyTreeSplit s;
+    NBodyTreeLoader ld;
+    unsigned int* key;
+    unsigned int* idx;
+    unsigned int* keyTmp;
+    unsigned int* idxTmp;
+    unsigned int i, n;
+    int j;
+    NBodyStatus rc = NBODY_SUCCESS;
+
+    nbNewTree(st, t);                                /* flush existing tree, etc */
+    expandBox(t, st->bodytab, st->nbody);            /* and expand cell to fit */
+
+    key = (unsigned int*) mwMalloc(4 * st->nbody * sizeof(unsigned int) + 1);
+    idx = key + st->nbody;
+    keyTmp = idx + st->nbody;
+    idxTmp = keyTmp + st->nbody;
+
+    for (i = 0, n = 0; i < (unsigned int) st->nbody; ++i)
+    {
+        if (Mass(&st->bodytab[i]) != 0.0)           /* exclude test particles */
+            idx[n++] = i;
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(j) schedule(static)
+  #endif
+    for (j = 0; j < (int) n; ++j)
+    {
+        key[j] = nbTreeKey(t, &st->bodytab[idx[j]]);
+    }
+
+    nbSortTreeKeys(key, idx, keyTmp, idxTmp, n);
+
+    memset(&s, 0, sizeof(s));
+    s.btab = st->bodytab;
+    s.key = key;
+    s.idx = idx;
+    s.minTask = MAX(NB_TREE_MIN_TASK, n / (8 * nbGetMaxThreads()));
+
+    nbInitLoader(&ld, &st->cellArena);
+    nbBuildTreeTop(&s, &ld, t, t->root, t->rsize, 0, 0, n);
+    nbMergeLoader(t, &ld);
+
+    if (t->structureError)
+    {
+        rc = NBODY_TREE_STRUCTURE_ERROR;
+        goto done;
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel private(j, i, ld)
+  #endif
+    {
+        nbInitLoader(&ld, &st->cellArena);
+
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 1)
+      #endif
+        for (j = 0; j < (int) s.nTask; ++j)
+        {
+            const NBodyTreeTask* task = &s.tasks[j];
+
+            for (i = task->lo; i < task->hi; ++i)
+            {
+                nbLoadBody(&ld, t, &st->bodytab[idx[i]], task->cell, task->qsize, task->lev);
+            }
+        }
+
+      #ifdef _OPENMP
+        #pragma omp critical (nbFreeCell)
+      #endif
+        {
+            nbMergeLoader(t, &ld);
+        }
+    }
+
+    /* Check if tree structure error occured */
+    if (t->structureError)
+    {
+        rc = NBODY_TREE_STRUCTURE_ERROR;
+        goto done;
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel private(j)
+  #endif
+    {
+        NBodyTree local = *t;   /* Separate error flag for each thread */
+
+      #ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 1)
+      #endif
+        for (j = 0; j < (int) s.nTask; ++j)
+        {
+            const NBodyTreeTask* task = &s.tasks[j];
+            hackCofM(ctx, &local, (NBodyCell*) Subp(task->cell)[task->sub], 0.5 * task->qsize);
+        }
+
+      #ifdef _OPENMP
+        #pragma omp critical (nbTreeError)
+      #endif
+        {
+            t->structureError |= local.structureError;
+        }
+    }
+
+    for (j = (int) s.nTop - 1; j >= 0; --j)
+    {
+        nbCellCofM(ctx, t, s.top[j].cell, s.top[j].psize);
+    }
+
+    /* Check if tree structure error occured */
+    if (t->structureError)
+    {
+        rc = NBODY_TREE_STRUCTURE_ERROR;
+        goto done;
+    }
+
+    Next(t->root) = NULL;                       /* add Next and More links */
+    for (i = 0; i < s.nTop; ++i)
+    {
+        nbThreadCell(s.top[i].cell);
+    }
+
+  #ifdef _OPENMP
+    #pragma omp parallel for private(j) schedule(dynamic, 1)
+  #endif
+    for (j = 0; j < (int) s.nTask; ++j)
+    {
+        NBodyNode* q = Subp(s.tasks[j].cell)[s.tasks[j].sub];
+        threadTree(q, Next(q));
+    }
+
+    if (ctx->useQuad)                           /* including quad moments? */
+    {
+      #ifdef _OPENMP
+        #pragma omp parallel for private(j) schedule(dynamic, 1)
+      #endif
+        for (j = 0; j < (int) s.nTask; ++j)
+        {
+            hackQuad((NBodyCell*) Subp(s.tasks[j].cell)[s.tasks[j].sub]);
+        }
+
+        for (j = (int) s.nTop - 1; j >= 0; --j)
+        {
+            nbCellQuad(s.top[j].cell);
+        }
+    }
+
+done:
+    free(s.tasks);
+    free(s.top);
+    free(key);
+
+    return rc;
+}
+
+static NBodyStatus nbMakeTreeSerial(const NBodyCtx* ctx, NBodyState* st)
 {
     Body* p;
     const Body* endp = st->bodytab + st->nbody;
     NBodyTree* t = &st->tree;
+    NBodyTreeLoader ld;
 
     nbNewTree(st, t);                                /* flush existing tree, etc */
 
     expandBox(t, st->bodytab, st->nbody);            /* and expand cell to fit */
+    nbInitLoader(&ld, &st->cellArena);
     for (p = st->bodytab; p < endp; p++)             /* loop over bodies... */
     {
         if (Mass(p) != 0.0)                  /* exclude test particles */
-            nbLoadBody(st, t, p);              /* and insert into tree */
+            nbLoadBody(&ld, t, p, t->root, t->rsize, 0); /* and insert into tree */
     }
+    nbMergeLoader(t, &ld);
 
     /* Check if tree structure error occured */
     if (st->tree.structureError)
@@ -459,6 +1018,240 @@ NBodyStatus nbMakeTree(const NBodyCtx* ctx, NBodyState* st)
     return NBODY_SUCCESS;
 }
 
+static void nbResizeFlatTree(NBodyFlatTree* ft, unsigned int n)
+{
+    unsigned int i;
+    real** reals[] = { &ft->pos[0], &ft->pos[1], &ft->pos[2],
+                       &ft->masses, &ft->critRadii,
+                       &ft->quad.xx, &ft->quad.xy, &ft->quad.xz,
+                       &ft->quad.yy, &ft->quad.yz, &ft->quad.zz };
+
+    if (n <= ft->maxNode)
+        return;
+
+    for (i = 0; i < sizeof(reals) / sizeof(reals[0]); ++i)
+    {
+        mwFreeA(*reals[i]);
+        *reals[i] = (real*) mwMallocA(n * sizeof(real));
+    }
+
+    mwFreeA(ft->next);
+    mwFreeA(ft->body);
+    mwFreeA(ft->count);
+    ft->next = (int*) mwMallocA(n * sizeof(int));
+    ft->body = (int*) mwMallocA(n * sizeof(int));
+    ft->count = (int*) mwMallocA(n * sizeof(int));
+
+    ft->maxNode = n;
+}
+
+/* Copy node p and its descendents into the flat tree in walk order.
+ * Returns the number of bodies copied. */
+static int nbFlattenNode(const NBodyCtx* ctx, NBodyState* st, const NBodyNode* p)
+{
+    NBodyFlatTree* ft = &st->flatTree;
+    const NBodyNode* q;
+    unsigned int i = ft->nNode++;
+    int count = 0;
+
+    ft->pos[0][i] = X(Pos(p));
+    ft->pos[1][i] = Y(Pos(p));
+    ft->pos[2][i] = Z(Pos(p));
+    ft->masses[i] = Mass(p);
+
+    if (isBody(p))
+    {
+        ft->critRadii[i] = 0.0;
+        ft->body[i] = (int) ((const Body*) p - st->bodytab);
+        count = 1;
+    }
+    else
+    {
+        ft->critRadii[i] = Rcrit2(p);
+        ft->body[i] = -1;
+
+        if (ctx->useQuad)
+        {
+            ft->quad.xx[i] = Quad(p).xx;
+            ft->quad.xy[i] = Quad(p).xy;
+            ft->quad.xz[i] = Quad(p).xz;
+            ft->quad.yy[i] = Quad(p).yy;
+            ft->quad.yz[i] = Quad(p).yz;
+            ft->quad.zz[i] = Quad(p).zz;
+        }
+
+        /* Children are linked from More(p) up to Next(p) */
+        for (q = More(p); q != Next(p); q = Next(q))
+        {
+            count += nbFlattenNode(ctx, st, q);
+        }
+    }
+
+    ft->next[i] = (int) ft->nNode;
+    ft->count[i] = count;
+
+    return count;
+}
+
+/* Copy the threaded tree into the structure of arrays flat tree */
+static void nbFlattenTree(const NBodyCtx* ctx, NBodyState* st)
+{
+    nbResizeFlatTree(&st->flatTree, st->tree.cellUsed + st->nbody);
+    st->flatTree.nNode = 0;
+    nbFlattenNode(ctx, st, (const NBodyNode*) st->tree.root);
+}
+
+/* Subcell index of position r in a cell centered on center, the same
+ * as nbSubIndex gives when the tree is built */
+static inline int nbRefitSubIndex(mwvector center, mwvector r)
+{
+    int ind = 0;
+
+    if (X(center) <= X(r))
+        ind += NSUB >> (0 + 1);
+
+    if (Y(center) <= Y(r))
+        ind += NSUB >> (1 + 1);
+
+    if (Z(center) <= Z(r))
+        ind += NSUB >> (2 + 1);
+
+    return ind;
+}
+
+static inline mwbool nbRefitInsideCell(mwvector center, real halfPsize, mwvector r)
+{
+    return    mw_abs(X(r) - X(center)) <= halfPsize
+           && mw_abs(Y(r) - Y(center)) <= halfPsize
+           && mw_abs(Z(r) - Z(center)) <= halfPsize;
+}
+
+/* refitCell: recalculate the center of mass, critical radius and
+ * quadrupole moment of cell p and its descendents, keeping the
+ * structure of the tree. The cell boxes move along with the system by
+ * shift. Every body must still be inside its cell and alone in its
+ * subcell, so the tree is the one loading the bodies into the moved
+ * boxes would build, and the usual critical radius holds. Returns
+ * FALSE as soon as a body has left its subcell, and the tree must be
+ * rebuilt.
+ */
+static mwbool nbRefitCell(const NBodyCtx* ctx, NBodyTree* t, NBodyCell* p, real psize, mwvector shift)
+{
+    NBodyNode* q;
+    mwvector cmpos = ZERO_VECTOR;
+    mwvector r;
+    const real halfPsize = 0.5 * psize;
+    unsigned int used = 0;   /* subcells already taken by a child */
+    unsigned int bit;
+
+    mw_incaddv(Center(p), shift);
+
+    Mass(p) = 0.0;
+    for (q = More(p); q != Next(p); q = Next(q))   /* loop over children */
+    {
+        if (isCell(q))
+        {
+            if (!nbRefitCell(ctx, t, (NBodyCell*) q, halfPsize, shift))
+                return FALSE;
+            r = Center(q);
+        }
+        else
+        {
+            r = Pos(q);
+            if (!nbRefitInsideCell(Center(p), halfPsize, r))
+                return FALSE;
+        }
+
+        bit = 1u << nbRefitSubIndex(Center(p), r);
+        if (used & bit)     /* moved into the subcell of another child */
+            return FALSE;
+        used |= bit;
+
+        Mass(p) += Mass(q);
+        mw_incaddv_s(cmpos, Pos(q), Mass(q));
+    }
+
+    if (Mass(p) > 0.0)
+    {
+        mw_incdivs(cmpos, Mass(p));
+    }
+    else
+    {
+        cmpos = Center(p);
+    }
+
+    Pos(p) = Center(p);     /* findRCrit measures from the geometric center */
+    Rcrit2(p) = findRCrit(ctx, p, t->rsize, cmpos, psize);
+    Pos(p) = cmpos;
+
+    if (ctx->useQuad)
+    {
+        memset(&Quad(p), 0, sizeof(Quad(p)));
+        for (q = More(p); q != Next(p); q = Next(q))
+        {
+            nbAddSubnodeQuad(p, q);
+        }
+    }
+
+    return TRUE;
+}
+
+/* Between full rebuilds keep the tree from the last step as long as
+ * no body has left the subcell it was loaded into. The
+ * system as a whole moves along its orbit much faster than bodies
+ * move within it, so the cells are carried along with the center of
+ * mass. */
+static mwbool nbRefitTree(const NBodyCtx* ctx, NBodyState* st)
+{
+    NBodyTree* t = &st->tree;
+    const Body* p;
+    const Body* endp = st->bodytab + st->nbody;
+    mwvector cmpos = ZERO_VECTOR;
+    mwvector shift;
+    real mass = 0.0;
+
+    if (   ctx->treeRebuildInterval <= 1
+        || t->root == NULL
+        || st->step % ctx->treeRebuildInterval == 0)
+    {
+        return FALSE;
+    }
+
+    for (p = st->bodytab; p < endp; p++)
+    {
+        mass += Mass(p);
+        mw_incaddv_s(cmpos, Pos(p), Mass(p));
+    }
+
+    if (mass <= 0.0)
+        return FALSE;
+
+    mw_incdivs(cmpos, mass);
+    shift = mw_subv(cmpos, Pos(t->root));     /* motion since the last step */
+
+    return nbRefitCell(ctx, t, t->root, t->rsize, shift);
+}
+
+/* nbMakeTree: initialize tree structure for hierarchical force calculation
+ * from body array btab, which contains ctx.nbody bodies.
+ */
+NBodyStatus nbMakeTree(const NBodyCtx* ctx, NBodyState* st)
+{
+    NBodyStatus rc;
+
+    if (nbRefitTree(ctx, st))
+        rc = NBODY_SUCCESS;
+    else if (ctx->parallelTree)
+        rc = nbMakeTreeParallel(ctx, st);
+    else
+        rc = nbMakeTreeSerial(ctx, st);
+
+    if (rc == NBODY_SUCCESS && (ctx->flatTree || ctx->groupSize > 0))
+        nbFlattenTree(ctx, st);
+
+    return rc;
+}
+
 #if 0
 /* For testing */
 static int luaFindRCrit(lua_State* luaSt)
@@ -24,6 +24,10 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
 #include "nbody_types.h"
 #include "nbody_show.h"
 #include "nbody_defaults.h"
+#include "nbody_tree.h"
+#include "nbody_checkpoint.h"
+#include "nbody_snapshot.h"
+#include "nbody_stream.h"
 
 #if NBODY_OPENCL
   #include "nbody_cl.h"
@@ -33,43 +37,38 @@ along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
   #include <sys/mman.h>
 #endif
 
-static void freeNBodyTree(NBodyTree* t)
+static void freeFlatTree(NBodyFlatTree* ft)
 {
-    NBodyNode* p;
-    NBodyNode* tmp;
-
-    p = (NBodyNode*) t->root;
-    while (p != NULL)
-    {
-        if (isCell(p))
-        {
-            tmp = More(p);
-            mwFreeA(p);
-            p = tmp;
-        }
-        else                        /* skip over bodies */
-        {
-            p = Next(p);
-        }
-    }
-
-    t->root = NULL;
-    t->cellUsed = 0;
-    t->maxDepth = 0;
+    mwFreeA(ft->pos[0]);
+    mwFreeA(ft->pos[1]);
+    mwFreeA(ft->pos[2]);
+    mwFreeA(ft->masses);
+    mwFreeA(ft->critRadii);
+
+    mwFreeA(ft->quad.xx);
+    mwFreeA(ft->quad.xy);
+    mwFreeA(ft->quad.xz);
+    mwFreeA(ft->quad.yy);
+    mwFreeA(ft->quad.yz);
+    mwFreeA(ft->quad.zz);
+
+    mwFreeA(ft->next);
+    mwFreeA(ft->body);
+    mwFreeA(ft->count);
+
+    ft->nNode = 0;
+    ft->maxNode = 0;
 }
 
-static void freeFreeCells(NBodyNode* freeCell)
+static void freeExactSoA(NBodyExactSoA* soa)
 {
-    NBodyNode* p;
-    NBodyNode* tmp;
+    mwFreeA(soa->pos[0]);
+    mwFreeA(soa->pos[1]);
+    mwFreeA(soa->pos[2]);
+    mwFreeA(soa->masses);
 
-    p = freeCell;
-    while (p)
-    {
-        tmp = Next(p);
-        mwFreeA(p);
-        p = tmp;
-    }
+    soa->nPad = 0;
+    soa->maxBody = 0;
 }
 
 int nbDetachSharedScene(NBodyState* st)
@@ -105,12 +104,30 @@ int destroyNBodyState(NBodyState* st)
     int nThread = nbGetMaxThreads();
     int i;
 
-    freeNBodyTree(&st->tree);
-    freeFreeCells(st->freeCell);
+    nbFreeCellArena(&st->cellArena);
+    st->tree.root = NULL;
+    st->tree.cellUsed = 0;
+    st->tree.maxDepth = 0;
+    freeFlatTree(&st->flatTree);
+    freeExactSoA(&st->exactSoA);
     mwFreeA(st->bodytab);
     mwFreeA(st->acctab);
+    free(st->bodyOrder);
+    free(st->bodyStride);
+    free(st->activeBodies);
     mwFreeA(st->orbitTrace);
 
+    if (nbDestroyCheckpointWriter(st))
+    {
+        failed = TRUE;
+    }
+
+    if (nbCloseSnapshotWriter(st))
+    {
+        failed = TRUE;
+    }
+
+    nbCloseStreamServer(st);
     free(st->checkpointResolved);
 
     if (st->potEvalStates)
@@ -167,9 +184,10 @@ int destroyNBodyState(NBodyState* st)
 void setInitialNBodyState(NBodyState* st, const NBodyCtx* ctx, Body* bodies, int nbody)
 {
     static const NBodyTree emptyTree = EMPTY_TREE;
+    static const NBodyCellArena emptyCellArena = EMPTY_CELL_ARENA;
 
     st->tree = emptyTree;
-    st->freeCell = NULL;
+    st->cellArena = emptyCellArena;
     st->usesQuad = ctx->useQuad;
     st->usesExact = (ctx->criterion == Exact);
 
@@ -238,6 +256,20 @@ NBodyStatus nbInitNBodyStateCL(NBodyState* st, const NBodyCtx* ctx)
         return NBODY_UNSUPPORTED;
     }
 
+    if (   ctx->pot.nExtraSphere != 0
+        || ctx->pot.nExtraDisk != 0
+        || ctx->pot.nExtraHalo != 0)
+    {
+        mw_printf("Cannot use potential with extra components with OpenCL\n");
+        return NBODY_UNSUPPORTED;
+    }
+
+    if (ctx->timestepLevels > 0)
+    {
+        mw_printf("Cannot use block timesteps with OpenCL\n");
+        return NBODY_UNSUPPORTED;
+    }
+
     devInfo = &st->ci->di;
 
     if (!nbCheckDevCapabilities(devInfo, ctx, st->nbody))
@@ -397,12 +429,17 @@ int equalNBodyState(const NBodyState* st1, const NBodyState* st2)
 void cloneNBodyState(NBodyState* st, const NBodyState* oldSt)
 {
     static const NBodyTree emptyTree = EMPTY_TREE;
+    static const NBodyFlatTree emptyFlatTree = EMPTY_FLAT_TREE;
+    static const NBodyExactSoA emptyExactSoA = EMPTY_EXACT_SOA;
+    static const NBodyCellArena emptyCellArena = EMPTY_CELL_ARENA;
     unsigned int nbody = oldSt->nbody;
 
     st->tree = emptyTree;
+    st->flatTree = emptyFlatTree;
+    st->exactSoA = emptyExactSoA;
     st->tree.rsize = oldSt->tree.rsize;
 
-    st->freeCell = NULL;
+    st->cellArena = emptyCellArena;
 
     st->lastCheckpoint = oldSt->lastCheckpoint;
     st->step           = oldSt->step;
@@ -415,6 +452,8 @@ void cloneNBodyState(NBodyState* st, const NBodyState* oldSt)
     st->dirty = oldSt->dirty;
     st->usesCL = oldSt->usesCL;
     st->reportProgress = oldSt->reportProgress;
+    st->compressCheckpoint = oldSt->compressCheckpoint;
+    st->asyncCheckpoint = oldSt->asyncCheckpoint;
 
     st->treeIncest = oldSt->treeIncest;
     st->tree.structureError = oldSt->tree.structureError;
@@ -428,6 +467,12 @@ void cloneNBodyState(NBodyState* st, const NBodyState* oldSt)
     st->acctab = (mwvector*) mwMallocA(nbody * sizeof(mwvector));
     memcpy(st->acctab, oldSt->acctab, nbody * sizeof(mwvector));
 
+    if (oldSt->bodyOrder)
+    {
+        st->bodyOrder = (int*) mwMalloc(nbody * sizeof(int));
+        memcpy(st->bodyOrder, oldSt->bodyOrder, nbody * sizeof(int));
+    }
+
     if (oldSt->orbitTrace)
     {
         st->orbitTrace = (mwvector*) mwMallocA(oldSt->nOrbitTrace * sizeof(mwvector));
@@ -568,9 +613,48 @@ int equalSpherical(const Spherical* s1, const Spherical* s2)
 
 int equalPotential(const Potential* p1, const Potential* p2)
 {
-    return equalSpherical(&p1->sphere[0], &p2->sphere[0])
-        && equalDisk(&p1->disk, &p2->disk)
-        && equalHalo(&p1->halo, &p2->halo);
+    int i;
+
+    if (   !equalSpherical(&p1->sphere[0], &p2->sphere[0])
+        || !equalDisk(&p1->disk, &p2->disk)
+        || !equalHalo(&p1->halo, &p2->halo))
+    {
+        return FALSE;
+    }
+
+    if (   p1->nExtraSphere != p2->nExtraSphere
+        || p1->nExtraDisk != p2->nExtraDisk
+        || p1->nExtraHalo != p2->nExtraHalo)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < p1->nExtraSphere; ++i)
+    {
+        if (!equalSpherical(&p1->extraSphere[i], &p2->extraSphere[i]))
+            return FALSE;
+    }
+
+    for (i = 0; i < p1->nExtraDisk; ++i)
+    {
+        if (!equalDisk(&p1->extraDisk[i], &p2->extraDisk[i]))
+            return FALSE;
+    }
+
+    for (i = 0; i < p1->nExtraHalo; ++i)
+    {
+        if (!equalHalo(&p1->extraHalo[i], &p2->extraHalo[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int equalHistogramAxis(const HistogramAxis* a1, const HistogramAxis* a2)
+{
+    return feqWithNan(a1->start, a2->start)
+        && feqWithNan(a1->end, a2->end)
+        && feqWithNan(a1->binSize, a2->binSize);
 }
 
 int equalHistogramParams(const HistogramParams* hp1, const HistogramParams* hp2)
@@ -581,7 +665,11 @@ int equalHistogramParams(const HistogramParams* hp1, const HistogramParams* hp2)
         && feqWithNan(hp1->startRaw, hp2->startRaw)
         && feqWithNan(hp1->endRaw, hp2->endRaw)
         && feqWithNan(hp1->binSize, hp2->binSize)
-        && feqWithNan(hp1->center, hp2->center);
+        && feqWithNan(hp1->center, hp2->center)
+        && equalHistogramAxis(&hp1->beta, &hp2->beta)
+        && equalHistogramAxis(&hp1->distance, &hp2->distance)
+        && equalHistogramAxis(&hp1->vlos, &hp2->vlos)
+        && hp1->sparse == hp2->sparse;
 }
 
 int equalNBodyCtx(const NBodyCtx* ctx1, const NBodyCtx* ctx2)
@@ -592,11 +680,18 @@ int equalNBodyCtx(const NBodyCtx* ctx1, const NBodyCtx* ctx2)
         && feqWithNan(ctx1->timeEvolve, ctx2->timeEvolve)
         && feqWithNan(ctx1->treeRSize, ctx2->treeRSize)
         && feqWithNan(ctx1->sunGCDist, ctx2->sunGCDist)
+        && feqWithNan(ctx1->timestepEta, ctx2->timestepEta)
         && feqWithNan(ctx1->criterion, ctx2->criterion)
         && (ctx1->potentialType == ctx2->potentialType)
         && feqWithNan(ctx1->useQuad, ctx2->useQuad)
         && feqWithNan(ctx1->allowIncest, ctx2->allowIncest)
         && feqWithNan(ctx1->quietErrors, ctx2->quietErrors)
+        && feqWithNan(ctx1->parallelTree, ctx2->parallelTree)
+        && ctx1->bodySortInterval == ctx2->bodySortInterval
+        && feqWithNan(ctx1->flatTree, ctx2->flatTree)
+        && ctx1->groupSize == ctx2->groupSize
+        && ctx1->treeRebuildInterval == ctx2->treeRebuildInterval
+        && ctx1->timestepLevels == ctx2->timestepLevels
         && ctx1->checkpointT == ctx2->checkpointT
         && feqWithNan(ctx1->nStep, ctx2->nStep)
         && equalPotential(&ctx1->pot, &ctx2->pot);
@@ -18,6 +18,8 @@
 --
 --
 
+args = { ... }
+
 require "NBodyTesting"
 SM = require "SampleModels"
 SP = require "SamplePotentials"
@@ -36,7 +38,8 @@ function randomNBodyCtx(prng)
       criterion   = prng:randomListItem({"NewCriterion", "SW93", "BH86", "Exact"}),
       useQuad     = prng:randomBool(),
       allowIncest = true,
-      quietErrors = true
+      quietErrors = true,
+      timestepLevels = prng:randomListItem({ 0, 2, 4 })
    }
 end
 
@@ -55,7 +58,7 @@ function runInterruptedSteps(st, totalSteps, ctx, prng)
       st:step(ctx)
       if prng:randomBool() then
          local tmp = tmpDir .. os.tmpname()
-         st:writeCheckpoint(ctx, checkpoint, tmp)
+         st:writeCheckpoint(ctx, checkpoint, tmp, prng:randomBool())
          ctx, st = NBodyState.readCheckpoint(checkpoint)
          os.remove(checkpoint)
       end
@@ -99,3 +102,26 @@ for i = 1, nTests do
 end
 
 
+-- A version 1 checkpoint written by an older build, from
+-- checkpoints/plummer_64_v1.lua. It is only usable by builds with the
+-- same real size and architecture, so it is only passed for those.
+local v1Checkpoint = args[1]
+if v1Checkpoint ~= nil then
+   local ctx, st = NBodyState.readCheckpoint(v1Checkpoint)
+
+   assert(ctx.timestep == 1.0e-3, "Version 1 checkpoint timestep does not match")
+   assert(ctx.timeEvolve == 0.1, "Version 1 checkpoint timeEvolve does not match")
+   assert(ctx.eps2 == 1.0e-4, "Version 1 checkpoint eps2 does not match")
+   assert(ctx.theta == 0.5, "Version 1 checkpoint theta does not match")
+   assert(ctx.criterion == "NewCriterion", "Version 1 checkpoint criterion does not match")
+   assert(ctx.useQuad, "Version 1 checkpoint useQuad does not match")
+
+   -- Fields that did not exist in version 1 get their defaults
+   local default = NBodyCtx.create{ timestep = 1.0e-3, timeEvolve = 0.1, eps2 = 1.0e-4, theta = 0.5 }
+   assert(ctx.timestepLevels == default.timestepLevels,
+          "Version 1 checkpoint did not get default timestepLevels")
+   assert(ctx.groupSize == default.groupSize,
+          "Version 1 checkpoint did not get default groupSize")
+
+   runNSteps(st, 10, ctx)
+end
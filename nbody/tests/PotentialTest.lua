@@ -18,6 +18,8 @@
 --
 --
 
+args = { ... }
+
 require "NBodyTesting"
 SP = require "SamplePotentials"
 SM = require "SampleModels"
@@ -81,8 +83,74 @@ function checkPotentialTests()
    end
 end
 
+local function accelerationsClose(a, b, tol)
+   return Vector.length(a - b) <= tol * Vector.length(b)
+end
+
+local function accelerationsEqual(a, b)
+   return a.x == b.x and a.y == b.y and a.z == b.z
+end
+
+local function countRegistryEntries()
+   local n = 0
+   for _ in pairs(debug.getregistry()) do
+      n = n + 1
+   end
+   return n
+end
+
+-- Potentials with extra components should be the sum of all of them,
+-- no matter which are the main ones and which are extra
+function checkCompositePotentials()
+   local prng = DSFMT.create(4321)
+   local sphericals = SP.buildAllSphericals()
+   local disks = SP.buildAllDisks()
+   local halos = SP.buildAllHalos()
+
+   for i = 1, 200 do
+      local s1, s2 = prng:randomListItem(sphericals), prng:randomListItem(sphericals)
+      local d1, d2 = prng:randomListItem(disks), prng:randomListItem(disks)
+      local h1, h2 = prng:randomListItem(halos), prng:randomListItem(halos)
+      local r = prng:randomVector(50)
+
+      local base = Potential.create{ spherical = s1, disk = d1, halo = h1 }
+      local noExtra = Potential.create{ spherical = s1, disk = d1, halo = h1, extra = { } }
+      local composite = Potential.create{ spherical = s1, disk = d1, halo = h1, extra = { s2, d2, h2 } }
+      local swapped = Potential.create{ spherical = s2, disk = d2, halo = h2, extra = { h1, d1, s1 } }
+      local positional = Potential.create(s1, d1, h1, { s2, d2, h2 })
+
+      assert(accelerationsEqual(noExtra:acceleration(r), base:acceleration(r)),
+             "Empty extra table changed the acceleration")
+      assert(accelerationsEqual(positional:acceleration(r), composite:acceleration(r)),
+             "Positional extra argument does not match named argument")
+      assert(accelerationsClose(composite:acceleration(r), swapped:acceleration(r), 1.0e-12),
+             string.format("Composite potential is not the sum of its components:\n%s\n%s",
+                           tostring(composite), tostring(swapped)))
+   end
+
+   local s, d, h = sphericals[1], disks[1], halos[1]
+
+   assert(pcall(Potential.create, { spherical = s, disk = d, halo = h, extra = { d, d, d, d } }),
+          "Maximum number of extra components rejected")
+   assert(not pcall(Potential.create, { spherical = s, disk = d, halo = h, extra = { d, d, d, d, d } }),
+          "Too many extra components accepted")
+   assert(not pcall(Potential.create, { spherical = s, disk = d, halo = h, extra = { 5 } }),
+          "Extra component which is not a component accepted")
+   assert(not pcall(Potential.create, { spherical = s, disk = d, halo = h, extra = d }),
+          "Extra argument which is not a table accepted")
+
+   -- The table is held as a registry reference while it is read
+   local before = countRegistryEntries()
+   for i = 1, 1000 do
+      Potential.create{ spherical = s, disk = d, halo = h, extra = { d } }
+   end
+   assert(countRegistryEntries() <= before + 1, "Extra components table leaked from registry")
+end
+
 
-if generatingResults then
+if args[1] == "composite" then
+   checkCompositePotentials()
+elseif generatingResults then
    generatePotentialComboTests()
 else
    checkPotentialTests()
@@ -0,0 +1,184 @@
+require "NBodyTesting"
+
+local args = { ... }
+
+assert(args and #args == 1, "Path to milkyway_nbody required")
+
+local nbodyBin = args[1]
+local failCount = 0
+local tmpFiles = { }
+
+local header = {
+   "# Histogram used by RunHistogramTests.lua",
+   "n = 100",
+   "massPerParticle = 0.0100000000",
+   "totalSimulated = 100"
+}
+
+local bins = {
+   "1 -1.5000000000 0.1000000000 0.0316227766",
+   "1 -0.5000000000 0.4000000000 0.0632455532",
+   "1 0.5000000000 0.3000000000 0.0547722558",
+   "1 1.5000000000 0.2000000000 0.0447213595"
+}
+
+local shiftedBins = {
+   "1 -1.5000000000 0.2000000000 0.0447213595",
+   "1 -0.5000000000 0.3000000000 0.0547722558",
+   "1 0.5000000000 0.4000000000 0.0632455532",
+   "1 1.5000000000 0.1000000000 0.0316227766"
+}
+
+-- Sparse lambda x beta histogram, leaving out the empty bins
+local multiDim = {
+   "n = 100",
+   "massPerParticle = 0.0100000000",
+   "totalSimulated = 100",
+   "dimensions = 2",
+   "axis = lambda -2.0000000000 1.0000000000 4",
+   "axis = beta -1.0000000000 1.0000000000 2",
+   "sparse = 1",
+   "1 -1.5000000000 -0.5000000000 0.1000000000 0.0316227766",
+   "1 -0.5000000000 0.5000000000 0.4000000000 0.0632455532",
+   "1 0.5000000000 -0.5000000000 0.3000000000 0.0547722558",
+   "1 1.5000000000 0.5000000000 0.2000000000 0.0447213595"
+}
+
+local function lines(...)
+   local all = { }
+   for _, t in ipairs({ ... }) do
+      for _, l in ipairs(t) do
+         all[#all + 1] = l
+      end
+   end
+   return all
+end
+
+-- Write lines to a new temporary file ending each with eol, leaving
+-- the newline off the last one if noFinalNewline
+local function writeTmp(ls, eol, noFinalNewline)
+   local name = os.tmpname()
+   local f = assert(io.open(name, "wb"))
+   f:write(table.concat(ls, eol))
+   if not noFinalNewline then
+      f:write(eol)
+   end
+   f:close()
+   tmpFiles[#tmpFiles + 1] = name
+   return name
+end
+
+local function check(ok, fmt, ...)
+   if ok then
+      printf("passed: " .. fmt .. "\n", ...)
+   else
+      eprintf("FAILED: " .. fmt .. "\n", ...)
+      failCount = failCount + 1
+   end
+end
+
+local function matchHistogram(a, b)
+   local output = os.readProcess(nbodyBin, "-h", a, "-s", b)
+   return tonumber(output:match("([-%d.naif]+)%s*$")), output
+end
+
+-- Scores of each file in the list by method, keyed by file name
+local function matchHistogramList(a, methods, names)
+   local list = writeTmp(names, "\n")
+   local output = os.readProcess(nbodyBin,
+                                 "-h", a,
+                                 "--match-histogram-list", list,
+                                 "--match-methods", methods)
+   local scores = { }
+   local columns
+
+   for line in output:gmatch("[^\n]+") do
+      local fields = { }
+      for field in line:gmatch("[^\t]+") do
+         fields[#fields + 1] = field
+      end
+
+      if fields[1] == "# histogram" then
+         columns = fields
+      elseif columns and #fields == #columns then
+         local row = { }
+         for j = 2, #fields do
+            row[columns[j]] = tonumber(fields[j])
+         end
+         scores[fields[1]] = row
+      end
+   end
+
+   return scores, output
+end
+
+-- The EMD of identical histograms is only zero up to rounding
+local function isZero(x)
+   return x ~= nil and math.abs(x) < 1.0e-9
+end
+
+local function isNaN(x)
+   return x ~= x
+end
+
+
+local ref = writeTmp(lines(header, bins), "\n")
+local crlf = writeTmp(lines(header, bins), "\r\n")
+local noNewline = writeTmp(lines(header, bins), "\n", true)
+local shifted = writeTmp(lines(header, shiftedBins), "\n")
+local multi = writeTmp(multiDim, "\r\n")
+local bad = writeTmp(lines(header, { bins[1], "1 -0.5000000000 garbage", bins[3] }), "\n")
+
+local emd, output = matchHistogram(ref, crlf)
+check(isZero(emd), "CRLF histogram matches LF histogram (%s)", output)
+
+emd, output = matchHistogram(ref, noNewline)
+check(isZero(emd), "Histogram without final newline matches (%s)", output)
+
+local shiftedEMD
+shiftedEMD, output = matchHistogram(ref, shifted)
+check(shiftedEMD ~= nil and shiftedEMD > 0.0, "Different histogram has positive EMD (%s)", output)
+
+emd, output = matchHistogram(multi, multi)
+check(isZero(emd), "Multidimensional histogram matches itself (%s)", output)
+
+output = os.readProcess(nbodyBin, "-h", ref, "-s", bad)
+check(output:find("Error reading histogram line 6") ~= nil, "Bad line is reported")
+
+
+local scores
+scores, output = matchHistogramList(ref, "EMD,Original,Poisson", { crlf, noNewline, shifted, multi, bad })
+
+check(scores[crlf] and isZero(scores[crlf].EMD) and scores[crlf].Original == 0.0,
+      "List scores CRLF histogram")
+check(scores[noNewline] and isZero(scores[noNewline].EMD),
+      "List scores histogram without final newline")
+check(scores[shifted] and math.abs(scores[shifted].EMD - shiftedEMD) < 1.0e-6,
+      "List EMD agrees with --match-histogram")
+check(scores[shifted] and scores[shifted].Original > 0.0 and scores[shifted].Poisson ~= nil,
+      "List scores every method")
+check(scores[multi] and isNaN(scores[multi].EMD),
+      "List does not compare histograms of different shapes")
+check(scores[bad] and isNaN(scores[bad].EMD) and isNaN(scores[bad].Poisson),
+      "List gives NaN for an unreadable histogram")
+
+if failCount ~= 0 then
+   io.stdout:write(output)
+end
+
+scores, output = matchHistogramList(multi, "EMD", { multi })
+check(scores[multi] and isZero(scores[multi].EMD), "List scores multidimensional histogram")
+
+output = os.readProcess(nbodyBin, "-h", ref, "--match-histogram-list", ref, "--match-methods", "EMD,Bogus")
+check(output:find("Unknown likelihood method 'Bogus'") ~= nil, "Unknown method is rejected")
+
+
+for _, name in ipairs(tmpFiles) do
+   os.remove(name)
+end
+
+eprintf("%d histogram tests failed.\n", failCount)
+
+if failCount ~= 0 then
+   os.exit(1)
+end
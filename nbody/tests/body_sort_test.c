@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_defaults.h"
+#include "nbody_show.h"
+#include "milkyway_util.h"
+#include "dSFMT.h"
+
+#define NBODY 2000
+#define NSTEP 20
+#define SORT_INTERVAL 3
+
+/* Sorting only changes the order forces are summed in, so the runs
+ * must agree up to rounding */
+#define POSITION_TOLERANCE 1.0e-9
+
+static dsfmt_t _prng;
+
+static real randomRange(real lo, real hi)
+{
+    return lo + (hi - lo) * (real) dsfmt_genrand_close_open(&_prng);
+}
+
+/* Uniform sphere of unit mass and radius, with random velocities */
+static Body* sphereBodies(void)
+{
+    int i;
+    mwvector r;
+    Body* bodies = (Body*) mwCallocA(NBODY, sizeof(Body));
+
+    for (i = 0; i < NBODY; ++i)
+    {
+        do
+        {
+            X(r) = randomRange(-1.0, 1.0);
+            Y(r) = randomRange(-1.0, 1.0);
+            Z(r) = randomRange(-1.0, 1.0);
+        }
+        while (mw_sqrv(r) > 1.0);
+
+        Pos(&bodies[i]) = r;
+        X(Vel(&bodies[i])) = randomRange(-0.5, 0.5);
+        Y(Vel(&bodies[i])) = randomRange(-0.5, 0.5);
+        Z(Vel(&bodies[i])) = randomRange(-0.5, 0.5);
+        Mass(&bodies[i]) = 1.0 / NBODY;
+        Type(&bodies[i]) = BODY(FALSE);
+    }
+
+    return bodies;
+}
+
+/* Step the same bodies with and without sorting them every few steps,
+ * and check they are in the same order and place after every step */
+static int testSortedRun(criterion_t criterion)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    NBodyCtx sortCtx;
+    NBodyState st = EMPTY_NBODYSTATE;
+    NBodyState sorted = EMPTY_NBODYSTATE;
+    Body* bodies = sphereBodies();
+    int i, step;
+    real d, maxDiff = 0.0;
+    int failed = 0;
+
+    ctx.theta = 0.5;
+    ctx.eps2 = 1.0e-4;
+    ctx.timestep = 1.0e-3;
+    ctx.criterion = criterion;
+    ctx.useQuad = TRUE;
+    ctx.potentialType = EXTERNAL_POTENTIAL_NONE;
+    ctx.treeRSize = 4.0;
+
+    sortCtx = ctx;
+    sortCtx.bodySortInterval = SORT_INTERVAL;
+
+    setInitialNBodyState(&st, &ctx, bodies, NBODY);
+    cloneNBodyState(&sorted, &st);
+
+    for (step = 0; step < NSTEP && !failed; ++step)
+    {
+        failed |= nbStatusIsFatal(nbStepSystem(&ctx, &st));
+        failed |= nbStatusIsFatal(nbStepSystem(&sortCtx, &sorted));
+
+        if (sorted.bodyOrder)
+        {
+            mw_printf("%s: bodies left sorted after step %d\n", showCriterionT(criterion), step);
+            failed = 1;
+        }
+
+        for (i = 0; i < NBODY; ++i)
+        {
+            d = mw_distv(Pos(&st.bodytab[i]), Pos(&sorted.bodytab[i]));
+            maxDiff = mw_fmax(maxDiff, d);
+        }
+    }
+
+    if (failed || maxDiff > POSITION_TOLERANCE)
+    {
+        mw_printf("%s: sorted run differs from unsorted run by %g\n", showCriterionT(criterion), maxDiff);
+        failed = 1;
+    }
+
+    destroyNBodyState(&st);
+    destroyNBodyState(&sorted);
+
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+
+    failed |= testSortedRun(NewCriterion);
+    failed |= testSortedRun(Exact);
+
+    if (failed)
+    {
+        mw_printf("Body sort tests failed\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,59 @@
+--
+-- Copyright (c) 2026 The Milkyway@Home Developers
+--
+-- This file is part of Milkway@Home.
+--
+-- Milkyway@Home is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 3 of the License, or
+-- (at your option) any later version.
+--
+-- Milkyway@Home is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+--
+
+-- Input used to write plummer_64_v1.checkpoint with a build from
+-- before version 2 checkpoints, with
+--   milkyway_nbody -f plummer_64_v1.lua -c plummer_64_v1.checkpoint --no-clean-checkpoint
+-- The checkpoint is for double precision on a 64 bit little endian system.
+
+function makePotential()
+   return Potential.create{
+      spherical = Spherical.spherical{ mass = 1.52954402e5, scale = 0.7 },
+      disk      = Disk.miyamotoNagai{ mass = 4.45865888e5, scaleLength = 6.5, scaleHeight = 0.26 },
+      halo      = Halo.logarithmic{ vhalo = 73, scaleLength = 12.0, flattenZ = 1.0 }
+   }
+end
+
+function makeContext()
+   return NBodyCtx.create{
+      timestep    = 1.0e-3,
+      timeEvolve  = 0.1,
+      eps2        = 1.0e-4,
+      criterion   = "NewCriterion",
+      useQuad     = true,
+      theta       = 0.5
+   }
+end
+
+function makeHistogram()
+   return HistogramParams.create()
+end
+
+function makeBodies(ctx, potential)
+   local prng = DSFMT.create(1234)
+   return predefinedModels.plummer{
+      nbody       = 64,
+      prng        = prng,
+      position    = Vector.create(8, 0, 10),
+      velocity    = Vector.create(0, 100, 0),
+      mass        = 20,
+      scaleRadius = 0.3,
+      ignore      = false
+   }
+end
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times the EMD solver on random 2D signatures, allocating the
+ * buffers for every call against reusing one workspace. Reuse only
+ * saves the allocations, which are small next to the solver, so the
+ * two times are usually within noise of each other.
+ *
+ * Usage: emd_bench [number of bins] [repetitions]
+ */
+
+#include "milkyway_util.h"
+#include "nbody_emd.h"
+#include "dSFMT.h"
+
+#define EMD_BENCH_DIMS 2
+
+static dsfmt_t _prng;
+
+/* Signature of n entries of a weight and EMD_BENCH_DIMS coordinates,
+ * with the weights summing to 1 */
+static float* randomSignature(unsigned int n)
+{
+    unsigned int i, j;
+    const unsigned int width = EMD_BENCH_DIMS + 1;
+    float total = 0.0f;
+    float* sig = (float*) mwCalloc((size_t) n * width, sizeof(float));
+
+    for (i = 0; i < n; ++i)
+    {
+        sig[i * width] = (float) dsfmt_genrand_open_open(&_prng);
+        total += sig[i * width];
+
+        for (j = 1; j < width; ++j)
+        {
+            sig[i * width + j] = (float) mwXrandom(&_prng, 0.0, 50.0);
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        sig[i * width] /= total;
+    }
+
+    return sig;
+}
+
+int main(int argc, const char* argv[])
+{
+    unsigned int i;
+    unsigned int n = 100;
+    unsigned int reps = 20;
+    float* sig1;
+    float* sig2;
+    float emdAlloc = 0.0f;
+    float emdReuse = 0.0f;
+    double t1, t2, t3;
+    EMDWorkspace* ws;
+
+    if (argc > 1)
+    {
+        n = (unsigned int) strtoul(argv[1], NULL, 10);
+    }
+
+    if (argc > 2)
+    {
+        reps = (unsigned int) strtoul(argv[2], NULL, 10);
+    }
+
+    if (n == 0 || reps == 0)
+    {
+        mw_printf("Usage: %s [number of bins] [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+    sig1 = randomSignature(n);
+    sig2 = randomSignature(n);
+
+    t1 = mwGetTime();
+    for (i = 0; i < reps; ++i)
+    {
+        emdAlloc = emdCalcDims(sig1, sig2, n, n, EMD_BENCH_DIMS, NULL);
+    }
+
+    t2 = mwGetTime();
+    ws = emdCreateWorkspace(n, n);
+    for (i = 0; i < reps; ++i)
+    {
+        emdReuse = emdCalcWorkspace(ws, sig1, sig2, n, n, EMD_BENCH_DIMS, NULL);
+    }
+    t3 = mwGetTime();
+
+    emdDestroyWorkspace(ws);
+    free(sig1);
+    free(sig2);
+
+    printf("EMD of %u bins in %d dimensions, %u repetitions:\n"
+           "  Allocating:       %f s per call, EMD = %f\n"
+           "  Reused workspace: %f s per call, EMD = %f\n",
+           n, EMD_BENCH_DIMS, reps,
+           (t2 - t1) / reps, emdAlloc,
+           (t3 - t2) / reps, emdReuse);
+
+    if (fabsf(emdAlloc - emdReuse) > 0.0f)
+    {
+        mw_printf("EMD with a reused workspace differs\n");
+        return 1;
+    }
+
+    return 0;
+}
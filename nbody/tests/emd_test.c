@@ -142,6 +142,71 @@ static int testDistributionEMD(const char* distName, EMDTestDistribFunc distribf
     return differs;
 }
 
+/* Signatures in order of position use the closed form for 1D. Reversing
+ * them makes emdCalc use the transportation solver, which should agree. */
+static int testClosedFormEMD(unsigned int n)
+{
+    unsigned int i;
+    WeightPos* arr1;
+    WeightPos* arr2;
+    WeightPos* rev1;
+    WeightPos* rev2;
+    float total1 = 0.0f;
+    float total2 = 0.0f;
+    float closed;
+    float solver;
+    int differs;
+
+    arr1 = mwCalloc(n, sizeof(WeightPos));
+    arr2 = mwCalloc(n, sizeof(WeightPos));
+    rev1 = mwCalloc(n, sizeof(WeightPos));
+    rev2 = mwCalloc(n, sizeof(WeightPos));
+
+    for (i = 0; i < n; ++i)
+    {
+        arr2[i].pos = arr1[i].pos = (float) i;
+        arr1[i].weight = (float) dsfmt_genrand_open_open(&_prng);
+        arr2[i].weight = (float) dsfmt_genrand_open_open(&_prng);
+        total1 += arr1[i].weight;
+        total2 += arr2[i].weight;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        arr1[i].weight /= total1;
+        arr2[i].weight /= total2;
+        rev1[n - i - 1] = arr1[i];
+        rev2[n - i - 1] = arr2[i];
+    }
+
+    closed = emdCalc((const float*) arr1, (const float*) arr2, n, n, NULL);
+    solver = emdCalc((const float*) rev1, (const float*) rev2, n, n, NULL);
+
+    free(arr1);
+    free(arr2);
+    free(rev1);
+    free(rev2);
+
+    differs = (fabsf(closed - solver) >= 1.0e-4f * (1.0f + solver));
+
+    if (differs)
+    {
+        mw_printf("Closed form EMD different from solver with %u bins:\n"
+                  "  Solver %f, Closed form %f, |Diff| = %f\n",
+                  n,
+                  solver,
+                  closed,
+                  fabsf(closed - solver)
+            );
+    }
+    else
+    {
+        printf("EMD closed form test [%u] = %f, %f\n", n, solver, closed);
+    }
+
+    return differs;
+}
+
 int main(int argc, const char* argv[])
 {
     int fails = 0;
@@ -177,6 +242,11 @@ int main(int argc, const char* argv[])
     fails += testDistributionEMD("allInDifferentBins", allInDifferentBins, 34);
     fails += testDistributionEMD("allInDifferentBins", allInDifferentBins, 50);
 
+    fails += testClosedFormEMD(1);
+    fails += testClosedFormEMD(7);
+    fails += testClosedFormEMD(20);
+    fails += testClosedFormEMD(50);
+
     if (fails != 0)
     {
         mw_printf("%d EMD test distributions failed\n", fails);
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_chisq.h"
+#include "nbody_coordinates.h"
+#include "nbody_defaults.h"
+#include "milkyway_util.h"
+#include "dSFMT.h"
+
+#define NBODY 100000
+
+/* Half width of the box of bodies around the galactic center, in kpc */
+#define BOX_SIZE 40.0
+
+static dsfmt_t _prng;
+
+static real randomRange(real lo, real hi)
+{
+    return lo + (hi - lo) * (real) dsfmt_genrand_close_open(&_prng);
+}
+
+static Body* boxBodies(void)
+{
+    int i;
+    Body* bodies = (Body*) mwCallocA(NBODY, sizeof(Body));
+
+    for (i = 0; i < NBODY; ++i)
+    {
+        X(Pos(&bodies[i])) = randomRange(-BOX_SIZE, BOX_SIZE);
+        Y(Pos(&bodies[i])) = randomRange(-BOX_SIZE, BOX_SIZE);
+        Z(Pos(&bodies[i])) = randomRange(-BOX_SIZE, BOX_SIZE);
+        Mass(&bodies[i]) = 1.0 / NBODY;
+        Type(&bodies[i]) = BODY(FALSE);
+    }
+
+    return bodies;
+}
+
+/* Lambda the way it used to be found, converting to (l, b) and then
+ * rotating with the Newberg et al (2009) matrices */
+static real referenceLambda(const HistogramParams* hp, mwvector xyz, real sunGCDist)
+{
+    real rphi = d2r(hp->phi);
+    real rpsi = d2r(hp->psi);
+    real rth = d2r(hp->theta);
+    real cosphi = mw_cos(rphi), sinphi = mw_sin(rphi);
+    real cospsi = mw_cos(rpsi), sinpsi = mw_sin(rpsi);
+    real costh = mw_cos(rth), sinth = mw_sin(rth);
+    mwvector lbr = cartesianToLbr_rad(xyz, sunGCDist);
+    real bcos = mw_cos(B(lbr));
+    real bsin = mw_sin(B(lbr));
+    real lcos = mw_cos(L(lbr));
+    real lsin = mw_sin(L(lbr));
+
+    return r2d(mw_atan2(
+                   -(sinpsi * cosphi + costh * sinphi * cospsi) * bcos * lcos
+                   + (-sinpsi * sinphi + costh * cosphi * cospsi) * bcos * lsin
+                   + cospsi * sinth * bsin,
+
+                   (cospsi * cosphi - costh * sinphi * sinpsi) * bcos * lcos
+                   + (cospsi * sinphi + costh * cosphi * sinpsi) * bcos * lsin
+                   + sinpsi * sinth * bsin));
+}
+
+/* Lambda from the rotation can only differ from the old conversion by
+ * rounding, so a body right on a bin edge may move to the next bin,
+ * but no bin count may be off by more than one */
+static int checkLambdaBins(const NBodyCtx* ctx, const NBodyState* st, const HistogramParams* hp)
+{
+    int i;
+    unsigned int k, nMoved = 0;
+    double bin;
+    unsigned int* counts;
+    const NBodyHistogramDim* dim;
+    NBodyHistogram* h = nbCreateHistogram(ctx, st, hp);
+    int failed = 0;
+
+    if (!h || h->nDims != 1 || h->sparse || h->totalNum < NBODY / 10)
+    {
+        mw_printf("Failed to bin bodies into a lambda histogram\n");
+        free(h);
+        return 1;
+    }
+
+    dim = &h->dims[0];
+    counts = (unsigned int*) mwCalloc(dim->nBin, sizeof(unsigned int));
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        bin = floor((referenceLambda(hp, Pos(&st->bodytab[i]), ctx->sunGCDist) - dim->start) / dim->binSize);
+        if (bin >= 0.0 && bin < (double) dim->nBin)
+        {
+            ++counts[(unsigned int) bin];
+        }
+    }
+
+    for (k = 0; k < dim->nBin; ++k)
+    {
+        unsigned int binned = h->data[k].rawCount;
+        unsigned int diff = binned > counts[k] ? binned - counts[k] : counts[k] - binned;
+
+        nMoved += diff;
+        if (diff > 1)
+        {
+            mw_printf("Lambda bin %u has %u bodies, expected %u\n", k, binned, counts[k]);
+            failed = 1;
+        }
+    }
+
+    if (nMoved > 0)
+    {
+        mw_printf("%u bodies landed in a neighbouring bin\n", nMoved);
+    }
+
+    free(counts);
+    free(h);
+
+    return failed;
+}
+
+int main(void)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    NBodyState st = EMPTY_NBODYSTATE;
+    HistogramParams hp = defaultHistogramParams;
+    int failed = 0;
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+
+    ctx.potentialType = EXTERNAL_POTENTIAL_NONE;
+    setInitialNBodyState(&st, &ctx, boxBodies(), NBODY);
+
+    /* The default orphan stream rotation, and one of its own bin
+     * sizes so the edges fall in different places */
+    failed |= checkLambdaBins(&ctx, &st, &hp);
+
+    hp.phi = 30.0;
+    hp.theta = 70.0;
+    hp.psi = 200.0;
+    hp.startRaw = -180.0;
+    hp.endRaw = 180.0;
+    hp.binSize = 0.1;
+    failed |= checkLambdaBins(&ctx, &st, &hp);
+
+    destroyNBodyState(&st);
+
+    if (failed)
+    {
+        mw_printf("Histogram binning tests failed\n");
+    }
+
+    return failed;
+}
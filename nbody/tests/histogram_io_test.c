@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_chisq.h"
+#include "nbody_defaults.h"
+#include "milkyway_util.h"
+#include "dSFMT.h"
+
+#define NBODY 2000
+
+/* Largest relative difference allowed between likelihoods of sparse
+ * and dense histograms, which are written with limited precision */
+#define LIKELIHOOD_TOLERANCE 1.0e-6
+
+static const char* denseFile = "histogram_io_test_dense.hist";
+static const char* sparseFile = "histogram_io_test_sparse.hist";
+
+static dsfmt_t _prng;
+
+static real randomRange(real lo, real hi)
+{
+    return lo + (hi - lo) * (real) dsfmt_genrand_close_open(&_prng);
+}
+
+/* Bodies in a clump seen from the Sun, around longitude 10 and
+ * latitude 5 degrees, at 5 to 15 kpc */
+static Body* clumpBodies(const NBodyCtx* ctx)
+{
+    int i;
+    real l, b, d;
+    Body* bodies = (Body*) mwCallocA(NBODY, sizeof(Body));
+
+    for (i = 0; i < NBODY; ++i)
+    {
+        l = d2r(10.0 + 8.0 * (randomRange(0.0, 1.0) + randomRange(-1.0, 0.0)));
+        b = d2r(5.0 + 4.0 * (randomRange(0.0, 1.0) + randomRange(-1.0, 0.0)));
+        d = randomRange(5.0, 15.0);
+
+        X(Pos(&bodies[i])) = d * mw_cos(b) * mw_cos(l) - ctx->sunGCDist;
+        Y(Pos(&bodies[i])) = d * mw_cos(b) * mw_sin(l);
+        Z(Pos(&bodies[i])) = d * mw_sin(b);
+        Mass(&bodies[i]) = 1.0 / NBODY;
+        Type(&bodies[i]) = BODY(FALSE);
+    }
+
+    return bodies;
+}
+
+static int sameShape(const NBodyHistogram* a, const NBodyHistogram* b)
+{
+    unsigned int i;
+
+    if (a->nDims != b->nDims || a->totalBins != b->totalBins)
+        return FALSE;
+
+    for (i = 0; i < a->nDims; ++i)
+    {
+        if (   a->dims[i].type != b->dims[i].type
+            || a->dims[i].nBin != b->dims[i].nBin
+            || mw_abs(a->dims[i].start - b->dims[i].start) > 1.0e-6
+            || mw_abs(a->dims[i].binSize - b->dims[i].binSize) > 1.0e-6)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Every bin of the sparse histogram must be in the dense one with the
+ * same count, and together they must hold every body in range */
+static int checkSparseBins(const char* name, const NBodyHistogram* sparse, const NBodyHistogram* dense)
+{
+    unsigned int i, total = 0;
+    const HistData* s;
+    const HistData* d;
+
+    if (!sparse->sparse || dense->sparse || sparse->nBin >= dense->nBin || !sameShape(sparse, dense))
+    {
+        mw_printf("%s: sparse histogram has %u of %u bins and does not match the dense shape\n",
+                  name, sparse->nBin, dense->nBin);
+        return 1;
+    }
+
+    for (i = 0; i < sparse->nBin; ++i)
+    {
+        s = &sparse->data[i];
+        if (s->index >= dense->nBin || (i > 0 && s->index <= sparse->data[i - 1].index))
+        {
+            mw_printf("%s: sparse bin %u has bad index %u\n", name, i, s->index);
+            return 1;
+        }
+
+        d = &dense->data[s->index];
+        if (   d->index != s->index
+            || mw_abs(d->count - s->count) > 1.0e-9
+            || mw_abs(d->lambda - s->lambda) > 1.0e-6
+            || mw_abs(d->extra[0] - s->extra[0]) > 1.0e-6)
+        {
+            mw_printf("%s: sparse bin %u (%f, %f) = %f does not match dense bin (%f, %f) = %f\n",
+                      name, s->index, s->lambda, s->extra[0], s->count, d->lambda, d->extra[0], d->count);
+            return 1;
+        }
+
+        total += (unsigned int) (s->count * sparse->totalNum + 0.5);
+    }
+
+    if (total != sparse->totalNum)
+    {
+        mw_printf("%s: sparse bins hold %u bodies, expected %u\n", name, total, sparse->totalNum);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Some methods give NaN with empty bins, which they must do for both */
+static int equalLikelihoods(double a, double b)
+{
+    if (isnan(a) || isnan(b))
+        return isnan(a) && isnan(b);
+
+    return mw_abs(a - b) <= LIKELIHOOD_TOLERANCE * (1.0 + mw_abs(b));
+}
+
+static int checkLikelihoods(const NBodyState* st,
+                            const NBodyHistogram* sparseData,
+                            const NBodyHistogram* denseData,
+                            const NBodyHistogram* sparseSim,
+                            const NBodyHistogram* denseSim)
+{
+    static const NBodyLikelihoodMethod methods[] =
+        {
+            NBODY_EMD,
+            NBODY_ORIG_CHISQ,
+            NBODY_ORIG_ALT,
+            NBODY_CHISQ_ALT,
+            NBODY_POISSON,
+            NBODY_KOLMOGOROV,
+            NBODY_KULLBACK_LEIBLER,
+            NBODY_SAHA
+        };
+    unsigned int i;
+    double dense, sparse, sparseSimulated;
+    int failed = 0;
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i)
+    {
+        dense = nbSystemChisq(st, denseData, denseSim, methods[i]);
+        sparse = nbSystemChisq(st, sparseData, denseSim, methods[i]);
+        sparseSimulated = nbSystemChisq(st, denseData, sparseSim, methods[i]);
+
+        if (   !equalLikelihoods(sparse, dense)
+            || !equalLikelihoods(sparseSimulated, dense)
+            || (methods[i] == NBODY_EMD && !(dense > 0.0)))
+        {
+            mw_printf("Likelihood method %u: dense %.15g, sparse data %.15g, sparse simulation %.15g\n",
+                      methods[i], dense, sparse, sparseSimulated);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+/* Lambda by beta histograms of the bodies of st, with most of the
+ * bins empty */
+static int createHistograms(const NBodyCtx* ctx,
+                            const NBodyState* st,
+                            NBodyHistogram** dense,
+                            NBodyHistogram** sparse)
+{
+    HistogramParams hp = defaultHistogramParams;
+
+    hp.phi = 0.0;
+    hp.theta = 0.0;
+    hp.psi = 0.0;
+    hp.startRaw = -60.0;
+    hp.endRaw = 60.0;
+    hp.binSize = 2.0;
+    hp.center = 0.0;
+    hp.beta.start = -30.0;
+    hp.beta.end = 30.0;
+    hp.beta.binSize = 2.0;
+
+    hp.sparse = FALSE;
+    *dense = nbCreateHistogram(ctx, st, &hp);
+    hp.sparse = TRUE;
+    *sparse = nbCreateHistogram(ctx, st, &hp);
+
+    if (!*dense || !*sparse || (*dense)->nDims != 2 || (*dense)->totalNum < NBODY / 2)
+    {
+        mw_printf("Failed to bin bodies into a 2D histogram\n");
+        return 1;
+    }
+
+    return checkSparseBins("created", *sparse, *dense);
+}
+
+int main(void)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    NBodyState st = EMPTY_NBODYSTATE;
+    NBodyState simSt = EMPTY_NBODYSTATE;
+    NBodyHistogram* dense = NULL;
+    NBodyHistogram* sparse = NULL;
+    NBodyHistogram* denseSim = NULL;
+    NBodyHistogram* sparseSim = NULL;
+    NBodyHistogram* denseData = NULL;
+    NBodyHistogram* sparseData = NULL;
+    int failed = 0;
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+
+    ctx.potentialType = EXTERNAL_POTENTIAL_NONE;
+    setInitialNBodyState(&st, &ctx, clumpBodies(&ctx), NBODY);
+    setInitialNBodyState(&simSt, &ctx, clumpBodies(&ctx), NBODY);
+
+    failed |= createHistograms(&ctx, &st, &dense, &sparse);
+    failed |= createHistograms(&ctx, &simSt, &denseSim, &sparseSim);
+    if (failed)
+    {
+        return failed;
+    }
+
+    /* Write both with their dimensions, axis and sparse headers and
+     * read them back */
+    nbWriteHistogram(denseFile, &ctx, &st, dense);
+    nbWriteHistogram(sparseFile, &ctx, &st, sparse);
+
+    denseData = nbReadHistogram(denseFile);
+    sparseData = nbReadHistogram(sparseFile);
+    if (!denseData || !sparseData)
+    {
+        mw_printf("Failed to read back written histograms\n");
+        failed = 1;
+    }
+    else
+    {
+        if (!sameShape(denseData, dense) || denseData->nBin != dense->nBin || denseData->sparse)
+        {
+            mw_printf("Dense histogram read back with a different shape\n");
+            failed = 1;
+        }
+
+        failed |= checkSparseBins("read", sparseData, denseData);
+
+        /* Matching another draw of the same clump against the data */
+        failed |= checkLikelihoods(&simSt, sparseData, denseData, sparseSim, denseSim);
+    }
+
+    free(dense);
+    free(sparse);
+    free(denseSim);
+    free(sparseSim);
+    free(denseData);
+    free(sparseData);
+    destroyNBodyState(&st);
+    destroyNBodyState(&simSt);
+
+    mw_remove(denseFile);
+    mw_remove(sparseFile);
+
+    if (failed)
+    {
+        mw_printf("Histogram IO tests failed\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "milkyway_util.h"
+#include "milkyway_math.h"
+#include "nbody_sampler.h"
+#include "dSFMT.h"
+
+#define NSAMPLE 200000
+
+/* Critical value of the Kolmogorov-Smirnov statistic at the 0.001
+ * level is 1.95 / sqrt(n) */
+#define KS_CRITICAL (1.95 / sqrt((double) NSAMPLE))
+
+/* Allowed error of sample moments, in standard errors */
+#define MOMENT_SIGMAS 5.0
+
+static dsfmt_t _prng;
+
+static int compareReal(const void* a, const void* b)
+{
+    real x = *(const real*) a;
+    real y = *(const real*) b;
+
+    return (x > y) - (x < y);
+}
+
+typedef double (*CDFFunc)(double x);
+
+/* Largest difference between the empirical CDF of sorted samples and cdf */
+static double ksStatistic(const real* samples, unsigned int n, CDFFunc cdf)
+{
+    unsigned int i;
+    double f, d = 0.0;
+
+    for (i = 0; i < n; ++i)
+    {
+        f = cdf((double) samples[i]);
+        d = fmax(d, fabs(f - (double) i / n));
+        d = fmax(d, fabs((double) (i + 1) / n - f));
+    }
+
+    return d;
+}
+
+static real* drawSamples(const NBodySampler* s)
+{
+    unsigned int i;
+    real* samples = (real*) mwMalloc(NSAMPLE * sizeof(real));
+
+    for (i = 0; i < NSAMPLE; ++i)
+    {
+        samples[i] = nbSample(s, &_prng);
+    }
+
+    qsort(samples, NSAMPLE, sizeof(real), compareReal);
+
+    return samples;
+}
+
+
+/* Density which is exactly piecewise linear */
+static real linearDensity(real x, const void* args)
+{
+    (void) args;
+    return x;
+}
+
+static double linearCDF(double x)
+{
+    return sqr(x);
+}
+
+
+/* Plummer sphere mass distribution, cut off at PLUMMER_RMAX */
+#define PLUMMER_RMAX 5.0
+
+static real plummerDensity(real r, const void* args)
+{
+    (void) args;
+    return sqr(r) * mw_pow(1.0 + sqr(r), -2.5);
+}
+
+static double plummerMass(double r)
+{
+    return cube(r) / mw_pow(1.0 + sqr(r), 1.5);
+}
+
+static double plummerCDF(double r)
+{
+    return plummerMass(r) / plummerMass(PLUMMER_RMAX);
+}
+
+
+static int testKS(const char* name, NBodyDensity density, CDFFunc cdf, real xMin, real xMax)
+{
+    NBodySampler s;
+    real* samples;
+    double d;
+    int failed;
+
+    if (nbInitSampler(&s, density, NULL, xMin, xMax))
+    {
+        mw_printf("Failed to create sampler for %s\n", name);
+        return 1;
+    }
+
+    samples = drawSamples(&s);
+
+    failed = samples[0] < xMin || samples[NSAMPLE - 1] > xMax;
+    if (failed)
+    {
+        mw_printf("%s: sample out of range [%f, %f]\n", name, xMin, xMax);
+    }
+
+    d = ksStatistic(samples, NSAMPLE, cdf);
+    if (d > KS_CRITICAL)
+    {
+        mw_printf("%s: KS statistic %g > %g\n", name, d, KS_CRITICAL);
+        failed = 1;
+    }
+
+    free(samples);
+    return failed;
+}
+
+
+/* Distribution of v / v_escape used for Plummer velocities */
+static real plummerG(real x, const void* args)
+{
+    (void) args;
+    return sqr(x) * mw_pow(1.0 - sqr(x), 3.5);
+}
+
+/* Integral of x^a (1 - x^2)^b over [0, 1] */
+static double powerIntegral(double a, double b)
+{
+    double p = 0.5 * (a + 1.0);
+    double q = b + 1.0;
+
+    return 0.5 * exp(lgamma(p) + lgamma(q) - lgamma(p + q));
+}
+
+/* Compare the first two moments of plummerG with the exact values */
+static int testPlummerGMoments(void)
+{
+    NBodySampler s;
+    unsigned int i;
+    int k, failed = 0;
+    double x, norm, exact[5], sum[3] = { 0.0, 0.0, 0.0 };
+
+    if (nbInitSampler(&s, plummerG, NULL, 0.0, 1.0))
+    {
+        mw_printf("Failed to create sampler for plummerG\n");
+        return 1;
+    }
+
+    norm = powerIntegral(2.0, 3.5);
+    for (k = 1; k <= 4; ++k)
+    {
+        exact[k] = powerIntegral(2.0 + k, 3.5) / norm;
+    }
+
+    for (i = 0; i < NSAMPLE; ++i)
+    {
+        x = (double) nbSample(&s, &_prng);
+        sum[1] += x;
+        sum[2] += sqr(x);
+    }
+
+    for (k = 1; k <= 2; ++k)
+    {
+        double mean = sum[k] / NSAMPLE;
+        double stdErr = sqrt((exact[2 * k] - sqr(exact[k])) / NSAMPLE);
+
+        if (fabs(mean - exact[k]) > MOMENT_SIGMAS * stdErr)
+        {
+            mw_printf("plummerG: moment %d is %g, expected %g +/- %g\n", k, mean, exact[k], stdErr);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+static real zeroDensity(real x, const void* args)
+{
+    (void) x, (void) args;
+    return 0.0;
+}
+
+int main(void)
+{
+    int failed = 0;
+    NBodySampler s;
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+
+    failed |= testKS("linear", linearDensity, linearCDF, 0.0, 1.0);
+    failed |= testKS("plummer", plummerDensity, plummerCDF, 0.0, PLUMMER_RMAX);
+    failed |= testPlummerGMoments();
+
+    if (!nbInitSampler(&s, zeroDensity, NULL, 0.0, 1.0))
+    {
+        mw_printf("Sampler accepted a density which is zero everywhere\n");
+        failed = 1;
+    }
+
+    if (failed)
+    {
+        mw_printf("Sampler tests failed\n");
+    }
+
+    return failed;
+}
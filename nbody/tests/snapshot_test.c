@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_snapshot.h"
+#include "nbody_defaults.h"
+#include "milkyway_util.h"
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#endif
+
+#define NBODY 1000
+#define NSTEP 10
+
+/* Step a run is resumed from, and the last step written after the
+ * resume, so the resumed run writes fewer frames than the first */
+#define RESUME_STEP 5
+#define LAST_STEP 7
+
+#define TIMESTEP 1.0e-3
+
+static const char* snapshotFile = "snapshot_test.snap";
+static const char* referenceFile = "snapshot_test_reference.snap";
+
+/* Positions and velocities of body i at a step, easy to check after
+ * reading them back */
+static mwvector bodyPosition(int i, int step)
+{
+    mwvector r = mw_vec((real) i, (real) -i, (real) (i * NSTEP + step));
+    return r;
+}
+
+static mwvector bodyVelocity(int i, int step)
+{
+    mwvector v = mw_vec((real) step, (real) (i + step), 0.5 * (real) i);
+    return v;
+}
+
+static int equalVectors(mwvector a, mwvector b)
+{
+    return X(a) == X(b) && Y(a) == Y(b) && Z(a) == Z(b);
+}
+
+static void setBodies(NBodyState* st, int step)
+{
+    int i, orig;
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        orig = st->bodyOrder ? st->bodyOrder[i] : i;
+        Pos(&st->bodytab[i]) = bodyPosition(orig, step);
+        Vel(&st->bodytab[i]) = bodyVelocity(orig, step);
+        Mass(&st->bodytab[i]) = 1.0;
+    }
+}
+
+/* Write the frames from step first to last, resuming the snapshot
+ * file if first isn't 0. With reordered set the bodies are stored in
+ * reverse order, as after sorting them. */
+static int writeFrames(const NBodyCtx* ctx, const char* filename, int first, int last, mwbool reordered)
+{
+    NBodyState st = EMPTY_NBODYSTATE;
+    int i, step;
+    int failed = 0;
+
+    setInitialNBodyState(&st, ctx, (Body*) mwCallocA(NBODY, sizeof(Body)), NBODY);
+    st.step = first;
+
+    if (reordered)
+    {
+        st.bodyOrder = (int*) mwMalloc(NBODY * sizeof(int));
+        for (i = 0; i < NBODY; ++i)
+        {
+            st.bodyOrder[i] = NBODY - 1 - i;
+        }
+    }
+
+    if (nbCreateSnapshotWriter(&st, filename, 1, 0.0, 0))
+    {
+        mw_printf("Failed to create snapshot writer for '%s'\n", filename);
+        destroyNBodyState(&st);
+        return 1;
+    }
+
+    for (step = first; step <= last && !failed; ++step)
+    {
+        st.step = step;
+        setBodies(&st, step);
+        if (nbTimeToSnapshot(ctx, &st))
+        {
+            failed |= nbAppendSnapshotFrame(ctx, &st);
+        }
+    }
+
+    failed |= nbCloseSnapshotWriter(&st);
+    destroyNBodyState(&st);
+
+    return failed;
+}
+
+static int readFrames(const char* filename, int nFrames)
+{
+    NBodySnapshotReader r;
+    mwvector* pos;
+    mwvector* vel;
+    uint64_t k;
+    int i;
+    int failed = 0;
+
+    if (nbOpenSnapshotReader(&r, filename))
+    {
+        return 1;
+    }
+
+    if (r.nbody != NBODY || r.nFrames != (uint64_t) nFrames)
+    {
+        mw_printf("Snapshot has "LLU" bodies and "LLU" frames, expected %d and %d\n",
+                  r.nbody, r.nFrames, NBODY, nFrames);
+        nbCloseSnapshotReader(&r);
+        return 1;
+    }
+
+    pos = (mwvector*) mwMalloc(NBODY * sizeof(mwvector));
+    vel = (mwvector*) mwMalloc(NBODY * sizeof(mwvector));
+
+    /* Read the frames out of order to seek to each one by index */
+    for (k = r.nFrames; k-- > 0 && !failed; )
+    {
+        if (r.steps[k] != k || r.times[k] != (double) k * TIMESTEP)
+        {
+            mw_printf("Frame "LLU" has step "LLU" and time %f\n", k, r.steps[k], r.times[k]);
+            failed = 1;
+            break;
+        }
+
+        if (nbReadSnapshotFrame(&r, k, pos, vel))
+        {
+            mw_printf("Failed to read frame "LLU"\n", k);
+            failed = 1;
+            break;
+        }
+
+        for (i = 0; i < NBODY; ++i)
+        {
+            if (   !equalVectors(pos[i], bodyPosition(i, (int) k))
+                || !equalVectors(vel[i], bodyVelocity(i, (int) k)))
+            {
+                mw_printf("Frame "LLU" body %d does not match what was written\n", k, i);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    free(pos);
+    free(vel);
+    nbCloseSnapshotReader(&r);
+
+    return failed;
+}
+
+static int equalFiles(const char* a, const char* b)
+{
+    size_t sizeA, sizeB;
+    char* dataA = mwReadFileWithSize(a, &sizeA);
+    char* dataB = mwReadFileWithSize(b, &sizeB);
+    int equal = dataA && dataB && sizeA == sizeB && memcmp(dataA, dataB, sizeA) == 0;
+
+    free(dataA);
+    free(dataB);
+
+    return equal;
+}
+
+int main(void)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    int failed = 0;
+
+    ctx.timestep = TIMESTEP;
+    ctx.nStep = NSTEP;
+
+    /* Write the whole run, then resume it partway through as if from
+     * a checkpoint and stop earlier. Frames after the resume must
+     * be replaced, and none of the first run's may be left. */
+    failed |= writeFrames(&ctx, snapshotFile, 0, NSTEP, FALSE);
+    failed |= readFrames(snapshotFile, NSTEP + 1);
+
+    failed |= writeFrames(&ctx, snapshotFile, RESUME_STEP, LAST_STEP, TRUE);
+    failed |= readFrames(snapshotFile, LAST_STEP + 1);
+
+    failed |= writeFrames(&ctx, referenceFile, 0, LAST_STEP, FALSE);
+    if (!equalFiles(snapshotFile, referenceFile))
+    {
+        mw_printf("Resumed snapshot file differs from one written without a resume\n");
+        failed = 1;
+    }
+
+    mw_remove(snapshotFile);
+    mw_remove(referenceFile);
+
+    if (failed)
+    {
+        mw_printf("Snapshot tests failed\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_stream.h"
+#include "nbody_shmem.h"
+#include "nbody_defaults.h"
+#include "milkyway_util.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#endif
+
+#define NBODY 100
+#define STRIDE 3
+#define STEP 7
+
+#define HEADER_SIZE 72
+
+static const char* socketPath = "stream_test.sock";
+
+static mwvector bodyPosition(int i)
+{
+    mwvector r = mw_vec((real) i + 0.25, (real) -i, (real) (2 * i));
+    return r;
+}
+
+/* Bodies stored in reverse order, as after sorting them */
+static void createState(NBodyState* st, const NBodyCtx* ctx)
+{
+    int i, orig;
+    Body* bodies = (Body*) mwCallocA(NBODY, sizeof(Body));
+
+    setInitialNBodyState(st, ctx, bodies, NBODY);
+    st->step = STEP;
+    st->bodyOrder = (int*) mwMalloc(NBODY * sizeof(int));
+
+    for (i = 0; i < NBODY; ++i)
+    {
+        orig = NBODY - 1 - i;
+        st->bodyOrder[i] = orig;
+        Pos(&bodies[i]) = bodyPosition(orig);
+        Mass(&bodies[i]) = 1.0;
+        Type(&bodies[i]) = BODY(orig % 2 == 0);
+    }
+}
+
+static int connectClient(void)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    if (fd < 0 || connect(fd, (const struct sockaddr*) &addr, sizeof(addr)) < 0)
+    {
+        mwPerror("Connecting to stream socket");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int readAll(int fd, uint8_t* buf, size_t size)
+{
+    ssize_t n;
+    size_t got = 0;
+
+    while (got < size)
+    {
+        n = read(fd, buf + got, size - got);
+        if (n <= 0)
+            return 1;
+        got += (size_t) n;
+    }
+
+    return 0;
+}
+
+/* Read a frame and check every field against the state */
+static int checkFrame(int fd, const NBodyCtx* ctx, mwvector cmPos)
+{
+    const uint32_t nFrame = (NBODY + STRIDE - 1) / STRIDE;
+    const size_t frameSize = HEADER_SIZE + (3 * sizeof(float) + 1) * nFrame;
+    uint8_t* frame = (uint8_t*) mwMalloc(frameSize);
+    const float* pos = (const float*) (frame + HEADER_SIZE);
+    const uint8_t* ignore = frame + HEADER_SIZE + 3 * sizeof(float) * nFrame;
+    uint32_t counts[4];
+    uint64_t step;
+    double times[5];
+    mwvector r;
+    uint32_t i;
+    int failed = 0;
+
+    if (readAll(fd, frame, frameSize))
+    {
+        mw_printf("Failed to read a whole frame\n");
+        free(frame);
+        return 1;
+    }
+
+    memcpy(counts, frame + 8, sizeof(counts));
+    memcpy(&step, frame + 24, sizeof(step));
+    memcpy(times, frame + 32, sizeof(times));
+
+    if (   memcmp(frame, NBODY_STREAM_MAGIC, 8)
+        || counts[0] != NBODY_STREAM_VERSION
+        || counts[1] != nFrame
+        || counts[2] != NBODY
+        || counts[3] != STRIDE
+        || step != STEP
+        || times[0] != STEP * ctx->timestep
+        || times[1] != ctx->timeEvolve
+        || times[2] != X(cmPos) || times[3] != Y(cmPos) || times[4] != Z(cmPos))
+    {
+        mw_printf("Bad frame header\n");
+        failed = 1;
+    }
+
+    /* Bodies are in the original order however they are stored */
+    for (i = 0; i < nFrame && !failed; ++i)
+    {
+        r = bodyPosition(i * STRIDE);
+        if (   pos[3 * i + 0] != (float) X(r)
+            || pos[3 * i + 1] != (float) Y(r)
+            || pos[3 * i + 2] != (float) Z(r)
+            || ignore[i] != ((i * STRIDE) % 2 == 0))
+        {
+            mw_printf("Frame body %u is wrong\n", i);
+            failed = 1;
+        }
+    }
+
+    free(frame);
+    return failed;
+}
+
+int main(void)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    NBodyState st = EMPTY_NBODYSTATE;
+    mwvector unset = mw_vec(-1.0, -1.0, -1.0);
+    mwvector cmPos;
+    int fd;
+    int failed = 0;
+
+    ctx.timestep = 1.0e-3;
+    ctx.timeEvolve = 1.0;
+    ctx.nStep = 1000;
+    createState(&st, &ctx);
+
+    if (nbCreateStreamServer(&st, socketPath, STRIDE))
+    {
+        mw_printf("Failed to create stream server\n");
+        return 1;
+    }
+
+    /* Without clients, nothing should be done for the display */
+    st.orbitTrace[STEP] = unset;
+    nbUpdateDisplayedBodies(&ctx, &st);
+    if (nbStreamHasClients(&st) || X(st.orbitTrace[STEP]) != X(unset))
+    {
+        mw_printf("Display was updated without any clients\n");
+        failed = 1;
+    }
+
+    fd = connectClient();
+    if (fd < 0)
+    {
+        nbCloseStreamServer(&st);
+        return 1;
+    }
+
+    /* The client is accepted, and gets the next step */
+    nbUpdateDisplayedBodies(&ctx, &st);
+    cmPos = st.orbitTrace[STEP];
+    if (X(cmPos) == X(unset))
+    {
+        mw_printf("Center of mass not found for a client\n");
+        failed = 1;
+    }
+
+    failed |= checkFrame(fd, &ctx, cmPos);
+
+    /* A client going away is dropped */
+    close(fd);
+    nbPublishStreamFrame(&ctx, &st, &cmPos);
+    if (nbStreamHasClients(&st))
+    {
+        mw_printf("Closed client was not dropped\n");
+        failed = 1;
+    }
+
+    nbCloseStreamServer(&st);
+    if (access(socketPath, F_OK) == 0)
+    {
+        mw_printf("Stream socket was not removed\n");
+        failed = 1;
+    }
+
+    destroyNBodyState(&st);
+
+    if (failed)
+    {
+        mw_printf("Stream tests failed\n");
+    }
+
+    return failed;
+}
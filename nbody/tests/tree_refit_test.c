@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2026 The Milkyway@Home Developers
+ *
+ * This file is part of Milkway@Home.
+ *
+ * Milkyway@Home is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Milkyway@Home is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Milkyway@Home.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbody.h"
+#include "nbody_priv.h"
+#include "nbody_grav.h"
+#include "nbody_defaults.h"
+#include "milkyway_util.h"
+#include "dSFMT.h"
+
+#define NBODY 2000
+#define NSTEP 12
+#define REBUILD_INTERVAL 4
+
+/* Bulk velocity of the sphere along its orbit */
+#define ORBIT_VELOCITY 100.0
+
+/* How much less accurate than a rebuilt tree the refit tree may be,
+ * relative to the exact forces */
+#define REFIT_ERROR_RATIO 1.1
+
+static dsfmt_t _prng;
+
+static real randomGaussian(void)
+{
+    real u = (real) dsfmt_genrand_open_open(&_prng);
+    real v = (real) dsfmt_genrand_open_open(&_prng);
+
+    return mw_sqrt(-2.0 * mw_log(u)) * mw_cos(2.0 * M_PI * v);
+}
+
+static mwvector randomDirection(void)
+{
+    mwvector d;
+    real z = 2.0 * (real) dsfmt_genrand_open_open(&_prng) - 1.0;
+    real phi = 2.0 * M_PI * (real) dsfmt_genrand_open_open(&_prng);
+    real s = mw_sqrt(1.0 - sqr(z));
+
+    X(d) = s * mw_cos(phi);
+    Y(d) = s * mw_sin(phi);
+    Z(d) = z;
+    W(d) = 0.0;
+
+    return d;
+}
+
+/* Plummer sphere of unit mass and scale radius, moving along x */
+static Body* plummerSphere(void)
+{
+    int i;
+    real u, r, sigma;
+    Body* bodies = (Body*) mwCallocA(NBODY, sizeof(Body));
+
+    for (i = 0; i < NBODY; ++i)
+    {
+        u = 0.999 * (real) dsfmt_genrand_open_open(&_prng);
+        r = 1.0 / mw_sqrt(mw_pow(u, -2.0 / 3.0) - 1.0);
+        sigma = mw_sqrt(1.0 / (6.0 * mw_sqrt(sqr(r) + 1.0)));
+
+        Pos(&bodies[i]) = mw_mulvs(randomDirection(), r);
+        X(Vel(&bodies[i])) = ORBIT_VELOCITY + sigma * randomGaussian();
+        Y(Vel(&bodies[i])) = sigma * randomGaussian();
+        Z(Vel(&bodies[i])) = sigma * randomGaussian();
+        Mass(&bodies[i]) = 1.0 / NBODY;
+        Type(&bodies[i]) = BODY(FALSE);
+    }
+
+    return bodies;
+}
+
+static void drift(NBodyState* st, real dt)
+{
+    int i;
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        mw_incaddv_s(Pos(&st->bodytab[i]), Vel(&st->bodytab[i]), dt);
+    }
+}
+
+/* Accelerations of a copy of st found with ctx */
+static void cloneAccelerations(NBodyState* copy, const NBodyCtx* ctx, const NBodyState* st)
+{
+    static const NBodyState emptyState = EMPTY_NBODYSTATE;
+
+    *copy = emptyState;
+    cloneNBodyState(copy, st);
+    nbGravMap(ctx, copy);
+}
+
+/* RMS relative error of the accelerations of st against exact */
+static real accelerationError(const NBodyState* st, const NBodyState* exact)
+{
+    int i;
+    real sum = 0.0;
+
+    for (i = 0; i < st->nbody; ++i)
+    {
+        sum += mw_sqrv(mw_subv(st->acctab[i], exact->acctab[i])) / mw_sqrv(exact->acctab[i]);
+    }
+
+    return mw_sqrt(sum / st->nbody);
+}
+
+static int equalAccelerations(const NBodyState* a, const NBodyState* b)
+{
+    return memcmp(a->acctab, b->acctab, a->nbody * sizeof(mwvector)) == 0;
+}
+
+/* Step a system refitting the tree, and compare the forces of each
+ * step with those from a tree built from scratch and the exact
+ * forces. With the small timestep the bodies stay in their subcells
+ * and the tree is refit, with the large one it must be rebuilt every
+ * step. */
+static int testRefit(real dt, mwbool expectRefit)
+{
+    NBodyCtx ctx = defaultNBodyCtx;
+    NBodyCtx rebuildCtx, exactCtx;
+    NBodyState st = EMPTY_NBODYSTATE;
+    NBodyState rebuilt, exact;
+    real refitError, rebuildError;
+    int step, nRefit = 0, failed = 0;
+
+    ctx.theta = 0.5;
+    ctx.eps2 = 1.0e-4;
+    ctx.timestep = dt;
+    ctx.criterion = NewCriterion;
+    ctx.useQuad = TRUE;
+    ctx.potentialType = EXTERNAL_POTENTIAL_NONE;
+    ctx.treeRSize = 4.0;
+    ctx.treeRebuildInterval = REBUILD_INTERVAL;
+
+    rebuildCtx = ctx;
+    rebuildCtx.treeRebuildInterval = 0;
+
+    exactCtx = ctx;
+    exactCtx.criterion = Exact;
+
+    setInitialNBodyState(&st, &ctx, plummerSphere(), NBODY);
+    nbGravMap(&ctx, &st);
+
+    for (step = 1; step <= NSTEP; ++step)
+    {
+        drift(&st, dt);
+        st.step = step;
+        nbGravMap(&ctx, &st);
+
+        cloneAccelerations(&rebuilt, &rebuildCtx, &st);
+        cloneAccelerations(&exact, &exactCtx, &st);
+
+        if (equalAccelerations(&st, &rebuilt))
+        {
+            /* Every rebuild gives the same tree */
+        }
+        else if (step % REBUILD_INTERVAL == 0 || !expectRefit)
+        {
+            mw_printf("dt = %g, step %d: tree was refit when it should have been rebuilt\n", dt, step);
+            failed = 1;
+        }
+        else
+        {
+            ++nRefit;
+        }
+
+        refitError = accelerationError(&st, &exact);
+        rebuildError = accelerationError(&rebuilt, &exact);
+        if (refitError > REFIT_ERROR_RATIO * rebuildError)
+        {
+            mw_printf("dt = %g, step %d: refit force error %g, rebuilt %g\n",
+                      dt, step, refitError, rebuildError);
+            failed = 1;
+        }
+
+        destroyNBodyState(&rebuilt);
+        destroyNBodyState(&exact);
+    }
+
+    if (expectRefit && nRefit == 0)
+    {
+        mw_printf("dt = %g: tree was never refit\n", dt);
+        failed = 1;
+    }
+
+    destroyNBodyState(&st);
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    dsfmt_init_gen_rand(&_prng, 1234);
+
+    failed |= testRefit(1.0e-6, TRUE);
+    failed |= testRefit(1.0e-2, FALSE);
+
+    if (failed)
+    {
+        mw_printf("Tree refit tests failed\n");
+    }
+
+    return failed;
+}